@@ -0,0 +1,417 @@
+#define _GNU_SOURCE  // Pinned pool workers (sched_setaffinity), MAP_ANONYMOUS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "../common/matrix.h"
+#include "../common/blocked.h"
+#include "../common/simd.h"
+#include "../common/thread_pool.h"
+#include "../common/process_pool.h"
+#include "../common/transpose.h"
+
+// In-process benchmark of the multiplication kernels on one backend.
+//
+// Every configuration of a dimension multiplies the same A and B: a few
+// warmup runs (page faults, cold caches, CPU frequency ramp-up) are thrown
+// away, then every timed repetition is written to the CSV with the schema of
+// the main_run.sh scripts (timestamp,dimension,iteration,configuration,time),
+// so utils/plot_matrix_results.py reads it unchanged. The compiler-flag
+// configurations of those scripts are reproduced without recompiling: each
+// of their kernels is built here with its own optimize attribute.
+
+#define MAX_DIMS 64
+#define MAX_CONFIGS 16
+#define MAX_TIMES 100000
+
+// Row kernel: multiplies the rows [i0, i1) of the job's product
+struct BenchJob;
+typedef void (*RowKernel)(const struct BenchJob *job, int i0, int i1);
+
+typedef struct {
+    const char *key;    // Name on the command line (--configs)
+    const char *name;   // Label in the CSV, as in the main_run.sh scripts
+    RowKernel kernel;
+    int packB;          // Runs the timed transpose stage that writes Bᵀ first
+} BenchConfig;
+
+// The product being measured. Lives in shared memory, so pre-forked
+// process workers see the configuration the parent switches to.
+typedef struct BenchJob {
+    int n;
+    Matrix a, b, c;
+    Matrix bt;          // Bᵀ, written by the pack stage of the transpose configurations
+    RowKernel kernel;
+    int rowsPerTask;
+    TileSizes tiles;
+    SimdKernels simd;
+} BenchJob;
+
+// Function to multiply rows with the naive i-j-k loop, built like "Standard" (no flags)
+__attribute__((optimize("O0")))
+void standardRowsO0(const BenchJob *job, int i0, int i1) {
+    int n = job->n, lda = job->a.stride, ldb = job->b.stride, ldc = job->c.stride;
+    const int *a = job->a.data, *b = job->b.data;
+    int *c = job->c.data;
+    for (int i = i0; i < i1; i++){
+        for (int j = 0; j < n; j++){
+            for (int k = 0; k < n; k++){
+                c[(size_t) i*ldc + j] += a[(size_t) i*lda + k] * b[(size_t) k*ldb + j];
+            }
+        }
+    }
+}
+
+// Function to multiply rows with the packed Bᵀ read row-wise, built like "Transpose Only" (no flags)
+__attribute__((optimize("O0")))
+void transposeRowsO0(const BenchJob *job, int i0, int i1) {
+    int n = job->n, lda = job->a.stride, ldb = job->bt.stride, ldc = job->c.stride;
+    const int *a = job->a.data, *b = job->bt.data;
+    int *c = job->c.data;
+    for (int i = i0; i < i1; i++){
+        for (int j = 0; j < n; j++){
+            for (int k = 0; k < n; k++){
+                c[(size_t) i*ldc + j] += a[(size_t) i*lda + k] * b[(size_t) j*ldb + k];
+            }
+        }
+    }
+}
+
+// Function to multiply rows with the naive loop, built like "O3 + loop" (-O3 -floop-interchange)
+__attribute__((optimize("O3", "loop-interchange")))
+void standardRowsO3(const BenchJob *job, int i0, int i1) {
+    int n = job->n, lda = job->a.stride, ldb = job->b.stride, ldc = job->c.stride;
+    const int *restrict a = job->a.data, *restrict b = job->b.data;
+    int *restrict c = job->c.data;
+    for (int i = i0; i < i1; i++){
+        for (int j = 0; j < n; j++){
+            for (int k = 0; k < n; k++){
+                c[(size_t) i*ldc + j] += a[(size_t) i*lda + k] * b[(size_t) k*ldb + j];
+            }
+        }
+    }
+}
+
+// Function to multiply rows with the packed Bᵀ read row-wise, built like "O3 + transpose" (-O3)
+__attribute__((optimize("O3")))
+void transposeRowsO3(const BenchJob *job, int i0, int i1) {
+    int n = job->n, lda = job->a.stride, ldb = job->bt.stride, ldc = job->c.stride;
+    const int *restrict a = job->a.data, *restrict b = job->bt.data;
+    int *restrict c = job->c.data;
+    for (int i = i0; i < i1; i++){
+        for (int j = 0; j < n; j++){
+            for (int k = 0; k < n; k++){
+                c[(size_t) i*ldc + j] += a[(size_t) i*lda + k] * b[(size_t) j*ldb + k];
+            }
+        }
+    }
+}
+
+// Function to multiply rows with the cache-blocked kernel
+void blockedRows(const BenchJob *job, int i0, int i1) {
+    multiplyBlockedRows(&job->a, &job->b, (Matrix *) &job->c, i0, i1, &job->tiles, NULL);
+}
+
+// Function to multiply rows with the SIMD micro-kernel
+void simdRows(const BenchJob *job, int i0, int i1) {
+    job->simd.panel(job->a.data, job->a.stride, job->b.data, job->b.stride, job->c.data, job->c.stride,
+                    i0, i1, 0, job->n, 0, job->n);
+}
+
+// Function to multiply rows with the cache-blocked kernel and SIMD L1 tiles
+void blockedSimdRows(const BenchJob *job, int i0, int i1) {
+    multiplyBlockedRows(&job->a, &job->b, (Matrix *) &job->c, i0, i1, &job->tiles, job->simd.panel);
+}
+
+static const BenchConfig benchConfigs[] = {
+    { "standard",     "Standard",       standardRowsO0,  0 },
+    { "transpose",    "Transpose Only", transposeRowsO0, 1 },
+    { "o3-loop",      "O3 + loop",      standardRowsO3,  0 },
+    { "o3-transpose", "O3 + transpose", transposeRowsO3, 1 },
+    { "blocked",      "Blocked",        blockedRows,     0 },
+    { "simd",         "SIMD",           simdRows,        0 },
+    { "blocked-simd", "Blocked + SIMD", blockedSimdRows, 0 },
+};
+#define NUM_BENCH_CONFIGS ((int) (sizeof(benchConfigs) / sizeof(benchConfigs[0])))
+
+// Function to run one row block as a thread or process pool task
+void runBenchTask(void *arg, int task) {
+    const BenchJob *job = (const BenchJob *) arg;
+    int i0 = task * job->rowsPerTask;
+    int i1 = minInt(i0 + job->rowsPerTask, job->n);
+    job->kernel(job, i0, i1);
+}
+
+// Function to write one band of rows of Bᵀ as a thread or process pool task
+void runTransposeTask(void *arg, int band) {
+    BenchJob *job = (BenchJob *) arg;
+    transposeBand(&job->b, &job->bt, band);
+}
+
+// Function to compare two doubles for qsort
+int compareDoubles(const void *x, const void *y) {
+    double a = *(const double *) x, b = *(const double *) y;
+    return (a > b) - (a < b);
+}
+
+// Function to parse a comma-separated list of integers. Returns the count.
+int parseIntList(const char *text, int *values, int max) {
+    int count = 0;
+    const char *p = text;
+    while (*p != '\0' && count < max) {
+        char *end;
+        long value = strtol(p, &end, 10);
+        if (end == p || value < 1) {
+            fprintf(stderr, "Invalid dimension list '%s'\n", text);
+            exit(EXIT_FAILURE);
+        }
+        values[count++] = (int) value;
+        p = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+// Function to look up the configurations of a comma-separated key list ("all" for every one)
+int parseConfigList(const char *text, int *configs) {
+    if (strcmp(text, "all") == 0) {
+        for (int c = 0; c < NUM_BENCH_CONFIGS; c++) {
+            configs[c] = c;
+        }
+        return NUM_BENCH_CONFIGS;
+    }
+    int count = 0;
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "%s", text);
+    for (char *key = strtok(buffer, ","); key != NULL && count < MAX_CONFIGS; key = strtok(NULL, ",")) {
+        int found = -1;
+        for (int c = 0; c < NUM_BENCH_CONFIGS; c++) {
+            if (strcmp(key, benchConfigs[c].key) == 0) {
+                found = c;
+            }
+        }
+        if (found < 0) {
+            fprintf(stderr, "Unknown configuration '%s' (use", key);
+            for (int c = 0; c < NUM_BENCH_CONFIGS; c++) {
+                fprintf(stderr, " %s", benchConfigs[c].key);
+            }
+            fprintf(stderr, " or all)\n");
+            exit(EXIT_FAILURE);
+        }
+        configs[count++] = found;
+    }
+    return count;
+}
+
+int main(int argc, char *argv[]) {
+    int dims[MAX_DIMS] = { 10, 100, 200, 400, 800 };
+    int numDims = 5;
+    int configs[MAX_CONFIGS] = { 0, 1, 2, 3 };  // The four configurations of main_run.sh
+    int numConfigs = 4;
+    int warmup = 2;         // Untimed runs before the repetitions
+    int reps = 10;          // Timed repetitions per dimension and configuration
+    int workers = 0;        // Threads or processes, 0 for #CPUs
+    char backend[16] = "sequential";
+    char simdIsa[16] = "";
+    char fileCsv[256] = "benchmark_results.csv";
+    TileSizes tiles = defaultTileSizes();
+
+    // Parse arguments
+    for (int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--dims") == 0 && (i+1 < argc)) {
+            numDims = parseIntList(argv[++i], dims, MAX_DIMS);
+        } else if(strcmp(argv[i], "--configs") == 0 && (i+1 < argc)) {
+            numConfigs = parseConfigList(argv[++i], configs);
+        } else if(strcmp(argv[i], "--backend") == 0 && (i+1 < argc)) {
+            snprintf(backend, sizeof(backend), "%s", argv[++i]);
+        } else if(strcmp(argv[i], "--workers") == 0 && (i+1 < argc)) {
+            workers = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--warmup") == 0 && (i+1 < argc)) {
+            warmup = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--reps") == 0 && (i+1 < argc)) {
+            reps = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--csv") == 0 && (i+1 < argc)) {
+            snprintf(fileCsv, sizeof(fileCsv), "%s", argv[++i]);
+        } else if(strcmp(argv[i], "--isa") == 0 && (i+1 < argc)) {
+            snprintf(simdIsa, sizeof(simdIsa), "%s", argv[++i]);
+        } else if(strcmp(argv[i], "--tiles") == 0 && (i+3 < argc)) {
+            tiles.l1 = atoi(argv[++i]);
+            tiles.l2 = atoi(argv[++i]);
+            tiles.l3 = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "Unknown argument '%s'\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    checkTileSizes(&tiles);
+    if (reps < 1 || reps > MAX_TIMES || warmup < 0) {
+        fprintf(stderr, "--reps must be in 1..%d and --warmup at least 0\n", MAX_TIMES);
+        return EXIT_FAILURE;
+    }
+    int useThreads = strcmp(backend, "threads") == 0;
+    int useProcesses = strcmp(backend, "processes") == 0;
+    int useOpenmp = strcmp(backend, "openmp") == 0;
+    if (!useThreads && !useProcesses && !useOpenmp && strcmp(backend, "sequential") != 0) {
+        fprintf(stderr, "Unknown backend '%s' (use sequential, threads, processes or openmp)\n", backend);
+        return EXIT_FAILURE;
+    }
+#ifndef _OPENMP
+    if (useOpenmp) {
+        fprintf(stderr, "The openmp backend needs a build with -fopenmp\n");
+        return EXIT_FAILURE;
+    }
+#endif
+    if (workers <= 0) {
+        workers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (!useThreads && !useProcesses && !useOpenmp) {
+        workers = 1;
+    }
+
+    // The job is shared with the process workers; the SIMD kernels are picked once
+    BenchJob *job = mmap(NULL, sizeof(BenchJob), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (job == MAP_FAILED) {
+        perror("mmap");
+        return EXIT_FAILURE;
+    }
+    job->tiles = tiles;
+    job->simd = selectSimdKernels(simdIsa);
+
+    FILE *csv = fopen(fileCsv, "w");
+    if (csv == NULL) {
+        perror(fileCsv);
+        return EXIT_FAILURE;
+    }
+    fprintf(csv, "timestamp,dimension,iteration,configuration,time\n");
+
+    printf("Backend %s with %d worker(s), %d warmup run(s) and %d repetition(s), SIMD %s\n",
+           backend, workers, warmup, reps, job->simd.isa);
+    printf("%-16s %6s %12s %12s %12s %12s %10s\n",
+           "configuration", "n", "min (s)", "median (s)", "p95 (s)", "stddev (s)", "GFLOP/s");
+
+    double *times = malloc(reps * sizeof(double));
+    double *sorted = malloc(reps * sizeof(double));
+    ThreadPool *threadPool = useThreads ? createThreadPool(workers) : NULL;
+    srand(time(NULL));
+
+    for (int d = 0; d < numDims; d++) {
+        int n = dims[d];
+        job->n = n;
+        job->a = allocateMatrix(n, n, MATRIX_SHARED);
+        job->b = allocateMatrix(n, n, MATRIX_SHARED);
+        job->c = allocateMatrix(n, n, MATRIX_SHARED);
+        job->bt = allocateMatrix(n, n, MATRIX_SHARED | MATRIX_POPULATE);
+        fillMatrix(&job->a);
+        fillMatrix(&job->b);
+
+        // Row blocks, about four per worker, for every parallel backend
+        job->rowsPerTask = (n + 4 * workers - 1) / (4 * workers);
+        int numTasks = (n + job->rowsPerTask - 1) / job->rowsPerTask;
+        PoolTask *tasks = malloc(numTasks * sizeof(PoolTask));
+        for (int t = 0; t < numTasks; t++) {
+            tasks[t].run = runBenchTask;
+            tasks[t].arg = job;
+            tasks[t].index = t;
+        }
+        int numBands = transposeBandCount(&job->b);
+        PoolTask *bandTasks = malloc(numBands * sizeof(PoolTask));
+        for (int t = 0; t < numBands; t++) {
+            bandTasks[t].run = runTransposeTask;
+            bandTasks[t].arg = job;
+            bandTasks[t].index = t;
+        }
+        // Process workers are forked after the matrices of this dimension are mapped
+        ProcessPool processPool;
+        if (useProcesses) {
+            processPool = createProcessPool(workers, NULL);
+        }
+
+        for (int ci = 0; ci < numConfigs; ci++) {
+            const BenchConfig *config = &benchConfigs[configs[ci]];
+            job->kernel = config->kernel;
+            for (int r = -warmup; r < reps; r++) {
+                zeroMatrix(&job->c);  // The kernels accumulate into C
+
+                struct timespec start, end;
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                if (config->packB) {
+                    // The pack stage is part of the time, as in the transpose method of the backends
+                    if (useThreads) {
+                        threadPoolRun(threadPool, bandTasks, numBands);
+                    } else if (useProcesses) {
+                        processPoolRun(&processPool, runTransposeTask, job, numBands);
+                    } else if (useOpenmp) {
+#ifdef _OPENMP
+                        #pragma omp parallel for schedule(dynamic, 1) num_threads(workers)
+                        for (int t = 0; t < numBands; t++) {
+                            runTransposeTask(job, t);
+                        }
+#endif
+                    } else {
+                        transposeMatrix(&job->b, &job->bt);
+                    }
+                }
+                if (useThreads) {
+                    threadPoolRun(threadPool, tasks, numTasks);
+                } else if (useProcesses) {
+                    processPoolRun(&processPool, runBenchTask, job, numTasks);
+                } else if (useOpenmp) {
+#ifdef _OPENMP
+                    #pragma omp parallel for schedule(dynamic, 1) num_threads(workers)
+                    for (int t = 0; t < numTasks; t++) {
+                        runBenchTask(job, t);
+                    }
+#endif
+                } else {
+                    job->kernel(job, 0, n);
+                }
+                clock_gettime(CLOCK_MONOTONIC, &end);
+
+                if (r >= 0) {
+                    times[r] = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+                    fprintf(csv, "%ld,%d,%d,\"%s\",%.9f\n", (long) time(NULL), n, r + 1, config->name, times[r]);
+                }
+            }
+
+            // Statistics over the timed repetitions
+            memcpy(sorted, times, reps * sizeof(double));
+            qsort(sorted, reps, sizeof(double), compareDoubles);
+            double mean = 0, variance = 0;
+            for (int r = 0; r < reps; r++) {
+                mean += times[r] / reps;
+            }
+            for (int r = 0; r < reps; r++) {
+                variance += (times[r] - mean) * (times[r] - mean);
+            }
+            double stddev = reps > 1 ? sqrt(variance / (reps - 1)) : 0;
+            double median = reps % 2 ? sorted[reps / 2] : (sorted[reps / 2 - 1] + sorted[reps / 2]) / 2;
+            double p95 = sorted[(int) ceil(0.95 * reps) - 1];  // Nearest rank
+            double gflops = 2.0 * n * n * (double) n / median / 1e9;
+            printf("%-16s %6d %12.9f %12.9f %12.9f %12.9f %10.3f\n",
+                   config->name, n, sorted[0], median, p95, stddev, gflops);
+        }
+        fflush(csv);
+
+        if (useProcesses) {
+            destroyProcessPool(&processPool);
+        }
+        free(tasks);
+        free(bandTasks);
+        freeMatrix(&job->a);
+        freeMatrix(&job->b);
+        freeMatrix(&job->bt);
+        freeMatrix(&job->c);
+    }
+
+    if (threadPool != NULL) {
+        destroyThreadPool(threadPool);
+    }
+    fclose(csv);
+    printf("Results written to %s\n", fileCsv);
+    free(times);
+    free(sorted);
+    munmap(job, sizeof(BenchJob));
+    return 0;
+}
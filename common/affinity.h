@@ -0,0 +1,384 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+// Worker pinning and NUMA placement for the parallel backends.
+//
+// The CPU topology is read from sysfs: for every online CPU its physical
+// core, package, NUMA node and its rank among the SMT siblings of its core.
+// --affinity builds an ordered list of CPUs and worker w is pinned to entry w:
+//   compact  one node after the other, core by core
+//   scatter  round-robin over the nodes, so every node gets a worker early
+//   LIST     an explicit CPU list such as 0-7,16-23
+// compact and scatter are SMT-aware: every physical core gets a worker before
+// any core gets a second one, and by default only one worker per physical
+// core is started (--smt uses the sibling hardware threads as well).
+//
+// Once workers are pinned, the pages of C are first touched by the worker
+// that computes them, and --numa places the shared inputs: "interleave"
+// spreads A and B round-robin over the nodes, "replicate" keeps one copy of B
+// per node (A stays interleaved, each row of it is read by one worker only).
+
+// cpu_set_t and sched_setaffinity need _GNU_SOURCE, defined by the backend
+// before its first #include
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "matrix.h"
+
+#define AFFINITY_NONE    0
+#define AFFINITY_COMPACT 1
+#define AFFINITY_SCATTER 2
+#define AFFINITY_LIST    3
+
+#define NUMA_FIRST_TOUCH 0  // Only C is placed, by its workers
+#define NUMA_INTERLEAVE  1
+#define NUMA_REPLICATE   2
+
+typedef struct {
+    int cpu;
+    int core;       // core_id, unique within a package
+    int package;
+    int node;
+    int sibling;    // 0 for the first hardware thread of a core, 1 for the second, ...
+} CpuInfo;
+
+typedef struct {
+    int numCpus;
+    CpuInfo *cpus;
+    int numCores;   // Physical cores (CPUs with sibling 0)
+    int numNodes;
+} CpuTopology;
+
+// Where the workers run: worker w is pinned to cpus[w % count]
+typedef struct {
+    int policy;     // AFFINITY_*
+    int count;
+    int *cpus;
+    int *nodes;     // NUMA node of each entry of cpus
+} Placement;
+
+// Function to read one integer from a sysfs file, fallback if it is missing
+static inline int readSysfsInt(const char *path, int fallback) {
+    FILE *file = fopen(path, "r");
+    int value;
+    if (file == NULL) {
+        return fallback;
+    }
+    if (fscanf(file, "%d", &value) != 1) {
+        value = fallback;
+    }
+    fclose(file);
+    return value;
+}
+
+// Function to parse a CPU list such as "0-3,8,10-11" into a new array.
+// Returns the number of CPUs, or -1 if the list is malformed.
+static inline int parseCpuList(const char *text, int **out) {
+    int capacity = 64, count = 0;
+    int *cpus = malloc(capacity * sizeof(int));
+    if (cpus == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    const char *p = text;
+    while (*p != '\0' && *p != '\n') {
+        char *stop;
+        long first = strtol(p, &stop, 10), last;
+        if (stop == p || first < 0) {
+            free(cpus);
+            return -1;
+        }
+        last = first;
+        p = stop;
+        if (*p == '-') {
+            last = strtol(p + 1, &stop, 10);
+            if (stop == p + 1 || last < first) {
+                free(cpus);
+                return -1;
+            }
+            p = stop;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            if (count == capacity) {
+                capacity *= 2;
+                cpus = realloc(cpus, capacity * sizeof(int));
+                if (cpus == NULL) {
+                    perror("realloc");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            cpus[count++] = (int) cpu;
+        }
+        if (*p == ',') {
+            p++;
+        } else if (*p != '\0' && *p != '\n') {
+            free(cpus);
+            return -1;
+        }
+    }
+    *out = cpus;
+    return count;
+}
+
+// Function to read a CPU list file of sysfs, -1 if it does not exist
+static inline int readSysfsCpuList(const char *path, int **out) {
+    char text[4096];
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    if (fgets(text, sizeof(text), file) == NULL) {
+        text[0] = '\0';
+    }
+    fclose(file);
+    return parseCpuList(text, out);
+}
+
+// Function to read the topology of the online CPUs from sysfs
+static inline CpuTopology readCpuTopology(void) {
+    CpuTopology topo;
+    int *online = NULL;
+    topo.numCpus = readSysfsCpuList("/sys/devices/system/cpu/online", &online);
+    if (topo.numCpus <= 0) {
+        // No sysfs: every CPU counts as its own core on node 0
+        topo.numCpus = (int) sysconf(_SC_NPROCESSORS_ONLN);
+        online = malloc(topo.numCpus * sizeof(int));
+        for (int c = 0; c < topo.numCpus; c++) {
+            online[c] = c;
+        }
+    }
+    topo.cpus = malloc(topo.numCpus * sizeof(CpuInfo));
+    if (online == NULL || topo.cpus == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    char path[128];
+    for (int c = 0; c < topo.numCpus; c++) {
+        CpuInfo *info = &topo.cpus[c];
+        info->cpu = online[c];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", info->cpu);
+        info->core = readSysfsInt(path, info->cpu);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", info->cpu);
+        info->package = readSysfsInt(path, 0);
+        info->node = 0;
+    }
+    free(online);
+
+    // NUMA node of every CPU, from the CPU lists of the nodes
+    topo.numNodes = onlineNumaNodes();
+    for (int node = 0; node < topo.numNodes; node++) {
+        int *cpus = NULL;
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        int count = readSysfsCpuList(path, &cpus);
+        for (int i = 0; i < count; i++) {
+            for (int c = 0; c < topo.numCpus; c++) {
+                if (topo.cpus[c].cpu == cpus[i]) {
+                    topo.cpus[c].node = node;
+                }
+            }
+        }
+        if (count >= 0) {
+            free(cpus);
+        }
+    }
+
+    // SMT rank: siblings of a core share its package and core_id
+    topo.numCores = 0;
+    for (int c = 0; c < topo.numCpus; c++) {
+        CpuInfo *info = &topo.cpus[c];
+        info->sibling = 0;
+        for (int o = 0; o < c; o++) {
+            if (topo.cpus[o].package == info->package && topo.cpus[o].core == info->core) {
+                info->sibling++;
+            }
+        }
+        topo.numCores += info->sibling == 0;
+    }
+    return topo;
+}
+
+// Function to release a topology
+static inline void freeCpuTopology(CpuTopology *topo) {
+    free(topo->cpus);
+    topo->cpus = NULL;
+}
+
+// Function to parse the --affinity argument (a CPU list gives AFFINITY_LIST)
+static inline int parseAffinity(const char *arg) {
+    if (strcmp(arg, "none") == 0) return AFFINITY_NONE;
+    if (strcmp(arg, "compact") == 0) return AFFINITY_COMPACT;
+    if (strcmp(arg, "scatter") == 0) return AFFINITY_SCATTER;
+    if (arg[0] >= '0' && arg[0] <= '9') return AFFINITY_LIST;
+    fprintf(stderr, "Unknown affinity '%s' (use compact, scatter, none or a CPU list like 0-3,8)\n", arg);
+    exit(EXIT_FAILURE);
+}
+
+// Function to parse the --numa argument
+static inline int parseNumaMode(const char *arg) {
+    if (strcmp(arg, "first-touch") == 0) return NUMA_FIRST_TOUCH;
+    if (strcmp(arg, "interleave") == 0) return NUMA_INTERLEAVE;
+    if (strcmp(arg, "replicate") == 0) return NUMA_REPLICATE;
+    fprintf(stderr, "Unknown NUMA placement '%s' (use first-touch, interleave or replicate)\n", arg);
+    exit(EXIT_FAILURE);
+}
+
+// Function to get the name of a NUMA placement mode
+static inline const char *numaModeName(int mode) {
+    return mode == NUMA_INTERLEAVE ? "interleave" : mode == NUMA_REPLICATE ? "replicate" : "first-touch";
+}
+
+// Function to get the number of workers an affinity policy starts by default:
+// one per physical core, or one per hardware thread with SMT
+static inline int defaultWorkerCount(const CpuTopology *topo, int useSmt) {
+    return useSmt ? topo->numCpus : topo->numCores;
+}
+
+// Sort key of compact and scatter (see buildPlacement)
+typedef struct {
+    int sibling;
+    int first;
+    int second;
+    int cpu;
+    int node;
+} PlacementKey;
+
+// Function to compare two placement keys (for qsort)
+static inline int comparePlacementKeys(const void *x, const void *y) {
+    const PlacementKey *a = x, *b = y;
+    if (a->sibling != b->sibling) return a->sibling - b->sibling;
+    if (a->first != b->first) return a->first - b->first;
+    if (a->second != b->second) return a->second - b->second;
+    return a->cpu - b->cpu;
+}
+
+// Function to build the CPU order of an affinity policy. list is the CPU list
+// of AFFINITY_LIST and is ignored otherwise.
+static inline Placement buildPlacement(const CpuTopology *topo, int policy, const char *list) {
+    Placement placement;
+    placement.policy = policy;
+    placement.count = 0;
+    placement.cpus = NULL;
+    placement.nodes = NULL;
+    if (policy == AFFINITY_NONE) {
+        return placement;
+    }
+    if (policy == AFFINITY_LIST) {
+        placement.count = parseCpuList(list, &placement.cpus);
+        if (placement.count <= 0) {
+            fprintf(stderr, "Invalid CPU list '%s'\n", list);
+            exit(EXIT_FAILURE);
+        }
+        placement.nodes = malloc(placement.count * sizeof(int));
+        for (int i = 0; i < placement.count; i++) {
+            placement.nodes[i] = 0;
+            for (int c = 0; c < topo->numCpus; c++) {
+                if (topo->cpus[c].cpu == placement.cpus[i]) {
+                    placement.nodes[i] = topo->cpus[c].node;
+                }
+            }
+        }
+        return placement;
+    }
+
+    // compact: node, package, core; scatter: rank of the core within its node, then node
+    PlacementKey *keys = malloc(topo->numCpus * sizeof(PlacementKey));
+    int *rankInNode = calloc(topo->numNodes > 0 ? topo->numNodes : 1, sizeof(int));
+    if (keys == NULL || rankInNode == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int c = 0; c < topo->numCpus; c++) {
+        const CpuInfo *info = &topo->cpus[c];
+        keys[c].sibling = info->sibling;
+        keys[c].cpu = info->cpu;
+        keys[c].node = info->node;
+        if (policy == AFFINITY_COMPACT) {
+            keys[c].first = info->node;
+            keys[c].second = info->package * 65536 + info->core;
+        } else {
+            keys[c].first = info->sibling == 0 ? rankInNode[info->node]++ : 0;
+            keys[c].second = info->node;
+        }
+    }
+    if (policy == AFFINITY_SCATTER) {
+        // Siblings take the rank of their core, so second threads are scattered the same way
+        for (int c = 0; c < topo->numCpus; c++) {
+            if (topo->cpus[c].sibling > 0) {
+                for (int o = 0; o < topo->numCpus; o++) {
+                    if (topo->cpus[o].sibling == 0 && topo->cpus[o].package == topo->cpus[c].package &&
+                        topo->cpus[o].core == topo->cpus[c].core) {
+                        keys[c].first = keys[o].first;
+                    }
+                }
+            }
+        }
+    }
+    qsort(keys, topo->numCpus, sizeof(PlacementKey), comparePlacementKeys);
+    placement.count = topo->numCpus;
+    placement.cpus = malloc(placement.count * sizeof(int));
+    placement.nodes = malloc(placement.count * sizeof(int));
+    if (placement.cpus == NULL || placement.nodes == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < placement.count; i++) {
+        placement.cpus[i] = keys[i].cpu;
+        placement.nodes[i] = keys[i].node;
+    }
+    free(keys);
+    free(rankInNode);
+    return placement;
+}
+
+// Function to release a placement
+static inline void freePlacement(Placement *placement) {
+    free(placement->cpus);
+    free(placement->nodes);
+    placement->cpus = NULL;
+    placement->nodes = NULL;
+}
+
+// Function to get the CPU of worker w, -1 when workers are not pinned
+static inline int placementCpu(const Placement *placement, int w) {
+    return placement->count > 0 ? placement->cpus[w % placement->count] : -1;
+}
+
+// Function to get the NUMA node of worker w (0 when workers are not pinned)
+static inline int placementNode(const Placement *placement, int w) {
+    return placement->count > 0 ? placement->nodes[w % placement->count] : 0;
+}
+
+// Function to pin the calling thread (or process) to one CPU
+static inline void pinToCpu(int cpu) {
+    if (cpu < 0) {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+        fprintf(stderr, "Cannot pin to CPU %d, running unpinned\n", cpu);
+    }
+}
+
+// Function to print where numWorkers workers are pinned
+static inline void printPlacement(const Placement *placement, const CpuTopology *topo, int numWorkers) {
+    static const char *names[] = { "none", "compact", "scatter", "list" };
+    printf("Affinity %s: %d worker(s) on %d core(s) / %d hardware thread(s) / %d node(s), CPUs",
+           names[placement->policy], numWorkers, topo->numCores, topo->numCpus, topo->numNodes);
+    for (int w = 0; w < numWorkers && w < 16; w++) {
+        printf("%s%d", w == 0 ? " " : ",", placementCpu(placement, w));
+    }
+    printf("%s\n", numWorkers > 16 ? ",..." : "");
+}
+
+// Function to allocate a copy of m whose pages are bound to one NUMA node
+static inline Matrix replicateMatrix(const Matrix *m, int node, int flags) {
+    Matrix copy = allocateTypedMatrix(m->rows, m->cols, m->type, flags);
+    bindMemory(copy.data, copy.bytes, MATRIX_MPOL_BIND, node);
+    memcpy(copy.data, m->data, (size_t) m->rows * m->stride * m->elemSize);
+    return copy;
+}
+
+#endif
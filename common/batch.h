@@ -0,0 +1,369 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+// Batched multiplication of many small, independent products (--batch FILE).
+//
+// A batch file is plain text: for every product a line with its size n, then
+// the n rows of A and the n rows of B (see utils/generate_batch.py). Products
+// are square and may all have different sizes. Every matrix of the batch is
+// packed into one arena, with A, B and C of a product next to each other, and
+// a product is never split between workers: parallel backends hand out whole
+// products, largest first, so a worker multiplies a 10 x 10 product without
+// any synchronization and the throughput grows with the number of cores.
+//
+// The result file has the same layout: n, then the n rows of C, per product.
+
+#include <limits.h>
+#include "matrix.h"
+#include "matrix_io.h"
+#include "blocked.h"
+#include "simd.h"
+#include "typed.h"
+#include "transpose.h"
+
+#define BATCH_MAX_N 46340  // n^2 must fit in an int
+
+typedef struct {
+    int n;
+    Matrix a;  // Views into the batch arena
+    Matrix b;
+    Matrix c;
+} BatchProduct;
+
+typedef struct {
+    int count;
+    BatchProduct *products;
+    int *order;         // Product indices sorted by decreasing n
+    void *arena;        // One mapping behind every matrix of the batch
+    size_t arenaBytes;
+    int minN;
+    int maxN;
+    double flops;       // 2 n^3 summed over the products
+} Batch;
+
+// Method every product of the batch is multiplied with
+typedef struct {
+    int method;                 // TYPED_STANDARD, TYPED_TRANSPOSE or TYPED_BLOCKED
+    int useSimd;
+    const SimdKernels *simd;    // Kernels of int32 batches
+    const TypedKernels *typed;  // Kernels of the other element types
+    const TileSizes *tiles;
+} BatchKernel;
+
+// Parsing job: a contiguous range of products
+typedef struct {
+    Batch *batch;
+    const char **text;  // Start of A and of B in the mapped file, per product
+    const char *end;
+    int first;
+    int last;
+    int error;
+} BatchParse;
+
+// Formatting job: a contiguous range of products
+typedef struct {
+    const Batch *batch;
+    int first;
+    int last;
+    char *buffer;
+    size_t length;
+} BatchText;
+
+// Function to skip count whitespace-separated tokens. Returns NULL if the text ends first.
+static inline const char *skipTextNumbers(const char *p, const char *end, size_t count) {
+    while (count > 0) {
+        while (p < end && isTextSpace(*p)) p++;
+        if (p == end) {
+            return NULL;
+        }
+        while (p < end && !isTextSpace(*p)) p++;
+        count--;
+    }
+    return p;
+}
+
+// Function to parse the A and B matrices of a range of products and to zero their C
+static inline void *parseBatchProducts(void *arg) {
+    BatchParse *job = (BatchParse *) arg;
+    for (int p = job->first; p < job->last; p++) {
+        BatchProduct *product = &job->batch->products[p];
+        TextChunk a = { job->text[2 * p], job->end, 0, 0, &product->a, 1, 0 };
+        TextChunk b = { job->text[2 * p + 1], job->end, 0, 0, &product->b, 1, 0 };
+        scanTextChunk(&a);
+        scanTextChunk(&b);
+        if (a.error || b.error) {
+            job->error = 1;
+            return NULL;
+        }
+        zeroMatrix(&product->c);
+    }
+    return NULL;
+}
+
+// Function to compare two products by decreasing size (for qsort)
+static inline int compareBatchSizes(const void *x, const void *y) {
+    const int *a = x, *b = y;  // { n, index } pairs
+    if (a[0] != b[0]) {
+        return a[0] > b[0] ? -1 : 1;
+    }
+    return a[1] - b[1];
+}
+
+// Function to read a batch file into one arena of the given element type.
+// The size lines are scanned first so the arena can be laid out, then the
+// products are parsed by ioThreads threads.
+static inline void readBatchFile(Batch *batch, const char *fileName, int type, int flags, int ioThreads) {
+    int fd = open(fileName, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "Cannot open file %s\n", fileName);
+        exit(EXIT_FAILURE);
+    }
+    size_t size = (size_t) st.st_size;
+    const char *text = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    if (text == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    const char *end = text + size;
+
+    // First pass: sizes and where each matrix starts
+    int capacity = 1024;
+    int count = 0;
+    int *sizes = malloc(capacity * sizeof(int));
+    const char **starts = malloc(2 * capacity * sizeof(const char *));
+    if (sizes == NULL || starts == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    const char *p = text;
+    while (p < end) {
+        while (p < end && isTextSpace(*p)) p++;
+        if (p == end) break;
+        long n = 0;
+        while (p < end && *p >= '0' && *p <= '9' && n <= BATCH_MAX_N) {
+            n = n * 10 + (*p - '0');
+            p++;
+        }
+        if (n < 1 || n > BATCH_MAX_N || (p < end && !isTextSpace(*p))) {
+            fprintf(stderr, "Error reading file %s: bad size of product %d\n", fileName, count);
+            exit(EXIT_FAILURE);
+        }
+        if (count == capacity) {
+            capacity *= 2;
+            sizes = realloc(sizes, capacity * sizeof(int));
+            starts = realloc(starts, 2 * capacity * sizeof(const char *));
+            if (sizes == NULL || starts == NULL) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+        sizes[count] = (int) n;
+        starts[2 * count] = p;
+        starts[2 * count + 1] = p = skipTextNumbers(p, end, (size_t) n * n);
+        if (p != NULL) {
+            p = skipTextNumbers(p, end, (size_t) n * n);
+        }
+        if (p == NULL) {
+            fprintf(stderr, "Error reading file %s: product %d is truncated\n", fileName, count);
+            exit(EXIT_FAILURE);
+        }
+        count++;
+    }
+    if (count == 0) {
+        fprintf(stderr, "Error reading file %s: no products\n", fileName);
+        exit(EXIT_FAILURE);
+    }
+
+    // Lay out A, B and C of every product back to back. Every matrix is a
+    // whole number of cache lines, so all of them stay 64-byte aligned.
+    int elemSize = matrixTypeSize(type);
+    batch->count = count;
+    batch->products = malloc(count * sizeof(BatchProduct));
+    batch->order = malloc(count * sizeof(int));
+    int (*bysize)[2] = malloc(count * sizeof(*bysize));
+    if (batch->products == NULL || batch->order == NULL || bysize == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    size_t total = 0;
+    batch->minN = INT_MAX;
+    batch->maxN = 0;
+    batch->flops = 0;
+    for (int i = 0; i < count; i++) {
+        int n = sizes[i];
+        total += 3 * (size_t) n * paddedStrideOf(n, elemSize) * elemSize;
+        batch->minN = n < batch->minN ? n : batch->minN;
+        batch->maxN = n > batch->maxN ? n : batch->maxN;
+        batch->flops += 2.0 * n * n * n;
+        bysize[i][0] = n;
+        bysize[i][1] = i;
+    }
+    batch->arenaBytes = total;
+    batch->arena = allocateMatrixMemory(&batch->arenaBytes, flags);
+    char *next = batch->arena;
+    for (int i = 0; i < count; i++) {
+        BatchProduct *product = &batch->products[i];
+        Matrix *parts[3] = { &product->a, &product->b, &product->c };
+        product->n = sizes[i];
+        for (int m = 0; m < 3; m++) {
+            Matrix *v = parts[m];
+            v->rows = v->cols = sizes[i];
+            v->type = type;
+            v->elemSize = elemSize;
+            v->stride = paddedStrideOf(sizes[i], elemSize);
+            v->flags = flags;
+            v->data = next;
+            v->base = NULL;  // Freed with the arena
+            v->bytes = 0;
+            next += (size_t) v->rows * v->stride * elemSize;
+        }
+    }
+    qsort(bysize, count, sizeof(*bysize), compareBatchSizes);
+    for (int i = 0; i < count; i++) {
+        batch->order[i] = bysize[i][1];
+    }
+    free(bysize);
+    free(sizes);
+
+    // Second pass: parse contiguous ranges of products in parallel
+    if (ioThreads < 1) ioThreads = 1;
+    if (ioThreads > count) ioThreads = count;
+    BatchParse jobs[ioThreads];
+    for (int t = 0; t < ioThreads; t++) {
+        jobs[t] = (BatchParse) { batch, starts, end, (int) ((long) count * t / ioThreads),
+                                 (int) ((long) count * (t + 1) / ioThreads), 0 };
+    }
+    runTextJobs(parseBatchProducts, jobs, sizeof(BatchParse), ioThreads);
+    for (int t = 0; t < ioThreads; t++) {
+        if (jobs[t].error) {
+            fprintf(stderr, "Error reading file %s.\n", fileName);
+            exit(EXIT_FAILURE);
+        }
+    }
+    free(starts);
+    munmap((void *) text, size);
+}
+
+// Function to multiply one whole product of the batch (C must be zero)
+static inline void multiplyBatchProduct(const BatchKernel *kernel, BatchProduct *product) {
+    int n = product->n;
+    if (kernel->method == TYPED_TRANSPOSE) {
+        // --transpose: B is turned into Bᵀ in place in the arena, then read row-wise
+        transposeSquareInPlace(&product->b);
+    }
+    if (product->c.type != MATRIX_TYPE_INT32) {
+        multiplyTypedRange(kernel->typed, kernel->method, kernel->useSimd,
+                           &product->a, &product->b, &product->c, 0, n, 0, n, kernel->tiles);
+        return;
+    }
+    const int *restrict a = product->a.data;
+    const int *restrict b = product->b.data;
+    int *restrict c = product->c.data;
+    int lda = product->a.stride, ldb = product->b.stride, ldc = product->c.stride;
+    if (kernel->method == TYPED_BLOCKED) {
+        multiplyBlockedRows(&product->a, &product->b, &product->c, 0, n, kernel->tiles,
+                            kernel->useSimd ? kernel->simd->panel : NULL);
+    } else if (kernel->method == TYPED_TRANSPOSE) {
+        TileKernel transposed = kernel->useSimd ? kernel->simd->transposed : multiplyTransposedTile;
+        transposed(a, lda, b, ldb, c, ldc, 0, n, 0, n, 0, n);
+    } else if (kernel->useSimd) {
+        kernel->simd->panel(a, lda, b, ldb, c, ldc, 0, n, 0, n, 0, n);
+    } else {
+        for (int i = 0; i < n; i++){
+            for (int j = 0; j < n; j++){
+                for (int k = 0; k < n; k++){
+                    c[(size_t) i*ldc + j] += a[(size_t) i*lda + k] * b[(size_t) k*ldb + j];
+                }
+            }
+        }
+    }
+}
+
+// Function to format the results of a range of products: n, then the rows of C
+static inline void *formatBatchProducts(void *arg) {
+    BatchText *job = (BatchText *) arg;
+    const Batch *batch = job->batch;
+    size_t capacity = 1;
+    for (int p = job->first; p < job->last; p++) {
+        const Matrix *c = &batch->products[p].c;
+        size_t perElement = c->type == MATRIX_TYPE_INT32 ? 12 : 25;
+        capacity += 12 + (size_t) c->rows * ((size_t) c->cols * perElement + 1);
+    }
+    job->buffer = malloc(capacity);
+    if (job->buffer == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    char *out = job->buffer;
+    for (int p = job->first; p < job->last; p++) {
+        const Matrix *c = &batch->products[p].c;
+        out += formatInt(out, c->rows);
+        *out++ = '\n';
+        for (int i = 0; i < c->rows; i++){
+            const void *row = matrixRowAt(c, i);
+            for (int j = 0; j < c->cols; j++){
+                out += formatElement(out, c, row, j);
+                *out++ = ' ';
+            }
+            *out++ = '\n';
+        }
+    }
+    job->length = (size_t) (out - job->buffer);
+    return NULL;
+}
+
+// Function to write every result of the batch, in input order, with numThreads
+// formatting threads and a single writev
+static inline void writeBatchFile(const Batch *batch, const char *fileName, int numThreads) {
+    int fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open file %s for writing\n", fileName);
+        exit(EXIT_FAILURE);
+    }
+    if (numThreads < 1) numThreads = 1;
+    if (numThreads > batch->count) numThreads = batch->count;
+    BatchText parts[numThreads];
+    struct iovec iov[numThreads];
+    for (int t = 0; t < numThreads; t++) {
+        parts[t] = (BatchText) { batch, (int) ((long) batch->count * t / numThreads),
+                                 (int) ((long) batch->count * (t + 1) / numThreads), NULL, 0 };
+    }
+    runTextJobs(formatBatchProducts, parts, sizeof(BatchText), numThreads);
+    for (int t = 0; t < numThreads; t++) {
+        iov[t].iov_base = parts[t].buffer;
+        iov[t].iov_len = parts[t].length;
+    }
+    writevAll(fd, iov, numThreads, fileName);
+    for (int t = 0; t < numThreads; t++) {
+        free(parts[t].buffer);
+    }
+    close(fd);
+}
+
+// Function to print the shape of a batch
+static inline void printBatchSummary(const Batch *batch) {
+    printf("Batch of %d products, n from %d to %d (%.1f MB packed)\n", batch->count,
+           batch->minN, batch->maxN, batch->arenaBytes / (1024.0 * 1024.0));
+}
+
+// Function to print the throughput of a batch multiplied in computeTime seconds
+static inline void printBatchThroughput(const Batch *batch, double computeTime) {
+    printf("Batch throughput: %.1f products/s, %.3f GFLOP/s\n",
+           batch->count / computeTime, batch->flops / computeTime / 1e9);
+}
+
+// Function to release the arena and the product list of a batch
+static inline void freeBatch(Batch *batch) {
+    if (batch->arena != NULL && munmap(batch->arena, batch->arenaBytes) == -1) {
+        perror("munmap");
+    }
+    free(batch->products);
+    free(batch->order);
+    batch->arena = NULL;
+    batch->products = NULL;
+    batch->order = NULL;
+}
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef BLOCKED_H
+#define BLOCKED_H
+
+// Cache-blocked (tiled) matrix multiplication shared by every backend.
+//
+// The iteration space is cut into cubes of l3 x l3 x l3, each cube into cubes
+// of l2 x l2 x l2 and each of those into l1 x l1 x l1 tiles, so that the three
+// tiles touched at a given level stay resident in the matching cache level.
+// Inside an L1 tile the loops run i-k-j, which streams rows of B and C with
+// unit stride and lets the compiler vectorize the innermost loop.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "matrix.h"
+
+// Default tile edges (in elements) for a typical 32 KB L1 / 512 KB L2 / 8 MB L3.
+#define DEFAULT_TILE_L1 32
+#define DEFAULT_TILE_L2 128
+#define DEFAULT_TILE_L3 512
+
+// Tile edges for each cache level, innermost first
+typedef struct {
+    int l1;
+    int l2;
+    int l3;
+} TileSizes;
+
+// Function to get the default tile sizes
+static inline TileSizes defaultTileSizes(void) {
+    TileSizes tiles = { DEFAULT_TILE_L1, DEFAULT_TILE_L2, DEFAULT_TILE_L3 };
+    return tiles;
+}
+
+// Function to validate tile sizes given on the command line.
+// Every level must be positive and no smaller than the level below it.
+static inline void checkTileSizes(const TileSizes *tiles) {
+    if (tiles->l1 <= 0 || tiles->l2 < tiles->l1 || tiles->l3 < tiles->l2) {
+        fprintf(stderr, "Invalid tile sizes %d %d %d (expected 0 < L1 <= L2 <= L3)\n",
+                tiles->l1, tiles->l2, tiles->l3);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static inline int minInt(int a, int b) {
+    return a < b ? a : b;
+}
+
+// Signature shared by every tile kernel (scalar here, SIMD ones in simd.h):
+// C[i0:i1, j0:j1] += A[i0:i1, k0:k1] * B[k0:k1, j0:j1] on row-major data with
+// leading dimensions lda, ldb and ldc.
+typedef void (*TileKernel)(const int *restrict a, int lda, const int *restrict b, int ldb,
+                           int *restrict c, int ldc,
+                           int i0, int i1, int j0, int j1, int k0, int k1);
+
+// Function to multiply one L1 tile: C[i0:i1, j0:j1] += A[i0:i1, k0:k1] * B[k0:k1, j0:j1]
+static inline void multiplyTile(const int *restrict a, int lda, const int *restrict b, int ldb,
+                                int *restrict c, int ldc,
+                                int i0, int i1, int j0, int j1, int k0, int k1) {
+    for (int i = i0; i < i1; i++){
+        int *restrict cRow = c + (size_t) i * ldc;
+        const int *restrict aRow = a + (size_t) i * lda;
+        for (int k = k0; k < k1; k++){
+            const int aik = aRow[k];
+            const int *restrict bRow = b + (size_t) k * ldb;
+            for (int j = j0; j < j1; j++){
+                cRow[j] += aik * bRow[j];
+            }
+        }
+    }
+}
+
+// Function to walk one tiling level and recurse into the next smaller one
+static inline void multiplyBlockedLevel(const int *restrict a, int lda, const int *restrict b, int ldb,
+                                        int *restrict c, int ldc, TileKernel kernel,
+                                        const int *edges, int level,
+                                        int i0, int i1, int j0, int j1, int k0, int k1) {
+    if (level < 0) {
+        kernel(a, lda, b, ldb, c, ldc, i0, i1, j0, j1, k0, k1);
+        return;
+    }
+    int t = edges[level];
+    for (int ii = i0; ii < i1; ii += t){
+        int iEnd = minInt(ii + t, i1);
+        for (int kk = k0; kk < k1; kk += t){
+            int kEnd = minInt(kk + t, k1);
+            for (int jj = j0; jj < j1; jj += t){
+                int jEnd = minInt(jj + t, j1);
+                multiplyBlockedLevel(a, lda, b, ldb, c, ldc, kernel, edges, level - 1,
+                                     ii, iEnd, jj, jEnd, kk, kEnd);
+            }
+        }
+    }
+}
+
+// Function to multiply the block [startRow, endRow) x [startCol, endCol) of the result
+// with L1/L2/L3 tiling. The result matrix must be initialized to 0 (the kernel
+// accumulates into it). tileKernel multiplies each L1 tile; NULL selects the
+// scalar multiplyTile.
+static inline void multiplyBlockedRange(const Matrix *matrix1, const Matrix *matrix2, Matrix *resultMatrix,
+                                        int startRow, int endRow, int startCol, int endCol,
+                                        const TileSizes *tiles, TileKernel tileKernel) {
+    // Levels are walked from L3 down to L1; each L1 step ends in the tile kernel.
+    int edges[3] = { tiles->l1, tiles->l2, tiles->l3 };
+    multiplyBlockedLevel(matrix1->data, matrix1->stride, matrix2->data, matrix2->stride,
+                         resultMatrix->data, resultMatrix->stride,
+                         tileKernel != NULL ? tileKernel : multiplyTile, edges, 2,
+                         startRow, endRow, startCol, endCol, 0, matrix1->cols);
+}
+
+// Function to multiply the rows [startRow, endRow) of the result with L1/L2/L3 tiling
+static inline void multiplyBlockedRows(const Matrix *matrix1, const Matrix *matrix2, Matrix *resultMatrix,
+                                       int startRow, int endRow, const TileSizes *tiles,
+                                       TileKernel tileKernel) {
+    multiplyBlockedRange(matrix1, matrix2, resultMatrix, startRow, endRow, 0, resultMatrix->cols,
+                         tiles, tileKernel);
+}
+
+#endif
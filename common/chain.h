@@ -0,0 +1,385 @@
+#ifndef CHAIN_H
+#define CHAIN_H
+
+// Matrix-chain products: --chain A1,A2,...,Ak computes A1·A2·...·Ak for int32
+// matrices of any compatible shapes.
+//
+// The order comes from the classic dynamic program over the chain: every
+// sub-chain i..j is split where the work of both halves plus the product
+// joining them (rows · inner · cols multiply-adds) is smallest; among equally
+// cheap splits the shallower tree wins, so more products are independent.
+// The tree is run in waves, a wave holding every product whose operands are
+// ready. The output tiles of all the products of a wave (gemm.h, C = A·B)
+// form one list of independent tasks that the backend runs through a
+// callback, like the sparse kernels; without a callback they run in order.
+//
+// Intermediates stay in memory. Their buffers come from a pool planned before
+// timing: a product takes the smallest free buffer it fits in, else grows the
+// largest free one, else opens a new one, and a buffer is free again once the
+// wave that read it has finished. Every buffer is sized to its largest user
+// and the pool is one mapping, shared when forked children write it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include "matrix.h"
+#include "matrix_io.h"
+#include "blocked.h"
+#include "simd.h"
+#include "gemm.h"
+
+#define CHAIN_MAX_MATRICES 64
+#define CHAIN_MAX_NODES    (2 * CHAIN_MAX_MATRICES - 1)
+
+// One matrix of the tree: an input (left == -1) or the product of two nodes
+typedef struct {
+    int left, right;
+    int rows, cols;
+    int inner;          // Columns of the left operand
+    int wave;           // 0 for inputs, 1 + the later operand's wave for products
+    int buffer;         // Pool buffer of an intermediate, -1 for inputs and the result
+    int *data;
+    int ld;
+} ChainNode;
+
+struct ChainPlan;
+
+// Callback that runs tasks 0 .. count-1 of the current wave, each through
+// chainRunTask(); tasks of one wave are independent
+typedef void (*ChainRunTasks)(void *context, struct ChainPlan *plan, int count);
+
+typedef struct ChainPlan {
+    int count;                          // Input matrices
+    char *names[CHAIN_MAX_MATRICES];
+    Matrix inputs[CHAIN_MAX_MATRICES];
+    ChainNode nodes[CHAIN_MAX_NODES];   // Inputs first, then products; the root is the last one
+    int numNodes;
+    int numWaves;
+    int maxTasks;                       // Most tasks of one wave
+    double cost;                        // Multiply-adds of the chosen order
+    double leftToRightCost;             // Multiply-adds of ((A1·A2)·A3)·...
+    int numBuffers;
+    size_t bufferInts[CHAIN_MAX_MATRICES];
+    int *pool;
+    size_t poolBytes;
+    Matrix result;
+    const TileSizes *tiles;
+    const SimdKernels *simd;
+    GemmProblem problems[CHAIN_MAX_MATRICES];   // Products of the current wave
+    int firstTask[CHAIN_MAX_MATRICES + 1];      // Their first task; firstTask[numProblems] is the total
+    int numProblems;
+    ChainRunTasks run;
+    void *context;
+} ChainPlan;
+
+// Function to append the products of sub-chain i..j to the tree; returns its node
+static inline int buildChainNode(ChainPlan *plan, const int *split, int i, int j) {
+    if (i == j) {
+        return i;
+    }
+    int s = split[i * plan->count + j];
+    int left = buildChainNode(plan, split, i, s);
+    int right = buildChainNode(plan, split, s + 1, j);
+    ChainNode *node = &plan->nodes[plan->numNodes];
+    node->left = left;
+    node->right = right;
+    node->rows = plan->nodes[left].rows;
+    node->cols = plan->nodes[right].cols;
+    node->inner = plan->nodes[left].cols;
+    node->wave = 1 + (plan->nodes[left].wave > plan->nodes[right].wave ? plan->nodes[left].wave : plan->nodes[right].wave);
+    node->buffer = -1;
+    if (node->wave > plan->numWaves) {
+        plan->numWaves = node->wave;
+    }
+    return plan->numNodes++;
+}
+
+// Function to order the chain: cost[i][j] is the least work of sub-chain i..j
+// and split[i][j] the last matrix of its left half
+static inline void orderChain(ChainPlan *plan) {
+    int k = plan->count;
+    double *cost = calloc((size_t) k * k, sizeof(double));
+    int *depth = calloc((size_t) k * k, sizeof(int));
+    int *split = calloc((size_t) k * k, sizeof(int));
+    if (cost == NULL || depth == NULL || split == NULL) {
+        printf("Error in memory allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int length = 2; length <= k; length++) {
+        for (int i = 0; i + length - 1 < k; i++) {
+            int j = i + length - 1;
+            double best = -1;
+            for (int s = i; s < j; s++) {
+                double c = cost[i * k + s] + cost[(s + 1) * k + j] +
+                           (double) plan->nodes[i].rows * plan->nodes[s].cols * plan->nodes[j].cols;
+                int d = 1 + (depth[i * k + s] > depth[(s + 1) * k + j] ? depth[i * k + s] : depth[(s + 1) * k + j]);
+                if (best < 0 || c < best || (c == best && d < depth[i * k + j])) {
+                    best = c;
+                    depth[i * k + j] = d;
+                    split[i * k + j] = s;
+                }
+            }
+            cost[i * k + j] = best;
+        }
+    }
+    plan->cost = cost[k - 1];
+    plan->leftToRightCost = 0;
+    for (int j = 1; j < k; j++) {
+        plan->leftToRightCost += (double) plan->nodes[0].rows * plan->nodes[j].rows * plan->nodes[j].cols;
+    }
+    plan->numNodes = k;
+    plan->numWaves = 0;
+    buildChainNode(plan, split, 0, k - 1);
+    free(cost);
+    free(depth);
+    free(split);
+}
+
+// Function to assign a pool buffer to every intermediate, wave by wave. The
+// buffers read by a wave are released only after the whole wave, since its
+// products run at the same time.
+static inline void planChainBuffers(ChainPlan *plan) {
+    int root = plan->numNodes - 1;
+    int isFree[CHAIN_MAX_MATRICES] = { 0 };
+    plan->numBuffers = 0;
+    for (int w = 1; w <= plan->numWaves; w++) {
+        for (int v = plan->count; v < root; v++) {
+            ChainNode *node = &plan->nodes[v];
+            if (node->wave != w) {
+                continue;
+            }
+            size_t size = (size_t) node->rows * node->cols;
+            int fit = -1, largest = -1;
+            for (int b = 0; b < plan->numBuffers; b++) {
+                if (!isFree[b]) {
+                    continue;
+                }
+                if (plan->bufferInts[b] >= size && (fit < 0 || plan->bufferInts[b] < plan->bufferInts[fit])) {
+                    fit = b;
+                }
+                if (largest < 0 || plan->bufferInts[b] > plan->bufferInts[largest]) {
+                    largest = b;
+                }
+            }
+            int b = fit >= 0 ? fit : (largest >= 0 ? largest : plan->numBuffers++);
+            if (plan->bufferInts[b] < size) {
+                plan->bufferInts[b] = size;
+            }
+            isFree[b] = 0;
+            node->buffer = b;
+        }
+        for (int v = plan->count; v <= root; v++) {
+            ChainNode *node = &plan->nodes[v];
+            if (node->wave != w) {
+                continue;
+            }
+            if (plan->nodes[node->left].buffer >= 0) {
+                isFree[plan->nodes[node->left].buffer] = 1;
+            }
+            if (plan->nodes[node->right].buffer >= 0) {
+                isFree[plan->nodes[node->right].buffer] = 1;
+            }
+        }
+    }
+}
+
+// Function to split a comma-separated list of matrix files
+static inline int parseChainList(const char *list, char **names) {
+    int count = 0;
+    const char *p = list;
+    while (*p != '\0') {
+        const char *end = strchr(p, ',');
+        size_t length = end != NULL ? (size_t) (end - p) : strlen(p);
+        if (length > 0) {
+            if (count == CHAIN_MAX_MATRICES) {
+                fprintf(stderr, "--chain takes at most %d matrices\n", CHAIN_MAX_MATRICES);
+                exit(EXIT_FAILURE);
+            }
+            names[count] = malloc(length + 1);  // strndup needs POSIX 2008
+            if (names[count] == NULL) {
+                printf("Error in memory allocation.\n");
+                exit(EXIT_FAILURE);
+            }
+            memcpy(names[count], p, length);
+            names[count][length] = '\0';
+            count++;
+        }
+        p += length + (end != NULL);
+    }
+    return count;
+}
+
+// Function to create the plan of --chain LIST: loads the matrices, orders the
+// products and allocates the buffer pool and the result. flags are the
+// allocation flags of the result and the pool (MATRIX_SHARED for forked
+// workers). run may be NULL to run every task on the calling thread.
+static inline ChainPlan *createChainPlan(const char *list, int flags, int ioThreads, const TileSizes *tiles,
+                                         const SimdKernels *simd, ChainRunTasks run, void *context) {
+    ChainPlan *plan = calloc(1, sizeof(ChainPlan));
+    if (plan == NULL) {
+        printf("Error in memory allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+    plan->count = parseChainList(list, plan->names);
+    if (plan->count < 2) {
+        fprintf(stderr, "--chain needs at least two comma-separated matrix files\n");
+        exit(EXIT_FAILURE);
+    }
+    plan->tiles = tiles;
+    plan->simd = simd;
+    plan->run = run;
+    plan->context = context;
+
+    // Shapes first, so a mismatch is reported before anything is parsed
+    for (int i = 0; i < plan->count; i++) {
+        ChainNode *node = &plan->nodes[i];
+        probeMatrixShape(plan->names[i], &node->rows, &node->cols);
+        if (node->rows < 1 || node->cols < 1) {
+            fprintf(stderr, "%s holds no matrix\n", plan->names[i]);
+            exit(EXIT_FAILURE);
+        }
+        if (i > 0 && plan->nodes[i - 1].cols != node->rows) {
+            fprintf(stderr, "Cannot multiply %s (%d x %d) by %s (%d x %d)\n", plan->names[i - 1],
+                    plan->nodes[i - 1].rows, plan->nodes[i - 1].cols, plan->names[i], node->rows, node->cols);
+            exit(EXIT_FAILURE);
+        }
+        node->left = node->right = -1;
+        node->buffer = -1;
+    }
+    for (int i = 0; i < plan->count; i++) {
+        ChainNode *node = &plan->nodes[i];
+        loadMatrix(&plan->inputs[i], node->rows, node->cols, plan->names[i], 0, ioThreads);
+        node->data = plan->inputs[i].data;
+        node->ld = plan->inputs[i].stride;
+    }
+
+    orderChain(plan);
+    planChainBuffers(plan);
+
+    // One mapping for the pool, each buffer starting on a cache line
+    size_t offsets[CHAIN_MAX_MATRICES];
+    plan->poolBytes = 0;
+    for (int b = 0; b < plan->numBuffers; b++) {
+        offsets[b] = plan->poolBytes;
+        plan->poolBytes += (plan->bufferInts[b] * sizeof(int) + MATRIX_ALIGNMENT - 1) / MATRIX_ALIGNMENT * MATRIX_ALIGNMENT;
+    }
+    if (plan->poolBytes > 0) {
+        plan->pool = mmap(NULL, plan->poolBytes, PROT_READ | PROT_WRITE,
+                          ((flags & MATRIX_SHARED) ? MAP_SHARED : MAP_PRIVATE) | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (plan->pool == MAP_FAILED) {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+    }
+    ChainNode *root = &plan->nodes[plan->numNodes - 1];
+    plan->result = allocateMatrix(root->rows, root->cols, flags);
+    for (int v = plan->count; v < plan->numNodes; v++) {
+        ChainNode *node = &plan->nodes[v];
+        if (node->buffer >= 0) {
+            node->data = (int *) ((char *) plan->pool + offsets[node->buffer]);
+            node->ld = node->cols;
+        } else {
+            node->data = plan->result.data;
+            node->ld = plan->result.stride;
+        }
+    }
+
+    // Largest wave, so the backend can size its task list once
+    int edge = tiles->l2;
+    for (int w = 1; w <= plan->numWaves; w++) {
+        int tasks = 0;
+        for (int v = plan->count; v < plan->numNodes; v++) {
+            if (plan->nodes[v].wave == w) {
+                tasks += ((plan->nodes[v].rows + edge - 1) / edge) * ((plan->nodes[v].cols + edge - 1) / edge);
+            }
+        }
+        if (tasks > plan->maxTasks) {
+            plan->maxTasks = tasks;
+        }
+    }
+    return plan;
+}
+
+// Function to run one task (one output tile of one product) of the current wave
+static inline void chainRunTask(const ChainPlan *plan, int task) {
+    int p = 0;
+    while (task >= plan->firstTask[p + 1]) {
+        p++;
+    }
+    // alpha 1 and untransposed operands: the products go straight into C and
+    // the workspace is never touched
+    int unused = 0;
+    gemmRunTile(&plan->problems[p], task - plan->firstTask[p], &unused);
+}
+
+// Function to multiply the chain, one wave of independent products at a time
+static inline void chainMultiply(ChainPlan *plan) {
+    for (int w = 1; w <= plan->numWaves; w++) {
+        plan->numProblems = 0;
+        plan->firstTask[0] = 0;
+        for (int v = plan->count; v < plan->numNodes; v++) {
+            const ChainNode *node = &plan->nodes[v];
+            if (node->wave != w) {
+                continue;
+            }
+            const ChainNode *a = &plan->nodes[node->left], *b = &plan->nodes[node->right];
+            GemmProblem *problem = &plan->problems[plan->numProblems];
+            *problem = createGemm(GEMM_ROW_MAJOR, 0, 0, node->rows, node->cols, node->inner, 1, a->data, a->ld,
+                                  b->data, b->ld, 0, node->data, node->ld, plan->tiles, plan->simd);
+            plan->firstTask[plan->numProblems + 1] = plan->firstTask[plan->numProblems] + gemmTileCount(problem);
+            plan->numProblems++;
+        }
+        int count = plan->firstTask[plan->numProblems];
+        if (plan->run != NULL) {
+            plan->run(plan->context, plan, count);
+        } else {
+            for (int t = 0; t < count; t++) {
+                chainRunTask(plan, t);
+            }
+        }
+    }
+}
+
+// Function to print the parenthesization of a node, inputs numbered from 1
+static inline void printChainNode(const ChainPlan *plan, int v) {
+    const ChainNode *node = &plan->nodes[v];
+    if (node->left < 0) {
+        printf("%d", v + 1);
+        return;
+    }
+    printf("(");
+    printChainNode(plan, node->left);
+    printf(" ");
+    printChainNode(plan, node->right);
+    printf(")");
+}
+
+// Function to print the order, its cost and the pool of the chain
+static inline void printChainPlan(const ChainPlan *plan, const char *simdNote) {
+    printf("Using matrix chain method (%d matrices, %d products in %d waves)%s\n", plan->count,
+           plan->count - 1, plan->numWaves, simdNote);
+    printf("Chain order: ");
+    printChainNode(plan, plan->numNodes - 1);
+    printf("\n");
+    printf("Chain cost: %.0f multiply-adds (left to right: %.0f, %.2fx)\n", plan->cost, plan->leftToRightCost,
+           plan->cost > 0 ? plan->leftToRightCost / plan->cost : 1.0);
+    printf("Intermediate buffers: %d for %d intermediates (%.1f MB)\n", plan->numBuffers, plan->count - 2,
+           plan->poolBytes / 1048576.0);
+}
+
+// Function to free the inputs, the pool and the result of a chain plan
+static inline void freeChainPlan(ChainPlan *plan) {
+    for (int i = 0; i < plan->count; i++) {
+        freeMatrix(&plan->inputs[i]);
+        free(plan->names[i]);
+    }
+    if (plan->pool != NULL) {
+        munmap(plan->pool, plan->poolBytes);
+    }
+    freeMatrix(&plan->result);
+    free(plan);
+}
+
+#endif
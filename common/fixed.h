@@ -0,0 +1,283 @@
+#ifndef FIXED_H
+#define FIXED_H
+
+// Kernels specialized at compile time for registered sizes of the int32
+// square product.
+//
+// Every other kernel takes n at run time, so loop trip counts and tile
+// remainders are only known while it runs. The sizes the benchmark grid
+// (main_run.sh) and repeated traffic keep hitting get their own copies here,
+// generated by macros with n as a constant so the compiler can unroll them
+// and drop the remainder handling:
+//   - tiny sizes (4, 8, 10): a whole row of C is one vector of 4, 8 or 16
+//     ints (GCC vector extensions) and the n rows of B stay in registers, so
+//     each row of C is n broadcast multiply-adds, fully unrolled. Rows of B
+//     and C are read and written a whole vector wide, so their stride must be
+//     at least that wide (the padded stride always is); the padding columns
+//     of C receive junk that nothing reads. One copy per --isa level, used
+//     with --simd;
+//   - benchmark sizes (100 ... 3200): the blocked walk with the default
+//     L2/L1 edges (128/32), where every tile extent, including the
+//     remainders n % 128 and n % 32, is a constant, and each L1 tile keeps
+//     4 rows x 8 columns of C in registers across k. Scalar only: with
+//     --simd the hand-written panels of simd.h are faster, so they stay.
+// Anything else (other sizes, --tiles, non-int32) keeps the generic kernels.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "matrix.h"
+#include "blocked.h"
+#include "simd.h"
+
+#define FIXED_MR    4                // Rows of C per register block of the blocked kernels
+#define FIXED_NR    8                // Columns of C per register block of the blocked kernels
+#define FIXED_INLINE static inline __attribute__((always_inline))
+
+// Signature of the specialized kernels: rows [i0, i1) of C += A * B, all n x n
+typedef void (*FixedKernel)(const int *restrict a, int lda, const int *restrict b, int ldb,
+                            int *restrict c, int ldc, int i0, int i1);
+
+// Vector of one row of a tiny product
+typedef int FixedVec4 __attribute__((vector_size(16)));
+typedef int FixedVec8 __attribute__((vector_size(32)));
+typedef int FixedVec16 __attribute__((vector_size(64)));
+
+// Tiny kernel body: B in N vector registers, one row of C per step
+#define FIXED_TINY_BODY(N, VEC)                                                 \
+    VEC bRows[N];                                                               \
+    _Pragma("GCC unroll 16")                                                    \
+    for (int k = 0; k < N; k++){                                                \
+        memcpy(&bRows[k], b + (size_t) k * ldb, sizeof(VEC));                   \
+    }                                                                           \
+    for (int i = i0; i < i1; i++){                                              \
+        const int *restrict aRow = a + (size_t) i * lda;                        \
+        int *restrict cRow = c + (size_t) i * ldc;                              \
+        VEC acc;                                                                \
+        memcpy(&acc, cRow, sizeof(VEC));                                        \
+        _Pragma("GCC unroll 16")                                                \
+        for (int k = 0; k < N; k++){                                            \
+            acc += aRow[k] * bRows[k];                                          \
+        }                                                                       \
+        memcpy(cRow, &acc, sizeof(VEC));                                        \
+    }
+
+// Function to multiply rows [i0, i1) of one register block: at most FIXED_MR
+// rows by cols <= FIXED_NR columns over depth k, C held in registers
+FIXED_INLINE void multiplyFixedStrip(const int *restrict a, int lda, const int *restrict b, int ldb,
+                                     int *restrict c, int ldc, int i0, int i1, int j0, int k0,
+                                     const int cols, const int depth) {
+    int i = i0;
+    for (; i + FIXED_MR <= i1; i += FIXED_MR){
+        int acc[FIXED_MR][FIXED_NR];
+        for (int r = 0; r < FIXED_MR; r++){
+            for (int j = 0; j < cols; j++){
+                acc[r][j] = c[(size_t) (i + r) * ldc + j0 + j];
+            }
+        }
+        for (int k = 0; k < depth; k++){
+            const int *restrict bRow = b + (size_t) (k0 + k) * ldb + j0;
+            for (int r = 0; r < FIXED_MR; r++){
+                const int aik = a[(size_t) (i + r) * lda + k0 + k];
+                for (int j = 0; j < cols; j++){
+                    acc[r][j] += aik * bRow[j];
+                }
+            }
+        }
+        for (int r = 0; r < FIXED_MR; r++){
+            for (int j = 0; j < cols; j++){
+                c[(size_t) (i + r) * ldc + j0 + j] = acc[r][j];
+            }
+        }
+    }
+    // Leftover rows, one at a time
+    for (; i < i1; i++){
+        int acc[FIXED_NR];
+        for (int j = 0; j < cols; j++){
+            acc[j] = c[(size_t) i * ldc + j0 + j];
+        }
+        for (int k = 0; k < depth; k++){
+            const int *restrict bRow = b + (size_t) (k0 + k) * ldb + j0;
+            const int aik = a[(size_t) i * lda + k0 + k];
+            for (int j = 0; j < cols; j++){
+                acc[j] += aik * bRow[j];
+            }
+        }
+        for (int j = 0; j < cols; j++){
+            c[(size_t) i * ldc + j0 + j] = acc[j];
+        }
+    }
+}
+
+// Function to multiply one L1 tile of constant cols x depth, in register blocks
+FIXED_INLINE void multiplyFixedTile(const int *restrict a, int lda, const int *restrict b, int ldb,
+                                    int *restrict c, int ldc, int i0, int i1, int j0, int k0,
+                                    const int cols, const int depth) {
+    int j = 0;
+    for (; j + FIXED_NR <= cols; j += FIXED_NR){
+        multiplyFixedStrip(a, lda, b, ldb, c, ldc, i0, i1, j0 + j, k0, FIXED_NR, depth);
+    }
+    if (cols % FIXED_NR) {
+        multiplyFixedStrip(a, lda, b, ldb, c, ldc, i0, i1, j0 + j, k0, cols % FIXED_NR, depth);
+    }
+}
+
+// Function to multiply one L2 block of constant cols x depth in L1 tiles; the
+// full tiles and the remainders are separate calls so each has constant extents
+FIXED_INLINE void multiplyFixedBlock(const int *restrict a, int lda, const int *restrict b, int ldb,
+                                     int *restrict c, int ldc, int i0, int i1, int j0, int k0,
+                                     const int cols, const int depth) {
+    const int t = DEFAULT_TILE_L1;
+    for (int ii = i0; ii < i1; ii += t){
+        int iEnd = minInt(ii + t, i1);
+        int kk = 0;
+        for (; kk + t <= depth; kk += t){
+            int jj = 0;
+            for (; jj + t <= cols; jj += t){
+                multiplyFixedTile(a, lda, b, ldb, c, ldc, ii, iEnd, j0 + jj, k0 + kk, t, t);
+            }
+            if (cols % t) {
+                multiplyFixedTile(a, lda, b, ldb, c, ldc, ii, iEnd, j0 + jj, k0 + kk, cols % t, t);
+            }
+        }
+        if (depth % t) {
+            int jj = 0;
+            for (; jj + t <= cols; jj += t){
+                multiplyFixedTile(a, lda, b, ldb, c, ldc, ii, iEnd, j0 + jj, k0 + kk, t, depth % t);
+            }
+            if (cols % t) {
+                multiplyFixedTile(a, lda, b, ldb, c, ldc, ii, iEnd, j0 + jj, k0 + kk, cols % t, depth % t);
+            }
+        }
+    }
+}
+
+// Function to multiply rows [i0, i1) of an n x n product, n constant, in L2 blocks
+FIXED_INLINE void multiplyFixedBlocked(const int *restrict a, int lda, const int *restrict b, int ldb,
+                                       int *restrict c, int ldc, int i0, int i1, const int n) {
+    const int t = DEFAULT_TILE_L2;
+    for (int ii = i0; ii < i1; ii += t){
+        int iEnd = minInt(ii + t, i1);
+        int kk = 0;
+        for (; kk + t <= n; kk += t){
+            int jj = 0;
+            for (; jj + t <= n; jj += t){
+                multiplyFixedBlock(a, lda, b, ldb, c, ldc, ii, iEnd, jj, kk, t, t);
+            }
+            if (n % t) {
+                multiplyFixedBlock(a, lda, b, ldb, c, ldc, ii, iEnd, jj, kk, n % t, t);
+            }
+        }
+        if (n % t) {
+            int jj = 0;
+            for (; jj + t <= n; jj += t){
+                multiplyFixedBlock(a, lda, b, ldb, c, ldc, ii, iEnd, jj, kk, t, n % t);
+            }
+            multiplyFixedBlock(a, lda, b, ldb, c, ldc, ii, iEnd, jj, kk, n % t, n % t);
+        }
+    }
+}
+
+#define FIXED_KERNEL_ARGS const int *restrict a, int lda, const int *restrict b, int ldb, \
+                          int *restrict c, int ldc, int i0, int i1
+
+// One tiny kernel per SIMD level. There is no portable copy: before SSE4.1
+// x86-64 has no 32-bit vector multiply, and emulating it on every lane
+// costs more than the generic loops save
+#ifdef SIMD_X86
+#define FIXED_TINY_KERNELS(N, VEC)                                                                      \
+    __attribute__((target("sse4.1")))                                                                   \
+    static void multiplyFixed##N##Sse4(FIXED_KERNEL_ARGS) { FIXED_TINY_BODY(N, VEC) }                   \
+    __attribute__((target("avx2")))                                                                     \
+    static void multiplyFixed##N##Avx2(FIXED_KERNEL_ARGS) { FIXED_TINY_BODY(N, VEC) }                   \
+    __attribute__((target("avx512f")))                                                                  \
+    static void multiplyFixed##N##Avx512(FIXED_KERNEL_ARGS) { FIXED_TINY_BODY(N, VEC) }
+#define FIXED_TINY_ENTRY(N, VEC) \
+    { N, sizeof(VEC) / sizeof(int), NULL, multiplyFixed##N##Sse4, multiplyFixed##N##Avx2, multiplyFixed##N##Avx512 },
+#else
+#define FIXED_TINY_KERNELS(N, VEC)
+#define FIXED_TINY_ENTRY(N, VEC)
+#endif
+
+#define FIXED_BLOCKED_KERNELS(N) \
+    static void multiplyFixed##N##Blocked(FIXED_KERNEL_ARGS) { multiplyFixedBlocked(a, lda, b, ldb, c, ldc, i0, i1, N); }
+#define FIXED_BLOCKED_ENTRY(N) \
+    { N, 0, multiplyFixed##N##Blocked, NULL, NULL, NULL },
+
+// Registered sizes. A tiny vector must hold the whole row: n <= 16
+#define FIXED_TINY_SIZES(X) X(4, FixedVec4) X(8, FixedVec8) X(10, FixedVec16)
+#define FIXED_BLOCKED_SIZES(X) X(100) X(200) X(400) X(800) X(1600) X(3200)
+
+FIXED_TINY_SIZES(FIXED_TINY_KERNELS)
+FIXED_BLOCKED_SIZES(FIXED_BLOCKED_KERNELS)
+
+// One registered size; width 0 marks the blocked kernels
+typedef struct {
+    int n;
+    int width;              // Ints of B and C read and written per row by the tiny kernels
+    FixedKernel scalar;     // Blocked sizes only
+    FixedKernel sse4;
+    FixedKernel avx2;
+    FixedKernel avx512;
+} FixedSize;
+
+static const FixedSize fixedSizes[] = {
+    FIXED_TINY_SIZES(FIXED_TINY_ENTRY)
+    FIXED_BLOCKED_SIZES(FIXED_BLOCKED_ENTRY)
+};
+
+// Kernel chosen for a product, or kernel NULL if none applies
+typedef struct {
+    FixedKernel kernel;
+    int n;
+    const char *shape;      // "unrolled" or "blocked"
+} FixedPlan;
+
+// Function to find the specialized kernel of an n x n int32 product. Tiny
+// sizes replace the standard and blocked methods with --simd (same ISA) as
+// long as the strides hold a whole vector; the blocked sizes replace the
+// scalar blocked method with the default tiles.
+static inline FixedPlan selectFixedKernel(const Matrix *a, const Matrix *b, const Matrix *c, int useBlocked,
+                                          const TileSizes *tiles, int useSimd, const SimdKernels *simd) {
+    FixedPlan plan = { NULL, a->rows, NULL };
+    int n = a->rows;
+    if (a->type != MATRIX_TYPE_INT32 || a->cols != n || b->rows != n || b->cols != n) {
+        return plan;
+    }
+    for (size_t s = 0; s < sizeof(fixedSizes) / sizeof(fixedSizes[0]); s++) {
+        const FixedSize *size = &fixedSizes[s];
+        if (size->n != n) {
+            continue;
+        }
+        if (size->width == 0) {
+            TileSizes defaults = defaultTileSizes();
+            if (useBlocked && !useSimd && tiles->l1 == defaults.l1 && tiles->l2 == defaults.l2) {
+                plan.kernel = size->scalar;
+                plan.shape = "blocked";
+            }
+            return plan;
+        }
+        if (!useSimd || b->stride < size->width || c->stride < size->width) {
+            return plan;
+        }
+        if (strcmp(simd->isa, "sse4") == 0) {
+            plan.kernel = size->sse4;
+        } else if (strcmp(simd->isa, "avx2") == 0) {
+            plan.kernel = size->avx2;
+        } else if (strcmp(simd->isa, "avx512") == 0) {
+            plan.kernel = size->avx512;
+        }
+        plan.shape = "unrolled";
+        return plan;
+    }
+    return plan;
+}
+
+// Function to multiply rows [startRow, endRow) of the result with a specialized kernel
+static inline void multiplyFixedRows(const FixedPlan *plan, const Matrix *matrix1, const Matrix *matrix2,
+                                     Matrix *resultMatrix, int startRow, int endRow) {
+    plan->kernel(matrix1->data, matrix1->stride, matrix2->data, matrix2->stride,
+                 resultMatrix->data, resultMatrix->stride, startRow, endRow);
+}
+
+#endif
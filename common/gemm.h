@@ -0,0 +1,307 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+// General matrix multiply: C = alpha * op(A) * op(B) + beta * C for int32.
+//
+// The BLAS-style entry point: op(A) is M x K, op(B) is K x N and C is M x N,
+// each given as a pointer and a leading dimension, so views into larger
+// buffers are multiplied in place. op(X) is X or Xᵀ (transA, transB), and
+// the operands are row-major or column-major (layout). Column-major is
+// turned into row-major by computing Cᵀ = op(B)ᵀ op(A)ᵀ, which only swaps
+// the operands and M with N.
+//
+// C is split into square output tiles that are independent of each other,
+// so a backend can hand them to its workers (gemmRunTile()) or run them all
+// in turn (gemm()). Each tile is computed with the blocked walk of blocked.h
+// and the existing tile kernels: the panel kernel for op(B) = B, the
+// transposed one for op(B) = Bᵀ. A transposed A is packed tile row by tile
+// row into the worker's workspace. beta is applied to a tile just before
+// its products are accumulated into it, while it is in cache, so there is
+// no separate zero-fill or scaling pass; with alpha != 1 the products are
+// accumulated in a workspace tile and combined with C once at the end.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "matrix.h"
+#include "matrix_io.h"
+#include "blocked.h"
+#include "simd.h"
+
+#define GEMM_ROW_MAJOR 0
+#define GEMM_COL_MAJOR 1
+
+// A problem normalized to row-major
+typedef struct {
+    int transA;
+    int transB;
+    int m;
+    int n;
+    int k;
+    int alpha;
+    int beta;
+    const int *a;
+    int lda;
+    const int *b;
+    int ldb;
+    int *c;
+    int ldc;
+    int tileEdge;           // Edge of the output tiles
+    int tilesPerRow;
+    const TileSizes *tiles;
+    TileKernel panel;       // C += A * B tile kernel
+    TileKernel transposed;  // C += A * B^T tile kernel
+} GemmProblem;
+
+// Function to check a leading dimension, exits if it is too small
+static inline void checkLeadingDimension(const char *name, int ld, int minimum) {
+    if (ld < (minimum > 1 ? minimum : 1)) {
+        fprintf(stderr, "Invalid leading dimension %s = %d (must be at least %d)\n", name, ld, minimum);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Function to set up C = alpha * op(A) * op(B) + beta * C. simd may be NULL
+// for the scalar kernels. Exits if a size or a leading dimension is invalid.
+static inline GemmProblem createGemm(int layout, int transA, int transB, int m, int n, int k,
+                                     int alpha, const int *a, int lda, const int *b, int ldb,
+                                     int beta, int *c, int ldc, const TileSizes *tiles, const SimdKernels *simd) {
+    if (m < 0 || n < 0 || k < 0) {
+        fprintf(stderr, "Invalid GEMM shape %d x %d x %d\n", m, n, k);
+        exit(EXIT_FAILURE);
+    }
+    // Leading dimensions count the elements between rows (row-major) or columns (column-major)
+    int major = layout == GEMM_COL_MAJOR;
+    checkLeadingDimension("lda", lda, (transA != major) ? m : k);
+    checkLeadingDimension("ldb", ldb, (transB != major) ? k : n);
+    checkLeadingDimension("ldc", ldc, major ? m : n);
+
+    GemmProblem p;
+    if (major) {
+        // Column-major C is row-major Cᵀ = op(B)ᵀ * op(A)ᵀ
+        p.transA = transB;
+        p.transB = transA;
+        p.m = n;
+        p.n = m;
+        p.a = b;
+        p.lda = ldb;
+        p.b = a;
+        p.ldb = lda;
+    } else {
+        p.transA = transA;
+        p.transB = transB;
+        p.m = m;
+        p.n = n;
+        p.a = a;
+        p.lda = lda;
+        p.b = b;
+        p.ldb = ldb;
+    }
+    p.k = k;
+    p.alpha = alpha;
+    p.beta = beta;
+    p.c = c;
+    p.ldc = ldc;
+    p.tiles = tiles;
+    p.tileEdge = tiles->l2;
+    p.tilesPerRow = (p.n + p.tileEdge - 1) / p.tileEdge;
+    p.panel = simd != NULL ? simd->panel : multiplyTile;
+    p.transposed = simd != NULL ? simd->transposed : multiplyTransposedTile;
+    return p;
+}
+
+// Function to get the number of output tiles
+static inline int gemmTileCount(const GemmProblem *p) {
+    return p->tilesPerRow * ((p->m + p->tileEdge - 1) / p->tileEdge);
+}
+
+// Function to get the workspace one worker needs, in ints
+static inline size_t gemmWorkspaceSize(const GemmProblem *p) {
+    return (size_t) p->tileEdge * p->tileEdge + (p->transA ? (size_t) p->tileEdge * p->k : 0);
+}
+
+// Function to compute one output tile; workspace holds gemmWorkspaceSize() ints
+// owned by the calling worker
+static inline void gemmRunTile(const GemmProblem *p, int tile, int *workspace) {
+    int i0 = tile / p->tilesPerRow * p->tileEdge, j0 = tile % p->tilesPerRow * p->tileEdge;
+    int rows = minInt(p->tileEdge, p->m - i0), cols = minInt(p->tileEdge, p->n - j0);
+    int *c = p->c + (size_t) i0 * p->ldc + j0;
+
+    // Rows i0 .. i0+rows of op(A), packed when A is transposed
+    const int *a = p->a + (size_t) i0 * p->lda;
+    int lda = p->lda;
+    if (p->transA) {
+        int *packed = workspace + (size_t) p->tileEdge * p->tileEdge;
+        for (int kk = 0; kk < p->k; kk++) {
+            const int *column = p->a + (size_t) kk * p->lda + i0;
+            for (int i = 0; i < rows; i++) {
+                packed[(size_t) i * p->k + kk] = column[i];
+            }
+        }
+        a = packed;
+        lda = p->k;
+    }
+    // Columns j0 .. j0+cols of op(B): columns of B, or rows of B when transposed
+    const int *b = p->transB ? p->b + (size_t) j0 * p->ldb : p->b + j0;
+    TileKernel kernel = p->transB ? p->transposed : p->panel;
+    int edges[3] = { p->tiles->l1, p->tiles->l2, p->tiles->l3 };
+
+    if (p->alpha == 1) {
+        // Scale C in place, then accumulate the products into it
+        for (int i = 0; i < rows && p->beta != 1; i++) {
+            int *cRow = c + (size_t) i * p->ldc;
+            for (int j = 0; j < cols; j++) {
+                cRow[j] = p->beta == 0 ? 0 : p->beta * cRow[j];
+            }
+        }
+        if (p->k > 0) {
+            multiplyBlockedLevel(a, lda, b, p->ldb, c, p->ldc, kernel, edges, 2, 0, rows, 0, cols, 0, p->k);
+        }
+        return;
+    }
+    // Products into the workspace tile, then C = alpha * tile + beta * C
+    int *product = workspace;
+    memset(product, 0, (size_t) rows * cols * sizeof(int));
+    if (p->alpha != 0 && p->k > 0) {
+        multiplyBlockedLevel(a, lda, b, p->ldb, product, cols, kernel, edges, 2, 0, rows, 0, cols, 0, p->k);
+    }
+    for (int i = 0; i < rows; i++) {
+        int *cRow = c + (size_t) i * p->ldc;
+        const int *tRow = product + (size_t) i * cols;
+        for (int j = 0; j < cols; j++) {
+            cRow[j] = p->alpha * tRow[j] + (p->beta == 0 ? 0 : p->beta * cRow[j]);
+        }
+    }
+}
+
+// Function to compute C = alpha * op(A) * op(B) + beta * C on the calling thread
+static inline void gemm(int layout, int transA, int transB, int m, int n, int k,
+                        int alpha, const int *a, int lda, const int *b, int ldb,
+                        int beta, int *c, int ldc, const TileSizes *tiles, const SimdKernels *simd) {
+    GemmProblem p = createGemm(layout, transA, transB, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc, tiles, simd);
+    int *workspace = malloc(gemmWorkspaceSize(&p) * sizeof(int));
+    if (workspace == NULL) {
+        printf("Error in memory allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int t = 0; t < gemmTileCount(&p); t++) {
+        gemmRunTile(&p, t, workspace);
+    }
+    free(workspace);
+}
+
+// Command line of the GEMM mode (--shape, --alpha, --beta, --transa, --transb,
+// --layout, --cfile), shared by the backends
+typedef struct {
+    int enabled;        // Any GEMM option was given
+    int m, n, k;
+    int alpha, beta;
+    int transA, transB;
+    int layout;
+    char fileC[100];    // Initial C for beta, empty for zeros (random without --files)
+} GemmArgs;
+
+// Function to get the default GEMM arguments (square n x n x n, alpha 1, beta 0)
+static inline GemmArgs defaultGemmArgs(int n) {
+    GemmArgs args;
+    memset(&args, 0, sizeof(args));
+    args.m = args.n = args.k = n;
+    args.alpha = 1;
+    args.layout = GEMM_ROW_MAJOR;
+    return args;
+}
+
+// Function to consume a GEMM option at argv[*i]; returns 0 if it is not one
+static inline int parseGemmOption(int argc, char *argv[], int *i, GemmArgs *args) {
+    if (strcmp(argv[*i], "--shape") == 0 && (*i+3 < argc)) {
+        args->m = atoi(argv[++*i]);
+        args->n = atoi(argv[++*i]);
+        args->k = atoi(argv[++*i]);
+    } else if (strcmp(argv[*i], "--alpha") == 0 && (*i+1 < argc)) {
+        args->alpha = atoi(argv[++*i]);
+    } else if (strcmp(argv[*i], "--beta") == 0 && (*i+1 < argc)) {
+        args->beta = atoi(argv[++*i]);
+    } else if (strcmp(argv[*i], "--transa") == 0) {
+        args->transA = 1;
+    } else if (strcmp(argv[*i], "--transb") == 0) {
+        args->transB = 1;
+    } else if (strcmp(argv[*i], "--layout") == 0 && (*i+1 < argc)) {
+        ++*i;
+        if (strcmp(argv[*i], "row") == 0) {
+            args->layout = GEMM_ROW_MAJOR;
+        } else if (strcmp(argv[*i], "col") == 0) {
+            args->layout = GEMM_COL_MAJOR;
+        } else {
+            fprintf(stderr, "Unknown layout '%s' (use row or col)\n", argv[*i]);
+            exit(EXIT_FAILURE);
+        }
+    } else if (strcmp(argv[*i], "--cfile") == 0 && (*i+1 < argc)) {
+        snprintf(args->fileC, sizeof(args->fileC), "%s", argv[++*i]);
+    } else {
+        return 0;
+    }
+    args->enabled = 1;
+    return 1;
+}
+
+// Function to get the storage of an operand whose op() is rows x cols: the
+// matrix is cols x rows when transposed, and a column-major matrix is stored
+// (in memory and in files) as the rows of its transpose
+static inline void gemmStorageShape(const GemmArgs *args, int trans, int rows, int cols,
+                                    int *storedRows, int *storedCols) {
+    int flip = (trans != 0) != (args->layout == GEMM_COL_MAJOR);
+    *storedRows = flip ? cols : rows;
+    *storedCols = flip ? rows : cols;
+}
+
+// Function to load (or fill with random values) the A, B and C storage of the GEMM mode
+static inline void loadGemmOperands(const GemmArgs *args, const char *fileA, const char *fileB, int useFiles,
+                                    int ioThreads, Matrix *a, Matrix *b, Matrix *c) {
+    int rows, cols;
+    gemmStorageShape(args, args->transA, args->m, args->k, &rows, &cols);
+    if (useFiles) {
+        loadMatrix(a, rows, cols, fileA, 0, ioThreads);
+    } else {
+        *a = allocateMatrix(rows, cols, 0);
+        fillMatrix(a);
+    }
+    gemmStorageShape(args, args->transB, args->k, args->n, &rows, &cols);
+    if (useFiles) {
+        loadMatrix(b, rows, cols, fileB, 0, ioThreads);
+    } else {
+        *b = allocateMatrix(rows, cols, 0);
+        fillMatrix(b);
+    }
+    gemmStorageShape(args, 0, args->m, args->n, &rows, &cols);
+    if (args->fileC[0] != '\0') {
+        // Loaded into private memory, so C can be updated in place
+        Matrix loaded;
+        loadMatrix(&loaded, rows, cols, args->fileC, 0, ioThreads);
+        *c = allocateMatrix(rows, cols, 0);
+        for (int i = 0; i < rows; i++) {
+            memcpy(matrixRow(c, i), matrixRow(&loaded, i), cols * sizeof(int));
+        }
+        freeMatrix(&loaded);
+    } else {
+        *c = allocateMatrix(rows, cols, 0);
+        if (!useFiles) {
+            fillMatrix(c);
+        }
+    }
+}
+
+// Function to set up the GEMM of the mode on its loaded operands
+static inline GemmProblem createGemmFromArgs(const GemmArgs *args, const Matrix *a, const Matrix *b, Matrix *c,
+                                             const TileSizes *tiles, const SimdKernels *simd) {
+    return createGemm(args->layout, args->transA, args->transB, args->m, args->n, args->k, args->alpha,
+                      a->data, a->stride, b->data, b->stride, args->beta, c->data, c->stride, tiles, simd);
+}
+
+// Function to print the GEMM of the mode
+static inline void printGemm(const GemmArgs *args, const char *simdNote) {
+    printf("Using GEMM method C = %d * %s * %s + %d * C (%d x %d x %d, %s-major)%s\n", args->alpha,
+           args->transA ? "A^T" : "A", args->transB ? "B^T" : "B", args->beta, args->m, args->n, args->k,
+           args->layout == GEMM_COL_MAJOR ? "column" : "row", simdNote);
+}
+
+#endif
@@ -0,0 +1,275 @@
+#ifndef MATRIX_H
+#define MATRIX_H
+
+// Contiguous matrix storage shared by every backend.
+//
+// A matrix is one 64-byte aligned buffer in row-major order. Rows are padded
+// so that the row stride is an odd number of cache lines: with power-of-two
+// friendly sizes (1600, 3200, ...) an unpadded column walk would only hit a
+// few cache sets and evict itself long before the cache is full.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define MATRIX_ALIGNMENT 64
+#define MATRIX_LINE_INTS (MATRIX_ALIGNMENT / (int) sizeof(int))
+
+// Element types (also the type codes of the binary file format)
+#define MATRIX_TYPE_INT32   1
+#define MATRIX_TYPE_INT64   2
+#define MATRIX_TYPE_FLOAT32 3
+#define MATRIX_TYPE_FLOAT64 4
+// Narrow integer storage of int32 inputs (--narrow, see narrow.h); never a --dtype
+#define MATRIX_TYPE_INT8    5
+#define MATRIX_TYPE_INT16   6
+
+// Allocation flags
+#define MATRIX_SHARED    0x1  // MAP_SHARED, so forked children write into the same pages
+#define MATRIX_HUGEPAGES 0x2  // Back the buffer with huge pages when the system allows it
+#define MATRIX_FILE      0x4  // Set by the loader: data is a private mapping of a binary matrix file
+#define MATRIX_INTERLEAVE 0x8 // Spread the pages round-robin over every NUMA node (see affinity.h)
+#define MATRIX_POPULATE  0x10 // Fault in every page at mmap time (MAP_POPULATE)
+
+// NUMA memory policies of the mbind system call (linux/mempolicy.h), used
+// through syscall() so no libnuma is needed
+#define MATRIX_MPOL_BIND       2
+#define MATRIX_MPOL_INTERLEAVE 3
+#define MATRIX_MAX_NODES       64
+
+typedef struct {
+    int rows;
+    int cols;
+    int stride;     // Elements between the start of two consecutive rows
+    void *data;     // Aligned to MATRIX_ALIGNMENT
+    void *base;     // Start of the mapping behind data (a file header may precede data)
+    size_t bytes;   // Size of the mapping behind data
+    int flags;
+    int type;       // MATRIX_TYPE_*
+    int elemSize;   // Bytes per element
+} Matrix;
+
+// Element access for int32 matrices: MAT(m, i, j) is m.data[i][j] taking the row padding into account
+#define MAT(m, i, j) (((int *) (m).data)[(size_t)(i) * (m).stride + (j)])
+
+// Function to get the size in bytes of an element type, 0 if the type is unknown
+static inline int matrixTypeSize(int type) {
+    switch (type) {
+        case MATRIX_TYPE_INT32:   return 4;
+        case MATRIX_TYPE_INT64:   return 8;
+        case MATRIX_TYPE_FLOAT32: return 4;
+        case MATRIX_TYPE_FLOAT64: return 8;
+        case MATRIX_TYPE_INT8:    return 1;
+        case MATRIX_TYPE_INT16:   return 2;
+        default:                  return 0;
+    }
+}
+
+// Function to get the --dtype name of an element type
+static inline const char *matrixTypeName(int type) {
+    switch (type) {
+        case MATRIX_TYPE_INT32:   return "int32";
+        case MATRIX_TYPE_INT64:   return "int64";
+        case MATRIX_TYPE_FLOAT32: return "float";
+        case MATRIX_TYPE_FLOAT64: return "double";
+        case MATRIX_TYPE_INT8:    return "int8";
+        case MATRIX_TYPE_INT16:   return "int16";
+        default:                  return "unknown";
+    }
+}
+
+// Function to check whether an integer value can be stored in an integer element type
+static inline int matrixTypeFits(int type, int64_t value) {
+    switch (type) {
+        case MATRIX_TYPE_INT8:  return value >= INT8_MIN && value <= INT8_MAX;
+        case MATRIX_TYPE_INT16: return value >= INT16_MIN && value <= INT16_MAX;
+        case MATRIX_TYPE_INT32: return value >= INT32_MIN && value <= INT32_MAX;
+        default:                return 1;
+    }
+}
+
+// Function to parse a --dtype name (int32, int64, float, double); exits if it is unknown
+static inline int parseMatrixType(const char *name) {
+    for (int type = MATRIX_TYPE_INT32; type <= MATRIX_TYPE_FLOAT64; type++) {
+        if (strcmp(name, matrixTypeName(type)) == 0) {
+            return type;
+        }
+    }
+    fprintf(stderr, "Unknown element type '%s' (use int32, int64, float or double)\n", name);
+    exit(EXIT_FAILURE);
+}
+
+// Function to compute the padded row stride, in elements, for cols elements of elemSize bytes
+static inline int paddedStrideOf(int cols, int elemSize) {
+    int perLine = MATRIX_ALIGNMENT / elemSize;
+    int lines = (cols + perLine - 1) / perLine;
+    if (lines > 1 && lines % 2 == 0) {
+        lines++;  // Odd number of cache lines per row spreads a column over every cache set
+    }
+    return lines * perLine;
+}
+
+// Function to compute the padded row stride of an int32 matrix
+static inline int paddedStride(int cols) {
+    return paddedStrideOf(cols, sizeof(int));
+}
+
+// Function to get a pointer to the first element of row i of an int32 matrix
+static inline int *matrixRow(const Matrix *m, int i) {
+    return (int *) m->data + (size_t) i * m->stride;
+}
+
+// Function to get a pointer to the first element of row i, whatever the element type
+static inline void *matrixRowAt(const Matrix *m, int i) {
+    return (char *) m->data + (size_t) i * m->stride * m->elemSize;
+}
+
+// Function to get the rows x cols block of m starting at (i, j). The view shares
+// m's storage and stride and must not be freed.
+static inline Matrix matrixView(const Matrix *m, int i, int j, int rows, int cols) {
+    Matrix v = *m;
+    v.rows = rows;
+    v.cols = cols;
+    v.data = (char *) matrixRowAt(m, i) + (size_t) j * m->elemSize;
+    v.base = NULL;
+    v.bytes = 0;
+    return v;
+}
+
+// Function to count the online NUMA nodes (1 when sysfs has no node directory)
+static inline int onlineNumaNodes(void) {
+    FILE *file = fopen("/sys/devices/system/node/online", "r");
+    int first = 0, last = 0;
+    if (file == NULL) {
+        return 1;
+    }
+    int fields = fscanf(file, "%d-%d", &first, &last);
+    fclose(file);
+    return fields == 2 && last >= 0 && last < MATRIX_MAX_NODES ? last + 1 : 1;
+}
+
+// Function to set the NUMA policy of a page-aligned range before it is first
+// touched: MATRIX_MPOL_INTERLEAVE over every node, or MATRIX_MPOL_BIND to node.
+// Returns 0 on success; failures (no NUMA support, seccomp) leave the default policy.
+static inline int bindMemory(void *addr, size_t bytes, int mode, int node) {
+#ifdef SYS_mbind
+    unsigned long mask = 0;
+    if (mode == MATRIX_MPOL_INTERLEAVE) {
+        int nodes = onlineNumaNodes();
+        mask = nodes >= 64 ? ~0ul : (1ul << nodes) - 1;
+    } else {
+        mask = 1ul << node;
+    }
+    return (int) syscall(SYS_mbind, addr, bytes, mode, &mask, (unsigned long) MATRIX_MAX_NODES + 1, 0);
+#else
+    (void) addr; (void) bytes; (void) mode; (void) node;
+    return -1;
+#endif
+}
+
+// Function to map *bytes of zero-filled memory with the MATRIX_* allocation flags.
+// *bytes is rounded up when the mapping ends up larger (huge pages).
+static inline void *allocateMatrixMemory(size_t *bytes, int flags) {
+    if (*bytes == 0) {
+        *bytes = MATRIX_ALIGNMENT;
+    }
+    int visibility = (flags & MATRIX_SHARED) ? MAP_SHARED : MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if ((flags & MATRIX_POPULATE) && !(flags & MATRIX_INTERLEAVE)) {
+        visibility |= MAP_POPULATE;  // Interleaved memory is populated after mbind instead
+    }
+#endif
+    void *data = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (flags & MATRIX_HUGEPAGES) {
+        // Explicit huge pages need a reserved pool (vm.nr_hugepages) and a
+        // size that is a multiple of the huge page size.
+        size_t hugeBytes = (*bytes + (2u << 20) - 1) & ~(size_t) ((2u << 20) - 1);
+        data = mmap(NULL, hugeBytes, PROT_READ | PROT_WRITE,
+                    visibility | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (data != MAP_FAILED) {
+            *bytes = hugeBytes;
+        }
+    }
+#endif
+    if (data == MAP_FAILED) {
+        data = mmap(NULL, *bytes, PROT_READ | PROT_WRITE,
+                    visibility | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED) {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+#ifdef MADV_HUGEPAGE
+        if (flags & MATRIX_HUGEPAGES) {
+            madvise(data, *bytes, MADV_HUGEPAGE);  // Fall back to transparent huge pages
+        }
+#endif
+    }
+    if ((flags & MATRIX_INTERLEAVE) && onlineNumaNodes() > 1) {
+        bindMemory(data, *bytes, MATRIX_MPOL_INTERLEAVE, 0);
+    }
+#ifdef MADV_POPULATE_WRITE
+    if ((flags & MATRIX_POPULATE) && (flags & MATRIX_INTERLEAVE)) {
+        madvise(data, *bytes, MADV_POPULATE_WRITE);
+    }
+#endif
+    return data;
+}
+
+// Function to allocate a rows x cols matrix of the given element type with a single mapping.
+// The memory is zero-filled by the kernel, but pages are only touched on first use.
+static inline Matrix allocateTypedMatrix(int rows, int cols, int type, int flags) {
+    Matrix m;
+    m.rows = rows;
+    m.cols = cols;
+    m.type = type;
+    m.elemSize = matrixTypeSize(type);
+    m.stride = paddedStrideOf(cols, m.elemSize);
+    m.flags = flags;
+    m.bytes = (size_t) rows * m.stride * m.elemSize;
+    m.data = allocateMatrixMemory(&m.bytes, flags);
+    m.base = m.data;
+    return m;
+}
+
+// Function to allocate a rows x cols int32 matrix
+static inline Matrix allocateMatrix(int rows, int cols, int flags) {
+    return allocateTypedMatrix(rows, cols, MATRIX_TYPE_INT32, flags);
+}
+
+// Function to free a matrix allocated with allocateMatrix
+static inline void freeMatrix(Matrix *m) {
+    if (m->base != NULL && munmap(m->base, m->bytes) == -1) {
+        perror("munmap");
+    }
+    m->data = NULL;
+    m->base = NULL;
+}
+
+// Function to set every element (padding included) to 0, which also faults in all pages
+static inline void zeroMatrix(Matrix *m) {
+    memset(m->data, 0, (size_t) m->rows * m->stride * m->elemSize);
+}
+
+// Function to fill a matrix with random integer numbers (stored in its element type)
+static inline void fillMatrix(Matrix *m) {
+    for (int i = 0; i < m->rows; i++){
+        void *row = matrixRowAt(m, i);
+        for (int j = 0; j < m->cols; j++){
+            int value = rand() % 10;  // Random numbers between 0 and 9
+            switch (m->type) {
+                case MATRIX_TYPE_INT64:   ((int64_t *) row)[j] = value; break;
+                case MATRIX_TYPE_FLOAT32: ((float *) row)[j] = (float) value; break;
+                case MATRIX_TYPE_FLOAT64: ((double *) row)[j] = value; break;
+                default:                  ((int *) row)[j] = value; break;
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,913 @@
+#ifndef MATRIX_IO_H
+#define MATRIX_IO_H
+
+// Reading and writing matrices, either in the plain whitespace-separated text
+// format produced by utils/generate_matrix.py or in the binary format below.
+// Text output is byte-for-byte what fprintf("%d ") per element and "\n" per
+// row produce, so downstream tools keep reading it. int64 matrices use the
+// same layout; float and double elements are written with "%.9g" / "%.17g",
+// which reads back to the exact same value.
+//
+// Binary format (".bin", see utils/convert_matrix.py):
+//   offset 0            BinaryMatrixHeader (little or big endian, see endianTag)
+//   offset dataOffset   rows x stride elements, row-major, padding included
+// dataOffset is a multiple of the page size, so mapping the file gives a
+// page-aligned element block that is used in place without copying.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include "matrix.h"
+
+#define BINARY_MATRIX_MAGIC "MMB1"
+#define BINARY_MATRIX_VERSION 1
+#define BINARY_MATRIX_ENDIAN_TAG 0x01020304u
+#define BINARY_MATRIX_DATA_OFFSET 4096
+#define MATRIX_IO_ERROR_MAX 128  // Size of the error buffer of the try* loaders and writers
+
+typedef struct {
+    char magic[4];          // "MMB1"
+    uint32_t version;
+    uint32_t endianTag;     // 0x01020304 in the byte order of the writer
+    uint32_t elemType;      // MATRIX_TYPE_* (see matrix.h)
+    uint32_t elemSize;      // Bytes per element
+    uint32_t alignment;     // Alignment of dataOffset in bytes
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t stride;        // Elements between the start of two consecutive rows
+    uint64_t dataOffset;    // Byte offset of element (0, 0)
+} BinaryMatrixHeader;
+
+// The try* loaders and writers return 0 (or a result), or -1 with the reason
+// in error (MATRIX_IO_ERROR_MAX bytes) and nothing left open or mapped, for
+// callers that outlive a bad file (the server). The plain versions report the
+// reason and exit, as the one-shot binaries always did.
+
+// Function to describe a failed load or write in error; returns -1
+static inline int loadError(char *error, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(error, MATRIX_IO_ERROR_MAX, format, args);
+    va_end(args);
+    return -1;
+}
+
+// Function to exit with the reason of a failed try* loader or writer
+static inline void exitOnLoadError(int status, const char *error) {
+    if (status < 0) {
+        fprintf(stderr, "%s\n", error);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Text I/O runs on a few threads: the input file is mapped and cut into
+// chunks on line boundaries, each chunk is parsed by a hand-rolled integer
+// scanner (a first pass counts the numbers in each chunk so every thread
+// knows which element it starts at), and the output rows are formatted into
+// one buffer per thread that are written out with a single writev.
+
+typedef struct {
+    const char *begin;
+    const char *end;
+    size_t count;       // Numbers found in the chunk (counting pass)
+    size_t firstIndex;  // Element index of the chunk's first number (parsing pass)
+    Matrix *matrix;
+    int parse;          // 0: count numbers, 1: parse them into the matrix
+    int error;
+} TextChunk;
+
+static inline int isTextSpace(char ch) {
+    return ch == ' ' || ch == '\n' || ch == '\t' || ch == '\r' || ch == '\v' || ch == '\f';
+}
+
+// Function to parse one float or double token at p into out. Returns the end
+// of the token, or NULL if it is not a number.
+static inline const char *parseTextReal(const char *p, const char *end, int type, void *out) {
+    // The mapped text is not NUL-terminated, so the token is copied for strtod
+    char token[64];
+    size_t len = 0;
+    while (p + len < end && !isTextSpace(p[len])) {
+        if (len == sizeof(token) - 1) {
+            return NULL;
+        }
+        token[len] = p[len];
+        len++;
+    }
+    token[len] = '\0';
+    char *stop;
+    if (type == MATRIX_TYPE_FLOAT32) {
+        *(float *) out = strtof(token, &stop);
+    } else {
+        *(double *) out = strtod(token, &stop);
+    }
+    return len > 0 && stop == token + len ? p + len : NULL;
+}
+
+// Function to count or parse the numbers of one chunk of a text matrix
+static inline void *scanTextChunk(void *arg) {
+    TextChunk *chunk = (TextChunk *) arg;
+    const char *p = chunk->begin, *end = chunk->end;
+    size_t index = chunk->firstIndex;
+    size_t total = chunk->parse ? (size_t) chunk->matrix->rows * chunk->matrix->cols : 0;
+    size_t count = 0;
+    while (p < end) {
+        while (p < end && isTextSpace(*p)) p++;
+        if (p == end) break;
+        if (!chunk->parse) {
+            while (p < end && !isTextSpace(*p)) p++;
+            count++;
+            continue;
+        }
+        if (index >= total) break;  // Like fscanf, anything after the last element is ignored
+        Matrix *m = chunk->matrix;
+        void *element = (char *) matrixRowAt(m, (int) (index / m->cols)) + (index % m->cols) * m->elemSize;
+        if (m->type == MATRIX_TYPE_FLOAT32 || m->type == MATRIX_TYPE_FLOAT64) {
+            p = parseTextReal(p, end, m->type, element);
+            if (p == NULL) {
+                chunk->error = 1;
+                return NULL;
+            }
+            index++;
+            continue;
+        }
+        int negative = 0;
+        if (*p == '-' || *p == '+') {
+            negative = *p == '-';
+            p++;
+        }
+        if (p == end || *p < '0' || *p > '9') {
+            chunk->error = 1;
+            return NULL;
+        }
+        uint64_t value = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            value = value * 10 + (uint64_t) (*p - '0');
+            p++;
+        }
+        if (p < end && !isTextSpace(*p)) {
+            chunk->error = 1;
+            return NULL;
+        }
+        value = negative ? 0u - value : value;
+        if (m->type == MATRIX_TYPE_INT64) {
+            *(int64_t *) element = (int64_t) value;
+        } else if (m->type == MATRIX_TYPE_INT8 || m->type == MATRIX_TYPE_INT16) {
+            // Narrow storage: a value that does not fit is an error, not a wraparound
+            if (!matrixTypeFits(m->type, (int64_t) value)) {
+                chunk->error = 1;
+                return NULL;
+            }
+            if (m->type == MATRIX_TYPE_INT8) {
+                *(int8_t *) element = (int8_t) value;
+            } else {
+                *(int16_t *) element = (int16_t) value;
+            }
+        } else {
+            *(int *) element = (int) (uint32_t) value;
+        }
+        index++;
+    }
+    chunk->count = count;
+    return NULL;
+}
+
+// Function to run one job per chunk, on the calling thread when there is only one
+static inline void runTextJobs(void *(*job)(void *), void *chunks, size_t chunkSize, int numChunks) {
+    if (numChunks == 1) {
+        job(chunks);
+        return;
+    }
+    pthread_t *threads = malloc(numChunks * sizeof(pthread_t));
+    if (threads == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int t = 0; t < numChunks; t++) {
+        pthread_create(&threads[t], NULL, job, (char *) chunks + t * chunkSize);
+    }
+    for (int t = 0; t < numChunks; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    free(threads);
+}
+
+static inline int tryReadMatrixFromFile(Matrix *matrix, const char* fileName, int numThreads, char *error) {
+    int fd = open(fileName, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        if (fd >= 0) close(fd);
+        return loadError(error, "Cannot open file %s", fileName);
+    }
+    size_t size = (size_t) st.st_size;
+    size_t total = (size_t) matrix->rows * matrix->cols;
+    if (size == 0) {
+        close(fd);
+        return total == 0 ? 0 : loadError(error, "Error reading file %s.", fileName);
+    }
+    const char *text = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED) {
+        return loadError(error, "mmap: %s", strerror(errno));
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise((void *) text, size, MADV_SEQUENTIAL);
+#endif
+
+    // Cut the file into chunks that start right after a newline
+    if (numThreads < 1) numThreads = 1;
+    TextChunk chunks[numThreads];
+    const char *end = text + size;
+    const char *p = text;
+    for (int t = 0; t < numThreads; t++) {
+        const char *chunkEnd = (t == numThreads - 1) ? end : text + size / numThreads * (t + 1);
+        if (chunkEnd < p) chunkEnd = p;
+        while (chunkEnd > text && chunkEnd < end && chunkEnd[-1] != '\n') chunkEnd++;
+        chunks[t] = (TextChunk) { p, chunkEnd, 0, 0, matrix, 0, 0 };
+        p = chunkEnd;
+    }
+
+    runTextJobs(scanTextChunk, chunks, sizeof(TextChunk), numThreads);
+    size_t found = 0;
+    for (int t = 0; t < numThreads; t++) {
+        chunks[t].firstIndex = found;
+        chunks[t].parse = 1;
+        found += chunks[t].count;
+    }
+    int failed = found < total;
+    if (!failed) {
+        runTextJobs(scanTextChunk, chunks, sizeof(TextChunk), numThreads);
+        for (int t = 0; t < numThreads; t++) {
+            failed |= chunks[t].error;
+        }
+    }
+    munmap((void *) text, size);
+    return failed ? loadError(error, "Error reading file %s.", fileName) : 0;
+}
+
+static inline void readMatrixFromFile(Matrix *matrix, const char* fileName, int numThreads) {
+    char error[MATRIX_IO_ERROR_MAX];
+    exitOnLoadError(tryReadMatrixFromFile(matrix, fileName, numThreads, error), error);
+}
+
+typedef struct {
+    const Matrix *matrix;
+    int startRow;
+    int endRow;
+    char *buffer;
+    size_t length;
+} TextRows;
+
+// Function to write the decimal form of value at out, returning the number of characters
+static inline int formatInt64(char *out, int64_t value) {
+    static const char digitPairs[201] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char tmp[21];
+    int pos = 21;
+    uint64_t v = value < 0 ? 0u - (uint64_t) value : (uint64_t) value;
+    while (v >= 100) {
+        unsigned int pair = (unsigned int) (v % 100) * 2;
+        v /= 100;
+        tmp[--pos] = digitPairs[pair + 1];
+        tmp[--pos] = digitPairs[pair];
+    }
+    if (v >= 10) {
+        tmp[--pos] = digitPairs[v * 2 + 1];
+        tmp[--pos] = digitPairs[v * 2];
+    } else {
+        tmp[--pos] = (char) ('0' + v);
+    }
+    if (value < 0) {
+        tmp[--pos] = '-';
+    }
+    int len = 21 - pos;
+    memcpy(out, tmp + pos, len);
+    return len;
+}
+
+// Function to write the decimal form of an int at out, returning the number of characters
+static inline int formatInt(char *out, int value) {
+    return formatInt64(out, value);
+}
+
+// Function to write one element of any type at out, returning the number of characters
+static inline int formatElement(char *out, const Matrix *m, const void *row, int j) {
+    switch (m->type) {
+        case MATRIX_TYPE_INT64:   return formatInt64(out, ((const int64_t *) row)[j]);
+        case MATRIX_TYPE_FLOAT32: return sprintf(out, "%.9g", (double) ((const float *) row)[j]);
+        case MATRIX_TYPE_FLOAT64: return sprintf(out, "%.17g", ((const double *) row)[j]);
+        case MATRIX_TYPE_INT8:    return formatInt(out, ((const int8_t *) row)[j]);
+        case MATRIX_TYPE_INT16:   return formatInt(out, ((const int16_t *) row)[j]);
+        default:                  return formatInt(out, ((const int *) row)[j]);
+    }
+}
+
+// Function to format a range of rows exactly like fprintf("%d ") per element and "\n" per row,
+// leaving buffer NULL if it cannot be allocated
+static inline void *formatTextRows(void *arg) {
+    TextRows *rows = (TextRows *) arg;
+    const Matrix *m = rows->matrix;
+    // At most 11 characters per int (20 per int64, 24 per double) plus the
+    // separator, plus one newline per row
+    size_t perElement = m->type == MATRIX_TYPE_INT32 ? 12 : 25;
+    size_t capacity = (size_t) (rows->endRow - rows->startRow) * ((size_t) m->cols * perElement + 1);
+    rows->buffer = malloc(capacity > 0 ? capacity : 1);
+    if (rows->buffer == NULL) {
+        return NULL;  // Reported by tryWriteTextRows()
+    }
+    char *out = rows->buffer;
+    for (int i = rows->startRow; i < rows->endRow; i++){
+        if (m->type == MATRIX_TYPE_INT32) {
+            const int *row = matrixRow(m, i);
+            for (int j = 0; j < m->cols; j++){
+                out += formatInt(out, row[j]);
+                *out++ = ' ';
+            }
+        } else {
+            const void *row = matrixRowAt(m, i);
+            for (int j = 0; j < m->cols; j++){
+                out += formatElement(out, m, row, j);
+                *out++ = ' ';
+            }
+        }
+        *out++ = '\n';
+    }
+    rows->length = (size_t) (out - rows->buffer);
+    return NULL;
+}
+
+// Function to write count buffers with writev, resumed only if the kernel writes less
+static inline int tryWritevAll(int fd, struct iovec *iov, int count, const char *fileName, char *error) {
+    int first = 0;
+    while (first < count) {
+        ssize_t w = writev(fd, iov + first, count - first);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return loadError(error, "Error writing file %s", fileName);
+        }
+        while (first < count && (size_t) w >= iov[first].iov_len) {
+            w -= iov[first].iov_len;
+            first++;
+        }
+        if (first < count) {
+            iov[first].iov_base = (char *) iov[first].iov_base + w;
+            iov[first].iov_len -= w;
+        }
+    }
+    return 0;
+}
+
+static inline void writevAll(int fd, struct iovec *iov, int count, const char *fileName) {
+    char error[MATRIX_IO_ERROR_MAX];
+    exitOnLoadError(tryWritevAll(fd, iov, count, fileName, error), error);
+}
+
+// Function to format the rows of a matrix with numThreads threads and append
+// them to an open file with a single writev
+static inline int tryWriteTextRows(int fd, const Matrix *matrix, int numThreads, const char *fileName,
+                                   char *error) {
+    if (numThreads < 1) numThreads = 1;
+    if (numThreads > matrix->rows && matrix->rows > 0) numThreads = matrix->rows;
+    TextRows parts[numThreads];
+    int baseChunk = matrix->rows / numThreads;
+    int remainder = matrix->rows % numThreads;
+    int currentRow = 0;
+    for (int t = 0; t < numThreads; t++) {
+        int rowsForThisThread = baseChunk + (t < remainder ? 1 : 0);
+        parts[t] = (TextRows) { matrix, currentRow, currentRow + rowsForThisThread, NULL, 0 };
+        currentRow += rowsForThisThread;
+    }
+    runTextJobs(formatTextRows, parts, sizeof(TextRows), numThreads);
+
+    // One writev for all the buffers
+    struct iovec iov[numThreads];
+    int status = 0;
+    for (int t = 0; t < numThreads; t++) {
+        iov[t].iov_base = parts[t].buffer;
+        iov[t].iov_len = parts[t].length;
+        if (parts[t].buffer == NULL) {
+            status = loadError(error, "Out of memory formatting file %s", fileName);
+        }
+    }
+    if (status == 0) {
+        status = tryWritevAll(fd, iov, numThreads, fileName, error);
+    }
+    for (int t = 0; t < numThreads; t++) {
+        free(parts[t].buffer);
+    }
+    return status;
+}
+
+static inline void writeTextRows(int fd, const Matrix *matrix, int numThreads, const char *fileName) {
+    char error[MATRIX_IO_ERROR_MAX];
+    exitOnLoadError(tryWriteTextRows(fd, matrix, numThreads, fileName, error), error);
+}
+
+static inline int tryWriteMatrixToFile(const Matrix *matrix, const char* fileName, int numThreads, char *error) {
+    int fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return loadError(error, "Cannot open file %s for writing", fileName);
+    }
+    int status = tryWriteTextRows(fd, matrix, numThreads, fileName, error);
+    close(fd);
+    return status;
+}
+
+static inline void writeMatrixToFile(const Matrix *matrix, const char* fileName, int numThreads) {
+    char error[MATRIX_IO_ERROR_MAX];
+    exitOnLoadError(tryWriteMatrixToFile(matrix, fileName, numThreads, error), error);
+}
+
+// Function to check whether a file name selects the binary format for writing
+static inline int isBinaryFileName(const char *fileName) {
+    size_t len = strlen(fileName);
+    return len > 4 && strcmp(fileName + len - 4, ".bin") == 0;
+}
+
+// Function to check whether a file starts with the binary matrix magic (1 or 0)
+static inline int tryIsBinaryMatrixFile(const char *fileName, char *error) {
+    char magic[4];
+    FILE *file = fopen(fileName, "rb");
+    if (!file) {
+        return loadError(error, "Cannot open file %s", fileName);
+    }
+    size_t got = fread(magic, 1, sizeof(magic), file);
+    fclose(file);
+    return got == sizeof(magic) && memcmp(magic, BINARY_MATRIX_MAGIC, sizeof(magic)) == 0;
+}
+
+static inline int isBinaryMatrixFile(const char *fileName) {
+    char error[MATRIX_IO_ERROR_MAX];
+    int binary = tryIsBinaryMatrixFile(fileName, error);
+    exitOnLoadError(binary, error);
+    return binary;
+}
+
+static inline uint32_t byteSwap32(uint32_t v) {
+    return __builtin_bswap32(v);
+}
+
+static inline uint64_t byteSwap64(uint64_t v) {
+    return __builtin_bswap64(v);
+}
+
+// Function to read and validate the header of an open binary matrix file
+// holding rows x cols elements of the given type.
+// Returns 1 if the file was written with the other byte order (the header is
+// returned already swapped, the elements still need swapping), 0 otherwise.
+static inline int tryReadBinaryMatrixHeader(int fd, const char *fileName, int rows, int cols, int type,
+                                            BinaryMatrixHeader *header, char *error) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        return loadError(error, "fstat: %s", strerror(errno));
+    }
+    if ((size_t) st.st_size < sizeof(*header) || pread(fd, header, sizeof(*header), 0) != (ssize_t) sizeof(*header)) {
+        return loadError(error, "Error reading file %s.", fileName);
+    }
+
+    int swapped = header->endianTag != BINARY_MATRIX_ENDIAN_TAG;
+    if (swapped) {
+        if (byteSwap32(header->endianTag) != BINARY_MATRIX_ENDIAN_TAG) {
+            return loadError(error, "File %s has an invalid byte order tag", fileName);
+        }
+        header->version = byteSwap32(header->version);
+        header->elemType = byteSwap32(header->elemType);
+        header->elemSize = byteSwap32(header->elemSize);
+        header->alignment = byteSwap32(header->alignment);
+        header->rows = byteSwap64(header->rows);
+        header->cols = byteSwap64(header->cols);
+        header->stride = byteSwap64(header->stride);
+        header->dataOffset = byteSwap64(header->dataOffset);
+    }
+    if (header->version != BINARY_MATRIX_VERSION || matrixTypeSize((int) header->elemType) == 0 ||
+        header->elemSize != (uint32_t) matrixTypeSize((int) header->elemType) || header->stride < header->cols) {
+        return loadError(error, "File %s is not a supported binary matrix", fileName);
+    }
+    if (header->elemType != (uint32_t) type) {
+        return loadError(error, "File %s holds %s elements, expected %s (see --dtype and --narrow)", fileName,
+                         matrixTypeName((int) header->elemType), matrixTypeName(type));
+    }
+    if (header->rows != (uint64_t) rows || header->cols != (uint64_t) cols) {
+        return loadError(error, "File %s holds a %llu x %llu matrix, expected %d x %d", fileName,
+                         (unsigned long long) header->rows, (unsigned long long) header->cols, rows, cols);
+    }
+    size_t dataBytes = (size_t) header->rows * header->stride * header->elemSize;
+    if (header->dataOffset % MATRIX_ALIGNMENT != 0 || (uint64_t) st.st_size < header->dataOffset + dataBytes) {
+        return loadError(error, "File %s is truncated or misaligned", fileName);
+    }
+    return swapped;
+}
+
+static inline int readBinaryMatrixHeader(int fd, const char *fileName, int rows, int cols, int type,
+                                         BinaryMatrixHeader *header) {
+    char error[MATRIX_IO_ERROR_MAX];
+    int swapped = tryReadBinaryMatrixHeader(fd, fileName, rows, cols, type, header, error);
+    exitOnLoadError(swapped, error);
+    return swapped;
+}
+
+// Function to map a binary matrix file. The elements are used in place
+// (MAP_PRIVATE, so writes never reach the file) unless the file was written
+// with the other byte order, in which case it is copied and swapped once.
+static inline int tryMapBinaryMatrix(Matrix *matrix, int rows, int cols, int type, const char *fileName, int flags,
+                                     char *error) {
+    memset(matrix, 0, sizeof(*matrix));  // No data to free if the load fails
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0) {
+        return loadError(error, "Cannot open file %s", fileName);
+    }
+    BinaryMatrixHeader header;
+    int swapped = tryReadBinaryMatrixHeader(fd, fileName, rows, cols, type, &header, error);
+    if (swapped < 0) {
+        close(fd);
+        return -1;
+    }
+    size_t dataBytes = (size_t) header.rows * header.stride * header.elemSize;
+
+    size_t mapBytes = header.dataOffset + dataBytes;
+    void *base = mmap(NULL, mapBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return loadError(error, "mmap: %s", strerror(errno));
+    }
+    const char *elements = (const char *) base + header.dataOffset;
+
+    if (swapped) {
+        *matrix = allocateTypedMatrix(rows, cols, type, flags);
+        for (int i = 0; i < rows; i++){
+            const char *src = elements + (size_t) i * header.stride * header.elemSize;
+            if (header.elemSize == 8) {
+                const uint64_t *s = (const uint64_t *) src;
+                uint64_t *dst = matrixRowAt(matrix, i);
+                for (int j = 0; j < cols; j++){
+                    dst[j] = byteSwap64(s[j]);
+                }
+            } else if (header.elemSize == 4) {
+                const uint32_t *s = (const uint32_t *) src;
+                uint32_t *dst = matrixRowAt(matrix, i);
+                for (int j = 0; j < cols; j++){
+                    dst[j] = byteSwap32(s[j]);
+                }
+            } else if (header.elemSize == 2) {
+                const uint16_t *s = (const uint16_t *) src;
+                uint16_t *dst = matrixRowAt(matrix, i);
+                for (int j = 0; j < cols; j++){
+                    dst[j] = __builtin_bswap16(s[j]);
+                }
+            } else {
+                memcpy(matrixRowAt(matrix, i), src, cols);
+            }
+        }
+        munmap(base, mapBytes);
+        return 0;
+    }
+
+    matrix->rows = rows;
+    matrix->cols = cols;
+    matrix->stride = (int) header.stride;
+    matrix->data = (void *) elements;
+    matrix->base = base;
+    matrix->bytes = mapBytes;
+    matrix->flags = MATRIX_FILE;
+    matrix->type = type;
+    matrix->elemSize = (int) header.elemSize;
+#ifdef MADV_WILLNEED
+    madvise(base, mapBytes, MADV_WILLNEED);  // Start reading ahead before the kernel touches it
+#endif
+    return 0;
+}
+
+static inline void mapBinaryMatrix(Matrix *matrix, int rows, int cols, int type, const char *fileName, int flags) {
+    char error[MATRIX_IO_ERROR_MAX];
+    exitOnLoadError(tryMapBinaryMatrix(matrix, rows, cols, type, fileName, flags, error), error);
+}
+
+// Function to write size bytes at offset, retrying short writes
+static inline int tryPwriteAll(int fd, const void *buffer, size_t size, off_t offset, const char *fileName,
+                               char *error) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t w = pwrite(fd, (const char *) buffer + done, size - done, offset + (off_t) done);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return loadError(error, "Error writing file %s", fileName);
+        }
+        done += (size_t) w;
+    }
+    return 0;
+}
+
+static inline void pwriteAll(int fd, const void *buffer, size_t size, off_t offset, const char *fileName) {
+    char error[MATRIX_IO_ERROR_MAX];
+    exitOnLoadError(tryPwriteAll(fd, buffer, size, offset, fileName, error), error);
+}
+
+// Function to write the header page of a binary matrix file
+static inline int tryWriteBinaryMatrixHeader(int fd, const char *fileName, int rows, int cols, int stride,
+                                             int type, char *error) {
+    char page[BINARY_MATRIX_DATA_OFFSET];
+    memset(page, 0, sizeof(page));
+    BinaryMatrixHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BINARY_MATRIX_MAGIC, sizeof(header.magic));
+    header.version = BINARY_MATRIX_VERSION;
+    header.endianTag = BINARY_MATRIX_ENDIAN_TAG;
+    header.elemType = type;
+    header.elemSize = matrixTypeSize(type);
+    header.alignment = BINARY_MATRIX_DATA_OFFSET;
+    header.rows = rows;
+    header.cols = cols;
+    header.stride = stride;
+    header.dataOffset = BINARY_MATRIX_DATA_OFFSET;
+    memcpy(page, &header, sizeof(header));
+    return tryPwriteAll(fd, page, sizeof(page), 0, fileName, error);
+}
+
+static inline void writeBinaryMatrixHeader(int fd, const char *fileName, int rows, int cols, int stride,
+                                           int type) {
+    char error[MATRIX_IO_ERROR_MAX];
+    exitOnLoadError(tryWriteBinaryMatrixHeader(fd, fileName, rows, cols, stride, type, error), error);
+}
+
+// Function to write a matrix in the binary format with one header write and
+// one bulk write of the (padded) element block
+static inline int tryWriteBinaryMatrix(const Matrix *matrix, const char *fileName, char *error) {
+    int fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return loadError(error, "Cannot open file %s for writing", fileName);
+    }
+    int status = tryWriteBinaryMatrixHeader(fd, fileName, matrix->rows, matrix->cols, matrix->stride,
+                                            matrix->type, error);
+    if (status == 0) {
+        status = tryPwriteAll(fd, matrix->data, (size_t) matrix->rows * matrix->stride * matrix->elemSize,
+                              BINARY_MATRIX_DATA_OFFSET, fileName, error);
+    }
+    close(fd);
+    return status;
+}
+
+static inline void writeBinaryMatrix(const Matrix *matrix, const char *fileName) {
+    char error[MATRIX_IO_ERROR_MAX];
+    exitOnLoadError(tryWriteBinaryMatrix(matrix, fileName, error), error);
+}
+
+// Function to check whether a file name selects the Matrix Market format
+static inline int isMatrixMarketFileName(const char *fileName) {
+    size_t len = strlen(fileName);
+    return len > 4 && strcmp(fileName + len - 4, ".mtx") == 0;
+}
+
+// Function to read the size line of a Matrix Market file (after the banner and
+// comments). Sets *pattern and *symmetric from the banner and returns the file
+// positioned at the first entry.
+static inline FILE *tryOpenMatrixMarket(const char *fileName, int *rows, int *cols, size_t *nnz,
+                                        int *pattern, int *symmetric, char *error) {
+    FILE *file = fopen(fileName, "r");
+    char line[1024];
+    if (file == NULL || fgets(line, sizeof(line), file) == NULL ||
+        strncmp(line, "%%MatrixMarket matrix coordinate", 32) != 0) {
+        if (file != NULL) fclose(file);
+        loadError(error, "%s is not a Matrix Market coordinate file", fileName);
+        return NULL;
+    }
+    *pattern = strstr(line, "pattern") != NULL;
+    *symmetric = strstr(line, "symmetric") != NULL;
+    while (fgets(line, sizeof(line), file) != NULL && line[0] == '%') {
+        // Comment
+    }
+    long long r, c, count;
+    if (sscanf(line, "%lld %lld %lld", &r, &c, &count) != 3 || r < 0 || c < 0 || count < 0) {
+        fclose(file);
+        loadError(error, "Error reading file %s.", fileName);
+        return NULL;
+    }
+    *rows = (int) r;
+    *cols = (int) c;
+    *nnz = (size_t) count;
+    return file;
+}
+
+static inline FILE *openMatrixMarket(const char *fileName, int *rows, int *cols, size_t *nnz,
+                                     int *pattern, int *symmetric) {
+    char error[MATRIX_IO_ERROR_MAX];
+    FILE *file = tryOpenMatrixMarket(fileName, rows, cols, nnz, pattern, symmetric, error);
+    exitOnLoadError(file == NULL ? -1 : 0, error);
+    return file;
+}
+
+// Function to read a Matrix Market coordinate file ("%%MatrixMarket matrix
+// coordinate integer|real|pattern general|symmetric", 1-based indices) into
+// a zeroed dense matrix. Pattern entries are 1, repeated entries are added.
+static inline int tryReadMatrixMarket(Matrix *matrix, const char *fileName, char *error) {
+    int rows, cols, pattern, symmetric;
+    size_t nnz;
+    FILE *file = tryOpenMatrixMarket(fileName, &rows, &cols, &nnz, &pattern, &symmetric, error);
+    if (file == NULL) {
+        return -1;
+    }
+    if (rows != matrix->rows || cols != matrix->cols) {
+        fclose(file);
+        return loadError(error, "%s is %d x %d, expected %d x %d", fileName, rows, cols, matrix->rows, matrix->cols);
+    }
+    for (size_t e = 0; e < nnz; e++) {
+        long long i, j;
+        double real = 1;
+        long long integer = 1;
+        int got = matrix->type == MATRIX_TYPE_FLOAT32 || matrix->type == MATRIX_TYPE_FLOAT64 ?
+                  fscanf(file, "%lld %lld %lf", &i, &j, &real) : fscanf(file, "%lld %lld %lld", &i, &j, &integer);
+        if (got < (pattern ? 2 : 3) || i < 1 || i > rows || j < 1 || j > cols ||
+            (matrix->elemSize < 4 && !matrixTypeFits(matrix->type, integer))) {
+            fclose(file);
+            return loadError(error, "Error reading file %s.", fileName);
+        }
+        for (int mirror = 0; mirror <= (symmetric && i != j); mirror++) {
+            int row = (int) (mirror ? j : i) - 1, col = (int) (mirror ? i : j) - 1;
+            void *element = (char *) matrixRowAt(matrix, row) + (size_t) col * matrix->elemSize;
+            switch (matrix->type) {
+                case MATRIX_TYPE_INT64:   *(int64_t *) element += integer; break;
+                case MATRIX_TYPE_FLOAT32: *(float *) element += (float) real; break;
+                case MATRIX_TYPE_FLOAT64: *(double *) element += real; break;
+                case MATRIX_TYPE_INT8:    *(int8_t *) element += (int8_t) integer; break;
+                case MATRIX_TYPE_INT16:   *(int16_t *) element += (int16_t) integer; break;
+                default:                  *(int *) element += (int) integer; break;
+            }
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+static inline void readMatrixMarket(Matrix *matrix, const char *fileName) {
+    char error[MATRIX_IO_ERROR_MAX];
+    exitOnLoadError(tryReadMatrixMarket(matrix, fileName, error), error);
+}
+
+// Function to write the nonzero elements of a matrix as a Matrix Market coordinate file
+static inline int tryWriteMatrixMarket(const Matrix *matrix, const char *fileName, char *error) {
+    FILE *file = fopen(fileName, "w");
+    if (file == NULL) {
+        return loadError(error, "Error opening file %s for writing.", fileName);
+    }
+    static const char zero[8] = { 0 };
+    size_t nnz = 0;
+    for (int i = 0; i < matrix->rows; i++) {
+        const char *row = matrixRowAt(matrix, i);
+        for (int j = 0; j < matrix->cols; j++) {
+            nnz += memcmp(row + (size_t) j * matrix->elemSize, zero, matrix->elemSize) != 0;
+        }
+    }
+    int real = matrix->type == MATRIX_TYPE_FLOAT32 || matrix->type == MATRIX_TYPE_FLOAT64;
+    fprintf(file, "%%%%MatrixMarket matrix coordinate %s general\n%d %d %zu\n",
+            real ? "real" : "integer", matrix->rows, matrix->cols, nnz);
+    char value[32];
+    for (int i = 0; i < matrix->rows; i++) {
+        const char *row = matrixRowAt(matrix, i);
+        for (int j = 0; j < matrix->cols; j++) {
+            if (memcmp(row + (size_t) j * matrix->elemSize, zero, matrix->elemSize) != 0) {
+                value[formatElement(value, matrix, row, j)] = '\0';
+                fprintf(file, "%d %d %s\n", i + 1, j + 1, value);
+            }
+        }
+    }
+    if (fclose(file) != 0) {
+        return loadError(error, "Error writing file %s.", fileName);
+    }
+    return 0;
+}
+
+static inline void writeMatrixMarket(const Matrix *matrix, const char *fileName) {
+    char error[MATRIX_IO_ERROR_MAX];
+    exitOnLoadError(tryWriteMatrixMarket(matrix, fileName, error), error);
+}
+
+// Function to get the shape of a text, binary or Matrix Market matrix file
+// without loading it: a text matrix has one row per non-empty line
+static inline int tryProbeMatrixShape(const char *fileName, int *rows, int *cols, char *error) {
+    if (isMatrixMarketFileName(fileName)) {
+        int pattern, symmetric;
+        size_t nnz;
+        FILE *file = tryOpenMatrixMarket(fileName, rows, cols, &nnz, &pattern, &symmetric, error);
+        if (file == NULL) {
+            return -1;
+        }
+        fclose(file);
+        return 0;
+    }
+    int fd = open(fileName, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        if (fd >= 0) close(fd);
+        return loadError(error, "Cannot open file %s", fileName);
+    }
+    int binary = tryIsBinaryMatrixFile(fileName, error);
+    if (binary != 0) {
+        BinaryMatrixHeader header;
+        if (binary > 0 && pread(fd, &header, sizeof(header), 0) != (ssize_t) sizeof(header)) {
+            binary = loadError(error, "Error reading file %s.", fileName);
+        }
+        close(fd);
+        if (binary < 0) {
+            return -1;
+        }
+        int swapped = header.endianTag != BINARY_MATRIX_ENDIAN_TAG;
+        *rows = (int) (swapped ? byteSwap64(header.rows) : header.rows);
+        *cols = (int) (swapped ? byteSwap64(header.cols) : header.cols);
+        return 0;
+    }
+    *rows = *cols = 0;
+    size_t size = (size_t) st.st_size;
+    if (size > 0) {
+        const char *text = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (text == MAP_FAILED) {
+            close(fd);
+            return loadError(error, "mmap: %s", strerror(errno));
+        }
+        int inNumber = 0, lineHasNumber = 0;
+        for (size_t i = 0; i < size; i++) {
+            int digit = (text[i] >= '0' && text[i] <= '9') || text[i] == '-';
+            if (digit && !inNumber && *rows == 0) {
+                (*cols)++;
+            }
+            inNumber = digit;
+            lineHasNumber |= digit;
+            if (text[i] == '\n' || i + 1 == size) {
+                *rows += lineHasNumber;
+                lineHasNumber = 0;
+            }
+        }
+        munmap((void *) text, size);
+    }
+    close(fd);
+    return 0;
+}
+
+static inline void probeMatrixShape(const char *fileName, int *rows, int *cols) {
+    char error[MATRIX_IO_ERROR_MAX];
+    exitOnLoadError(tryProbeMatrixShape(fileName, rows, cols, error), error);
+}
+
+// Function to get the element type of a binary matrix file (MATRIX_TYPE_*),
+// 0 if the file is not in the binary format
+static inline int probeBinaryMatrixType(const char *fileName) {
+    if (isMatrixMarketFileName(fileName) || !isBinaryMatrixFile(fileName)) {
+        return 0;
+    }
+    BinaryMatrixHeader header;
+    FILE *file = fopen(fileName, "rb");
+    if (file == NULL || fread(&header, sizeof(header), 1, file) != 1) {
+        fprintf(stderr, "Error reading file %s.\n", fileName);
+        exit(EXIT_FAILURE);
+    }
+    fclose(file);
+    return (int) (header.endianTag != BINARY_MATRIX_ENDIAN_TAG ? byteSwap32(header.elemType) : header.elemType);
+}
+
+// Function to load an input matrix of the given element type from a text,
+// binary (detected by its magic) or Matrix Market (.mtx) file. Text files are
+// parsed with ioThreads threads.
+static inline void loadTypedMatrix(Matrix *matrix, int rows, int cols, int type, const char *fileName, int flags,
+                                   int ioThreads) {
+    if (isMatrixMarketFileName(fileName)) {
+        *matrix = allocateTypedMatrix(rows, cols, type, flags);
+        readMatrixMarket(matrix, fileName);
+    } else if (isBinaryMatrixFile(fileName)) {
+        mapBinaryMatrix(matrix, rows, cols, type, fileName, flags);
+    } else {
+        *matrix = allocateTypedMatrix(rows, cols, type, flags);
+        readMatrixFromFile(matrix, fileName, ioThreads);
+    }
+}
+
+// Function to load an int32 input matrix from a text or binary file
+static inline void loadMatrix(Matrix *matrix, int rows, int cols, const char *fileName, int flags, int ioThreads) {
+    loadTypedMatrix(matrix, rows, cols, MATRIX_TYPE_INT32, fileName, flags, ioThreads);
+}
+
+// Function to save a result matrix, in binary when the file name ends in ".bin"
+// and as Matrix Market when it ends in ".mtx". Text output is formatted with
+// ioThreads threads.
+static inline int trySaveMatrix(const Matrix *matrix, const char *fileName, int ioThreads, char *error) {
+    if (isBinaryFileName(fileName)) {
+        return tryWriteBinaryMatrix(matrix, fileName, error);
+    } else if (isMatrixMarketFileName(fileName)) {
+        return tryWriteMatrixMarket(matrix, fileName, error);
+    }
+    return tryWriteMatrixToFile(matrix, fileName, ioThreads, error);
+}
+
+static inline void saveMatrix(const Matrix *matrix, const char *fileName, int ioThreads) {
+    char error[MATRIX_IO_ERROR_MAX];
+    exitOnLoadError(trySaveMatrix(matrix, fileName, ioThreads, error), error);
+}
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef MESSAGE_H
+#define MESSAGE_H
+
+// Message passing between local processes over Unix-domain stream sockets.
+//
+// sendAll()/receiveAll() move one buffer over a blocking socket. Transfers
+// that must progress together (a block sent to one neighbour while the next
+// one arrives from another, a broadcast to every peer of a row) go through
+// runTransfers(), which drives any number of them on non-blocking sockets
+// with poll(), so no ordering of the peers can deadlock on full socket buffers.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+// One message in flight: size bytes of data sent to or received from fd
+typedef struct {
+    int fd;
+    char *data;
+    size_t size;
+    size_t done;
+    int sending;    // 1 to send data, 0 to receive into it
+} Transfer;
+
+// Function to send size bytes over a blocking socket; returns 0, or -1 on error
+static inline int sendAll(int fd, const void *data, size_t size) {
+    const char *p = data;
+    while (size > 0) {
+        ssize_t sent = send(fd, p, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return -1;
+        }
+        p += sent;
+        size -= (size_t) sent;
+    }
+    return 0;
+}
+
+// Function to receive exactly size bytes from a blocking socket; returns 0, or
+// -1 on error or when the peer closed the connection first
+static inline int receiveAll(int fd, void *data, size_t size) {
+    char *p = data;
+    while (size > 0) {
+        ssize_t got = recv(fd, p, size, 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return -1;
+        }
+        p += got;
+        size -= (size_t) got;
+    }
+    return 0;
+}
+
+// Function to switch a socket to non-blocking mode (needed by runTransfers())
+static inline void setNonBlocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+// Function to complete every transfer of the list, progressing all of them at
+// once. The sockets must be non-blocking. Exits if a peer goes away.
+static inline void runTransfers(Transfer *transfers, int count) {
+    struct pollfd stackFds[16];
+    struct pollfd *fds = count <= 16 ? stackFds : malloc(count * sizeof(struct pollfd));
+    int *index = malloc((count > 0 ? count : 1) * sizeof(int));
+    for (;;) {
+        int waiting = 0;
+        for (int t = 0; t < count; t++) {
+            if (transfers[t].done < transfers[t].size) {
+                fds[waiting].fd = transfers[t].fd;
+                fds[waiting].events = transfers[t].sending ? POLLOUT : POLLIN;
+                index[waiting++] = t;
+            }
+        }
+        if (waiting == 0) {
+            break;
+        }
+        if (poll(fds, waiting, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            exit(EXIT_FAILURE);
+        }
+        for (int w = 0; w < waiting; w++) {
+            if (fds[w].revents == 0) {
+                continue;
+            }
+            Transfer *t = &transfers[index[w]];
+            ssize_t moved = t->sending ?
+                            send(t->fd, t->data + t->done, t->size - t->done, MSG_NOSIGNAL) :
+                            recv(t->fd, t->data + t->done, t->size - t->done, 0);
+            if (moved > 0) {
+                t->done += (size_t) moved;
+            } else if (moved == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                fprintf(stderr, "Lost the connection to a peer\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+    if (fds != stackFds) {
+        free(fds);
+    }
+    free(index);
+}
+
+#endif
@@ -0,0 +1,468 @@
+#ifndef NARROW_H
+#define NARROW_H
+
+// Narrow integer storage for int32 products (--narrow).
+//
+// The generators and fillMatrix() only produce 0..9, so int32 operands spend
+// three of every four bytes they move on zeros. With --narrow, A and B are
+// stored as int8 or int16 (the narrowest type their value range allows, or
+// the one forced) and multiplied with widening SIMD instructions that
+// accumulate into the int32 C:
+//   - int8:  pmaddubsw (u8 x s8 pairs to int16) then pmaddwd by 1 (pairs of
+//            those to int32), or a single vpdpbusd with AVX-512 VNNI. A must
+//            be in 0..127 (it is the unsigned operand) and B in -128..127;
+//            then the int16 pair sums cannot saturate (2 * 127 * 128 < 2^15);
+//   - int16: pmaddwd (s16 x s16 pairs to int32), or vpdpwssd with VNNI.
+// Both sum a group of 4 (int8) or 2 (int16) consecutive k per 32-bit lane, so
+// B is packed once per product (a timed stage, like the --transpose pack):
+// row g of the packed matrix holds, column after column, the group
+// B[g*G .. g*G+G-1][j]. A row of A already has its groups contiguous; k is
+// rounded up to the group and A's padding columns are cleared. Results are
+// identical to the int32 kernels, modulo 2^32 like them.
+//
+// Text and .mtx files can be read straight into narrow storage (a value out
+// of range is an error) and int8/int16 binary files are mapped in place.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "matrix.h"
+#include "matrix_io.h"
+#include "blocked.h"
+#include "simd.h"
+
+// --narrow modes
+#define NARROW_OFF   0
+#define NARROW_AUTO  1  // Narrowest type the values of A and B allow, int32 if none
+#define NARROW_INT8  2
+#define NARROW_INT16 3
+
+#define NARROW_PACK_GROUPS 64  // Group rows of packed B per pack task
+
+// Signature of the narrow tile kernels: C[i0:i1, j0:j1] += A[i0:i1, k0:k1] *
+// B[k0:k1, j0:j1] with A narrow and row-major, B packed in groups (ldb is the
+// stride of a packed group row) and C int32; k0 and k1 are multiples of the group
+typedef void (*NarrowKernel)(const void *a, int lda, const void *b, int ldb, int *c, int ldc,
+                             int i0, int i1, int j0, int j1, int k0, int k1);
+
+typedef struct {
+    int64_t min;
+    int64_t max;
+} MatrixRange;
+
+typedef struct {
+    int type;               // MATRIX_TYPE_INT8 or MATRIX_TYPE_INT16
+    int group;              // k values per 32-bit lane: 4 or 2
+    int depth;              // k rounded up to the group
+    const char *isa;
+    NarrowKernel kernel;
+    const Matrix *a;
+    const Matrix *b;
+    Matrix packed;          // Filled by narrowPackBand()
+    int edges[3];           // Tile edges of the blocked walk, rounded up to the group
+} NarrowPlan;
+
+// Function to parse a --narrow mode (auto, int8, int16, off); exits if it is unknown
+static inline int parseNarrowMode(const char *name) {
+    if (strcmp(name, "auto") == 0) return NARROW_AUTO;
+    if (strcmp(name, "int8") == 0) return NARROW_INT8;
+    if (strcmp(name, "int16") == 0) return NARROW_INT16;
+    if (strcmp(name, "off") == 0) return NARROW_OFF;
+    fprintf(stderr, "Unknown narrow mode '%s' (use auto, int8, int16 or off)\n", name);
+    exit(EXIT_FAILURE);
+}
+
+// Function to get the element type a --narrow mode forces, 0 for auto and off
+static inline int narrowModeType(int mode) {
+    return mode == NARROW_INT8 ? MATRIX_TYPE_INT8 : mode == NARROW_INT16 ? MATRIX_TYPE_INT16 : 0;
+}
+
+// Function to read element j of a row of an int8, int16 or int32 matrix
+static inline int64_t integerElement(const Matrix *m, const void *row, int j) {
+    switch (m->type) {
+        case MATRIX_TYPE_INT8:  return ((const int8_t *) row)[j];
+        case MATRIX_TYPE_INT16: return ((const int16_t *) row)[j];
+        default:                return ((const int *) row)[j];
+    }
+}
+
+// Function to get the smallest and largest element of an int8, int16 or int32 matrix
+static inline MatrixRange matrixRange(const Matrix *m) {
+    MatrixRange range = { 0, 0 };
+    for (int i = 0; i < m->rows; i++){
+        const void *row = matrixRowAt(m, i);
+        for (int j = 0; j < m->cols; j++){
+            int64_t x = integerElement(m, row, j);
+            if ((i == 0 && j == 0) || x < range.min) range.min = x;
+            if ((i == 0 && j == 0) || x > range.max) range.max = x;
+        }
+    }
+    return range;
+}
+
+// Function to check whether A and B with these ranges can be multiplied in a narrow type
+static inline int narrowTypeFits(int type, MatrixRange a, MatrixRange b) {
+    if (type == MATRIX_TYPE_INT8) {
+        return a.min >= 0 && a.max <= INT8_MAX && b.min >= INT8_MIN && b.max <= INT8_MAX;
+    }
+    return a.min >= INT16_MIN && a.max <= INT16_MAX && b.min >= INT16_MIN && b.max <= INT16_MAX;
+}
+
+// Function to pick the narrowest storage for A and B: int8, int16, or int32 if neither fits
+static inline int chooseNarrowType(MatrixRange a, MatrixRange b) {
+    if (narrowTypeFits(MATRIX_TYPE_INT8, a, b)) return MATRIX_TYPE_INT8;
+    if (narrowTypeFits(MATRIX_TYPE_INT16, a, b)) return MATRIX_TYPE_INT16;
+    return MATRIX_TYPE_INT32;
+}
+
+// Function to replace an integer matrix by a copy in another integer type
+// (the values must fit); the copy's padding is zero
+static inline void convertIntegerMatrix(Matrix *m, int type, int flags) {
+    Matrix copy = allocateTypedMatrix(m->rows, m->cols, type, flags);
+    for (int i = 0; i < m->rows; i++){
+        const void *src = matrixRowAt(m, i);
+        void *dst = matrixRowAt(&copy, i);
+        for (int j = 0; j < m->cols; j++){
+            int64_t x = integerElement(m, src, j);
+            switch (type) {
+                case MATRIX_TYPE_INT8:  ((int8_t *) dst)[j] = (int8_t) x; break;
+                case MATRIX_TYPE_INT16: ((int16_t *) dst)[j] = (int16_t) x; break;
+                default:                ((int *) dst)[j] = (int) x; break;
+            }
+        }
+    }
+    freeMatrix(m);
+    *m = copy;
+}
+
+// Function to load an input of a --narrow product: int8/int16 binary files are
+// mapped as they are, a forced type parses text and .mtx files straight into
+// it, everything else is read as int32 and narrowed by narrowOperands()
+static inline void loadNarrowMatrix(Matrix *matrix, int rows, int cols, const char *fileName, int mode, int flags,
+                                    int ioThreads) {
+    int type = probeBinaryMatrixType(fileName);
+    if (type == 0) {
+        type = narrowModeType(mode);
+    } else if (type != MATRIX_TYPE_INT8 && type != MATRIX_TYPE_INT16) {
+        type = MATRIX_TYPE_INT32;
+    }
+    loadTypedMatrix(matrix, rows, cols, type != 0 ? type : MATRIX_TYPE_INT32, fileName, flags, ioThreads);
+}
+
+// Function to bring A and B to the storage a --narrow mode asks for. Returns
+// the type both are in afterwards; int32 (auto only) means their values need
+// the int32 kernels, and any operand read narrow has been widened back.
+static inline int narrowOperands(Matrix *a, Matrix *b, int mode, int flags) {
+    MatrixRange rangeA = matrixRange(a), rangeB = matrixRange(b);
+    int type = narrowModeType(mode);
+    if (type == 0) {
+        type = chooseNarrowType(rangeA, rangeB);
+    } else if (!narrowTypeFits(type, rangeA, rangeB)) {
+        fprintf(stderr, "--narrow %s needs A in %s and B in %s, they are in %lld..%lld and %lld..%lld\n",
+                matrixTypeName(type), type == MATRIX_TYPE_INT8 ? "0..127" : "-32768..32767",
+                type == MATRIX_TYPE_INT8 ? "-128..127" : "-32768..32767", (long long) rangeA.min,
+                (long long) rangeA.max, (long long) rangeB.min, (long long) rangeB.max);
+        exit(EXIT_FAILURE);
+    }
+    if (a->type != type) convertIntegerMatrix(a, type, flags);
+    if (b->type != type) convertIntegerMatrix(b, type, flags);
+    return type;
+}
+
+// Function to get the 4 bytes of one k group of a row of A as a 32-bit lane
+static inline int32_t narrowGroup(const void *p) {
+    int32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// Scalar tile body, the fallback and the kernel for leftover rows and columns
+#define NARROW_TILE_BODY(ELEM)                                                                  \
+    const ELEM *a = ap, *b = bp;                                                                \
+    const int G = 4 / (int) sizeof(ELEM);                                                       \
+    for (int i = i0; i < i1; i++){                                                              \
+        int *cRow = c + (size_t) i * ldc;                                                       \
+        const ELEM *aRow = a + (size_t) i * lda;                                                \
+        for (int k = k0; k < k1; k += G){                                                       \
+            const ELEM *bg = b + (size_t) (k / G) * ldb;                                        \
+            for (int q = 0; q < G; q++){                                                        \
+                int aik = aRow[k + q];                                                          \
+                for (int j = j0; j < j1; j++){                                                  \
+                    cRow[j] += aik * bg[(size_t) j * G + q];                                    \
+                }                                                                               \
+            }                                                                                   \
+        }                                                                                       \
+    }
+
+static void multiplyNarrowTileInt8(const void *ap, int lda, const void *bp, int ldb, int *c, int ldc,
+                                   int i0, int i1, int j0, int j1, int k0, int k1) {
+    NARROW_TILE_BODY(int8_t)
+}
+
+static void multiplyNarrowTileInt16(const void *ap, int lda, const void *bp, int ldb, int *c, int ldc,
+                                    int i0, int i1, int j0, int j1, int k0, int k1) {
+    NARROW_TILE_BODY(int16_t)
+}
+
+#ifdef SIMD_X86
+
+// Panel kernel body: 4 rows x 2 vectors of C stay in registers, like
+// SIMD_PANEL_BODY, but each step takes a whole k group: one 32-bit broadcast
+// of A's group per row against the packed groups of W columns of B.
+// MAC(acc, a, b) adds the group dot products of a and b to the int32 lanes of acc.
+#define NARROW_PANEL_BODY(ELEM, VEC, LOAD, STORE, SET1, MAC, W, TAIL)                           \
+    const ELEM *a = ap, *b = bp;                                                                \
+    const int G = 4 / (int) sizeof(ELEM);                                                       \
+    int jEnd = j0 + (j1 - j0) / (2 * W) * (2 * W);                                              \
+    int iEnd = i0 + (i1 - i0) / SIMD_MR * SIMD_MR;                                              \
+    for (int j = j0; j < jEnd; j += 2 * W){                                                     \
+        for (int i = i0; i < iEnd; i += SIMD_MR){                                               \
+            int *c0 = c + (size_t) i * ldc + j;                                                 \
+            int *c1 = c0 + ldc, *c2 = c1 + ldc, *c3 = c2 + ldc;                                 \
+            VEC c00 = LOAD((const VEC *) c0), c01 = LOAD((const VEC *) (c0 + W));               \
+            VEC c10 = LOAD((const VEC *) c1), c11 = LOAD((const VEC *) (c1 + W));               \
+            VEC c20 = LOAD((const VEC *) c2), c21 = LOAD((const VEC *) (c2 + W));               \
+            VEC c30 = LOAD((const VEC *) c3), c31 = LOAD((const VEC *) (c3 + W));               \
+            const ELEM *a0 = a + (size_t) i * lda;                                              \
+            const ELEM *a1 = a0 + lda, *a2 = a1 + lda, *a3 = a2 + lda;                          \
+            const ELEM *bg = b + (size_t) (k0 / G) * ldb + (size_t) j * G;                      \
+            for (int k = k0; k < k1; k += G, bg += ldb){                                        \
+                VEC b0 = LOAD((const VEC *) bg), b1 = LOAD((const VEC *) (bg + W * G));         \
+                VEC av = SET1(narrowGroup(a0 + k));                                             \
+                c00 = MAC(c00, av, b0); c01 = MAC(c01, av, b1);                                 \
+                av = SET1(narrowGroup(a1 + k));                                                 \
+                c10 = MAC(c10, av, b0); c11 = MAC(c11, av, b1);                                 \
+                av = SET1(narrowGroup(a2 + k));                                                 \
+                c20 = MAC(c20, av, b0); c21 = MAC(c21, av, b1);                                 \
+                av = SET1(narrowGroup(a3 + k));                                                 \
+                c30 = MAC(c30, av, b0); c31 = MAC(c31, av, b1);                                 \
+            }                                                                                   \
+            STORE((VEC *) c0, c00); STORE((VEC *) (c0 + W), c01);                               \
+            STORE((VEC *) c1, c10); STORE((VEC *) (c1 + W), c11);                               \
+            STORE((VEC *) c2, c20); STORE((VEC *) (c2 + W), c21);                               \
+            STORE((VEC *) c3, c30); STORE((VEC *) (c3 + W), c31);                               \
+        }                                                                                       \
+    }                                                                                           \
+    /* Leftover rows and columns */                                                             \
+    if (iEnd < i1) TAIL(ap, lda, bp, ldb, c, ldc, iEnd, i1, j0, jEnd, k0, k1);                  \
+    if (jEnd < j1) TAIL(ap, lda, bp, ldb, c, ldc, i0, i1, jEnd, j1, k0, k1);
+
+// Group dot products per ISA: int8 goes through int16 pair sums (pmaddubsw),
+// widened and paired again by a pmaddwd against ones; VNNI does it in one instruction
+#define NARROW_MAC_INT8_SSE4(acc, x, y) \
+    _mm_add_epi32(acc, _mm_madd_epi16(_mm_maddubs_epi16(x, y), _mm_set1_epi16(1)))
+#define NARROW_MAC_INT16_SSE4(acc, x, y) _mm_add_epi32(acc, _mm_madd_epi16(x, y))
+#define NARROW_MAC_INT8_AVX2(acc, x, y) \
+    _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_maddubs_epi16(x, y), _mm256_set1_epi16(1)))
+#define NARROW_MAC_INT16_AVX2(acc, x, y) _mm256_add_epi32(acc, _mm256_madd_epi16(x, y))
+#define NARROW_MAC_INT8_AVX512(acc, x, y) \
+    _mm512_add_epi32(acc, _mm512_madd_epi16(_mm512_maddubs_epi16(x, y), _mm512_set1_epi16(1)))
+#define NARROW_MAC_INT16_AVX512(acc, x, y) _mm512_add_epi32(acc, _mm512_madd_epi16(x, y))
+#define NARROW_MAC_INT8_VNNI(acc, x, y) _mm512_dpbusd_epi32(acc, x, y)
+#define NARROW_MAC_INT16_VNNI(acc, x, y) _mm512_dpwssd_epi32(acc, x, y)
+
+// SSE4: pmaddubsw is SSSE3, pmaddwd SSE2; 4 columns per vector
+__attribute__((target("sse4.1")))
+static void multiplyNarrowInt8Sse4(const void *ap, int lda, const void *bp, int ldb, int *c, int ldc,
+                                   int i0, int i1, int j0, int j1, int k0, int k1) {
+    NARROW_PANEL_BODY(int8_t, __m128i, _mm_loadu_si128, _mm_storeu_si128, _mm_set1_epi32,
+                      NARROW_MAC_INT8_SSE4, 4, multiplyNarrowTileInt8)
+}
+
+__attribute__((target("sse4.1")))
+static void multiplyNarrowInt16Sse4(const void *ap, int lda, const void *bp, int ldb, int *c, int ldc,
+                                    int i0, int i1, int j0, int j1, int k0, int k1) {
+    NARROW_PANEL_BODY(int16_t, __m128i, _mm_loadu_si128, _mm_storeu_si128, _mm_set1_epi32,
+                      NARROW_MAC_INT16_SSE4, 4, multiplyNarrowTileInt16)
+}
+
+// AVX2: 8 columns per vector
+__attribute__((target("avx2")))
+static void multiplyNarrowInt8Avx2(const void *ap, int lda, const void *bp, int ldb, int *c, int ldc,
+                                   int i0, int i1, int j0, int j1, int k0, int k1) {
+    NARROW_PANEL_BODY(int8_t, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_set1_epi32,
+                      NARROW_MAC_INT8_AVX2, 8, multiplyNarrowTileInt8)
+}
+
+__attribute__((target("avx2")))
+static void multiplyNarrowInt16Avx2(const void *ap, int lda, const void *bp, int ldb, int *c, int ldc,
+                                    int i0, int i1, int j0, int j1, int k0, int k1) {
+    NARROW_PANEL_BODY(int16_t, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_set1_epi32,
+                      NARROW_MAC_INT16_AVX2, 8, multiplyNarrowTileInt16)
+}
+
+// AVX-512BW: 16 columns per vector
+__attribute__((target("avx512f,avx512bw")))
+static void multiplyNarrowInt8Avx512(const void *ap, int lda, const void *bp, int ldb, int *c, int ldc,
+                                     int i0, int i1, int j0, int j1, int k0, int k1) {
+    NARROW_PANEL_BODY(int8_t, __m512i, _mm512_loadu_si512, _mm512_storeu_si512, _mm512_set1_epi32,
+                      NARROW_MAC_INT8_AVX512, 16, multiplyNarrowTileInt8)
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void multiplyNarrowInt16Avx512(const void *ap, int lda, const void *bp, int ldb, int *c, int ldc,
+                                      int i0, int i1, int j0, int j1, int k0, int k1) {
+    NARROW_PANEL_BODY(int16_t, __m512i, _mm512_loadu_si512, _mm512_storeu_si512, _mm512_set1_epi32,
+                      NARROW_MAC_INT16_AVX512, 16, multiplyNarrowTileInt16)
+}
+
+// AVX-512 VNNI: one vpdpbusd / vpdpwssd per group
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static void multiplyNarrowInt8Vnni(const void *ap, int lda, const void *bp, int ldb, int *c, int ldc,
+                                   int i0, int i1, int j0, int j1, int k0, int k1) {
+    NARROW_PANEL_BODY(int8_t, __m512i, _mm512_loadu_si512, _mm512_storeu_si512, _mm512_set1_epi32,
+                      NARROW_MAC_INT8_VNNI, 16, multiplyNarrowTileInt8)
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static void multiplyNarrowInt16Vnni(const void *ap, int lda, const void *bp, int ldb, int *c, int ldc,
+                                    int i0, int i1, int j0, int j1, int k0, int k1) {
+    NARROW_PANEL_BODY(int16_t, __m512i, _mm512_loadu_si512, _mm512_storeu_si512, _mm512_set1_epi32,
+                      NARROW_MAC_INT16_VNNI, 16, multiplyNarrowTileInt16)
+}
+
+#endif
+
+// Function to get the narrow kernel of one type and ISA ("scalar", "sse4",
+// "avx2", "avx512", "avx512vnni"). Returns NULL if the CPU cannot run it.
+static inline NarrowKernel getNarrowKernel(int type, const char *isa) {
+    int int8 = type == MATRIX_TYPE_INT8;
+    if (strcmp(isa, "scalar") == 0) {
+        return int8 ? multiplyNarrowTileInt8 : multiplyNarrowTileInt16;
+    }
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (strcmp(isa, "sse4") == 0 && __builtin_cpu_supports("sse4.1")) {
+        return int8 ? multiplyNarrowInt8Sse4 : multiplyNarrowInt16Sse4;
+    }
+    if (strcmp(isa, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        return int8 ? multiplyNarrowInt8Avx2 : multiplyNarrowInt16Avx2;
+    }
+    if (strcmp(isa, "avx512") == 0 && __builtin_cpu_supports("avx512bw")) {
+        return int8 ? multiplyNarrowInt8Avx512 : multiplyNarrowInt16Avx512;
+    }
+    if (strcmp(isa, "avx512vnni") == 0 && __builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512vnni")) {
+        return int8 ? multiplyNarrowInt8Vnni : multiplyNarrowInt16Vnni;
+    }
+#endif
+    return NULL;
+}
+
+// Function to create the plan of a narrow product of A and B (both in the
+// narrow type) and pick its kernel: scalar without --simd, otherwise the
+// widest ISA available, starting from the --isa one if given (its VNNI
+// variant first for avx512, and narrower ones when the CPU lacks AVX-512BW).
+// The packed B is allocated here and filled by narrowPackBand().
+static inline NarrowPlan createNarrowPlan(Matrix *a, const Matrix *b, const TileSizes *tiles, int useSimd,
+                                          const char *requestedIsa, int flags) {
+    NarrowPlan plan;
+    plan.type = a->type;
+    plan.group = a->type == MATRIX_TYPE_INT8 ? 4 : 2;
+    plan.depth = (a->cols + plan.group - 1) / plan.group * plan.group;
+    plan.a = a;
+    plan.b = b;
+
+    // A's groups past its last column must read as 0: a file mapped with a
+    // tight stride is copied, otherwise the padding is cleared in place
+    if (a->stride < plan.depth) {
+        convertIntegerMatrix(a, a->type, flags);
+    }
+    for (int i = 0; i < a->rows; i++){
+        char *row = matrixRowAt(a, i);
+        memset(row + (size_t) a->cols * a->elemSize, 0, (size_t) (plan.depth - a->cols) * a->elemSize);
+    }
+
+    plan.packed = allocateTypedMatrix(plan.depth / plan.group, b->cols * plan.group, plan.type,
+                                      flags | MATRIX_POPULATE);
+    int sizes[3] = { tiles->l1, tiles->l2, tiles->l3 };
+    for (int l = 0; l < 3; l++) {
+        plan.edges[l] = (sizes[l] + plan.group - 1) / plan.group * plan.group;
+    }
+
+    const char *order[] = { "avx512vnni", "avx512", "avx2", "sse4", "scalar" };
+    int first = 0;
+    if (!useSimd) {
+        first = 4;
+    } else if (requestedIsa != NULL && requestedIsa[0] != '\0') {
+        while (first < 4 && strstr(order[first], requestedIsa) != order[first]) {
+            first++;
+        }
+    }
+    for (int i = first; i < 5; i++) {
+        plan.kernel = getNarrowKernel(plan.type, order[i]);
+        if (plan.kernel != NULL) {
+            plan.isa = order[i];
+            break;
+        }
+    }
+    return plan;
+}
+
+// Function to count the pack tasks of a plan
+static inline int narrowBandCount(const NarrowPlan *plan) {
+    return (plan->packed.rows + NARROW_PACK_GROUPS - 1) / NARROW_PACK_GROUPS;
+}
+
+// Function to pack the group rows of one band of B: packed[g][j * G + q] = B[g * G + q][j]
+static inline void narrowPackBand(NarrowPlan *plan, int band) {
+    const Matrix *b = plan->b;
+    int G = plan->group, n = b->cols;
+    int g1 = minInt((band + 1) * NARROW_PACK_GROUPS, plan->packed.rows);
+    for (int g = band * NARROW_PACK_GROUPS; g < g1; g++){
+        char *dst = matrixRowAt(&plan->packed, g);
+        for (int q = 0; q < G; q++){
+            int k = g * G + q;
+            if (plan->type == MATRIX_TYPE_INT8) {
+                int8_t *out = (int8_t *) dst + q;
+                const int8_t *in = k < b->rows ? matrixRowAt(b, k) : NULL;
+                for (int j = 0; j < n; j++){
+                    out[(size_t) j * G] = in != NULL ? in[j] : 0;
+                }
+            } else {
+                int16_t *out = (int16_t *) dst + q;
+                const int16_t *in = k < b->rows ? matrixRowAt(b, k) : NULL;
+                for (int j = 0; j < n; j++){
+                    out[(size_t) j * G] = in != NULL ? in[j] : 0;
+                }
+            }
+        }
+    }
+}
+
+// Function to walk the L3/L2/L1 tiles of one block, like multiplyBlockedLevel in blocked.h
+static inline void multiplyNarrowLevel(const NarrowPlan *plan, int *c, int ldc, int level,
+                                       int i0, int i1, int j0, int j1, int k0, int k1) {
+    if (level < 0) {
+        plan->kernel(plan->a->data, plan->a->stride, plan->packed.data, plan->packed.stride, c, ldc,
+                     i0, i1, j0, j1, k0, k1);
+        return;
+    }
+    int t = plan->edges[level];
+    for (int ii = i0; ii < i1; ii += t){
+        int iEnd = minInt(ii + t, i1);
+        for (int kk = k0; kk < k1; kk += t){
+            int kEnd = minInt(kk + t, k1);
+            for (int jj = j0; jj < j1; jj += t){
+                int jEnd = minInt(jj + t, j1);
+                multiplyNarrowLevel(plan, c, ldc, level - 1, ii, iEnd, jj, jEnd, kk, kEnd);
+            }
+        }
+    }
+}
+
+// Function to compute the block [startRow, endRow) x [startCol, endCol) of
+// the int32 result, which must be initialized to 0, once B is packed
+static inline void multiplyNarrowRange(const NarrowPlan *plan, Matrix *resultMatrix,
+                                       int startRow, int endRow, int startCol, int endCol) {
+    multiplyNarrowLevel(plan, resultMatrix->data, resultMatrix->stride, 2,
+                        startRow, endRow, startCol, endCol, 0, plan->depth);
+}
+
+// Function to free the packed B of a plan
+static inline void freeNarrowPlan(NarrowPlan *plan) {
+    freeMatrix(&plan->packed);
+}
+
+#endif
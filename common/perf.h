@@ -0,0 +1,207 @@
+#ifndef PERF_H
+#define PERF_H
+
+// Hardware performance counters for --perf.
+//
+// Every worker (thread, child process, or the main thread of the sequential
+// backend) opens one perf_event_open group on itself before timing starts.
+// The group is enabled only while the worker runs its part of the timed
+// region and read with PERF_FORMAT_GROUP, so the counts are consistent with
+// each other; when the PMU multiplexes, the values are scaled by
+// time_enabled / time_running. Events the host does not support (e.g. no
+// PMU inside a VM) are left out and reported as null. Per-worker wall
+// times come with the counters and expose load imbalance between workers.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define PERF_NUM_EVENTS 7
+
+typedef struct {
+    const char *name;   // Key in the JSON line
+    uint32_t type;
+    uint64_t config;
+} PerfEventSpec;
+
+// The first event that opens becomes the group leader. task-clock goes first:
+// it is a software event, so the group exists even without a PMU.
+static const PerfEventSpec perfEvents[PERF_NUM_EVENTS] = {
+    { "task_clock_ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+    { "page_faults",   PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+    { "cycles",        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "llc_misses",    PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { "l1d_misses",    PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                                           (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { "dtlb_misses",   PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                                           (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+};
+
+// Counter group of one worker. Plain data, so it can live in shared memory.
+typedef struct {
+    int fds[PERF_NUM_EVENTS];       // -1 for events that could not be opened
+    int leader;                     // fd of the group leader, -1 if nothing opened
+    unsigned int events;            // Bit e set when perfEvents[e] is counted (kept after perfClose)
+    uint64_t values[PERF_NUM_EVENTS];
+    double seconds;                 // Wall time the group was enabled
+    struct timespec started;
+} PerfCounters;
+
+// Function to open the counter group of the calling thread (disabled, user space
+// only). The totals are kept, so they must start zeroed (calloc or a fresh mapping).
+static inline void perfOpen(PerfCounters *counters) {
+    counters->leader = -1;
+    counters->events = 0;
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = perfEvents[e].type;
+        attr.config = perfEvents[e].config;
+        attr.disabled = counters->leader < 0;  // Members follow the leader
+        attr.exclude_kernel = 1;  // Allowed with perf_event_paranoid <= 2
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        counters->fds[e] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, counters->leader, 0);
+        if (counters->fds[e] >= 0) {
+            if (counters->leader < 0) {
+                counters->leader = counters->fds[e];
+            }
+            counters->events |= 1u << e;
+        }
+    }
+}
+
+// Function to reset and enable the group and start the worker's clock
+// (counters may be NULL when --perf is off)
+static inline void perfStart(PerfCounters *counters) {
+    if (counters == NULL) {
+        return;
+    }
+    if (counters->leader >= 0) {
+        ioctl(counters->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(counters->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &counters->started);
+}
+
+// Function to disable the group and add its counts and the elapsed time to the totals
+static inline void perfStop(PerfCounters *counters) {
+    if (counters == NULL) {
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    counters->seconds += (now.tv_sec - counters->started.tv_sec) + (now.tv_nsec - counters->started.tv_nsec) / 1e9;
+    if (counters->leader < 0) {
+        return;
+    }
+    ioctl(counters->leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    uint64_t buffer[3 + PERF_NUM_EVENTS];  // nr, time_enabled, time_running, values
+    if (read(counters->leader, buffer, sizeof(buffer)) < (ssize_t) (3 * sizeof(uint64_t))) {
+        return;
+    }
+    double scale = buffer[2] > 0 ? (double) buffer[1] / buffer[2] : 1.0;
+    for (int e = 0, v = 0; e < PERF_NUM_EVENTS && v < (int) buffer[0]; e++) {
+        if (counters->fds[e] >= 0) {
+            counters->values[e] += (uint64_t) (buffer[3 + v++] * scale);
+        }
+    }
+}
+
+// Function to close the group
+static inline void perfClose(PerfCounters *counters) {
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        if (counters->fds[e] >= 0) {
+            close(counters->fds[e]);
+            counters->fds[e] = -1;
+        }
+    }
+    counters->leader = -1;
+}
+
+// Pool job hooks (threadPoolSetHook(), processPoolSetHook()); context is the
+// PerfCounters array indexed by worker. perfOpenHook opens the group of each
+// worker on its own thread or process, perfCountHook counts while it works.
+static inline void perfOpenHook(void *context, int worker, int starting) {
+    if (starting) {
+        perfOpen(&((PerfCounters *) context)[worker]);
+    }
+}
+
+static inline void perfCountHook(void *context, int worker, int starting) {
+    if (starting) {
+        perfStart(&((PerfCounters *) context)[worker]);
+    } else {
+        perfStop(&((PerfCounters *) context)[worker]);
+    }
+}
+
+// Task that does nothing: a job of one such task runs the hooks on every pool worker
+static inline void perfNoopTask(void *arg, int task) {
+    (void) arg;
+    (void) task;
+}
+
+// Function to print the counts of a worker (or the totals) as JSON fields
+static inline void perfPrintFields(const PerfCounters *counters, const int *available) {
+    printf("\"time\":%.9f", counters->seconds);
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        if (available[e]) {
+            printf(",\"%s\":%llu", perfEvents[e].name, (unsigned long long) counters->values[e]);
+        } else {
+            printf(",\"%s\":null", perfEvents[e].name);
+        }
+    }
+    // IPC from cycles (2) and instructions (3)
+    if (available[2] && available[3] && counters->values[2] > 0) {
+        printf(",\"ipc\":%.3f", (double) counters->values[3] / counters->values[2]);
+    } else {
+        printf(",\"ipc\":null");
+    }
+}
+
+// Function to print one JSON line with the counters of every worker, their
+// sum and the load imbalance (slowest worker time / mean worker time)
+static inline void perfReport(const char *backend, const PerfCounters *workers, int numWorkers, double computeTime) {
+    int available[PERF_NUM_EVENTS];
+    PerfCounters total;
+    memset(&total, 0, sizeof(total));
+    double slowest = 0;
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        available[e] = numWorkers > 0;
+        for (int w = 0; w < numWorkers; w++) {
+            available[e] &= (workers[w].events >> e) & 1;
+        }
+    }
+    for (int w = 0; w < numWorkers; w++) {
+        for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+            total.values[e] += workers[w].values[e];
+        }
+        total.seconds += workers[w].seconds;
+        slowest = workers[w].seconds > slowest ? workers[w].seconds : slowest;
+    }
+    double mean = numWorkers > 0 ? total.seconds / numWorkers : 0;
+
+    printf("Perf: {\"backend\":\"%s\",\"compute_time\":%.9f,\"imbalance\":%.3f,\"total\":{",
+           backend, computeTime, mean > 0 ? slowest / mean : 1.0);
+    perfPrintFields(&total, available);
+    printf("},\"workers\":[");
+    for (int w = 0; w < numWorkers; w++) {
+        printf("%s{\"id\":%d,", w > 0 ? "," : "", w);
+        perfPrintFields(&workers[w], available);
+        printf("}");
+    }
+    printf("]}\n");
+}
+
+#endif
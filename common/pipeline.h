@@ -0,0 +1,395 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+// Pipelined load, multiply and store (--pipeline).
+//
+// The one-shot flow reads A, reads B, multiplies and only then writes C, so
+// the disk idles while the cores compute and the other way round. Here A is
+// loaded first (every panel of C needs its rows), then three stages overlap:
+//   - a reader thread parses B in chunks and publishes how many of its rows
+//     are in place (binary files are mapped in place, .mtx files are read
+//     whole, so only text B actually arrives piece by piece);
+//   - the caller computes C in panels of PIPELINE_PANEL_ROWS rows, each panel
+//     applying the blocks of PIPELINE_BLOCK_ROWS rows of B in order. A step
+//     whose block of B has not arrived yet gives way to the first panel that
+//     can advance, so compute starts with the first block of B and never
+//     idles while some panel has work; lower panels always go first, so the
+//     panels still finish in order;
+//   - every finished panel is queued in a bounded ring of PIPELINE_RING
+//     slots for a writer thread, which formats and appends the queued rows to
+//     the result file while later panels compute. A full ring makes compute
+//     wait, so the writer can never fall arbitrarily far behind.
+// The tasks of one step (column tiles of the panel) run through a backend
+// callback, like the sparse kernels; without one they run in order.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "matrix.h"
+#include "matrix_io.h"
+#include "blocked.h"
+
+#define PIPELINE_PANEL_ROWS 128         // Rows of C per panel, the unit handed to the writer
+#define PIPELINE_BLOCK_ROWS 128         // Rows of B per step, the unit of overlap with loading
+#define PIPELINE_RING       8           // Finished panels queued for the writer
+#define PIPELINE_TEXT_CHUNK (1 << 20)   // Bytes of text B parsed by one thread at a time
+
+typedef struct {
+    double loadATime;       // Loading A, before anything else
+    double loadBTime;       // From the start of compute until the last row of B was in place
+    double computeTime;     // From the start of compute until the last panel was done
+    double waitTime;        // Compute waiting for B
+    double stallTime;       // Compute waiting for room in the ring
+    double writeTime;       // Writer busy formatting and writing
+    double totalTime;       // End to end: loading A until the last row of C was written
+} PipelineStats;
+
+struct PipelinePlan;
+
+// Callback that runs tasks 0 .. count-1 of the current step, each through
+// pipelineRunTask(); tasks of one step are independent
+typedef void (*PipelineRunTasks)(void *context, struct PipelinePlan *plan, int count);
+
+typedef struct PipelinePlan {
+    int n;
+    Matrix a, b, c;
+    const char *fileA, *fileB;
+    const char *fileResult;     // NULL to keep C in memory only
+    int ioThreads;
+    const TileSizes *tiles;
+    TileKernel kernel;
+    int numPanels;
+    int numBlocks;
+    int *applied;               // Blocks of B applied to each panel so far
+    int stepPanel;              // Current step: panel of C and block of B
+    int stepBlock;
+    int tileEdge;               // Columns per task
+    int numTasks;
+    pthread_mutex_t lock;       // Protects the fields below
+    pthread_cond_t changed;     // Rows of B arrived, a panel was queued or written
+    int rowsLoaded;             // Rows of B in place
+    int ring[PIPELINE_RING];    // Finished panels waiting for the writer
+    int ringHead;
+    int ringCount;
+    int computeDone;
+    struct timespec start;      // Start of compute (and of loading B)
+    double loadBTime;
+    double writeTime;
+    PipelineRunTasks run;
+    void *context;
+} PipelinePlan;
+
+static inline double pipelineSince(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Function to create the plan of an n x n pipelined product of two files.
+// fileResult may be NULL to skip writing C; run may be NULL to run every task
+// on the calling thread.
+static inline PipelinePlan *createPipeline(const char *fileA, const char *fileB, const char *fileResult, int n,
+                                           int ioThreads, const TileSizes *tiles, TileKernel kernel,
+                                           PipelineRunTasks run, void *context) {
+    PipelinePlan *plan = calloc(1, sizeof(PipelinePlan));
+    if (plan == NULL) {
+        printf("Error in memory allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+    plan->n = n;
+    plan->fileA = fileA;
+    plan->fileB = fileB;
+    plan->fileResult = fileResult;
+    plan->ioThreads = ioThreads > 0 ? ioThreads : 1;
+    plan->tiles = tiles;
+    plan->kernel = kernel != NULL ? kernel : multiplyTile;
+    plan->numPanels = (n + PIPELINE_PANEL_ROWS - 1) / PIPELINE_PANEL_ROWS;
+    plan->numBlocks = (n + PIPELINE_BLOCK_ROWS - 1) / PIPELINE_BLOCK_ROWS;
+    plan->tileEdge = tiles->l2;
+    plan->numTasks = (n + plan->tileEdge - 1) / plan->tileEdge;
+    plan->applied = calloc(plan->numPanels > 0 ? plan->numPanels : 1, sizeof(int));
+    if (plan->applied == NULL) {
+        printf("Error in memory allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+    plan->run = run;
+    plan->context = context;
+    pthread_mutex_init(&plan->lock, NULL);
+    pthread_cond_init(&plan->changed, NULL);
+    // C is accumulated block by block into fresh (zero) pages
+    plan->c = allocateMatrix(n, n, MATRIX_POPULATE);
+    return plan;
+}
+
+// Function to publish that the first rows of B are in place
+static inline void pipelinePublishRows(PipelinePlan *plan, int rows) {
+    pthread_mutex_lock(&plan->lock);
+    plan->rowsLoaded = rows;
+    if (rows == plan->n) {
+        plan->loadBTime = pipelineSince(&plan->start);
+    }
+    pthread_cond_broadcast(&plan->changed);
+    pthread_mutex_unlock(&plan->lock);
+}
+
+// Reader thread: text B is parsed ioThreads chunks at a time (count, then
+// parse, as readMatrixFromFile() does) and its complete rows published after
+// every group; other formats are loaded whole
+static inline void *pipelineReadB(void *arg) {
+    PipelinePlan *plan = (PipelinePlan *) arg;
+    int n = plan->n;
+    if (isMatrixMarketFileName(plan->fileB) || isBinaryMatrixFile(plan->fileB)) {
+        loadMatrix(&plan->b, n, n, plan->fileB, 0, plan->ioThreads);
+        pipelinePublishRows(plan, n);
+        return NULL;
+    }
+    plan->b = allocateMatrix(n, n, 0);
+    int fd = open(plan->fileB, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "Cannot open file %s\n", plan->fileB);
+        exit(EXIT_FAILURE);
+    }
+    size_t size = (size_t) st.st_size;
+    size_t total = (size_t) n * n;
+    const char *text = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    if (text == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+#ifdef MADV_SEQUENTIAL
+    if (text != NULL) {
+        madvise((void *) text, size, MADV_SEQUENTIAL);
+    }
+#endif
+    const char *p = text, *end = text + size;
+    size_t found = 0;
+    TextChunk chunks[plan->ioThreads];
+    while (p < end && found < total) {
+        // The next ioThreads chunks, each ending right after a newline
+        int numChunks = 0;
+        while (numChunks < plan->ioThreads && p < end) {
+            const char *chunkEnd = size - (size_t) (p - text) > PIPELINE_TEXT_CHUNK ? p + PIPELINE_TEXT_CHUNK : end;
+            while (chunkEnd < end && chunkEnd[-1] != '\n') chunkEnd++;
+            chunks[numChunks++] = (TextChunk) { p, chunkEnd, 0, 0, &plan->b, 0, 0 };
+            p = chunkEnd;
+        }
+        runTextJobs(scanTextChunk, chunks, sizeof(TextChunk), numChunks);
+        for (int t = 0; t < numChunks; t++) {
+            chunks[t].firstIndex = found;
+            chunks[t].parse = 1;
+            found += chunks[t].count;
+        }
+        runTextJobs(scanTextChunk, chunks, sizeof(TextChunk), numChunks);
+        for (int t = 0; t < numChunks; t++) {
+            if (chunks[t].error) {
+                fprintf(stderr, "Error reading file %s.\n", plan->fileB);
+                exit(EXIT_FAILURE);
+            }
+        }
+        pipelinePublishRows(plan, (int) ((found < total ? found : total) / (n > 0 ? n : 1)));
+    }
+    if (found < total) {
+        fprintf(stderr, "Error reading file %s.\n", plan->fileB);
+        exit(EXIT_FAILURE);
+    }
+    if (text != NULL) {
+        munmap((void *) text, size);
+    }
+    if (n == 0) {
+        pipelinePublishRows(plan, 0);
+    }
+    return NULL;
+}
+
+// Writer thread: appends the queued panels to the result file as one block of
+// rows, text or binary. The last panels, queued after compute has finished,
+// are formatted with every I/O thread. A .mtx result needs its entry count up
+// front and is written whole at the end.
+static inline void *pipelineWriteC(void *arg) {
+    PipelinePlan *plan = (PipelinePlan *) arg;
+    int n = plan->n;
+    int marketFormat = isMatrixMarketFileName(plan->fileResult);
+    int binary = isBinaryFileName(plan->fileResult);
+    int fd = -1;
+    if (!marketFormat) {
+        fd = open(plan->fileResult, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            fprintf(stderr, "Cannot open file %s for writing\n", plan->fileResult);
+            exit(EXIT_FAILURE);
+        }
+        if (binary) {
+            writeBinaryMatrixHeader(fd, plan->fileResult, n, n, plan->c.stride, MATRIX_TYPE_INT32);
+        }
+    }
+    for (;;) {
+        pthread_mutex_lock(&plan->lock);
+        while (plan->ringCount == 0 && !plan->computeDone) {
+            pthread_cond_wait(&plan->changed, &plan->lock);
+        }
+        int count = plan->ringCount, first = plan->ring[plan->ringHead];
+        int finished = plan->computeDone;
+        pthread_mutex_unlock(&plan->lock);
+        if (count == 0) {
+            break;
+        }
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (!marketFormat) {
+            // Queued panels are consecutive, so they are one block of rows
+            int row0 = first * PIPELINE_PANEL_ROWS;
+            int row1 = minInt((first + count) * PIPELINE_PANEL_ROWS, n);
+            Matrix rows = matrixView(&plan->c, row0, 0, row1 - row0, n);
+            if (binary) {
+                pwriteAll(fd, rows.data, (size_t) rows.rows * rows.stride * sizeof(int),
+                          BINARY_MATRIX_DATA_OFFSET + (off_t) row0 * rows.stride * sizeof(int), plan->fileResult);
+            } else {
+                writeTextRows(fd, &rows, finished ? plan->ioThreads : 1, plan->fileResult);
+            }
+        }
+        double seconds = pipelineSince(&start);
+
+        pthread_mutex_lock(&plan->lock);
+        plan->writeTime += seconds;
+        plan->ringHead = (plan->ringHead + count) % PIPELINE_RING;
+        plan->ringCount -= count;
+        pthread_cond_broadcast(&plan->changed);
+        pthread_mutex_unlock(&plan->lock);
+    }
+    if (marketFormat) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        writeMatrixMarket(&plan->c, plan->fileResult);
+        plan->writeTime += pipelineSince(&start);
+    } else if (close(fd) != 0) {
+        fprintf(stderr, "Error writing file %s.\n", plan->fileResult);
+        exit(EXIT_FAILURE);
+    }
+    return NULL;
+}
+
+// Function to run one task (one column tile of the current panel and block of B)
+static inline void pipelineRunTask(const PipelinePlan *plan, int task) {
+    int i0 = plan->stepPanel * PIPELINE_PANEL_ROWS, i1 = minInt(i0 + PIPELINE_PANEL_ROWS, plan->n);
+    int k0 = plan->stepBlock * PIPELINE_BLOCK_ROWS, k1 = minInt(k0 + PIPELINE_BLOCK_ROWS, plan->n);
+    int j0 = task * plan->tileEdge, j1 = minInt(j0 + plan->tileEdge, plan->n);
+    int edges[3] = { plan->tiles->l1, plan->tiles->l2, plan->tiles->l3 };
+    multiplyBlockedLevel(plan->a.data, plan->a.stride, plan->b.data, plan->b.stride, plan->c.data, plan->c.stride,
+                         plan->kernel, edges, 2, i0, i1, j0, j1, k0, k1);
+}
+
+// Function to load A, then multiply while B is loaded and C is written
+static inline void pipelineMultiply(PipelinePlan *plan, PipelineStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    struct timespec begin;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    loadMatrix(&plan->a, plan->n, plan->n, plan->fileA, 0, plan->ioThreads);
+    stats->loadATime = pipelineSince(&begin);
+
+    clock_gettime(CLOCK_MONOTONIC, &plan->start);
+    pthread_t reader, writer;
+    if (pthread_create(&reader, NULL, pipelineReadB, plan) != 0 ||
+        (plan->fileResult != NULL && pthread_create(&writer, NULL, pipelineWriteC, plan) != 0)) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+    int firstOpen = 0;  // Lowest panel that is not finished
+    while (firstOpen < plan->numPanels) {
+        // The lowest panel whose next block of B is in place
+        pthread_mutex_lock(&plan->lock);
+        int panel = -1;
+        for (;;) {
+            for (int p = firstOpen; p < plan->numPanels; p++) {
+                int blockEnd = minInt((plan->applied[p] + 1) * PIPELINE_BLOCK_ROWS, plan->n);
+                if (plan->applied[p] < plan->numBlocks && blockEnd <= plan->rowsLoaded) {
+                    panel = p;
+                    break;
+                }
+            }
+            if (panel >= 0) {
+                break;
+            }
+            struct timespec start;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            pthread_cond_wait(&plan->changed, &plan->lock);
+            stats->waitTime += pipelineSince(&start);
+        }
+        pthread_mutex_unlock(&plan->lock);
+
+        plan->stepPanel = panel;
+        plan->stepBlock = plan->applied[panel];
+        if (plan->run != NULL) {
+            plan->run(plan->context, plan, plan->numTasks);
+        } else {
+            for (int t = 0; t < plan->numTasks; t++) {
+                pipelineRunTask(plan, t);
+            }
+        }
+        if (++plan->applied[panel] < plan->numBlocks) {
+            continue;
+        }
+
+        // Panel done (always the lowest open one): queue it for the writer
+        firstOpen++;
+        if (plan->fileResult != NULL) {
+            pthread_mutex_lock(&plan->lock);
+            struct timespec start;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            while (plan->ringCount == PIPELINE_RING) {
+                pthread_cond_wait(&plan->changed, &plan->lock);
+            }
+            stats->stallTime += pipelineSince(&start);
+            plan->ring[(plan->ringHead + plan->ringCount) % PIPELINE_RING] = panel;
+            plan->ringCount++;
+            pthread_cond_broadcast(&plan->changed);
+            pthread_mutex_unlock(&plan->lock);
+        }
+    }
+    stats->computeTime = pipelineSince(&plan->start);
+
+    pthread_mutex_lock(&plan->lock);
+    plan->computeDone = 1;
+    pthread_cond_broadcast(&plan->changed);
+    pthread_mutex_unlock(&plan->lock);
+    pthread_join(reader, NULL);
+    if (plan->fileResult != NULL) {
+        pthread_join(writer, NULL);
+    }
+    stats->loadBTime = plan->loadBTime;
+    stats->writeTime = plan->writeTime;
+    stats->totalTime = pipelineSince(&begin);
+}
+
+// Function to print where the time of a pipelined product went
+static inline void printPipelineStats(const PipelinePlan *plan, const PipelineStats *stats) {
+    printf("Pipeline: %d panel(s) of %d rows, blocks of %d rows of B, ring of %d\n", plan->numPanels,
+           PIPELINE_PANEL_ROWS, PIPELINE_BLOCK_ROWS, PIPELINE_RING);
+    printf("Load A time: %.9f seconds\n", stats->loadATime);
+    printf("Load B time: %.9f seconds (overlapped, compute waited %.9f seconds)\n", stats->loadBTime,
+           stats->waitTime);
+    if (plan->fileResult != NULL) {
+        printf("Write C time: %.9f seconds (overlapped, compute waited %.9f seconds for the ring)\n",
+               stats->writeTime, stats->stallTime);
+    }
+}
+
+// Function to free the matrices of a pipeline plan
+static inline void freePipeline(PipelinePlan *plan) {
+    freeMatrix(&plan->a);
+    freeMatrix(&plan->b);
+    freeMatrix(&plan->c);
+    pthread_mutex_destroy(&plan->lock);
+    pthread_cond_destroy(&plan->changed);
+    free(plan->applied);
+    free(plan);
+}
+
+#endif
@@ -0,0 +1,182 @@
+#ifndef PROCESS_POOL_H
+#define PROCESS_POOL_H
+
+// Pre-forked process pool with a job queue in shared memory.
+//
+// The workers are forked once and survive across jobs, so repeated
+// multiplications pay no fork or page-table copy. They are forked after the
+// shared matrices are mapped and inherit those mappings; everything a task
+// reads must therefore be in MAP_SHARED memory or set up before the pool is
+// created. A job is a task function plus a count: the parent publishes it in
+// the shared control block and bumps the generation futex, the workers claim
+// task indices with an atomic fetch-add on the queue head (no lock), and the
+// last worker to finish wakes the parent through the completion futex.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+typedef void (*ProcessTaskFunc)(void *arg, int task);
+
+// Control block shared by the parent and every worker
+typedef struct {
+    int generation;         // Futex: bumped by the parent to start a job
+    int remaining;          // Futex: workers that have not finished the current job
+    int nextTask;           // Head of the task queue, claimed with fetch-add
+    char padding[64];       // Keep the hot queue head away from the job description
+    int numTasks;
+    int quit;
+    ProcessTaskFunc run;    // Same address in every worker (forked from one image)
+    void *arg;              // Must point to memory the workers can see
+    void (*jobHook)(void *context, int worker, int starting);  // Optional, see processPoolSetHook()
+    void *hookContext;      // Shared memory as well
+} ProcessPoolShared;
+
+typedef struct {
+    int numWorkers;
+    pid_t *pids;
+    ProcessPoolShared *shared;
+} ProcessPool;
+
+// Index of the worker running in this process, -1 in the parent
+static int processPoolWorkerId = -1;
+
+// Function to call futex() on a word of shared memory (no FUTEX_PRIVATE_FLAG:
+// the waiters are separate processes)
+static inline long processPoolFutex(int *word, int op, int value, const struct timespec *timeout) {
+    return syscall(SYS_futex, word, op, value, timeout, NULL, 0);
+}
+
+// Function run by every worker until the pool is destroyed
+static inline void processPoolWorkerMain(ProcessPoolShared *shared) {
+    int seen = 0;
+    for (;;) {
+        int generation;
+        while ((generation = __atomic_load_n(&shared->generation, __ATOMIC_ACQUIRE)) == seen) {
+            processPoolFutex(&shared->generation, FUTEX_WAIT, seen, NULL);
+        }
+        seen = generation;
+        if (shared->quit) {
+            _exit(EXIT_SUCCESS);
+        }
+        if (shared->jobHook != NULL) {
+            shared->jobHook(shared->hookContext, processPoolWorkerId, 1);
+        }
+        for (;;) {
+            int task = __atomic_fetch_add(&shared->nextTask, 1, __ATOMIC_RELAXED);
+            if (task >= shared->numTasks) {
+                break;
+            }
+            shared->run(shared->arg, task);
+        }
+        if (shared->jobHook != NULL) {
+            shared->jobHook(shared->hookContext, processPoolWorkerId, 0);
+        }
+        if (__atomic_sub_fetch(&shared->remaining, 1, __ATOMIC_ACQ_REL) == 0) {
+            processPoolFutex(&shared->remaining, FUTEX_WAKE, 1, NULL);
+        }
+    }
+}
+
+// Function to fork numWorkers workers, worker w pinned to cpus[w]
+// (cpus may be NULL for unpinned workers; pinning needs _GNU_SOURCE)
+static inline ProcessPool createProcessPool(int numWorkers, const int *cpus) {
+    ProcessPool pool;
+    pool.numWorkers = numWorkers;
+    pool.pids = malloc(numWorkers * sizeof(pid_t));
+    pool.shared = mmap(NULL, sizeof(ProcessPoolShared), PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (pool.pids == NULL || pool.shared == MAP_FAILED) {
+        perror("createProcessPool");
+        exit(EXIT_FAILURE);
+    }
+    pool.shared->generation = 0;
+    pool.shared->remaining = 0;
+    pool.shared->nextTask = 0;
+    pool.shared->numTasks = 0;
+    pool.shared->quit = 0;
+    pool.shared->jobHook = NULL;
+
+    // Do not let the workers inherit (and later flush) buffered output
+    fflush(stdout);
+    for (int w = 0; w < numWorkers; w++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            exit(EXIT_FAILURE);
+        } else if (pid == 0) {
+#ifdef CPU_SET
+            if (cpus != NULL && cpus[w] >= 0) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(cpus[w], &set);
+                if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+                    fprintf(stderr, "Cannot pin worker %d to CPU %d, running unpinned\n", w, cpus[w]);
+                }
+            }
+#else
+            (void) cpus;  // Pinning needs _GNU_SOURCE
+#endif
+            processPoolWorkerId = w;
+            processPoolWorkerMain(pool.shared);
+        }
+        pool.pids[w] = pid;
+    }
+    return pool;
+}
+
+// Function to run tasks 0 .. numTasks-1 of run(arg, task) on the workers and
+// wait until all of them are done. Exits if a worker dies on the way.
+static inline void processPoolRun(ProcessPool *pool, ProcessTaskFunc run, void *arg, int numTasks) {
+    ProcessPoolShared *shared = pool->shared;
+    shared->run = run;
+    shared->arg = arg;
+    shared->numTasks = numTasks;
+    shared->nextTask = 0;
+    __atomic_store_n(&shared->remaining, pool->numWorkers, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&shared->generation, 1, __ATOMIC_RELEASE);
+    processPoolFutex(&shared->generation, FUTEX_WAKE, INT_MAX, NULL);
+
+    struct timespec timeout = { 1, 0 };
+    int left;
+    while ((left = __atomic_load_n(&shared->remaining, __ATOMIC_ACQUIRE)) != 0) {
+        if (processPoolFutex(&shared->remaining, FUTEX_WAIT, left, &timeout) == -1 && errno == ETIMEDOUT) {
+            // Still waiting after a second: make sure nobody died holding tasks
+            int status;
+            if (waitpid(-1, &status, WNOHANG) > 0) {
+                fprintf(stderr, "A worker process exited during a job\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+}
+
+// Function to make every worker call hook(context, id, 1) before and
+// hook(context, id, 0) after its part of each following job (NULL to stop).
+// context must point to shared memory.
+static inline void processPoolSetHook(ProcessPool *pool, void (*hook)(void *, int, int), void *context) {
+    pool->shared->jobHook = hook;
+    pool->shared->hookContext = context;
+}
+
+// Function to stop the workers and reap them
+static inline void destroyProcessPool(ProcessPool *pool) {
+    pool->shared->quit = 1;
+    __atomic_add_fetch(&pool->shared->generation, 1, __ATOMIC_RELEASE);
+    processPoolFutex(&pool->shared->generation, FUTEX_WAKE, INT_MAX, NULL);
+    for (int w = 0; w < pool->numWorkers; w++) {
+        waitpid(pool->pids[w], NULL, 0);
+    }
+    munmap(pool->shared, sizeof(ProcessPoolShared));
+    free(pool->pids);
+}
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+// Wire format of the multiplication server (server/server.c).
+//
+// A client connects to the server's Unix-domain stream socket and sends any
+// number of requests over the connection; each one gets one reply, in order.
+// A request asks for C = A·B on int32 matrices, A m x k and B k x n, given
+// either as file names (text, binary or .mtx like --files, C is written with
+// saveMatrix()) or as one shared-memory object whose descriptor travels with
+// the request (SCM_RIGHTS). In the shared case A, B and C are row-major and
+// unpadded at the byte offsets of the request and C is written in place, so
+// nothing is parsed or copied. The reply says how long the request waited in
+// the queue and how long the batch it was computed in took.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "message.h"
+
+#define SERVER_MAGIC          0x4d4d5231u  // "MMR1"
+#define SERVER_DEFAULT_SOCKET "/tmp/mmm-server.sock"
+#define SERVER_PATH_MAX       256
+
+#define REQUEST_FILES    1  // A, B and C are files
+#define REQUEST_SHARED   2  // A, B and C live in the shared-memory object sent along
+#define REQUEST_SHUTDOWN 3  // Stop the server
+
+typedef struct {
+    uint32_t magic;
+    uint32_t kind;              // REQUEST_*
+    int32_t m, n, k;            // 0 in a file request to take the shapes from the files
+    int32_t reserved;
+    uint64_t offsetA;           // Shared requests: byte offsets of A, B and C in the object
+    uint64_t offsetB;
+    uint64_t offsetC;
+    char fileA[SERVER_PATH_MAX];
+    char fileB[SERVER_PATH_MAX];
+    char fileResult[SERVER_PATH_MAX];
+} MultiplyRequest;
+
+typedef struct {
+    uint32_t magic;
+    int32_t status;             // 0, or -1 with the reason in error
+    int32_t m, n, k;            // Shape that was multiplied
+    int32_t batchSize;          // Requests of the batch it was computed in, itself included
+    double loadSeconds;         // File requests: reading A and B
+    double queueSeconds;        // From the request being ready to its batch starting
+    double computeSeconds;      // The whole batch
+    double saveSeconds;         // File requests: writing C
+    char error[128];
+} MultiplyReply;
+
+// Function to fill in the address of a socket path; returns -1 if the path is too long
+static inline int serverAddress(const char *path, struct sockaddr_un *address) {
+    size_t length = strlen(path);
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (length >= sizeof(address->sun_path)) {
+        return -1;
+    }
+    memcpy(address->sun_path, path, length + 1);
+    return 0;
+}
+
+// Function to connect to the server listening on path, exits if there is none
+static inline int connectServer(const char *path) {
+    struct sockaddr_un address;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || serverAddress(path, &address) < 0 || connect(fd, (struct sockaddr *) &address, sizeof(address)) < 0) {
+        fprintf(stderr, "Cannot connect to the server at %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+// Function to send a request, with the descriptor of its shared-memory
+// object unless sharedFd is -1; returns 0, or -1 on error
+static inline int sendRequest(int fd, const MultiplyRequest *request, int sharedFd) {
+    if (sharedFd < 0) {
+        return sendAll(fd, request, sizeof(*request));
+    }
+    // The descriptor rides on the first byte, the rest follows as plain data
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+    struct iovec part = { (void *) request, 1 };
+    struct msghdr message = { 0 };
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(header), &sharedFd, sizeof(int));
+    if (sendmsg(fd, &message, MSG_NOSIGNAL) != 1) {
+        return -1;
+    }
+    return sendAll(fd, (const char *) request + 1, sizeof(*request) - 1);
+}
+
+// Function to receive a request and the descriptor sent with it (-1 if
+// none); returns 0, or -1 when the connection is closed or broken
+static inline int receiveRequest(int fd, MultiplyRequest *request, int *sharedFd) {
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec part = { request, 1 };
+    struct msghdr message = { 0 };
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    *sharedFd = -1;
+    ssize_t got;
+    do {
+        got = recvmsg(fd, &message, 0);
+    } while (got < 0 && errno == EINTR);
+    if (got != 1) {
+        return -1;
+    }
+    for (struct cmsghdr *header = CMSG_FIRSTHDR(&message); header != NULL; header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+            memcpy(sharedFd, CMSG_DATA(header), sizeof(int));
+        }
+    }
+    if (receiveAll(fd, (char *) request + 1, sizeof(*request) - 1) < 0) {
+        if (*sharedFd >= 0) {
+            close(*sharedFd);
+        }
+        return -1;
+    }
+    return 0;
+}
+
+#endif
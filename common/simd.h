@@ -0,0 +1,252 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// Register-blocked SIMD micro-kernels for the int path, with runtime dispatch.
+//
+// Each ISA gets two hand-written kernels:
+//   - panel:      C[i, j] += sum_k A[i, k] * B[k, j]   (standard layout)
+//   - transposed: C[i, j] += sum_k A[i, k] * B[j, k]   (B read row-wise, as --transpose does)
+// The panel kernel keeps a 4 x (2 vectors) block of C in registers while it
+// walks k, broadcasting one element of A per row. The transposed kernel keeps
+// 2 x 4 dot products in vector accumulators and reduces them horizontally at
+// the end. Remainders that do not fill a register block go through the
+// scalar kernels, which are also the portable fallback.
+//
+// The kernels are compiled with per-function target attributes, so the
+// binary itself needs no -mavx2 / -mavx512f and runs on any x86-64; the
+// best ISA is picked at startup from CPUID (__builtin_cpu_supports).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "matrix.h"
+#include "blocked.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86 1
+#endif
+
+#define SIMD_MR 4  // Rows of C per register block (panel kernel)
+
+// Function to compute C[i0:i1, j0:j1] += A[i0:i1, k0:k1] * B[j0:j1, k0:k1]^T with scalar code
+static inline void multiplyTransposedTile(const int *restrict a, int lda, const int *restrict b, int ldb,
+                                          int *restrict c, int ldc,
+                                          int i0, int i1, int j0, int j1, int k0, int k1) {
+    for (int i = i0; i < i1; i++){
+        const int *restrict aRow = a + (size_t) i * lda;
+        for (int j = j0; j < j1; j++){
+            const int *restrict bRow = b + (size_t) j * ldb;
+            int sum = 0;
+            for (int k = k0; k < k1; k++){
+                sum += aRow[k] * bRow[k];
+            }
+            c[(size_t) i * ldc + j] += sum;
+        }
+    }
+}
+
+#ifdef SIMD_X86
+
+// Panel kernel body shared by the three ISAs. VEC/LOAD/STORE/ADD/MUL/SET1
+// name the intrinsics of the ISA and W is the number of ints per vector.
+// Column panels are the outer loop so the B panel stays in cache while all
+// row blocks of A stream past it.
+#define SIMD_PANEL_BODY(VEC, LOAD, STORE, ADD, MUL, SET1, W)                                   \
+    int jEnd = j0 + (j1 - j0) / (2 * W) * (2 * W);                                              \
+    int iEnd = i0 + (i1 - i0) / SIMD_MR * SIMD_MR;                                              \
+    for (int j = j0; j < jEnd; j += 2 * W){                                                     \
+        for (int i = i0; i < iEnd; i += SIMD_MR){                                               \
+            int *c0 = c + (size_t) i * ldc + j;                                                 \
+            int *c1 = c0 + ldc, *c2 = c1 + ldc, *c3 = c2 + ldc;                                 \
+            VEC c00 = LOAD((const VEC *) c0), c01 = LOAD((const VEC *) (c0 + W));               \
+            VEC c10 = LOAD((const VEC *) c1), c11 = LOAD((const VEC *) (c1 + W));               \
+            VEC c20 = LOAD((const VEC *) c2), c21 = LOAD((const VEC *) (c2 + W));               \
+            VEC c30 = LOAD((const VEC *) c3), c31 = LOAD((const VEC *) (c3 + W));               \
+            const int *a0 = a + (size_t) i * lda;                                               \
+            const int *a1 = a0 + lda, *a2 = a1 + lda, *a3 = a2 + lda;                           \
+            const int *bk = b + (size_t) k0 * ldb + j;                                          \
+            for (int k = k0; k < k1; k++, bk += ldb){                                           \
+                VEC b0 = LOAD((const VEC *) bk), b1 = LOAD((const VEC *) (bk + W));             \
+                VEC av = SET1(a0[k]);                                                           \
+                c00 = ADD(c00, MUL(av, b0)); c01 = ADD(c01, MUL(av, b1));                       \
+                av = SET1(a1[k]);                                                               \
+                c10 = ADD(c10, MUL(av, b0)); c11 = ADD(c11, MUL(av, b1));                       \
+                av = SET1(a2[k]);                                                               \
+                c20 = ADD(c20, MUL(av, b0)); c21 = ADD(c21, MUL(av, b1));                       \
+                av = SET1(a3[k]);                                                               \
+                c30 = ADD(c30, MUL(av, b0)); c31 = ADD(c31, MUL(av, b1));                       \
+            }                                                                                   \
+            STORE((VEC *) c0, c00); STORE((VEC *) (c0 + W), c01);                               \
+            STORE((VEC *) c1, c10); STORE((VEC *) (c1 + W), c11);                               \
+            STORE((VEC *) c2, c20); STORE((VEC *) (c2 + W), c21);                               \
+            STORE((VEC *) c3, c30); STORE((VEC *) (c3 + W), c31);                               \
+        }                                                                                       \
+    }                                                                                           \
+    /* Leftover rows and columns */                                                             \
+    if (iEnd < i1) multiplyTile(a, lda, b, ldb, c, ldc, iEnd, i1, j0, jEnd, k0, k1);            \
+    if (jEnd < j1) multiplyTile(a, lda, b, ldb, c, ldc, i0, i1, jEnd, j1, k0, k1);
+
+// Transposed kernel body: 2 rows of A against 4 rows of B, vectorized over k.
+#define SIMD_TRANSPOSED_BODY(VEC, LOAD, ADD, MUL, ZERO, HSUM, W)                                \
+    int iEnd = i0 + (i1 - i0) / 2 * 2;                                                          \
+    int jEnd = j0 + (j1 - j0) / 4 * 4;                                                          \
+    int kEnd = k0 + (k1 - k0) / W * W;                                                          \
+    for (int i = i0; i < iEnd; i += 2){                                                         \
+        const int *a0 = a + (size_t) i * lda, *a1 = a0 + lda;                                   \
+        for (int j = j0; j < jEnd; j += 4){                                                     \
+            const int *b0 = b + (size_t) j * ldb, *b1 = b0 + ldb;                               \
+            const int *b2 = b1 + ldb, *b3 = b2 + ldb;                                           \
+            VEC s00 = ZERO(), s01 = ZERO(), s02 = ZERO(), s03 = ZERO();                         \
+            VEC s10 = ZERO(), s11 = ZERO(), s12 = ZERO(), s13 = ZERO();                         \
+            for (int k = k0; k < kEnd; k += W){                                                 \
+                VEC x0 = LOAD((const VEC *) (a0 + k)), x1 = LOAD((const VEC *) (a1 + k));       \
+                VEC y = LOAD((const VEC *) (b0 + k));                                           \
+                s00 = ADD(s00, MUL(x0, y)); s10 = ADD(s10, MUL(x1, y));                         \
+                y = LOAD((const VEC *) (b1 + k));                                               \
+                s01 = ADD(s01, MUL(x0, y)); s11 = ADD(s11, MUL(x1, y));                         \
+                y = LOAD((const VEC *) (b2 + k));                                               \
+                s02 = ADD(s02, MUL(x0, y)); s12 = ADD(s12, MUL(x1, y));                         \
+                y = LOAD((const VEC *) (b3 + k));                                               \
+                s03 = ADD(s03, MUL(x0, y)); s13 = ADD(s13, MUL(x1, y));                         \
+            }                                                                                   \
+            int *c0 = c + (size_t) i * ldc + j, *c1 = c0 + ldc;                                 \
+            c0[0] += HSUM(s00); c0[1] += HSUM(s01); c0[2] += HSUM(s02); c0[3] += HSUM(s03);     \
+            c1[0] += HSUM(s10); c1[1] += HSUM(s11); c1[2] += HSUM(s12); c1[3] += HSUM(s13);     \
+        }                                                                                       \
+    }                                                                                           \
+    /* Leftover k (only for the vectorized block), rows and columns */                          \
+    if (kEnd < k1) multiplyTransposedTile(a, lda, b, ldb, c, ldc, i0, iEnd, j0, jEnd, kEnd, k1); \
+    if (iEnd < i1) multiplyTransposedTile(a, lda, b, ldb, c, ldc, iEnd, i1, j0, jEnd, k0, k1);  \
+    if (jEnd < j1) multiplyTransposedTile(a, lda, b, ldb, c, ldc, i0, i1, jEnd, j1, k0, k1);
+
+// SSE4.1: 4 ints per vector, _mm_mullo_epi32 is the first SSE multiply that keeps the low 32 bits
+__attribute__((target("sse4.1")))
+static inline int hsumSse4(__m128i v) {
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+__attribute__((target("sse4.1")))
+static void multiplyPanelSse4(const int *restrict a, int lda, const int *restrict b, int ldb,
+                              int *restrict c, int ldc,
+                              int i0, int i1, int j0, int j1, int k0, int k1) {
+    SIMD_PANEL_BODY(__m128i, _mm_loadu_si128, _mm_storeu_si128, _mm_add_epi32, _mm_mullo_epi32,
+                    _mm_set1_epi32, 4)
+}
+
+__attribute__((target("sse4.1")))
+static void multiplyTransposedSse4(const int *restrict a, int lda, const int *restrict b, int ldb,
+                                   int *restrict c, int ldc,
+                                   int i0, int i1, int j0, int j1, int k0, int k1) {
+    SIMD_TRANSPOSED_BODY(__m128i, _mm_loadu_si128, _mm_add_epi32, _mm_mullo_epi32,
+                         _mm_setzero_si128, hsumSse4, 4)
+}
+
+// AVX2: 8 ints per vector
+__attribute__((target("avx2")))
+static inline int hsumAvx2(__m256i v) {
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+
+__attribute__((target("avx2")))
+static void multiplyPanelAvx2(const int *restrict a, int lda, const int *restrict b, int ldb,
+                              int *restrict c, int ldc,
+                              int i0, int i1, int j0, int j1, int k0, int k1) {
+    SIMD_PANEL_BODY(__m256i, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_add_epi32,
+                    _mm256_mullo_epi32, _mm256_set1_epi32, 8)
+}
+
+__attribute__((target("avx2")))
+static void multiplyTransposedAvx2(const int *restrict a, int lda, const int *restrict b, int ldb,
+                                   int *restrict c, int ldc,
+                                   int i0, int i1, int j0, int j1, int k0, int k1) {
+    SIMD_TRANSPOSED_BODY(__m256i, _mm256_loadu_si256, _mm256_add_epi32, _mm256_mullo_epi32,
+                         _mm256_setzero_si256, hsumAvx2, 8)
+}
+
+// AVX-512F: 16 ints per vector
+__attribute__((target("avx512f")))
+static void multiplyPanelAvx512(const int *restrict a, int lda, const int *restrict b, int ldb,
+                                int *restrict c, int ldc,
+                                int i0, int i1, int j0, int j1, int k0, int k1) {
+    SIMD_PANEL_BODY(__m512i, _mm512_loadu_si512, _mm512_storeu_si512, _mm512_add_epi32,
+                    _mm512_mullo_epi32, _mm512_set1_epi32, 16)
+}
+
+__attribute__((target("avx512f")))
+static void multiplyTransposedAvx512(const int *restrict a, int lda, const int *restrict b, int ldb,
+                                     int *restrict c, int ldc,
+                                     int i0, int i1, int j0, int j1, int k0, int k1) {
+    SIMD_TRANSPOSED_BODY(__m512i, _mm512_loadu_si512, _mm512_add_epi32, _mm512_mullo_epi32,
+                         _mm512_setzero_si512, _mm512_reduce_add_epi32, 16)
+}
+
+#endif
+
+// Kernels selected for the running CPU
+typedef struct {
+    const char *isa;
+    TileKernel panel;       // C += A * B
+    TileKernel transposed;  // C += A * B^T
+} SimdKernels;
+
+// Function to get the kernels of one ISA by name ("scalar", "sse4", "avx2", "avx512").
+// Returns 0 if the name is unknown or the CPU cannot run that ISA.
+static inline int getSimdKernels(const char *isa, SimdKernels *kernels) {
+    if (strcmp(isa, "scalar") == 0) {
+        kernels->isa = "scalar";
+        kernels->panel = multiplyTile;
+        kernels->transposed = multiplyTransposedTile;
+        return 1;
+    }
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (strcmp(isa, "sse4") == 0 && __builtin_cpu_supports("sse4.1")) {
+        kernels->isa = "sse4";
+        kernels->panel = multiplyPanelSse4;
+        kernels->transposed = multiplyTransposedSse4;
+        return 1;
+    }
+    if (strcmp(isa, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        kernels->isa = "avx2";
+        kernels->panel = multiplyPanelAvx2;
+        kernels->transposed = multiplyTransposedAvx2;
+        return 1;
+    }
+    if (strcmp(isa, "avx512") == 0 && __builtin_cpu_supports("avx512f")) {
+        kernels->isa = "avx512";
+        kernels->panel = multiplyPanelAvx512;
+        kernels->transposed = multiplyTransposedAvx512;
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+// Function to pick the kernels at startup: the requested ISA if given
+// (exits if the CPU cannot run it), otherwise the widest one available.
+static inline SimdKernels selectSimdKernels(const char *requestedIsa) {
+    SimdKernels kernels;
+    if (requestedIsa != NULL && requestedIsa[0] != '\0') {
+        if (!getSimdKernels(requestedIsa, &kernels)) {
+            fprintf(stderr, "SIMD kernel '%s' is unknown or not supported by this CPU\n", requestedIsa);
+            exit(EXIT_FAILURE);
+        }
+        return kernels;
+    }
+    const char *order[] = { "avx512", "avx2", "sse4" };
+    for (int i = 0; i < 3; i++) {
+        if (getSimdKernels(order[i], &kernels)) {
+            return kernels;
+        }
+    }
+    getSimdKernels("scalar", &kernels);
+    return kernels;
+}
+
+#endif
@@ -0,0 +1,435 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+// Sparse multiplication (--sparse) for int32 matrices.
+//
+// Operands whose density (nonzeros / n^2) is at or below the threshold are
+// converted to CSR before timing starts; the others stay dense. Depending on
+// which operands are sparse, C = A * B is computed as
+//   - CSR x dense: each nonzero a_ik adds a_ik * row k of B to row i of C
+//   - dense x CSR: the same row update, driven by the nonzeros of A's rows
+//   - CSR x CSR (Gustavson): a symbolic pass counts the nonzeros of every
+//     row of C with a per-worker marker array, a prefix sum sizes C, and a
+//     numeric pass accumulates each row in a per-worker dense accumulator.
+// Work is split into row blocks of about equal flop count, a few per worker,
+// and the backend runs them through a callback like strassen.h. The CSR
+// product is scattered into the dense result after timing.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "matrix.h"
+#include "matrix_io.h"
+
+#define SPARSE_OFF  0
+#define SPARSE_AUTO 1   // Sparse kernels for operands at or below the threshold
+#define SPARSE_ON   2   // Both operands in CSR whatever their density
+
+#define SPARSE_DEFAULT_THRESHOLD 0.05
+
+// Kinds of product
+#define SPARSE_NONE      0  // Both operands dense: use the dense kernels
+#define SPARSE_CSR_DENSE 1
+#define SPARSE_DENSE_CSR 2
+#define SPARSE_CSR_CSR   3
+
+#define SPARSE_TASKS_PER_WORKER 4
+
+#define DENSITY_SAMPLE_ROWS  64         // Rows of a binary file counted by matrixFileDensity()
+#define DENSITY_SAMPLE_BYTES (1 << 20)  // Prefix of a text file counted by matrixFileDensity()
+
+typedef struct {
+    int rows;
+    int cols;
+    size_t nnz;
+    size_t *rowPtr;     // rows + 1 offsets into colIdx and values
+    int *colIdx;
+    int *values;
+} CsrMatrix;
+
+struct SparsePlan;
+
+// Callback of the backend: run sparseRunTask(plan, t, worker) for t = 0 .. count-1
+// on its workers and return when all of them are done
+typedef void (*SparseRunTasks)(void *context, struct SparsePlan *plan, int count);
+
+typedef struct SparsePlan {
+    int kind;               // SPARSE_*
+    int n;
+    const Matrix *a;
+    const Matrix *b;
+    Matrix *c;
+    CsrMatrix sa;           // A in CSR (kinds CSR_DENSE and CSR_CSR)
+    CsrMatrix sb;           // B in CSR (kinds DENSE_CSR and CSR_CSR)
+    CsrMatrix sc;           // Product of CSR_CSR
+    int numTasks;
+    int *taskRows;          // Task t covers rows taskRows[t] .. taskRows[t+1]-1
+    int numWorkers;
+    int *marker;            // numWorkers x n, Gustavson only
+    int *accumulator;       // numWorkers x n, Gustavson only
+    int numeric;            // Gustavson phase: 0 symbolic, 1 numeric
+    SparseRunTasks runTasks;
+    void *context;
+} SparsePlan;
+
+// Function to parse a --sparse mode (auto, on, off); exits if it is unknown
+static inline int parseSparseMode(const char *name) {
+    if (strcmp(name, "auto") == 0) {
+        return SPARSE_AUTO;
+    } else if (strcmp(name, "on") == 0) {
+        return SPARSE_ON;
+    } else if (strcmp(name, "off") == 0) {
+        return SPARSE_OFF;
+    }
+    fprintf(stderr, "Unknown sparse mode '%s' (use auto, on or off)\n", name);
+    exit(EXIT_FAILURE);
+}
+
+// Function to count the nonzero elements of an int32 matrix
+static inline size_t countNonzeros(const Matrix *m) {
+    size_t count = 0;
+    for (int i = 0; i < m->rows; i++) {
+        const int *row = matrixRow(m, i);
+        for (int j = 0; j < m->cols; j++) {
+            count += row[j] != 0;
+        }
+    }
+    return count;
+}
+
+// Function to get the fraction of nonzero elements of an int32 matrix
+static inline double matrixDensity(const Matrix *m) {
+    size_t elements = (size_t) m->rows * m->cols;
+    return elements > 0 ? (double) countNonzeros(m) / elements : 0.0;
+}
+
+// Function to estimate the density of an n x n int32 matrix file without
+// reading all of it: a Matrix Market header gives it directly, a binary file
+// is mapped and DENSITY_SAMPLE_ROWS rows spread over it are counted, and a
+// text file is sampled from its first DENSITY_SAMPLE_BYTES
+static inline double matrixFileDensity(const char *fileName, int n) {
+    if (isMatrixMarketFileName(fileName)) {
+        int rows, cols, pattern, symmetric;
+        size_t nnz;
+        FILE *file = openMatrixMarket(fileName, &rows, &cols, &nnz, &pattern, &symmetric);
+        fclose(file);
+        double density = rows > 0 && cols > 0 ? (double) nnz / ((double) rows * cols) : 0.0;
+        density *= symmetric ? 2 : 1;  // Off-diagonal entries are stored once
+        return density < 1.0 ? density : 1.0;
+    }
+    size_t nonzeros = 0, elements = 0;
+    if (isBinaryMatrixFile(fileName)) {
+        // Only the pages of the sampled rows are read from the mapping
+        Matrix m;
+        mapBinaryMatrix(&m, n, n, MATRIX_TYPE_INT32, fileName, 0);
+        int samples = n < DENSITY_SAMPLE_ROWS ? n : DENSITY_SAMPLE_ROWS;
+        for (int s = 0; s < samples; s++) {
+            const int *row = matrixRow(&m, (int) ((long long) s * n / samples));
+            for (int j = 0; j < n; j++) {
+                nonzeros += row[j] != 0;
+            }
+            elements += n;
+        }
+        freeMatrix(&m);
+    } else {
+        FILE *file = fopen(fileName, "r");
+        char *buffer = malloc(DENSITY_SAMPLE_BYTES + 1);
+        if (file == NULL || buffer == NULL) {
+            fprintf(stderr, "Error opening file %s.\n", fileName);
+            exit(EXIT_FAILURE);
+        }
+        size_t length = fread(buffer, 1, DENSITY_SAMPLE_BYTES, file);
+        if (length == DENSITY_SAMPLE_BYTES) {
+            while (length > 0 && !isspace((unsigned char) buffer[length - 1])) {
+                length--;  // Drop the value cut off at the end of the sample
+            }
+        }
+        buffer[length] = '\0';
+        fclose(file);
+        for (char *p = buffer, *end; ; p = end) {
+            long value = strtol(p, &end, 10);
+            if (end == p) {
+                break;
+            }
+            nonzeros += value != 0;
+            elements++;
+        }
+        free(buffer);
+    }
+    return elements > 0 ? (double) nonzeros / elements : 0.0;
+}
+
+// Function to allocate a CSR matrix with room for nnz nonzeros
+static inline CsrMatrix allocateCsr(int rows, int cols, size_t nnz) {
+    CsrMatrix s;
+    s.rows = rows;
+    s.cols = cols;
+    s.nnz = nnz;
+    s.rowPtr = calloc((size_t) rows + 1, sizeof(size_t));
+    s.colIdx = malloc((nnz > 0 ? nnz : 1) * sizeof(int));
+    s.values = malloc((nnz > 0 ? nnz : 1) * sizeof(int));
+    if (s.rowPtr == NULL || s.colIdx == NULL || s.values == NULL) {
+        printf("Error in memory allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+    return s;
+}
+
+// Function to build the CSR form of a dense int32 matrix
+static inline CsrMatrix csrFromDense(const Matrix *m) {
+    CsrMatrix s = allocateCsr(m->rows, m->cols, countNonzeros(m));
+    size_t p = 0;
+    for (int i = 0; i < m->rows; i++) {
+        const int *row = matrixRow(m, i);
+        for (int j = 0; j < m->cols; j++) {
+            if (row[j] != 0) {
+                s.colIdx[p] = j;
+                s.values[p++] = row[j];
+            }
+        }
+        s.rowPtr[i + 1] = p;
+    }
+    return s;
+}
+
+static inline void freeCsr(CsrMatrix *s) {
+    free(s->rowPtr);
+    free(s->colIdx);
+    free(s->values);
+    memset(s, 0, sizeof(*s));
+}
+
+// Function to pick the kind of product from the mode and the operand densities
+static inline int chooseSparseKind(int mode, double densityA, double densityB, double threshold) {
+    if (mode == SPARSE_OFF) {
+        return SPARSE_NONE;
+    }
+    int sparseA = mode == SPARSE_ON || densityA <= threshold;
+    int sparseB = mode == SPARSE_ON || densityB <= threshold;
+    if (sparseA && sparseB) {
+        return SPARSE_CSR_CSR;
+    }
+    return sparseA ? SPARSE_CSR_DENSE : (sparseB ? SPARSE_DENSE_CSR : SPARSE_NONE);
+}
+
+// Function to get a printable name of the plan's product
+static inline const char *sparseKindName(const SparsePlan *plan) {
+    switch (plan->kind) {
+        case SPARSE_CSR_DENSE: return "CSR x dense";
+        case SPARSE_DENSE_CSR: return "dense x CSR";
+        default:               return "Gustavson CSR x CSR";
+    }
+}
+
+// Function to estimate the multiply-adds of row i of the product
+static inline size_t sparseRowCost(const SparsePlan *plan, int i) {
+    size_t cost = 1;
+    if (plan->kind == SPARSE_CSR_DENSE) {
+        cost += (plan->sa.rowPtr[i + 1] - plan->sa.rowPtr[i]) * (size_t) plan->n;
+    } else if (plan->kind == SPARSE_DENSE_CSR) {
+        const int *row = matrixRow(plan->a, i);
+        cost += plan->n;
+        for (int k = 0; k < plan->n; k++) {
+            if (row[k] != 0) {
+                cost += plan->sb.rowPtr[k + 1] - plan->sb.rowPtr[k];
+            }
+        }
+    } else {
+        for (size_t p = plan->sa.rowPtr[i]; p < plan->sa.rowPtr[i + 1]; p++) {
+            int k = plan->sa.colIdx[p];
+            cost += plan->sb.rowPtr[k + 1] - plan->sb.rowPtr[k];
+        }
+    }
+    return cost;
+}
+
+// Function to prepare C = A * B as a product of the given kind: converts the
+// sparse operands, balances the row blocks and allocates the Gustavson workspace
+static inline SparsePlan createSparsePlan(int kind, const Matrix *a, const Matrix *b, Matrix *c,
+                                          int numWorkers, SparseRunTasks runTasks, void *context) {
+    SparsePlan plan;
+    memset(&plan, 0, sizeof(plan));
+    plan.kind = kind;
+    plan.n = a->rows;
+    plan.a = a;
+    plan.b = b;
+    plan.c = c;
+    plan.numWorkers = numWorkers;
+    plan.runTasks = runTasks;
+    plan.context = context;
+    if (kind != SPARSE_DENSE_CSR) {
+        plan.sa = csrFromDense(a);
+    }
+    if (kind != SPARSE_CSR_DENSE) {
+        plan.sb = csrFromDense(b);
+    }
+    if (kind == SPARSE_CSR_CSR) {
+        plan.sc.rows = plan.sc.cols = plan.n;
+        plan.sc.rowPtr = calloc((size_t) plan.n + 1, sizeof(size_t));
+        plan.marker = calloc((size_t) numWorkers * plan.n, sizeof(int));
+        plan.accumulator = malloc(((size_t) numWorkers * plan.n + 1) * sizeof(int));
+        if (plan.sc.rowPtr == NULL || plan.marker == NULL || plan.accumulator == NULL) {
+            printf("Error in memory allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Row blocks with about the same number of multiply-adds each
+    int wanted = numWorkers * SPARSE_TASKS_PER_WORKER;
+    wanted = wanted < plan.n ? wanted : plan.n;
+    plan.taskRows = malloc(((size_t) wanted + 1) * sizeof(int));
+    size_t *prefix = malloc(((size_t) plan.n + 1) * sizeof(size_t));
+    prefix[0] = 0;
+    for (int i = 0; i < plan.n; i++) {
+        prefix[i + 1] = prefix[i] + sparseRowCost(&plan, i);
+    }
+    plan.taskRows[0] = 0;
+    plan.numTasks = 0;
+    for (int i = 1; i <= plan.n; i++) {
+        if (i == plan.n || (double) prefix[i] >= (double) prefix[plan.n] * (plan.numTasks + 1) / wanted) {
+            plan.taskRows[++plan.numTasks] = i;
+        }
+    }
+    free(prefix);
+    return plan;
+}
+
+// C[i][:] += a * row k of B in CSR
+static inline void sparseAxpyCsrRow(int *c, int a, const CsrMatrix *b, int k) {
+    for (size_t q = b->rowPtr[k]; q < b->rowPtr[k + 1]; q++) {
+        c[b->colIdx[q]] += a * b->values[q];
+    }
+}
+
+// Rows of a CSR x dense product
+static inline void sparseCsrDenseRows(SparsePlan *plan, int rowStart, int rowEnd) {
+    const CsrMatrix *sa = &plan->sa;
+    int n = plan->n;
+    for (int i = rowStart; i < rowEnd; i++) {
+        int *c = matrixRow(plan->c, i);
+        for (size_t p = sa->rowPtr[i]; p < sa->rowPtr[i + 1]; p++) {
+            int a = sa->values[p];
+            const int *b = matrixRow(plan->b, sa->colIdx[p]);
+            for (int j = 0; j < n; j++) {
+                c[j] += a * b[j];
+            }
+        }
+    }
+}
+
+// Rows of a dense x CSR product
+static inline void sparseDenseCsrRows(SparsePlan *plan, int rowStart, int rowEnd) {
+    for (int i = rowStart; i < rowEnd; i++) {
+        const int *a = matrixRow(plan->a, i);
+        int *c = matrixRow(plan->c, i);
+        for (int k = 0; k < plan->n; k++) {
+            if (a[k] != 0) {
+                sparseAxpyCsrRow(c, a[k], &plan->sb, k);
+            }
+        }
+    }
+}
+
+// Rows of a Gustavson CSR x CSR product, symbolic or numeric pass. The
+// marker holds the last row that touched each column: i + 1 in the symbolic
+// pass, n + i + 1 in the numeric one, so it never needs clearing.
+static inline void sparseGustavsonRows(SparsePlan *plan, int rowStart, int rowEnd, int worker) {
+    const CsrMatrix *sa = &plan->sa, *sb = &plan->sb;
+    CsrMatrix *sc = &plan->sc;
+    int *marker = plan->marker + (size_t) worker * plan->n;
+    int *accumulator = plan->accumulator + (size_t) worker * plan->n;
+    for (int i = rowStart; i < rowEnd; i++) {
+        if (!plan->numeric) {
+            int stamp = i + 1;
+            size_t count = 0;
+            for (size_t p = sa->rowPtr[i]; p < sa->rowPtr[i + 1]; p++) {
+                int k = sa->colIdx[p];
+                for (size_t q = sb->rowPtr[k]; q < sb->rowPtr[k + 1]; q++) {
+                    int j = sb->colIdx[q];
+                    if (marker[j] != stamp) {
+                        marker[j] = stamp;
+                        count++;
+                    }
+                }
+            }
+            sc->rowPtr[i + 1] = count;
+        } else {
+            int stamp = plan->n + i + 1;
+            size_t start = sc->rowPtr[i], end = start;
+            for (size_t p = sa->rowPtr[i]; p < sa->rowPtr[i + 1]; p++) {
+                int k = sa->colIdx[p], a = sa->values[p];
+                for (size_t q = sb->rowPtr[k]; q < sb->rowPtr[k + 1]; q++) {
+                    int j = sb->colIdx[q];
+                    if (marker[j] != stamp) {
+                        marker[j] = stamp;
+                        sc->colIdx[end++] = j;
+                        accumulator[j] = a * sb->values[q];
+                    } else {
+                        accumulator[j] += a * sb->values[q];
+                    }
+                }
+            }
+            for (size_t p = start; p < end; p++) {
+                sc->values[p] = accumulator[sc->colIdx[p]];
+            }
+        }
+    }
+}
+
+// Function to run row block task of the plan on the given worker (0 .. numWorkers-1)
+static inline void sparseRunTask(SparsePlan *plan, int task, int worker) {
+    int rowStart = plan->taskRows[task], rowEnd = plan->taskRows[task + 1];
+    switch (plan->kind) {
+        case SPARSE_CSR_DENSE: sparseCsrDenseRows(plan, rowStart, rowEnd); break;
+        case SPARSE_DENSE_CSR: sparseDenseCsrRows(plan, rowStart, rowEnd); break;
+        default:               sparseGustavsonRows(plan, rowStart, rowEnd, worker); break;
+    }
+}
+
+// Function to compute the product (C must be zeroed; for CSR x CSR the result
+// is left in plan->sc until sparseStoreResult())
+static inline void sparseMultiply(SparsePlan *plan) {
+    if (plan->kind != SPARSE_CSR_CSR) {
+        plan->runTasks(plan->context, plan, plan->numTasks);
+        return;
+    }
+    plan->numeric = 0;
+    plan->runTasks(plan->context, plan, plan->numTasks);
+    for (int i = 0; i < plan->n; i++) {
+        plan->sc.rowPtr[i + 1] += plan->sc.rowPtr[i];
+    }
+    plan->sc.nnz = plan->sc.rowPtr[plan->n];
+    plan->sc.colIdx = malloc((plan->sc.nnz > 0 ? plan->sc.nnz : 1) * sizeof(int));
+    plan->sc.values = malloc((plan->sc.nnz > 0 ? plan->sc.nnz : 1) * sizeof(int));
+    if (plan->sc.colIdx == NULL || plan->sc.values == NULL) {
+        printf("Error in memory allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+    plan->numeric = 1;
+    plan->runTasks(plan->context, plan, plan->numTasks);
+}
+
+// Function to scatter a CSR x CSR product into the dense result
+static inline void sparseStoreResult(SparsePlan *plan) {
+    if (plan->kind != SPARSE_CSR_CSR) {
+        return;
+    }
+    for (int i = 0; i < plan->n; i++) {
+        int *c = matrixRow(plan->c, i);
+        for (size_t p = plan->sc.rowPtr[i]; p < plan->sc.rowPtr[i + 1]; p++) {
+            c[plan->sc.colIdx[p]] += plan->sc.values[p];
+        }
+    }
+}
+
+static inline void freeSparsePlan(SparsePlan *plan) {
+    freeCsr(&plan->sa);
+    freeCsr(&plan->sb);
+    freeCsr(&plan->sc);
+    free(plan->taskRows);
+    free(plan->marker);
+    free(plan->accumulator);
+}
+
+#endif
@@ -0,0 +1,340 @@
+#ifndef STRASSEN_H
+#define STRASSEN_H
+
+// Strassen-Winograd multiplication (7 products and 15 additions per level).
+//
+// The recursion splits C = A * B into 2 x 2 blocks until the size drops to
+// the cutoff, where the blocked kernel from blocked.h takes over. Odd sizes
+// are peeled: the even leading part is recursed on and the last row and
+// column of C are fixed up with O(n^2) work, so no padded copies are made.
+//
+// All temporaries come from one workspace allocated up front by the plan:
+//   - the sequential schedule (Boyer, Dumas, Pernet and Zhou) needs only two
+//     h x h temporaries per level, about 2/3 n^2 elements in total
+//   - the parallel levels keep S1..S4, T1..T4 and three products alive at
+//     once so that all seven sub-products are independent. The first
+//     parallelDepth levels are expanded into 7^parallelDepth leaf products,
+//     the backend runs them on its workers, then the levels are combined.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "matrix.h"
+#include "blocked.h"
+
+#define STRASSEN_DEFAULT_CUTOFF 512
+
+struct StrassenPlan;
+
+// One independent leaf product c = a * b of the parallel levels
+typedef struct {
+    const struct StrassenPlan *plan;
+    Matrix a, b, c;
+    int *work;  // Workspace of this product's sequential recursion
+} StrassenTask;
+
+// Callback that runs count tasks in parallel (each one with strassenRunTask)
+typedef void (*StrassenRunTasks)(void *context, StrassenTask *tasks, int count);
+
+typedef struct StrassenPlan {
+    int n;
+    int cutoff;           // Sizes up to this use the blocked kernel
+    int parallelDepth;    // Levels whose 7 products run in parallel
+    const TileSizes *tiles;
+    TileKernel tileKernel;
+    StrassenRunTasks runTasks;
+    void *context;
+    Matrix workspace;
+    StrassenTask *tasks;
+    int numTasks;
+} StrassenPlan;
+
+// Function to get the elements taken by one h x h temporary
+static inline size_t strassenTempSize(int h) {
+    return (size_t) h * paddedStride(h);
+}
+
+// Function to carve an h x h temporary out of the workspace
+static inline Matrix strassenTemp(int **work, int h) {
+    Matrix t;
+    t.rows = h;
+    t.cols = h;
+    t.stride = paddedStride(h);
+    t.data = *work;
+    t.base = NULL;
+    t.bytes = 0;
+    t.flags = 0;
+    t.type = MATRIX_TYPE_INT32;
+    t.elemSize = sizeof(int);
+    *work += strassenTempSize(h);
+    return t;
+}
+
+// Function to compute the workspace of the sequential recursion for size n
+static inline size_t strassenSequentialWork(int n, int cutoff) {
+    if (n <= cutoff) {
+        return 0;
+    }
+    int h = n / 2;
+    return 2 * strassenTempSize(h) + strassenSequentialWork(h, cutoff);
+}
+
+// Function to compute the workspace for size n with depth parallel levels on top
+static inline size_t strassenParallelWork(int n, int cutoff, int depth) {
+    if (depth == 0) {
+        return strassenSequentialWork(n, cutoff);
+    }
+    if (n <= cutoff) {
+        return 0;
+    }
+    int h = n / 2;
+    return 11 * strassenTempSize(h) + 7 * strassenParallelWork(h, cutoff, depth - 1);
+}
+
+// z = x + y (z may be x or y)
+static inline void strassenAdd(const Matrix *x, const Matrix *y, Matrix *z) {
+    for (int i = 0; i < z->rows; i++) {
+        const int *xr = matrixRow(x, i), *yr = matrixRow(y, i);
+        int *zr = matrixRow(z, i);
+        for (int j = 0; j < z->cols; j++) {
+            zr[j] = xr[j] + yr[j];
+        }
+    }
+}
+
+// z = x - y (z may be x or y)
+static inline void strassenSub(const Matrix *x, const Matrix *y, Matrix *z) {
+    for (int i = 0; i < z->rows; i++) {
+        const int *xr = matrixRow(x, i), *yr = matrixRow(y, i);
+        int *zr = matrixRow(z, i);
+        for (int j = 0; j < z->cols; j++) {
+            zr[j] = xr[j] - yr[j];
+        }
+    }
+}
+
+// Function to run the blocked kernel on a block that is too small to split
+static inline void strassenBase(const StrassenPlan *plan, const Matrix *a, const Matrix *b, Matrix *c) {
+    for (int i = 0; i < c->rows; i++) {
+        memset(matrixRow(c, i), 0, (size_t) c->cols * sizeof(int));
+    }
+    multiplyBlockedRange(a, b, c, 0, c->rows, 0, c->cols, plan->tiles, plan->tileKernel);
+}
+
+// Function to complete c = a * b for odd n once the leading m x m block
+// (m = n - 1) holds a[0:m, 0:m] * b[0:m, 0:m]
+static inline void strassenPeel(const Matrix *a, const Matrix *b, Matrix *c, int m) {
+    int n = m + 1;
+    // Rank-1 update of the leading block with the last column of A and last row of B
+    const int *bLast = matrixRow(b, m);
+    for (int i = 0; i < m; i++) {
+        int aim = matrixRow(a, i)[m];
+        int *cr = matrixRow(c, i);
+        for (int j = 0; j < m; j++) {
+            cr[j] += aim * bLast[j];
+        }
+    }
+    // Last column of C
+    for (int i = 0; i < m; i++) {
+        const int *ar = matrixRow(a, i);
+        int sum = 0;
+        for (int k = 0; k < n; k++) {
+            sum += ar[k] * matrixRow(b, k)[m];
+        }
+        matrixRow(c, i)[m] = sum;
+    }
+    // Last row of C
+    int *cLast = matrixRow(c, m);
+    const int *aLast = matrixRow(a, m);
+    memset(cLast, 0, (size_t) n * sizeof(int));
+    for (int k = 0; k < n; k++) {
+        int ak = aLast[k];
+        const int *br = matrixRow(b, k);
+        for (int j = 0; j < n; j++) {
+            cLast[j] += ak * br[j];
+        }
+    }
+}
+
+// Function to compute c = a * b (c is overwritten) with the two-temporary
+// sequential schedule; work must hold strassenSequentialWork(n) elements
+static inline void strassenSequential(const StrassenPlan *plan, const Matrix *a, const Matrix *b, Matrix *c,
+                                      int *work) {
+    int n = c->rows;
+    if (n <= plan->cutoff) {
+        strassenBase(plan, a, b, c);
+        return;
+    }
+    int h = n / 2;
+    Matrix X = strassenTemp(&work, h), Y = strassenTemp(&work, h);
+    Matrix A11 = matrixView(a, 0, 0, h, h), A12 = matrixView(a, 0, h, h, h);
+    Matrix A21 = matrixView(a, h, 0, h, h), A22 = matrixView(a, h, h, h, h);
+    Matrix B11 = matrixView(b, 0, 0, h, h), B12 = matrixView(b, 0, h, h, h);
+    Matrix B21 = matrixView(b, h, 0, h, h), B22 = matrixView(b, h, h, h, h);
+    Matrix C11 = matrixView(c, 0, 0, h, h), C12 = matrixView(c, 0, h, h, h);
+    Matrix C21 = matrixView(c, h, 0, h, h), C22 = matrixView(c, h, h, h, h);
+
+    strassenSub(&A11, &A21, &X);                        // S3
+    strassenSub(&B22, &B12, &Y);                        // T3
+    strassenSequential(plan, &X, &Y, &C21, work);       // P7
+    strassenAdd(&A21, &A22, &X);                        // S1
+    strassenSub(&B12, &B11, &Y);                        // T1
+    strassenSequential(plan, &X, &Y, &C22, work);       // P5
+    strassenSub(&X, &A11, &X);                          // S2 = S1 - A11
+    strassenSub(&B22, &Y, &Y);                          // T2 = B22 - T1
+    strassenSequential(plan, &X, &Y, &C12, work);       // P6
+    strassenSub(&A12, &X, &X);                          // S4 = A12 - S2
+    strassenSequential(plan, &X, &B22, &C11, work);     // P3
+    strassenSequential(plan, &A11, &B11, &X, work);     // P1
+    strassenAdd(&X, &C12, &C12);                        // U2 = P1 + P6
+    strassenAdd(&C12, &C21, &C21);                      // U3 = U2 + P7
+    strassenAdd(&C12, &C22, &C12);                      // U4 = U2 + P5
+    strassenAdd(&C21, &C22, &C22);                      // U7 = U3 + P5 (C22 done)
+    strassenAdd(&C12, &C11, &C12);                      // U5 = U4 + P3 (C12 done)
+    strassenSub(&Y, &B21, &Y);                          // T4 = T2 - B21
+    strassenSequential(plan, &A22, &Y, &C11, work);     // P4
+    strassenSub(&C21, &C11, &C21);                      // U6 = U3 - P4 (C21 done)
+    strassenSequential(plan, &A12, &B21, &C11, work);   // P2
+    strassenAdd(&C11, &X, &C11);                        // U1 = P2 + P1 (C11 done)
+
+    if (n % 2 == 1) {
+        strassenPeel(a, b, c, 2 * h);
+    }
+}
+
+// Function to run one leaf product of the parallel levels
+static inline void strassenRunTask(StrassenTask *task) {
+    strassenSequential(task->plan, &task->a, &task->b, &task->c, task->work);
+}
+
+// Walk over the parallel levels. The prepare pass forms S1..S4 and T1..T4 and
+// collects the leaf products; the combine pass (after the products ran) adds
+// them up bottom-up. Both passes carve the workspace identically.
+static inline void strassenParallelWalk(StrassenPlan *plan, const Matrix *a, const Matrix *b, Matrix *c,
+                                        int *work, int depth, int combine) {
+    int n = c->rows;
+    if (depth == 0 || n <= plan->cutoff) {
+        if (!combine) {
+            StrassenTask *task = &plan->tasks[plan->numTasks++];
+            task->plan = plan;
+            task->a = *a;
+            task->b = *b;
+            task->c = *c;
+            task->work = work;
+        }
+        return;
+    }
+    int h = n / 2;
+    Matrix S1 = strassenTemp(&work, h), S2 = strassenTemp(&work, h);
+    Matrix S3 = strassenTemp(&work, h), S4 = strassenTemp(&work, h);
+    Matrix T1 = strassenTemp(&work, h), T2 = strassenTemp(&work, h);
+    Matrix T3 = strassenTemp(&work, h), T4 = strassenTemp(&work, h);
+    Matrix P1 = strassenTemp(&work, h), P3 = strassenTemp(&work, h), P4 = strassenTemp(&work, h);
+    Matrix A11 = matrixView(a, 0, 0, h, h), A12 = matrixView(a, 0, h, h, h);
+    Matrix A21 = matrixView(a, h, 0, h, h), A22 = matrixView(a, h, h, h, h);
+    Matrix B11 = matrixView(b, 0, 0, h, h), B12 = matrixView(b, 0, h, h, h);
+    Matrix B21 = matrixView(b, h, 0, h, h), B22 = matrixView(b, h, h, h, h);
+    Matrix C11 = matrixView(c, 0, 0, h, h), C12 = matrixView(c, 0, h, h, h);
+    Matrix C21 = matrixView(c, h, 0, h, h), C22 = matrixView(c, h, h, h, h);
+
+    if (!combine) {
+        strassenAdd(&A21, &A22, &S1);
+        strassenSub(&S1, &A11, &S2);
+        strassenSub(&A11, &A21, &S3);
+        strassenSub(&A12, &S2, &S4);
+        strassenSub(&B12, &B11, &T1);
+        strassenSub(&B22, &T1, &T2);
+        strassenSub(&B22, &B12, &T3);
+        strassenSub(&T2, &B21, &T4);
+    }
+
+    // The seven products, each with its own slice of the workspace
+    const Matrix *left[7]  = { &A11, &A12, &S4, &A22, &S1, &S2, &S3 };
+    const Matrix *right[7] = { &B11, &B21, &B22, &T4, &T1, &T2, &T3 };
+    Matrix *out[7]         = { &P1, &C11, &P3, &P4, &C22, &C12, &C21 };
+    size_t childWork = strassenParallelWork(h, plan->cutoff, depth - 1);
+    for (int p = 0; p < 7; p++) {
+        strassenParallelWalk(plan, left[p], right[p], out[p], work + p * childWork, depth - 1, combine);
+    }
+
+    if (combine) {
+        strassenAdd(&C11, &P1, &C11);  // U1 = P2 + P1
+        strassenAdd(&C12, &P1, &C12);  // U2 = P6 + P1
+        strassenAdd(&C21, &C12, &C21); // U3 = P7 + U2
+        strassenAdd(&C12, &C22, &C12); // U4 = U2 + P5
+        strassenAdd(&C12, &P3, &C12);  // U5 = U4 + P3
+        strassenAdd(&C22, &C21, &C22); // U7 = P5 + U3
+        strassenSub(&C21, &P4, &C21);  // U6 = U3 - P4
+        if (n % 2 == 1) {
+            strassenPeel(a, b, c, 2 * h);
+        }
+    }
+}
+
+// Function to prepare a Strassen-Winograd multiplication of n x n matrices.
+// runTasks may be NULL (or parallelDepth 0) for a purely sequential recursion.
+// The workspace is allocated and touched here, outside any timed section.
+static inline StrassenPlan createStrassenPlan(int n, int cutoff, int parallelDepth, const TileSizes *tiles,
+                                              TileKernel tileKernel, StrassenRunTasks runTasks, void *context) {
+    StrassenPlan plan;
+    if (cutoff < 2) {
+        fprintf(stderr, "Invalid Strassen cutoff %d\n", cutoff);
+        exit(EXIT_FAILURE);
+    }
+    plan.n = n;
+    plan.cutoff = cutoff;
+    plan.parallelDepth = runTasks != NULL ? parallelDepth : 0;
+    plan.tiles = tiles;
+    plan.tileKernel = tileKernel;
+    plan.runTasks = runTasks;
+    plan.context = context;
+
+    int maxTasks = 1;
+    for (int d = 0; d < plan.parallelDepth; d++) {
+        maxTasks *= 7;
+    }
+    plan.tasks = malloc(maxTasks * sizeof(StrassenTask));
+    if (plan.tasks == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    plan.numTasks = 0;
+
+    // Every temporary is a whole number of cache lines, so they all stay aligned
+    size_t words = strassenParallelWork(n, cutoff, plan.parallelDepth);
+    plan.workspace = allocateMatrix((int) ((words + MATRIX_LINE_INTS - 1) / MATRIX_LINE_INTS), MATRIX_LINE_INTS, 0);
+    zeroMatrix(&plan.workspace);
+    return plan;
+}
+
+// Function to pick the number of parallel levels so that there are at least
+// as many leaf products as workers
+static inline int strassenParallelDepth(int numWorkers) {
+    int depth = 1, products = 7;
+    while (products < numWorkers) {
+        depth++;
+        products *= 7;
+    }
+    return depth;
+}
+
+// Function to compute c = a * b with a prepared plan
+static inline void strassenMultiply(StrassenPlan *plan, const Matrix *a, const Matrix *b, Matrix *c) {
+    if (plan->parallelDepth == 0) {
+        strassenSequential(plan, a, b, c, plan->workspace.data);
+        return;
+    }
+    plan->numTasks = 0;
+    strassenParallelWalk(plan, a, b, c, plan->workspace.data, plan->parallelDepth, 0);
+    plan->runTasks(plan->context, plan->tasks, plan->numTasks);
+    strassenParallelWalk(plan, a, b, c, plan->workspace.data, plan->parallelDepth, 1);
+}
+
+// Function to release the workspace of a plan
+static inline void freeStrassenPlan(StrassenPlan *plan) {
+    freeMatrix(&plan->workspace);
+    free(plan->tasks);
+    plan->tasks = NULL;
+}
+
+#endif
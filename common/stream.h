@@ -0,0 +1,289 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+// Out-of-core multiplication for matrices that do not fit in memory.
+//
+// A and B are binary matrix files (see matrix_io.h) read with pread, so only
+// a bounded set of tiles is ever resident:
+//   - one block row of C (panelRows x n), written out as soon as it is done
+//   - two A tiles (panelRows x tileEdge) and two B tiles (tileEdge x tileEdge)
+// For every block row I of C the loops run over k panels K and column tiles J
+// and compute C[I, J] += A[I, K] * B[K, J]. A reader thread fetches the tiles
+// of the next step while the current one is multiplied, so disk reads overlap
+// with compute. The memory budget picks panelRows and tileEdge.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "matrix.h"
+#include "matrix_io.h"
+#include "blocked.h"
+
+// Callback that computes c += a * b on in-memory blocks; each backend
+// parallelizes it its own way
+typedef void (*BlockMultiply)(void *context, const Matrix *a, const Matrix *b, Matrix *c);
+
+typedef struct {
+    int panelRows;        // Rows of C kept in memory
+    int tileEdge;         // Edge of the A/B tiles along k and j
+    size_t memoryBytes;   // Memory actually used by the buffers
+    size_t bytesRead;
+    size_t bytesWritten;
+    double readWaitTime;  // Time compute spent waiting for the reader
+    double computeTime;
+    double writeTime;
+} StreamStats;
+
+// One step of the schedule: multiply A[I, K] by B[K, J]
+typedef struct {
+    int I, K, J;
+    int rows, depth, cols;
+    const Matrix *aTile;
+    Matrix bTile;
+} StreamStep;
+
+typedef struct {
+    int n;
+    int panelRows;
+    int tileEdge;
+    int fdA, fdB;
+    BinaryMatrixHeader headerA, headerB;
+    int swappedA, swappedB;
+    const char *fileA, *fileB;
+    Matrix aTiles[2];     // Ping-pong A tiles, one per k panel
+    StreamStep slots[2];  // Ring of steps between reader and compute
+    int filled;           // Steps ready for compute (protected by lock)
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    size_t bytesRead;
+} StreamState;
+
+static inline double streamSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Function to read the block [row0, row0+rows) x [col0, col0+cols) of a binary matrix file
+static inline size_t readFileBlock(int fd, const BinaryMatrixHeader *header, int swapped, const char *fileName,
+                                   int row0, int rows, int col0, int cols, Matrix *dst) {
+    dst->rows = rows;
+    dst->cols = cols;
+    size_t rowBytes = (size_t) cols * sizeof(int);
+    for (int i = 0; i < rows; i++) {
+        off_t offset = (off_t) header->dataOffset +
+                       ((off_t) (row0 + i) * (off_t) header->stride + col0) * (off_t) sizeof(int);
+        int *row = matrixRow(dst, i);
+        size_t done = 0;
+        while (done < rowBytes) {
+            ssize_t got = pread(fd, (char *) row + done, rowBytes - done, offset + (off_t) done);
+            if (got <= 0) {
+                fprintf(stderr, "Error reading file %s.\n", fileName);
+                exit(EXIT_FAILURE);
+            }
+            done += (size_t) got;
+        }
+        if (swapped) {
+            for (int j = 0; j < cols; j++) {
+                row[j] = (int) byteSwap32((uint32_t) row[j]);
+            }
+        }
+    }
+    return (size_t) rows * rowBytes;
+}
+
+// Reader thread: walks the same schedule as the compute loop, one step ahead
+static inline void *streamReader(void *arg) {
+    StreamState *st = (StreamState *) arg;
+    int n = st->n, R = st->panelRows, T = st->tileEdge;
+    long step = 0, panel = 0;
+    for (int I = 0; I < n; I += R) {
+        for (int K = 0; K < n; K += T, panel++) {
+            for (int J = 0; J < n; J += T, step++) {
+                StreamStep *slot = &st->slots[step % 2];
+                pthread_mutex_lock(&st->lock);
+                while (st->filled == 2) {
+                    pthread_cond_wait(&st->changed, &st->lock);
+                }
+                pthread_mutex_unlock(&st->lock);
+
+                slot->I = I;
+                slot->K = K;
+                slot->J = J;
+                slot->rows = minInt(R, n - I);
+                slot->depth = minInt(T, n - K);
+                slot->cols = minInt(T, n - J);
+                // The A tile only changes with the k panel; compute is at most one
+                // step behind, so it never uses the buffer being refilled here
+                Matrix *aTile = &st->aTiles[panel % 2];
+                if (J == 0) {
+                    st->bytesRead += readFileBlock(st->fdA, &st->headerA, st->swappedA, st->fileA,
+                                                   I, slot->rows, K, slot->depth, aTile);
+                }
+                slot->aTile = aTile;
+                st->bytesRead += readFileBlock(st->fdB, &st->headerB, st->swappedB, st->fileB,
+                                               K, slot->depth, J, slot->cols, &slot->bTile);
+
+                pthread_mutex_lock(&st->lock);
+                st->filled++;
+                pthread_cond_broadcast(&st->changed);
+                pthread_mutex_unlock(&st->lock);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Function to choose the block row height and tile edge for a memory budget
+static inline int planStream(int n, size_t budgetBytes, int *panelRows, int *tileEdge) {
+    size_t panelRowBytes = (size_t) paddedStride(n) * sizeof(int);
+    int R = (int) ((budgetBytes / 2) / panelRowBytes);
+    if (R > n) R = n;
+    if (R < n && R >= 8) R -= R % 4;  // Whole register blocks for the SIMD kernels
+    while (R >= 1) {
+        size_t left = budgetBytes - (size_t) R * panelRowBytes;
+        int T = n < 2048 ? n : 2048;
+        while (T >= 1) {
+            // Two A tiles (R x T) and two B tiles (T x T)
+            size_t tiles = 2 * ((size_t) R + T) * paddedStride(T) * sizeof(int);
+            if (tiles <= left && (T >= 16 || T == n)) {
+                *panelRows = R;
+                *tileEdge = T;
+                return 1;
+            }
+            T = T > 16 ? (T - 16) & ~15 : 0;
+        }
+        R /= 2;
+    }
+    return 0;
+}
+
+// Function to multiply the n x n binary matrix files fileA and fileB into
+// fileResult (binary for ".bin" names, text otherwise) using at most
+// budgetBytes of buffers. multiply(context, ...) does the in-memory products.
+static inline void streamMultiply(const char *fileA, const char *fileB, const char *fileResult, int n,
+                                  size_t budgetBytes, BlockMultiply multiply, void *context,
+                                  int ioThreads, StreamStats *stats) {
+    StreamState st;
+    memset(&st, 0, sizeof(st));
+    memset(stats, 0, sizeof(*stats));
+    st.n = n;
+    st.fileA = fileA;
+    st.fileB = fileB;
+    if (!planStream(n, budgetBytes, &st.panelRows, &st.tileEdge)) {
+        fprintf(stderr, "Memory budget of %zu bytes is too small for n = %d\n", budgetBytes, n);
+        exit(EXIT_FAILURE);
+    }
+    const char *names[2] = { fileA, fileB };
+    int *fds[2] = { &st.fdA, &st.fdB };
+    for (int f = 0; f < 2; f++) {
+        *fds[f] = open(names[f], O_RDONLY);
+        if (*fds[f] < 0) {
+            fprintf(stderr, "Cannot open file %s\n", names[f]);
+            exit(EXIT_FAILURE);
+        }
+        if (!isBinaryMatrixFile(names[f])) {
+            fprintf(stderr, "Streaming needs binary input files, convert %s with utils/convert_matrix.py\n", names[f]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    st.swappedA = readBinaryMatrixHeader(st.fdA, fileA, n, n, MATRIX_TYPE_INT32, &st.headerA);
+    st.swappedB = readBinaryMatrixHeader(st.fdB, fileB, n, n, MATRIX_TYPE_INT32, &st.headerB);
+
+    Matrix panel = allocateMatrix(st.panelRows, n, 0);
+    for (int b = 0; b < 2; b++) {
+        st.aTiles[b] = allocateMatrix(st.panelRows, st.tileEdge, 0);
+        st.slots[b].bTile = allocateMatrix(st.tileEdge, st.tileEdge, 0);
+    }
+    stats->panelRows = st.panelRows;
+    stats->tileEdge = st.tileEdge;
+    stats->memoryBytes = (size_t) panel.rows * panel.stride * sizeof(int) +
+                         2 * ((size_t) st.aTiles[0].rows * st.aTiles[0].stride +
+                              (size_t) st.slots[0].bTile.rows * st.slots[0].bTile.stride) * sizeof(int);
+
+    int binaryOutput = isBinaryFileName(fileResult);
+    int fdC = open(fileResult, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fdC < 0) {
+        fprintf(stderr, "Cannot open file %s for writing\n", fileResult);
+        exit(EXIT_FAILURE);
+    }
+    if (binaryOutput) {
+        writeBinaryMatrixHeader(fdC, fileResult, n, n, panel.stride, MATRIX_TYPE_INT32);
+    }
+
+    pthread_mutex_init(&st.lock, NULL);
+    pthread_cond_init(&st.changed, NULL);
+    pthread_t reader;
+    pthread_create(&reader, NULL, streamReader, &st);
+
+    int R = st.panelRows, T = st.tileEdge;
+    long step = 0;
+    for (int I = 0; I < n; I += R) {
+        zeroMatrix(&panel);
+        for (int K = 0; K < n; K += T) {
+            for (int J = 0; J < n; J += T, step++) {
+                double t0 = streamSeconds();
+                pthread_mutex_lock(&st.lock);
+                while (st.filled == 0) {
+                    pthread_cond_wait(&st.changed, &st.lock);
+                }
+                pthread_mutex_unlock(&st.lock);
+                double t1 = streamSeconds();
+
+                StreamStep *slot = &st.slots[step % 2];
+                Matrix cBlock = matrixView(&panel, 0, slot->J, slot->rows, slot->cols);
+                multiply(context, slot->aTile, &slot->bTile, &cBlock);
+                double t2 = streamSeconds();
+
+                pthread_mutex_lock(&st.lock);
+                st.filled--;
+                pthread_cond_broadcast(&st.changed);
+                pthread_mutex_unlock(&st.lock);
+                stats->readWaitTime += t1 - t0;
+                stats->computeTime += t2 - t1;
+            }
+        }
+
+        // Block row finished: write it out and reuse the buffer for the next one
+        double t0 = streamSeconds();
+        Matrix done = panel;
+        done.rows = minInt(R, n - I);
+        if (binaryOutput) {
+            size_t bytes = (size_t) done.rows * done.stride * sizeof(int);
+            pwriteAll(fdC, done.data, bytes,
+                      BINARY_MATRIX_DATA_OFFSET + (off_t) I * done.stride * (off_t) sizeof(int), fileResult);
+            stats->bytesWritten += bytes;
+        } else {
+            off_t before = lseek(fdC, 0, SEEK_CUR);
+            writeTextRows(fdC, &done, ioThreads, fileResult);
+            stats->bytesWritten += (size_t) (lseek(fdC, 0, SEEK_CUR) - before);
+        }
+        stats->writeTime += streamSeconds() - t0;
+    }
+
+    pthread_join(reader, NULL);
+    stats->bytesRead = st.bytesRead;
+    pthread_mutex_destroy(&st.lock);
+    pthread_cond_destroy(&st.changed);
+    close(fdC);
+    close(st.fdA);
+    close(st.fdB);
+    freeMatrix(&panel);
+    for (int b = 0; b < 2; b++) {
+        freeMatrix(&st.aTiles[b]);
+        freeMatrix(&st.slots[b].bTile);
+    }
+}
+
+// Function to print the streaming summary next to the usual timing line
+static inline void printStreamStats(const StreamStats *stats) {
+    printf("Streaming: %d-row block panels, %d x %d tiles, %.1f MB of buffers\n",
+           stats->panelRows, stats->tileEdge, stats->tileEdge, stats->memoryBytes / 1048576.0);
+    printf("Streaming: read %.1f MB, wrote %.1f MB, compute %.3f s, waiting for reads %.3f s, writing %.3f s\n",
+           stats->bytesRead / 1048576.0, stats->bytesWritten / 1048576.0,
+           stats->computeTime, stats->readWaitTime, stats->writeTime);
+}
+
+#endif
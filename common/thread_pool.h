@@ -0,0 +1,321 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// Persistent pthread pool with work-stealing deques.
+//
+// Workers are created once and sleep on a condition variable between jobs.
+// A job is an array of tasks that is split into contiguous ranges, one per
+// worker deque, so neighbouring tiles start on the same worker. Each worker
+// pops from the bottom of its own deque and, once it is empty, steals from
+// the top of the others (Chase-Lev deque), which rebalances uneven tiles and
+// slow (e.g. SMT-sibling) cores without any central queue.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+typedef struct {
+    void (*run)(void *arg, int index);
+    void *arg;
+    int index;
+} PoolTask;
+
+// Single-owner deque: the owner pushes and pops at the bottom, thieves take from the top
+typedef struct {
+    _Atomic long top;
+    _Atomic long bottom;
+    _Atomic(PoolTask *) *buffer;
+    long capacity;  // Power of two
+    char padding[64];  // Keep deques of different workers on different cache lines
+} WorkDeque;
+
+struct ThreadPool;
+
+typedef struct {
+    struct ThreadPool *pool;
+    int id;
+    int cpu;            // CPU the worker pins itself to, -1 to float freely
+    unsigned int seed;  // For picking steal victims
+} PoolWorker;
+
+typedef struct ThreadPool {
+    int numWorkers;
+    pthread_t *threads;
+    PoolWorker *workers;
+    WorkDeque *deques;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    long generation;    // Bumped for every job (protected by lock)
+    int busyWorkers;    // Workers that have not finished the current job (protected by lock)
+    int shutdown;
+    _Atomic long pending;  // Tasks of the current job that have not finished
+    void (*jobHook)(void *context, int worker, int starting);  // Optional, see threadPoolSetHook()
+    void *hookContext;
+} ThreadPool;
+
+// Worker currently running on this thread, NULL outside the pool
+static __thread PoolWorker *currentPoolWorker = NULL;
+
+// Function to push a task at the bottom of a deque (owner only). Returns 0 if the deque is full.
+static inline int dequePush(WorkDeque *d, PoolTask *task) {
+    long b = atomic_load(&d->bottom);
+    long t = atomic_load(&d->top);
+    if (b - t >= d->capacity) {
+        return 0;
+    }
+    atomic_store(&d->buffer[b & (d->capacity - 1)], task);
+    atomic_store(&d->bottom, b + 1);
+    return 1;
+}
+
+// Function to pop a task from the bottom of a deque (owner only)
+static inline PoolTask *dequePop(WorkDeque *d) {
+    long b = atomic_load(&d->bottom) - 1;
+    atomic_store(&d->bottom, b);
+    long t = atomic_load(&d->top);
+    if (t > b) {
+        atomic_store(&d->bottom, b + 1);
+        return NULL;
+    }
+    PoolTask *task = atomic_load(&d->buffer[b & (d->capacity - 1)]);
+    if (t == b) {
+        // Last task: race against thieves for it
+        if (!atomic_compare_exchange_strong(&d->top, &t, t + 1)) {
+            task = NULL;
+        }
+        atomic_store(&d->bottom, b + 1);
+    }
+    return task;
+}
+
+// Function to steal a task from the top of another worker's deque
+static inline PoolTask *dequeSteal(WorkDeque *d) {
+    long t = atomic_load(&d->top);
+    long b = atomic_load(&d->bottom);
+    if (t >= b) {
+        return NULL;
+    }
+    PoolTask *task = atomic_load(&d->buffer[t & (d->capacity - 1)]);
+    if (!atomic_compare_exchange_strong(&d->top, &t, t + 1)) {
+        return NULL;  // Another thief or the owner got it first
+    }
+    return task;
+}
+
+// Function to grow a deque to hold at least count tasks (only while the pool is idle)
+static inline void dequeReserve(WorkDeque *d, long count) {
+    if (count <= d->capacity) {
+        return;
+    }
+    long capacity = d->capacity > 0 ? d->capacity : 64;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    free(d->buffer);
+    d->buffer = malloc(capacity * sizeof(*d->buffer));
+    if (d->buffer == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    d->capacity = capacity;
+}
+
+// Function to execute tasks until the current job has none left
+static inline void runPoolTasks(ThreadPool *pool, PoolWorker *worker) {
+    WorkDeque *own = &pool->deques[worker->id];
+    while (atomic_load(&pool->pending) > 0) {
+        PoolTask *task = dequePop(own);
+        if (task == NULL) {
+            // Own deque is empty: try every other worker, starting at a random one
+            int start = (int) (rand_r(&worker->seed) % pool->numWorkers);
+            for (int v = 0; v < pool->numWorkers && task == NULL; v++) {
+                int victim = (start + v) % pool->numWorkers;
+                if (victim != worker->id) {
+                    task = dequeSteal(&pool->deques[victim]);
+                }
+            }
+        }
+        if (task == NULL) {
+            sched_yield();  // Remaining tasks are running elsewhere
+            continue;
+        }
+        task->run(task->arg, task->index);
+        atomic_fetch_sub(&pool->pending, 1);
+    }
+}
+
+static inline void *poolWorkerMain(void *arg) {
+    PoolWorker *worker = (PoolWorker *) arg;
+    ThreadPool *pool = worker->pool;
+    currentPoolWorker = worker;
+#ifdef CPU_SET
+    // Pinned before the first job, so everything the worker touches is allocated on its node
+    if (worker->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(worker->cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+            fprintf(stderr, "Cannot pin worker %d to CPU %d, running unpinned\n", worker->id, worker->cpu);
+        }
+    }
+#endif
+    long seen = 0;
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->generation == seen && !pool->shutdown) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->shutdown) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        void (*hook)(void *, int, int) = pool->jobHook;
+        if (hook != NULL) {
+            hook(pool->hookContext, worker->id, 1);
+        }
+        runPoolTasks(pool, worker);
+        if (hook != NULL) {
+            hook(pool->hookContext, worker->id, 0);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busyWorkers == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return NULL;
+}
+
+// Function to start a pool of numWorkers threads, worker w pinned to cpus[w]
+// (cpus may be NULL for unpinned workers; pinning needs _GNU_SOURCE)
+static inline ThreadPool *createPinnedThreadPool(int numWorkers, const int *cpus) {
+    ThreadPool *pool = calloc(1, sizeof(ThreadPool));
+    if (pool == NULL || numWorkers < 1) {
+        fprintf(stderr, "Cannot create a thread pool of %d worker(s)\n", numWorkers);
+        exit(EXIT_FAILURE);
+    }
+    pool->numWorkers = numWorkers;
+    pool->threads = malloc(numWorkers * sizeof(pthread_t));
+    pool->workers = malloc(numWorkers * sizeof(PoolWorker));
+    pool->deques = calloc(numWorkers, sizeof(WorkDeque));
+    if (pool->threads == NULL || pool->workers == NULL || pool->deques == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    atomic_init(&pool->pending, 0);
+    for (int w = 0; w < numWorkers; w++) {
+        atomic_init(&pool->deques[w].top, 0);
+        atomic_init(&pool->deques[w].bottom, 0);
+        dequeReserve(&pool->deques[w], 64);
+        pool->workers[w].pool = pool;
+        pool->workers[w].id = w;
+        pool->workers[w].cpu = cpus != NULL ? cpus[w] : -1;
+        pool->workers[w].seed = 0x9e3779b9u * (unsigned int) (w + 1);
+    }
+    for (int w = 0; w < numWorkers; w++) {
+        if (pthread_create(&pool->threads[w], NULL, poolWorkerMain, &pool->workers[w]) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return pool;
+}
+
+// Function to start a pool of numWorkers unpinned threads
+static inline ThreadPool *createThreadPool(int numWorkers) {
+    return createPinnedThreadPool(numWorkers, NULL);
+}
+
+// Function to run count tasks on the pool and wait until all of them have finished.
+// Worker w starts with the contiguous range of tasks [w*count/N, (w+1)*count/N).
+static inline void threadPoolRun(ThreadPool *pool, PoolTask *tasks, int count) {
+    if (count <= 0) {
+        return;
+    }
+    // No worker touches the deques between jobs, so they can be filled directly
+    int n = pool->numWorkers;
+    for (int w = 0; w < n; w++) {
+        long first = (long) count * w / n;
+        long last = (long) count * (w + 1) / n;
+        WorkDeque *d = &pool->deques[w];
+        dequeReserve(d, last - first);
+        atomic_store(&d->top, 0);
+        atomic_store(&d->bottom, 0);
+        // Pushed in reverse so the owner pops its range in order
+        for (long t = last - 1; t >= first; t--) {
+            dequePush(d, &tasks[t]);
+        }
+    }
+    atomic_store(&pool->pending, count);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->busyWorkers = n;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+    while (pool->busyWorkers > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Pool and task list the jobs of a plan are scheduled with: the context the
+// backends pass to the *RunTasks callbacks of the plans in common/. Task t
+// of a job runs as run(plan, t).
+typedef struct {
+    ThreadPool *pool;
+    PoolTask *tasks;    // Room for the largest job of the plan
+    void (*run)(void *plan, int index);
+} PoolRunner;
+
+// Function to run tasks 0..count-1 of plan on the runner's pool and wait for them
+static inline void poolRunnerRun(PoolRunner *runner, void *plan, int count) {
+    for (int t = 0; t < count; t++) {
+        runner->tasks[t].run   = runner->run;
+        runner->tasks[t].arg   = plan;
+        runner->tasks[t].index = t;
+    }
+    threadPoolRun(runner->pool, runner->tasks, count);
+}
+
+// Function to make every worker call hook(context, id, 1) before and
+// hook(context, id, 0) after its part of each following job (NULL to stop).
+// Must not be called while a job is running.
+static inline void threadPoolSetHook(ThreadPool *pool, void (*hook)(void *, int, int), void *context) {
+    pthread_mutex_lock(&pool->lock);
+    pool->jobHook = hook;
+    pool->hookContext = context;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Function to stop the workers and release the pool
+static inline void destroyThreadPool(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (int w = 0; w < pool->numWorkers; w++) {
+        pthread_join(pool->threads[w], NULL);
+    }
+    for (int w = 0; w < pool->numWorkers; w++) {
+        free(pool->deques[w].buffer);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->done);
+    free(pool->threads);
+    free(pool->workers);
+    free(pool->deques);
+    free(pool);
+}
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef TRANSPOSE_H
+#define TRANSPOSE_H
+
+// Explicit transpose of B for --transpose.
+//
+// The transposed kernels read B row by row (C[i, j] += sum_k A[i, k] * B[j, k]),
+// so --transpose first packs Bᵀ into a matrix of its own and multiplies A by
+// that: the result is A·B like every other method, and the pack is timed as a
+// separate stage. The copy is cache-oblivious: the longer side of a block is
+// halved until the block fits TRANSPOSE_LEAF x TRANSPOSE_LEAF, so both the
+// reads and the strided writes stay within a few cache lines per row at every
+// cache level without a tuned tile size. Backends with workers split the rows
+// of Bᵀ into bands of TRANSPOSE_BAND and hand them out with transposeBand().
+//
+// Batch products are small and square; they are transposed in place with
+// transposeSquareInPlace(), which swaps mirrored blocks the same recursive way.
+
+#include <stdint.h>
+#include "matrix.h"
+
+#define TRANSPOSE_LEAF 16   // Edge of the blocks copied element by element
+#define TRANSPOSE_BAND 64   // Rows of the destination per parallel task
+
+// Leaf copy dst[j][i] = src[i][j] for one element width
+#define TRANSPOSE_COPY(T)                                                                       \
+    for (int i = r0; i < r1; i++) {                                                             \
+        const T *restrict s = (const T *) src->data + (size_t) i * src->stride;                 \
+        T *restrict d = (T *) dst->data + i;                                                    \
+        for (int j = c0; j < c1; j++) {                                                         \
+            d[(size_t) j * dst->stride] = s[j];                                                 \
+        }                                                                                       \
+    }
+
+// Leaf swap m[i][j] <-> m[j][i] of two mirrored blocks (rows r0..r1, columns c0..c1
+// and their mirror); with diagonal set, the block is on the diagonal and only
+// the elements above it are swapped
+#define TRANSPOSE_SWAP(T)                                                                       \
+    for (int i = r0; i < r1; i++) {                                                             \
+        T *restrict row = (T *) m->data + (size_t) i * m->stride;                               \
+        T *restrict col = (T *) m->data + i;                                                    \
+        for (int j = diagonal ? i + 1 : c0; j < c1; j++) {                                      \
+            T value = row[j];                                                                   \
+            row[j] = col[(size_t) j * m->stride];                                               \
+            col[(size_t) j * m->stride] = value;                                                \
+        }                                                                                       \
+    }
+
+// Function to copy the transpose of rows r0..r1, columns c0..c1 of src into dst
+static inline void transposeBlock(const Matrix *src, Matrix *dst, int r0, int r1, int c0, int c1) {
+    if (r1 - r0 > TRANSPOSE_LEAF || c1 - c0 > TRANSPOSE_LEAF) {
+        if (r1 - r0 >= c1 - c0) {
+            int mid = r0 + (r1 - r0) / 2;
+            transposeBlock(src, dst, r0, mid, c0, c1);
+            transposeBlock(src, dst, mid, r1, c0, c1);
+        } else {
+            int mid = c0 + (c1 - c0) / 2;
+            transposeBlock(src, dst, r0, r1, c0, mid);
+            transposeBlock(src, dst, r0, r1, mid, c1);
+        }
+        return;
+    }
+    if (src->elemSize == 8) {
+        TRANSPOSE_COPY(uint64_t)
+    } else {
+        TRANSPOSE_COPY(uint32_t)
+    }
+}
+
+// Function to get the number of bands transposeBand() splits dst into
+static inline int transposeBandCount(const Matrix *src) {
+    return (src->cols + TRANSPOSE_BAND - 1) / TRANSPOSE_BAND;
+}
+
+// Function to write one band of rows of dst = srcᵀ (one band of columns of src)
+static inline void transposeBand(const Matrix *src, Matrix *dst, int band) {
+    int c0 = band * TRANSPOSE_BAND;
+    int c1 = c0 + TRANSPOSE_BAND < src->cols ? c0 + TRANSPOSE_BAND : src->cols;
+    transposeBlock(src, dst, 0, src->rows, c0, c1);
+}
+
+// Function to write dst = srcᵀ (dst must be src->cols x src->rows, same type)
+static inline void transposeMatrix(const Matrix *src, Matrix *dst) {
+    transposeBlock(src, dst, 0, src->rows, 0, src->cols);
+}
+
+// Function to swap rows r0..r1, columns c0..c1 of m with their mirror block;
+// diagonal means the block lies on the diagonal (r0 == c0, r1 == c1)
+static inline void transposeSwapBlock(Matrix *m, int r0, int r1, int c0, int c1, int diagonal) {
+    if (r1 - r0 > TRANSPOSE_LEAF || c1 - c0 > TRANSPOSE_LEAF) {
+        if (diagonal) {
+            int mid = r0 + (r1 - r0) / 2;
+            transposeSwapBlock(m, r0, mid, r0, mid, 1);
+            transposeSwapBlock(m, r0, mid, mid, r1, 0);
+            transposeSwapBlock(m, mid, r1, mid, r1, 1);
+        } else if (r1 - r0 >= c1 - c0) {
+            int mid = r0 + (r1 - r0) / 2;
+            transposeSwapBlock(m, r0, mid, c0, c1, 0);
+            transposeSwapBlock(m, mid, r1, c0, c1, 0);
+        } else {
+            int mid = c0 + (c1 - c0) / 2;
+            transposeSwapBlock(m, r0, r1, c0, mid, 0);
+            transposeSwapBlock(m, r0, r1, mid, c1, 0);
+        }
+        return;
+    }
+    if (m->elemSize == 8) {
+        TRANSPOSE_SWAP(uint64_t)
+    } else {
+        TRANSPOSE_SWAP(uint32_t)
+    }
+}
+
+// Function to transpose a square matrix in place
+static inline void transposeSquareInPlace(Matrix *m) {
+    transposeSwapBlock(m, 0, m->rows, 0, m->rows, 1);
+}
+
+#endif
@@ -0,0 +1,232 @@
+#ifndef TYPED_H
+#define TYPED_H
+
+// Kernels for the int64, float and double element types (--dtype).
+//
+// C has no templates, so typed_kernels.h is the template: it is included once
+// per element type below with ELEM/SUFFIX defined, which generates a full set
+// of kernels specialized for that type (multiplyStandardDouble, ...). The
+// vector kernels use GCC vector types of the element, so one body gives the
+// right instructions for every type and width (vmulpd/vfmadd for double,
+// vmulps for float, vpmullq or its emulation for int64). The int32 path keeps
+// its hand-written kernels from simd.h.
+//
+// Every kernel has the TypedTileKernel signature of blocked.h's TileKernel,
+// with untyped pointers; leading dimensions and indices are in elements.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "matrix.h"
+#include "blocked.h"
+#include "simd.h"
+
+typedef void (*TypedTileKernel)(const void *a, int lda, const void *b, int ldb, void *c, int ldc,
+                                int i0, int i1, int j0, int j1, int k0, int k1);
+
+// Kernels of one element type, selected for the running CPU
+typedef struct {
+    int type;
+    const char *isa;
+    TypedTileKernel scalarStandard;   // Dot product per element, C += A * B
+    TypedTileKernel scalarTranspose;  // Dot product per element, C += A * B^T
+    TypedTileKernel scalarTile;       // i-k-j tile (blocked method without --simd)
+    TypedTileKernel panel;            // Register-blocked vector kernel, C += A * B
+    TypedTileKernel transposed;       // Vector kernel for C += A * B^T
+} TypedKernels;
+
+// Multiplication methods of the typed path
+#define TYPED_STANDARD  0
+#define TYPED_TRANSPOSE 1
+#define TYPED_BLOCKED   2
+
+// Function to get the name of a typed method for the "Using ... method" line
+static inline const char *typedMethodName(int method) {
+    return method == TYPED_BLOCKED ? "blocked" : method == TYPED_TRANSPOSE ? "transpose" : "standard";
+}
+
+#define TYPED_PASTE2(name, suffix) name##suffix
+#define TYPED_PASTE(name, suffix) TYPED_PASTE2(name, suffix)
+#define TYPED_NAME(name) TYPED_PASTE(name, SUFFIX)
+
+// Unaligned vector load and store (matrix rows are only element aligned at tile edges)
+#define TYPED_LOAD(v, p) __builtin_memcpy(&(v), (p), sizeof(v))
+#define TYPED_STORE(p, v) __builtin_memcpy((p), &(v), sizeof(v))
+
+// Panel kernel body: 4 rows x 2 vectors of C stay in registers while k is
+// walked, like SIMD_PANEL_BODY in simd.h. TAIL handles leftover rows/columns.
+#define TYPED_PANEL_BODY(VEC, TAIL)                                                             \
+    const ELEM *a = ap, *b = bp;                                                                \
+    ELEM *c = cp;                                                                               \
+    const int W = (int) (sizeof(VEC) / sizeof(ELEM));                                           \
+    int jEnd = j0 + (j1 - j0) / (2 * W) * (2 * W);                                              \
+    int iEnd = i0 + (i1 - i0) / SIMD_MR * SIMD_MR;                                              \
+    for (int j = j0; j < jEnd; j += 2 * W){                                                     \
+        for (int i = i0; i < iEnd; i += SIMD_MR){                                               \
+            ELEM *c0 = c + (size_t) i * ldc + j;                                                \
+            ELEM *c1 = c0 + ldc, *c2 = c1 + ldc, *c3 = c2 + ldc;                                \
+            VEC c00, c01, c10, c11, c20, c21, c30, c31;                                         \
+            TYPED_LOAD(c00, c0); TYPED_LOAD(c01, c0 + W);                                       \
+            TYPED_LOAD(c10, c1); TYPED_LOAD(c11, c1 + W);                                       \
+            TYPED_LOAD(c20, c2); TYPED_LOAD(c21, c2 + W);                                       \
+            TYPED_LOAD(c30, c3); TYPED_LOAD(c31, c3 + W);                                       \
+            const ELEM *a0 = a + (size_t) i * lda;                                              \
+            const ELEM *a1 = a0 + lda, *a2 = a1 + lda, *a3 = a2 + lda;                          \
+            const ELEM *bk = b + (size_t) k0 * ldb + j;                                         \
+            for (int k = k0; k < k1; k++, bk += ldb){                                           \
+                VEC b0, b1;                                                                     \
+                TYPED_LOAD(b0, bk); TYPED_LOAD(b1, bk + W);                                     \
+                c00 += a0[k] * b0; c01 += a0[k] * b1;                                           \
+                c10 += a1[k] * b0; c11 += a1[k] * b1;                                           \
+                c20 += a2[k] * b0; c21 += a2[k] * b1;                                           \
+                c30 += a3[k] * b0; c31 += a3[k] * b1;                                           \
+            }                                                                                   \
+            TYPED_STORE(c0, c00); TYPED_STORE(c0 + W, c01);                                     \
+            TYPED_STORE(c1, c10); TYPED_STORE(c1 + W, c11);                                     \
+            TYPED_STORE(c2, c20); TYPED_STORE(c2 + W, c21);                                     \
+            TYPED_STORE(c3, c30); TYPED_STORE(c3 + W, c31);                                     \
+        }                                                                                       \
+    }                                                                                           \
+    /* Leftover rows and columns */                                                             \
+    if (iEnd < i1) TAIL(ap, lda, bp, ldb, cp, ldc, iEnd, i1, j0, jEnd, k0, k1);                 \
+    if (jEnd < j1) TAIL(ap, lda, bp, ldb, cp, ldc, i0, i1, jEnd, j1, k0, k1);
+
+// Transposed kernel body: 2 rows of A against 4 rows of B, vectorized over k,
+// like SIMD_TRANSPOSED_BODY in simd.h
+#define TYPED_TRANSPOSED_BODY(VEC, TAIL)                                                        \
+    const ELEM *a = ap, *b = bp;                                                                \
+    ELEM *c = cp;                                                                               \
+    const int W = (int) (sizeof(VEC) / sizeof(ELEM));                                           \
+    int iEnd = i0 + (i1 - i0) / 2 * 2;                                                          \
+    int jEnd = j0 + (j1 - j0) / 4 * 4;                                                          \
+    int kEnd = k0 + (k1 - k0) / W * W;                                                          \
+    for (int i = i0; i < iEnd; i += 2){                                                         \
+        const ELEM *a0 = a + (size_t) i * lda, *a1 = a0 + lda;                                  \
+        for (int j = j0; j < jEnd; j += 4){                                                     \
+            const ELEM *bj[4] = { b + (size_t) j * ldb, b + (size_t) (j + 1) * ldb,             \
+                                  b + (size_t) (j + 2) * ldb, b + (size_t) (j + 3) * ldb };     \
+            VEC s0[4] = { 0 }, s1[4] = { 0 };                                                   \
+            for (int k = k0; k < kEnd; k += W){                                                 \
+                VEC x0, x1;                                                                     \
+                TYPED_LOAD(x0, a0 + k); TYPED_LOAD(x1, a1 + k);                                 \
+                for (int q = 0; q < 4; q++){                                                    \
+                    VEC y;                                                                      \
+                    TYPED_LOAD(y, bj[q] + k);                                                   \
+                    s0[q] += x0 * y; s1[q] += x1 * y;                                           \
+                }                                                                               \
+            }                                                                                   \
+            ELEM *c0 = c + (size_t) i * ldc + j, *c1 = c0 + ldc;                                \
+            for (int q = 0; q < 4; q++){                                                        \
+                ELEM sum0 = 0, sum1 = 0;                                                        \
+                for (int l = 0; l < W; l++){                                                    \
+                    sum0 += s0[q][l]; sum1 += s1[q][l];                                         \
+                }                                                                               \
+                c0[q] += sum0; c1[q] += sum1;                                                   \
+            }                                                                                   \
+        }                                                                                       \
+    }                                                                                           \
+    /* Leftover k (only for the vectorized block), rows and columns */                          \
+    if (kEnd < k1) TAIL(ap, lda, bp, ldb, cp, ldc, i0, iEnd, j0, jEnd, kEnd, k1);               \
+    if (iEnd < i1) TAIL(ap, lda, bp, ldb, cp, ldc, iEnd, i1, j0, jEnd, k0, k1);                 \
+    if (jEnd < j1) TAIL(ap, lda, bp, ldb, cp, ldc, i0, i1, jEnd, j1, k0, k1);
+
+#define ELEM int64_t
+#define SUFFIX Int64
+#include "typed_kernels.h"
+#undef ELEM
+#undef SUFFIX
+
+#define ELEM float
+#define SUFFIX Float
+#include "typed_kernels.h"
+#undef ELEM
+#undef SUFFIX
+
+#define ELEM double
+#define SUFFIX Double
+#include "typed_kernels.h"
+#undef ELEM
+#undef SUFFIX
+
+// Function to get the kernels of one element type and ISA ("scalar", "sse4", "avx2", "avx512").
+// Returns 0 if the type has no typed kernels (int32) or the CPU cannot run that ISA.
+static inline int getTypedKernels(int type, const char *isa, TypedKernels *kernels) {
+    kernels->type = type;
+    switch (type) {
+        case MATRIX_TYPE_INT64:   return getTypedKernelsInt64(isa, kernels);
+        case MATRIX_TYPE_FLOAT32: return getTypedKernelsFloat(isa, kernels);
+        case MATRIX_TYPE_FLOAT64: return getTypedKernelsDouble(isa, kernels);
+        default:                  return 0;
+    }
+}
+
+// Function to pick the kernels of an element type at startup: the requested
+// ISA if given (exits if the CPU cannot run it), otherwise the widest one available
+static inline TypedKernels selectTypedKernels(int type, const char *requestedIsa) {
+    TypedKernels kernels;
+    if (requestedIsa != NULL && requestedIsa[0] != '\0') {
+        if (!getTypedKernels(type, requestedIsa, &kernels)) {
+            fprintf(stderr, "SIMD kernel '%s' for %s is unknown or not supported by this CPU\n",
+                    requestedIsa, matrixTypeName(type));
+            exit(EXIT_FAILURE);
+        }
+        return kernels;
+    }
+    const char *order[] = { "avx512", "avx2", "sse4", "scalar" };
+    for (int i = 0; i < 4; i++) {
+        if (getTypedKernels(type, order[i], &kernels)) {
+            return kernels;
+        }
+    }
+    fprintf(stderr, "No typed kernels for %s\n", matrixTypeName(type));
+    exit(EXIT_FAILURE);
+}
+
+// Function to walk the L3/L2/L1 tiles of one block, like multiplyBlockedLevel in blocked.h
+static inline void multiplyTypedBlockedLevel(const void *a, int lda, const void *b, int ldb, void *c, int ldc,
+                                             TypedTileKernel kernel, const int *edges, int level,
+                                             int i0, int i1, int j0, int j1, int k0, int k1) {
+    if (level < 0) {
+        kernel(a, lda, b, ldb, c, ldc, i0, i1, j0, j1, k0, k1);
+        return;
+    }
+    int t = edges[level];
+    for (int ii = i0; ii < i1; ii += t){
+        int iEnd = minInt(ii + t, i1);
+        for (int kk = k0; kk < k1; kk += t){
+            int kEnd = minInt(kk + t, k1);
+            for (int jj = j0; jj < j1; jj += t){
+                int jEnd = minInt(jj + t, j1);
+                multiplyTypedBlockedLevel(a, lda, b, ldb, c, ldc, kernel, edges, level - 1,
+                                          ii, iEnd, jj, jEnd, kk, kEnd);
+            }
+        }
+    }
+}
+
+// Function to compute the block [startRow, endRow) x [startCol, endCol) of the
+// result with one of the typed methods. The result must be initialized to 0.
+// With useSimd the vector kernels are used (for the blocked method, as the L1 tile kernel).
+static inline void multiplyTypedRange(const TypedKernels *kernels, int method, int useSimd,
+                                      const Matrix *matrix1, const Matrix *matrix2, Matrix *resultMatrix,
+                                      int startRow, int endRow, int startCol, int endCol,
+                                      const TileSizes *tiles) {
+    const void *a = matrix1->data, *b = matrix2->data;
+    void *c = resultMatrix->data;
+    int lda = matrix1->stride, ldb = matrix2->stride, ldc = resultMatrix->stride;
+    int depth = matrix1->cols;
+    if (method == TYPED_BLOCKED) {
+        int edges[3] = { tiles->l1, tiles->l2, tiles->l3 };
+        multiplyTypedBlockedLevel(a, lda, b, ldb, c, ldc, useSimd ? kernels->panel : kernels->scalarTile, edges, 2,
+                                  startRow, endRow, startCol, endCol, 0, depth);
+    } else if (method == TYPED_TRANSPOSE) {
+        TypedTileKernel kernel = useSimd ? kernels->transposed : kernels->scalarTranspose;
+        kernel(a, lda, b, ldb, c, ldc, startRow, endRow, startCol, endCol, 0, depth);
+    } else {
+        TypedTileKernel kernel = useSimd ? kernels->panel : kernels->scalarStandard;
+        kernel(a, lda, b, ldb, c, ldc, startRow, endRow, startCol, endCol, 0, depth);
+    }
+}
+
+#endif
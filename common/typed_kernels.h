@@ -0,0 +1,141 @@
+// Kernel template for one element type, instantiated by typed.h.
+//
+// No include guard on purpose: typed.h includes this file once per type with
+//   ELEM    the C element type (int64_t, float, double)
+//   SUFFIX  the suffix appended to every function name (Int64, Float, Double)
+// and every instantiation gets its own scalar loops and its own SSE4.1, AVX2
+// and AVX-512 panel kernels, built from GCC vector types of that element.
+
+// Function to compute C[i0:i1, j0:j1] += A[i0:i1, k0:k1] * B[k0:k1, j0:j1] one dot product at a time
+static void TYPED_NAME(multiplyStandard)(const void *ap, int lda, const void *bp, int ldb, void *cp, int ldc,
+                                         int i0, int i1, int j0, int j1, int k0, int k1) {
+    const ELEM *restrict a = ap;
+    const ELEM *restrict b = bp;
+    ELEM *restrict c = cp;
+    for (int i = i0; i < i1; i++){
+        for (int j = j0; j < j1; j++){
+            ELEM sum = 0;
+            for (int k = k0; k < k1; k++){
+                sum += a[(size_t) i * lda + k] * b[(size_t) k * ldb + j];
+            }
+            c[(size_t) i * ldc + j] += sum;
+        }
+    }
+}
+
+// Function to compute C[i0:i1, j0:j1] += A[i0:i1, k0:k1] * B[j0:j1, k0:k1]^T
+static void TYPED_NAME(multiplyTransposed)(const void *ap, int lda, const void *bp, int ldb, void *cp, int ldc,
+                                           int i0, int i1, int j0, int j1, int k0, int k1) {
+    const ELEM *restrict a = ap;
+    const ELEM *restrict b = bp;
+    ELEM *restrict c = cp;
+    for (int i = i0; i < i1; i++){
+        const ELEM *restrict aRow = a + (size_t) i * lda;
+        for (int j = j0; j < j1; j++){
+            const ELEM *restrict bRow = b + (size_t) j * ldb;
+            ELEM sum = 0;
+            for (int k = k0; k < k1; k++){
+                sum += aRow[k] * bRow[k];
+            }
+            c[(size_t) i * ldc + j] += sum;
+        }
+    }
+}
+
+// Function to compute one tile in i-k-j order (unit stride on B and C), the
+// scalar tile kernel of the blocked method
+static void TYPED_NAME(multiplyTile)(const void *ap, int lda, const void *bp, int ldb, void *cp, int ldc,
+                                     int i0, int i1, int j0, int j1, int k0, int k1) {
+    const ELEM *restrict a = ap;
+    const ELEM *restrict b = bp;
+    ELEM *restrict c = cp;
+    for (int i = i0; i < i1; i++){
+        ELEM *restrict cRow = c + (size_t) i * ldc;
+        for (int k = k0; k < k1; k++){
+            ELEM aik = a[(size_t) i * lda + k];
+            const ELEM *restrict bRow = b + (size_t) k * ldb;
+            for (int j = j0; j < j1; j++){
+                cRow[j] += aik * bRow[j];
+            }
+        }
+    }
+}
+
+#ifdef SIMD_X86
+
+typedef ELEM TYPED_NAME(Vec16) __attribute__((vector_size(16)));
+typedef ELEM TYPED_NAME(Vec32) __attribute__((vector_size(32)));
+typedef ELEM TYPED_NAME(Vec64) __attribute__((vector_size(64)));
+
+__attribute__((target("sse4.1")))
+static void TYPED_NAME(multiplyPanelSse4)(const void *ap, int lda, const void *bp, int ldb, void *cp, int ldc,
+                                          int i0, int i1, int j0, int j1, int k0, int k1) {
+    TYPED_PANEL_BODY(TYPED_NAME(Vec16), TYPED_NAME(multiplyTile))
+}
+
+__attribute__((target("sse4.1")))
+static void TYPED_NAME(multiplyTransposedSse4)(const void *ap, int lda, const void *bp, int ldb, void *cp, int ldc,
+                                               int i0, int i1, int j0, int j1, int k0, int k1) {
+    TYPED_TRANSPOSED_BODY(TYPED_NAME(Vec16), TYPED_NAME(multiplyTransposed))
+}
+
+__attribute__((target("avx2,fma")))
+static void TYPED_NAME(multiplyPanelAvx2)(const void *ap, int lda, const void *bp, int ldb, void *cp, int ldc,
+                                          int i0, int i1, int j0, int j1, int k0, int k1) {
+    TYPED_PANEL_BODY(TYPED_NAME(Vec32), TYPED_NAME(multiplyTile))
+}
+
+__attribute__((target("avx2,fma")))
+static void TYPED_NAME(multiplyTransposedAvx2)(const void *ap, int lda, const void *bp, int ldb, void *cp, int ldc,
+                                               int i0, int i1, int j0, int j1, int k0, int k1) {
+    TYPED_TRANSPOSED_BODY(TYPED_NAME(Vec32), TYPED_NAME(multiplyTransposed))
+}
+
+__attribute__((target("avx512f")))
+static void TYPED_NAME(multiplyPanelAvx512)(const void *ap, int lda, const void *bp, int ldb, void *cp, int ldc,
+                                            int i0, int i1, int j0, int j1, int k0, int k1) {
+    TYPED_PANEL_BODY(TYPED_NAME(Vec64), TYPED_NAME(multiplyTile))
+}
+
+__attribute__((target("avx512f")))
+static void TYPED_NAME(multiplyTransposedAvx512)(const void *ap, int lda, const void *bp, int ldb, void *cp, int ldc,
+                                                 int i0, int i1, int j0, int j1, int k0, int k1) {
+    TYPED_TRANSPOSED_BODY(TYPED_NAME(Vec64), TYPED_NAME(multiplyTransposed))
+}
+
+#endif
+
+// Function to get the kernels of this element type for one ISA name
+static int TYPED_NAME(getTypedKernels)(const char *isa, TypedKernels *kernels) {
+    kernels->scalarStandard = TYPED_NAME(multiplyStandard);
+    kernels->scalarTranspose = TYPED_NAME(multiplyTransposed);
+    kernels->scalarTile = TYPED_NAME(multiplyTile);
+    if (strcmp(isa, "scalar") == 0) {
+        kernels->isa = "scalar";
+        kernels->panel = TYPED_NAME(multiplyTile);
+        kernels->transposed = TYPED_NAME(multiplyTransposed);
+        return 1;
+    }
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (strcmp(isa, "sse4") == 0 && __builtin_cpu_supports("sse4.1")) {
+        kernels->isa = "sse4";
+        kernels->panel = TYPED_NAME(multiplyPanelSse4);
+        kernels->transposed = TYPED_NAME(multiplyTransposedSse4);
+        return 1;
+    }
+    if (strcmp(isa, "avx2") == 0 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        kernels->isa = "avx2";
+        kernels->panel = TYPED_NAME(multiplyPanelAvx2);
+        kernels->transposed = TYPED_NAME(multiplyTransposedAvx2);
+        return 1;
+    }
+    if (strcmp(isa, "avx512") == 0 && __builtin_cpu_supports("avx512f")) {
+        kernels->isa = "avx512";
+        kernels->panel = TYPED_NAME(multiplyPanelAvx512);
+        kernels->transposed = TYPED_NAME(multiplyTransposedAvx512);
+        return 1;
+    }
+#endif
+    return 0;
+}
@@ -0,0 +1,368 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+// Verification of a product without recomputing it (--verify).
+//
+// Freivalds' check: for a random matrix R of v column vectors, A·(B·R) must
+// equal C·R. Both sides cost O(n²·v) instead of O(n³), and a wrong C passes a
+// random vector with probability at most 1/2 (far less in practice), so the
+// v independent vectors of --verify-rounds (default 8) bound it by 2^-v. The
+// checksum mode uses the two fixed vectors of the ABFT checksums instead, all
+// ones and 1, 2, ..., n: it is deterministic, catches any single wrong element
+// and locates its column (weighted row sum over plain row sum).
+//
+// Integer types are checked exactly, in the same wrap-around arithmetic as the
+// kernels (computed modulo 2^64, compared modulo 2^32 for int32). For float and
+// double both sides are computed in double together with |A|·(|B|·|R|) and
+// |C|·|R|, and a row fails when the difference exceeds 4·√k·ε of those bounds
+// (k the inner dimension, ε of the element type), a margin over the typical
+// rounding of the product. Wrong elements below that noise are not reported.
+//
+// The two passes (B·R, then A·(B·R) and C·R with the comparison) are split into
+// row blocks that the backend runs through a callback, like the sparse kernels;
+// without a callback they run in order on the calling thread. The buffers are
+// shared mappings, so forked children can run the blocks too.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "matrix.h"
+
+#define VERIFY_OFF       0
+#define VERIFY_FREIVALDS 1
+#define VERIFY_CHECKSUM  2
+
+#define VERIFY_MAX_VECTORS    16
+#define VERIFY_DEFAULT_ROUNDS 8
+
+struct VerifyPlan;
+
+// Callback that runs tasks 0 .. count-1 of the current pass, each through
+// verifyRunTask(); tasks of one pass are independent
+typedef void (*VerifyRunTasks)(void *context, struct VerifyPlan *plan, int count);
+
+typedef struct VerifyPlan {
+    int mode;                   // VERIFY_FREIVALDS or VERIFY_CHECKSUM
+    int vectors;                // Columns of R
+    int integer;                // int32/int64: exact check
+    const Matrix *a, *b, *c;
+    int numTasks;
+    int pass;                   // 0: Y = B·R, 1: compare A·Y with C·R
+    uint64_t *r, *y;            // Integer types: R (b->cols x vectors) and Y (b->rows x vectors)
+    double *fr, *frAbs;         // Floating types: R and |R|
+    double *fy, *fyAbs;         // Floating types: Y and |B|·|R|
+    double tolerance;           // Floating types: allowed difference relative to the bound
+    int *taskBad;               // Per task: rows that failed, first one, its located column
+    int *taskFirst;
+    int *taskColumn;
+    double *taskError;          // Per task: largest difference relative to the bound
+    size_t bytes;               // Size of the shared mapping behind the buffers
+    VerifyRunTasks run;
+    void *context;
+} VerifyPlan;
+
+typedef struct {
+    int badRows;                // Rows of C whose check failed
+    int firstRow;               // First of them, or -1
+    int column;                 // Column of the error in that row (checksum mode), or -1
+    double maxError;            // Floating types: largest difference relative to the bound
+    double seconds;
+} VerifyResult;
+
+// Function to parse the --verify mode
+static inline int parseVerifyMode(const char *name) {
+    if (strcmp(name, "freivalds") == 0) {
+        return VERIFY_FREIVALDS;
+    } else if (strcmp(name, "checksum") == 0) {
+        return VERIFY_CHECKSUM;
+    } else if (strcmp(name, "off") == 0) {
+        return VERIFY_OFF;
+    }
+    fprintf(stderr, "Unknown verify mode '%s' (use freivalds, checksum or off)\n", name);
+    exit(EXIT_FAILURE);
+}
+
+// Function to draw the next number of a splitmix64 sequence
+static inline uint64_t verifyRandom(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Function to get |x| without linking libm
+static inline double verifyAbs(double x) {
+    return x < 0 ? -x : x;
+}
+
+// Function to get the square root of x >= 1 with Newton steps, also without libm
+static inline double verifySqrt(double x) {
+    double root = x;
+    for (int step = 0; step < 64 && root * root - x > 1e-9 * x; step++) {
+        root = (root + x / root) / 2;
+    }
+    return root;
+}
+
+// Row times vectors for one integer element type, the body of verifyRowInteger()
+#define VERIFY_ROW_INTEGER(ELEM)                                                \
+    do {                                                                        \
+        const ELEM *row = matrixRowAt(m, i);                                    \
+        for (int k = 0; k < m->cols; k++) {                                     \
+            uint64_t x = (uint64_t) (int64_t) row[k];                           \
+            const uint64_t *vec = in + (size_t) k * v;                          \
+            for (int t = 0; t < v; t++) {                                       \
+                acc[t] += x * vec[t];                                           \
+            }                                                                   \
+        }                                                                       \
+    } while (0)
+
+// Function to compute out = row i of m times in (m->cols x v) modulo 2^64;
+// m is int32 or int64, or int8/int16 narrow storage of int32 inputs
+static inline void verifyRowInteger(const Matrix *m, int i, const uint64_t *in, int v, uint64_t *out) {
+    uint64_t acc[VERIFY_MAX_VECTORS] = { 0 };
+    switch (m->type) {
+        case MATRIX_TYPE_INT32: VERIFY_ROW_INTEGER(int32_t); break;
+        case MATRIX_TYPE_INT16: VERIFY_ROW_INTEGER(int16_t); break;
+        case MATRIX_TYPE_INT8:  VERIFY_ROW_INTEGER(int8_t); break;
+        default:                VERIFY_ROW_INTEGER(int64_t); break;
+    }
+    memcpy(out, acc, v * sizeof(uint64_t));
+}
+
+// Function to compute out = row i of m times in, and outAbs = |row i| times inAbs,
+// for a float or double matrix
+static inline void verifyRowFloat(const Matrix *m, int i, const double *in, const double *inAbs, int v,
+                                  double *out, double *outAbs) {
+    double acc[VERIFY_MAX_VECTORS] = { 0 }, accAbs[VERIFY_MAX_VECTORS] = { 0 };
+    const float *rowFloat = matrixRowAt(m, i);
+    const double *rowDouble = matrixRowAt(m, i);
+    for (int k = 0; k < m->cols; k++) {
+        double x = m->type == MATRIX_TYPE_FLOAT32 ? rowFloat[k] : rowDouble[k];
+        const double *vec = in + (size_t) k * v, *vecAbs = inAbs + (size_t) k * v;
+        for (int t = 0; t < v; t++) {
+            acc[t] += x * vec[t];
+            accAbs[t] += verifyAbs(x) * vecAbs[t];
+        }
+    }
+    memcpy(out, acc, v * sizeof(double));
+    memcpy(outAbs, accAbs, v * sizeof(double));
+}
+
+// Function to create the plan: draws R (or sets the checksum vectors) and
+// sizes the row blocks, a few per worker
+static inline VerifyPlan createVerifyPlan(int mode, int rounds, const Matrix *a, const Matrix *b, const Matrix *c,
+                                          int workers, VerifyRunTasks run, void *context) {
+    VerifyPlan plan;
+    memset(&plan, 0, sizeof(plan));
+    if (rounds < 1 || rounds > VERIFY_MAX_VECTORS) {
+        fprintf(stderr, "--verify-rounds must be in 1..%d\n", VERIFY_MAX_VECTORS);
+        exit(EXIT_FAILURE);
+    }
+    plan.mode = mode;
+    plan.vectors = mode == VERIFY_CHECKSUM ? 2 : rounds;
+    plan.integer = c->type == MATRIX_TYPE_INT32 || c->type == MATRIX_TYPE_INT64;
+    plan.a = a;
+    plan.b = b;
+    plan.c = c;
+    int rows = c->rows > b->rows ? c->rows : b->rows;
+    plan.numTasks = 4 * (workers > 0 ? workers : 1);
+    if (plan.numTasks > rows) {
+        plan.numTasks = rows > 0 ? rows : 1;
+    }
+    plan.run = run;
+    plan.context = context;
+
+    // One shared mapping: R and Y (and their bounds for the floating types), then the per-task results
+    size_t v = plan.vectors;
+    size_t vectorBytes = 2 * ((size_t) b->cols + (size_t) b->rows) * v * 8;
+    size_t taskBytes = (3 * (size_t) plan.numTasks + 1) * sizeof(int) + (size_t) plan.numTasks * sizeof(double);
+    plan.bytes = vectorBytes + taskBytes;
+    char *memory = mmap(NULL, plan.bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    uint64_t seed = (uint64_t) time(NULL) ^ ((uint64_t) (uintptr_t) memory << 16);
+    if (plan.integer) {
+        plan.r = (uint64_t *) memory;
+        plan.y = plan.r + (size_t) b->cols * v;
+        memory = (char *) (plan.y + (size_t) b->rows * v);
+        for (int k = 0; k < b->cols; k++) {
+            for (size_t t = 0; t < v; t++) {
+                plan.r[k * v + t] = mode == VERIFY_CHECKSUM ? (t == 0 ? 1 : (uint64_t) k + 1) : verifyRandom(&seed);
+            }
+        }
+    } else {
+        plan.fr = (double *) memory;
+        plan.frAbs = plan.fr + (size_t) b->cols * v;
+        plan.fy = plan.frAbs + (size_t) b->cols * v;
+        plan.fyAbs = plan.fy + (size_t) b->rows * v;
+        memory = (char *) (plan.fyAbs + (size_t) b->rows * v);
+        for (int k = 0; k < b->cols; k++) {
+            for (size_t t = 0; t < v; t++) {
+                // Uniform in [-1, 1), so positive and negative errors cannot cancel out systematically
+                double x = (double) (verifyRandom(&seed) >> 11) / 9007199254740992.0 * 2.0 - 1.0;
+                plan.fr[k * v + t] = mode == VERIFY_CHECKSUM ? (t == 0 ? 1.0 : (double) k + 1) : x;
+                plan.frAbs[k * v + t] = verifyAbs(plan.fr[k * v + t]);
+            }
+        }
+        double epsilon = c->type == MATRIX_TYPE_FLOAT32 ? FLT_EPSILON : DBL_EPSILON;
+        plan.tolerance = 4.0 * verifySqrt(a->cols + 2.0) * epsilon;
+    }
+    plan.taskBad = (int *) memory;
+    plan.taskFirst = plan.taskBad + plan.numTasks;
+    plan.taskColumn = plan.taskFirst + plan.numTasks;
+    plan.taskError = (double *) (plan.taskColumn + plan.numTasks + (plan.numTasks & 1));
+    return plan;
+}
+
+// Function to locate the column of a single wrong element of row i from the
+// differences of the plain and weighted checksums, or -1
+static inline int verifyLocateColumn(const VerifyPlan *plan, double plain, double weighted) {
+    if (plan->mode != VERIFY_CHECKSUM || plain == 0) {
+        return -1;
+    }
+    double column = weighted / plain - 1;
+    if (column < -0.5 || column > plan->c->cols - 0.5) {
+        return -1;
+    }
+    int rounded = (int) (column + 0.5);
+    return verifyAbs(column - rounded) > 1e-6 ? -1 : rounded;
+}
+
+// Function to run one row block of the current pass
+static inline void verifyRunTask(VerifyPlan *plan, int task) {
+    int v = plan->vectors;
+    if (plan->pass == 0) {
+        int r0 = (int) ((long) plan->b->rows * task / plan->numTasks);
+        int r1 = (int) ((long) plan->b->rows * (task + 1) / plan->numTasks);
+        for (int i = r0; i < r1; i++) {
+            if (plan->integer) {
+                verifyRowInteger(plan->b, i, plan->r, v, plan->y + (size_t) i * v);
+            } else {
+                verifyRowFloat(plan->b, i, plan->fr, plan->frAbs, v, plan->fy + (size_t) i * v,
+                               plan->fyAbs + (size_t) i * v);
+            }
+        }
+        return;
+    }
+    int r0 = (int) ((long) plan->c->rows * task / plan->numTasks);
+    int r1 = (int) ((long) plan->c->rows * (task + 1) / plan->numTasks);
+    int bad = 0, first = -1, column = -1;
+    double worst = 0;
+    for (int i = r0; i < r1; i++) {
+        int wrong = 0;
+        double plain = 0, weighted = 0;
+        if (plan->integer) {
+            uint64_t z[VERIFY_MAX_VECTORS], w[VERIFY_MAX_VECTORS];
+            verifyRowInteger(plan->a, i, plan->y, v, z);
+            verifyRowInteger(plan->c, i, plan->r, v, w);
+            int64_t difference[VERIFY_MAX_VECTORS];
+            for (int t = 0; t < v; t++) {
+                difference[t] = plan->c->type == MATRIX_TYPE_INT32 ? (int32_t) (uint32_t) (w[t] - z[t])
+                                                                   : (int64_t) (w[t] - z[t]);
+                wrong |= difference[t] != 0;
+            }
+            if (v == 2) {
+                plain = (double) difference[0];
+                weighted = (double) difference[1];
+            }
+        } else {
+            double z[VERIFY_MAX_VECTORS], zAbs[VERIFY_MAX_VECTORS], w[VERIFY_MAX_VECTORS], wAbs[VERIFY_MAX_VECTORS];
+            verifyRowFloat(plan->a, i, plan->fy, plan->fyAbs, v, z, zAbs);
+            verifyRowFloat(plan->c, i, plan->fr, plan->frAbs, v, w, wAbs);
+            for (int t = 0; t < v; t++) {
+                double bound = plan->tolerance * (zAbs[t] + wAbs[t]);
+                double difference = verifyAbs(w[t] - z[t]);
+                // Not-a-number in C fails as well
+                if (!(difference <= bound)) {
+                    wrong = 1;
+                }
+                if (bound > 0 && difference / bound > worst) {
+                    worst = difference / bound;
+                }
+            }
+            if (v == 2) {
+                plain = w[0] - z[0];
+                weighted = w[1] - z[1];
+            }
+        }
+        if (wrong) {
+            if (bad++ == 0) {
+                first = i;
+                column = verifyLocateColumn(plan, plain, weighted);
+            }
+        }
+    }
+    plan->taskBad[task] = bad;
+    plan->taskFirst[task] = first;
+    plan->taskColumn[task] = column;
+    plan->taskError[task] = worst;
+}
+
+// Function to run both passes and gather the result
+static inline VerifyResult verifyProduct(VerifyPlan *plan) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (plan->pass = 0; plan->pass < 2; plan->pass++) {
+        if (plan->run != NULL) {
+            plan->run(plan->context, plan, plan->numTasks);
+        } else {
+            for (int t = 0; t < plan->numTasks; t++) {
+                verifyRunTask(plan, t);
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    VerifyResult result = { 0, -1, -1, 0, 0 };
+    for (int t = 0; t < plan->numTasks; t++) {
+        if (plan->taskBad[t] > 0 && result.firstRow < 0) {
+            result.firstRow = plan->taskFirst[t];
+            result.column = plan->taskColumn[t];
+        }
+        result.badRows += plan->taskBad[t];
+        if (plan->taskError[t] > result.maxError) {
+            result.maxError = plan->taskError[t];
+        }
+    }
+    result.seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    return result;
+}
+
+// Function to print the outcome of a verification. Returns 1 when it passed.
+static inline int printVerifyResult(const VerifyPlan *plan, const VerifyResult *result) {
+    char method[64];
+    if (plan->mode == VERIFY_CHECKSUM) {
+        snprintf(method, sizeof(method), "row checksums");
+    } else {
+        snprintf(method, sizeof(method), "Freivalds, %d random vector(s)", plan->vectors);
+    }
+    char error[64] = "";
+    if (!plan->integer) {
+        snprintf(error, sizeof(error), ", worst row at %.3g of the rounding bound", result->maxError);
+    }
+    if (result->badRows == 0) {
+        printf("Verification (%s): passed in %.9f seconds%s\n", method, result->seconds, error);
+        return 1;
+    }
+    char where[64] = "";
+    if (result->column >= 0) {
+        snprintf(where, sizeof(where), ", column %d", result->column);
+    }
+    printf("Verification (%s): FAILED, %d row(s) differ, first at row %d%s\n", method, result->badRows,
+           result->firstRow, where);
+    return 0;
+}
+
+// Function to release the buffers of a plan
+static inline void freeVerifyPlan(VerifyPlan *plan) {
+    munmap(plan->r != NULL ? (void *) plan->r : (void *) plan->fr, plan->bytes);
+}
+
+#endif
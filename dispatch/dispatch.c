@@ -0,0 +1,573 @@
+#define _GNU_SOURCE  // readlink, MAP_POPULATE, CLOCK_MONOTONIC
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <sys/wait.h>
+#include "../common/matrix.h"
+#include "../common/sparse.h"
+
+// Front-end that runs every multiplication on the backend that is fastest for
+// its size. A threshold table, measured on this host by --calibrate (see
+// install.sh), maps each element type and range of n to a backend binary, a
+// worker count and a kernel variant; the dispatcher looks n up and execs that
+// backend with the caller's arguments, so small products never pay for
+// thread or process startup and large ones never run on a single core.
+//
+// Table format (one rule per line, '#' starts a comment):
+//   dtype  maxN  backend  workers  flags...
+// Rules are matched in order, the first one whose dtype matches and whose
+// maxN is >= n (or "max") wins.
+
+#define MAX_RULES 64
+#define MAX_FLAGS 64
+#define MAX_ARGS 256
+
+typedef struct {
+    int dtype;              // MATRIX_TYPE_*
+    int maxN;               // Largest n the rule applies to, 0 for no limit
+    char backend[16];       // sequential, threads, processes or omp
+    int workers;
+    char flags[MAX_FLAGS];  // Kernel variant, e.g. "--blocked --simd"
+} DispatchRule;
+
+typedef struct {
+    int count;
+    DispatchRule rules[MAX_RULES];
+} DispatchTable;
+
+// Kernel variants tried by --calibrate. --transpose packs Bᵀ in its timed
+// stage and computes A * B like the others; with --blocked it is ignored, so
+// "--blocked --transpose" would only repeat "--blocked --simd".
+static const char *calibrationVariants[] = { "--simd", "--transpose --simd", "--blocked --simd" };
+#define NUM_VARIANTS 3
+
+// A candidate must beat the simpler ones tried before it by this factor, so
+// timing noise does not flip the table between equivalent choices
+#define CALIBRATION_MARGIN 0.95
+
+// Options of the backends. Every backend takes the shared ones; the others are
+// implemented by some backends only, and a backend ignores an option it does
+// not know, so a product is never sent to a backend that lacks one of its
+// options (see missingOption()). Listed in the order a product is rerouted.
+#define SHARED_OPTIONS "--files --result --dtype --batch --chain --verify --verify-rounds --perf --hugepages " \
+                       "--transpose --blocked --simd --isa --tiles --no-fixed --narrow"
+#define DENSE_OPTIONS "--cutoff --pipeline --strassen --stream " \
+                      "--shape --alpha --beta --transa --transb --layout --cfile"
+static const struct {
+    const char *backend;
+    const char *options;
+} backendOptions[] = {
+    { "threads", DENSE_OPTIONS " --sparse --sparse-threshold --affinity --doublethreads --numa --smt --tasktile" },
+    { "omp", DENSE_OPTIONS " --sparse --sparse-threshold" },
+    { "processes", "--affinity --doublethreads --numa --smt --pool --populate --repeat" },
+    { "sequential", DENSE_OPTIONS },
+};
+#define NUM_BACKENDS 4
+
+// Function to check whether a space-separated list contains word
+int listHasWord(const char *list, const char *word) {
+    size_t length = strlen(word);
+    for (const char *p = strstr(list, word); p != NULL; p = strstr(p + 1, word)) {
+        if ((p == list || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0')) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Function to get the first option of args that backend does not implement,
+// NULL if it has them all. Options no backend knows are not checked.
+const char *missingOption(const char *backend, char **args, int count) {
+    for (int i = 0; i < count; i++) {
+        if (strncmp(args[i], "--", 2) != 0 || listHasWord(SHARED_OPTIONS, args[i])) {
+            continue;
+        }
+        int known = 0, implemented = 0;
+        for (int b = 0; b < NUM_BACKENDS; b++) {
+            int has = listHasWord(backendOptions[b].options, args[i]);
+            known |= has;
+            implemented |= has && strcmp(backendOptions[b].backend, backend) == 0;
+        }
+        if (known && !implemented) {
+            return args[i];
+        }
+    }
+    return NULL;
+}
+
+// Function to get the option that sets the worker count of a backend, NULL if it has none
+const char *workerOption(const char *backend) {
+    if (strcmp(backend, "threads") == 0 || strcmp(backend, "omp") == 0) {
+        return "--threads";
+    }
+    if (strcmp(backend, "processes") == 0) {
+        return "--processes";
+    }
+    return NULL;
+}
+
+// Function to build the table used when no calibration was run: the crossover
+// of the measurements in README.md (sequential up to n = 100, then all cores)
+void defaultDispatchTable(DispatchTable *table, int numCPUs) {
+    table->count = 2;
+    table->rules[0] = (DispatchRule) { MATRIX_TYPE_INT32, 100, "sequential", 1, "--simd" };
+    table->rules[1] = (DispatchRule) { MATRIX_TYPE_INT32, 0, "threads", numCPUs, "--blocked --simd" };
+}
+
+// Function to read a threshold table. Returns 0 if the file does not exist.
+int readDispatchTable(const char *fileName, DispatchTable *table) {
+    FILE *file = fopen(fileName, "r");
+    if (file == NULL) {
+        return 0;
+    }
+    char line[256];
+    int lineNumber = 0;
+    table->count = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        lineNumber++;
+        char *hash = strchr(line, '#');
+        if (hash != NULL) {
+            *hash = '\0';
+        }
+        char dtype[16], maxN[16];
+        DispatchRule rule;
+        int used = 0;
+        int fields = sscanf(line, "%15s %15s %15s %d %n", dtype, maxN, rule.backend, &rule.workers, &used);
+        if (fields <= 0) {
+            continue;  // Blank or comment line
+        }
+        if (fields < 4 || table->count == MAX_RULES) {
+            fprintf(stderr, "Error reading file %s: bad rule on line %d\n", fileName, lineNumber);
+            exit(EXIT_FAILURE);
+        }
+        rule.dtype = parseMatrixType(dtype);
+        rule.maxN = strcmp(maxN, "max") == 0 ? 0 : atoi(maxN);
+        snprintf(rule.flags, sizeof(rule.flags), "%s", line + used);
+        rule.flags[strcspn(rule.flags, "\r\n")] = '\0';
+        table->rules[table->count++] = rule;
+    }
+    fclose(file);
+    return 1;
+}
+
+// Function to write a threshold table
+void writeDispatchTable(const char *fileName, const DispatchTable *table) {
+    FILE *file = fopen(fileName, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Cannot open file %s for writing\n", fileName);
+        exit(EXIT_FAILURE);
+    }
+    time_t now = time(NULL);
+    fprintf(file, "# Calibrated by dispatch --calibrate on %s", ctime(&now));
+    fprintf(file, "# dtype  maxN  backend  workers  flags\n");
+    for (int r = 0; r < table->count; r++) {
+        const DispatchRule *rule = &table->rules[r];
+        char maxN[16] = "max";
+        if (rule->maxN > 0) {
+            snprintf(maxN, sizeof(maxN), "%d", rule->maxN);
+        }
+        fprintf(file, "%-6s  %-5s %-10s %3d  %s\n", matrixTypeName(rule->dtype), maxN,
+                rule->backend, rule->workers, rule->flags);
+    }
+    fclose(file);
+}
+
+// Function to find the rule for n elements of dtype, falling back to the int32 rules
+const DispatchRule *lookupRule(const DispatchTable *table, int dtype, int n) {
+    for (int pass = 0; pass < 2; pass++) {
+        int wanted = pass == 0 ? dtype : MATRIX_TYPE_INT32;
+        for (int r = 0; r < table->count; r++) {
+            const DispatchRule *rule = &table->rules[r];
+            if (rule->dtype == wanted && (rule->maxN == 0 || n <= rule->maxN)) {
+                return rule;
+            }
+        }
+    }
+    return NULL;
+}
+
+// Function to append the words of a flag string to an argument list
+void appendFlags(char **args, int *count, char *flags) {
+    for (char *word = strtok(flags, " \t"); word != NULL; word = strtok(NULL, " \t")) {
+        if (*count < MAX_ARGS - 1) {
+            args[(*count)++] = word;
+        }
+    }
+}
+
+// Function to run a backend with its output captured, returning its wall-clock
+// time in seconds (startup included) or -1 if it failed
+double runBackend(char **args) {
+    int pipeFds[2];
+    if (pipe(pipeFds) == -1) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    } else if (pid == 0) {
+        dup2(pipeFds[1], STDOUT_FILENO);
+        dup2(pipeFds[1], STDERR_FILENO);
+        close(pipeFds[0]);
+        close(pipeFds[1]);
+        execv(args[0], args);
+        _exit(127);
+    }
+    close(pipeFds[1]);
+    char buffer[4096];
+    while (read(pipeFds[0], buffer, sizeof(buffer)) > 0) {
+        // The output is not needed, only drained so the backend never blocks on it
+    }
+    close(pipeFds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        return -1;
+    }
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// Function to time one candidate on an n x n product, best of reps runs
+double timeCandidate(const char *binDir, const DispatchRule *candidate, int n, int reps) {
+    char path[512], size[16], workers[16], flags[MAX_FLAGS];
+    snprintf(path, sizeof(path), "%s/%s", binDir, candidate->backend);
+    snprintf(size, sizeof(size), "%d", n);
+    snprintf(workers, sizeof(workers), "%d", candidate->workers);
+    snprintf(flags, sizeof(flags), "%s", candidate->flags);
+    char *args[MAX_ARGS];
+    int count = 0;
+    args[count++] = path;
+    args[count++] = size;
+    const char *option = workerOption(candidate->backend);
+    if (option != NULL) {
+        args[count++] = (char *) option;
+        args[count++] = workers;
+    }
+    appendFlags(args, &count, flags);
+    args[count++] = "--dtype";
+    args[count++] = (char *) matrixTypeName(candidate->dtype);
+    args[count++] = "--result";
+    args[count++] = "/dev/null";
+    args[count] = NULL;
+
+    double best = -1;
+    for (int r = 0; r < reps; r++) {
+        double t = runBackend(args);
+        if (t < 0) {
+            return -1;
+        }
+        if (best < 0 || t < best) {
+            best = t;
+        }
+    }
+    return best;
+}
+
+// Function to get the largest m with m * m <= a * b
+int geometricMidpoint(int a, int b) {
+    long product = (long) a * b;
+    int m = a;
+    while ((long) (m + 1) * (m + 1) <= product) {
+        m++;
+    }
+    return m;
+}
+
+// Function to measure every candidate on a ladder of sizes and store, for
+// dtype, the fastest candidate of each size as rules of the table. Each size
+// covers n up to the geometric midpoint to the next size.
+void calibrate(const char *binDir, DispatchTable *table, int dtype, int maxSize, int reps, int numCPUs) {
+    // Candidates from the simplest to the most expensive to start: sequential,
+    // then each parallel backend with powers of two below the core count and every core
+    DispatchRule candidates[MAX_RULES];
+    int numCandidates = 0;
+    const char *backends[] = { "sequential", "threads", "omp", "processes" };
+    for (int b = 0; b < 4; b++) {
+        for (int w = 2; ; w *= 2) {
+            int workers = b == 0 ? 1 : (w < numCPUs ? w : numCPUs);
+            for (int v = 0; v < NUM_VARIANTS && numCandidates < MAX_RULES; v++) {
+                DispatchRule *c = &candidates[numCandidates++];
+                *c = (DispatchRule) { dtype, 0, "", workers, "" };
+                snprintf(c->backend, sizeof(c->backend), "%s", backends[b]);
+                snprintf(c->flags, MAX_FLAGS, "%s", calibrationVariants[v]);
+            }
+            if (b == 0 || workers == numCPUs) break;
+        }
+    }
+
+    int sizes[32];
+    int best[32];
+    int numSizes = 0;
+    for (int n = 16; n <= maxSize && numSizes < 32; n *= 2) {
+        sizes[numSizes++] = n;
+    }
+    printf("Calibrating %s on %d size(s) with %d candidate(s), best of %d run(s)\n",
+           matrixTypeName(dtype), numSizes, numCandidates, reps);
+    for (int s = 0; s < numSizes; s++) {
+        double bestTime = -1;
+        best[s] = -1;
+        for (int c = 0; c < numCandidates; c++) {
+            double t = timeCandidate(binDir, &candidates[c], sizes[s], reps);
+            if (t >= 0 && (bestTime < 0 || t < bestTime * CALIBRATION_MARGIN)) {
+                bestTime = t;
+                best[s] = c;
+            }
+        }
+        if (best[s] < 0) {
+            fprintf(stderr, "No backend in %s ran n = %d (build them with install.sh)\n", binDir, sizes[s]);
+            exit(EXIT_FAILURE);
+        }
+        const DispatchRule *c = &candidates[best[s]];
+        printf("n = %5d: %-10s %3d worker(s) %-18s %.6f seconds\n", sizes[s], c->backend, c->workers,
+               c->flags, bestTime);
+    }
+
+    // Drop the old rules of this dtype, then append the new ones with equal neighbours merged
+    int kept = 0;
+    for (int r = 0; r < table->count; r++) {
+        if (table->rules[r].dtype != dtype) {
+            table->rules[kept++] = table->rules[r];
+        }
+    }
+    table->count = kept;
+    for (int s = 0; s < numSizes && table->count < MAX_RULES; s++) {
+        if (s + 1 < numSizes && best[s + 1] == best[s]) {
+            continue;
+        }
+        DispatchRule rule = candidates[best[s]];
+        rule.maxN = s + 1 < numSizes ? geometricMidpoint(sizes[s], sizes[s + 1]) : 0;
+        table->rules[table->count++] = rule;
+    }
+}
+
+// Function to check whether an argument already chooses the kernel, in which case the table's variant is not added
+int isMethodOption(const char *arg) {
+    const char *options[] = { "--transpose", "--blocked", "--simd", "--isa", "--strassen", "--stream", "--narrow" };
+    for (int i = 0; i < 7; i++) {
+        if (strcmp(arg, options[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Function to check for options that have no sparse variant: --strassen,
+// --stream, the GEMM options, --chain (whose inputs are not n x n), --pipeline
+// and --narrow
+int isDenseOnlyOption(const char *arg) {
+    const char *options[] = { "--strassen", "--stream", "--shape", "--alpha", "--beta", "--transa", "--transb",
+                              "--layout", "--cfile", "--chain", "--pipeline", "--narrow" };
+    for (int i = 0; i < 12; i++) {
+        if (strcmp(arg, options[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int n = 2000;
+    int dtype = MATRIX_TYPE_INT32;
+    int useCalibrate = 0;   // Flag for measuring the threshold table
+    int dryRun = 0;         // Flag for printing the choice without running it
+    int maxSize = 1024;     // Largest size measured by --calibrate
+    int reps = 3;           // Runs per candidate and size
+    int userMethod = 0;     // The caller chose the kernel
+    int userWorkers = 0;    // Worker count given with --threads or --processes, 0 to use the table
+    int useBatch = 0;
+    int sparseMode = -1;    // --sparse given by the caller, -1 to decide from the input density
+    double sparseThreshold = SPARSE_DEFAULT_THRESHOLD;
+    int denseOnly = 0;      // An option without sparse variant, see isDenseOnlyOption()
+    const char *fileA = NULL, *fileB = NULL;
+    char tablePath[512] = "", binDir[512] = "";
+
+    // The table and the backends live next to the dispatcher by default
+    char self[512];
+    ssize_t length = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    self[length > 0 ? length : 0] = '\0';
+    char *selfDir = length > 0 ? dirname(self) : ".";
+
+    // Own options are consumed, everything else is passed on to the backend
+    char *passed[MAX_ARGS];
+    int numPassed = 0;
+    if (argc > 1) {
+        n = atoi(argv[1]);
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--calibrate") == 0) {
+            useCalibrate = 1;
+        } else if (strcmp(argv[i], "--dry-run") == 0) {
+            dryRun = 1;
+        } else if (strcmp(argv[i], "--table") == 0 && (i+1 < argc)) {
+            snprintf(tablePath, sizeof(tablePath), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--bin") == 0 && (i+1 < argc)) {
+            snprintf(binDir, sizeof(binDir), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--max") == 0 && (i+1 < argc)) {
+            maxSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--reps") == 0 && (i+1 < argc)) {
+            reps = atoi(argv[++i]);
+        } else if ((strcmp(argv[i], "--threads") == 0 || strcmp(argv[i], "--processes") == 0) && (i+1 < argc)) {
+            userWorkers = atoi(argv[++i]);  // Passed on with the option of the chosen backend
+        } else {
+            if (strcmp(argv[i], "--dtype") == 0 && (i+1 < argc)) {
+                dtype = parseMatrixType(argv[i + 1]);
+            }
+            if (strcmp(argv[i], "--files") == 0 && (i+2 < argc)) {
+                fileA = argv[i + 1];
+                fileB = argv[i + 2];
+            } else if (strcmp(argv[i], "--sparse") == 0 && (i+1 < argc)) {
+                sparseMode = parseSparseMode(argv[i + 1]);
+            } else if (strcmp(argv[i], "--sparse-threshold") == 0 && (i+1 < argc)) {
+                sparseThreshold = atof(argv[i + 1]);
+            }
+            userMethod |= isMethodOption(argv[i]);
+            useBatch |= strcmp(argv[i], "--batch") == 0;
+            denseOnly |= isDenseOnlyOption(argv[i]);
+            if (numPassed < MAX_ARGS - 8) {
+                passed[numPassed++] = argv[i];
+            }
+        }
+    }
+    if (tablePath[0] == '\0') {
+        snprintf(tablePath, sizeof(tablePath), "%s/thresholds.txt", selfDir);
+    }
+    if (binDir[0] == '\0') {
+        snprintf(binDir, sizeof(binDir), "%s/bin", selfDir);
+    }
+    int numCPUs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+
+    DispatchTable table;
+    int calibrated = readDispatchTable(tablePath, &table);
+
+    if (useCalibrate) {
+        if (!calibrated) {
+            table.count = 0;
+        }
+        if (maxSize < 16 || reps < 1) {
+            fprintf(stderr, "Invalid calibration range (--max %d, --reps %d)\n", maxSize, reps);
+            return EXIT_FAILURE;
+        }
+        calibrate(binDir, &table, dtype, maxSize, reps, numCPUs);
+        writeDispatchTable(tablePath, &table);
+        printf("Threshold table written to %s\n", tablePath);
+        return 0;
+    }
+
+    if (!calibrated) {
+        defaultDispatchTable(&table, numCPUs);
+    }
+    // A batch is many independent products: use the rule of the largest sizes
+    const DispatchRule *rule = lookupRule(&table, dtype, useBatch ? 1 << 30 : n);
+    if (rule == NULL) {
+        fprintf(stderr, "No rule for --dtype %s in %s\n", matrixTypeName(dtype), tablePath);
+        return EXIT_FAILURE;
+    }
+
+    // Sparse inputs: when either file is at or below the density threshold the
+    // CSR kernels beat every dense variant, so the product goes to a backend
+    // that has them (threads unless the rule already picked omp). The dense
+    // rule is kept when that backend lacks one of the caller's options
+    DispatchRule sparseRule;
+    const char *sparseBackend = strcmp(rule->backend, "omp") == 0 ? "omp" : "threads";
+    int useSparse = sparseMode > SPARSE_OFF;
+    if (sparseMode < 0 && fileA != NULL && dtype == MATRIX_TYPE_INT32 && !useBatch && !denseOnly) {
+        char *sparseOptions[MAX_ARGS];
+        for (int i = 0; i < numPassed; i++) {
+            sparseOptions[i] = passed[i];
+        }
+        sparseOptions[numPassed] = "--sparse";
+        const char *missing = missingOption(sparseBackend, sparseOptions, numPassed + 1);
+        useSparse = matrixFileDensity(fileA, n) <= sparseThreshold || matrixFileDensity(fileB, n) <= sparseThreshold;
+        if (useSparse && missing != NULL) {
+            printf("%s has no %s: sparse inputs are multiplied dense\n", sparseBackend, missing);
+            useSparse = 0;
+        }
+    }
+    if (useSparse) {
+        sparseRule = *rule;
+        if (strcmp(sparseBackend, "threads") == 0) {
+            snprintf(sparseRule.backend, sizeof(sparseRule.backend), "threads");
+            sparseRule.workers = strcmp(rule->backend, "threads") == 0 ? rule->workers : numCPUs;
+        }
+        snprintf(sparseRule.flags, sizeof(sparseRule.flags), "%s", sparseMode < 0 ? "--sparse auto" : "");
+        rule = &sparseRule;
+        userMethod = 0;  // The rule's flags are now only the sparse mode
+    }
+
+    // The caller's options and the rule's kernel variant must all be
+    // implemented by the backend, otherwise the product goes to the first
+    // backend that has them (keeping the worker count of a parallel rule)
+    const char *ruleFlags = userMethod ? "" : rule->flags;
+    char flags[MAX_FLAGS];
+    snprintf(flags, sizeof(flags), "%s", ruleFlags);  // Split in place by appendFlags()
+    char *options[MAX_ARGS];
+    int numOptions = 0;
+    for (int i = 0; i < numPassed; i++) {
+        options[numOptions++] = passed[i];
+    }
+    int numCallerOptions = numOptions;
+    appendFlags(options, &numOptions, flags);
+    DispatchRule reroutedRule;
+    const char *missing = missingOption(rule->backend, options, numOptions);
+    if (missing != NULL) {
+        int b = 0;
+        while (b < NUM_BACKENDS && missingOption(backendOptions[b].backend, options, numOptions) != NULL) {
+            b++;
+        }
+        if (b == NUM_BACKENDS) {
+            fprintf(stderr, "%s is not implemented by %s, and no backend implements every option given\n",
+                    missing, rule->backend);
+            return EXIT_FAILURE;
+        }
+        printf("%s has no %s: rerouted to %s\n", rule->backend, missing, backendOptions[b].backend);
+        reroutedRule = *rule;
+        snprintf(reroutedRule.backend, sizeof(reroutedRule.backend), "%s", backendOptions[b].backend);
+        reroutedRule.workers = workerOption(rule->backend) != NULL ? rule->workers : numCPUs;
+        rule = &reroutedRule;
+    }
+
+    // Backend arguments: the caller's, then the worker count and kernel variant of the rule
+    char path[1024], workers[16];
+    snprintf(path, sizeof(path), "%s/%s", binDir, rule->backend);
+    int numWorkers = userWorkers > 0 ? userWorkers : rule->workers;
+    snprintf(workers, sizeof(workers), "%d", numWorkers);
+    char *args[MAX_ARGS];
+    int count = 0;
+    args[count++] = path;
+    for (int i = 0; i < numCallerOptions; i++) {
+        args[count++] = options[i];
+    }
+    const char *option = workerOption(rule->backend);
+    if (option != NULL) {
+        args[count++] = (char *) option;
+        args[count++] = workers;
+    }
+    for (int i = numCallerOptions; i < numOptions; i++) {
+        args[count++] = options[i];
+    }
+    args[count] = NULL;
+
+    printf("Dispatching %s to %s (%d worker(s)%s%s)%s\n", useBatch ? "batch" : "product", rule->backend,
+           option != NULL ? numWorkers : 1, ruleFlags[0] != '\0' ? ", " : "", ruleFlags,
+           calibrated ? "" : " with the built-in thresholds (run install.sh to calibrate)");
+    if (dryRun) {
+        for (int i = 0; i < count; i++) {
+            printf("%s%s", i > 0 ? " " : "", args[i]);
+        }
+        printf("\n");
+        return 0;
+    }
+    fflush(stdout);
+    execv(path, args);
+    fprintf(stderr, "Cannot run %s: %s\n", path, strerror(errno));
+    return EXIT_FAILURE;
+}
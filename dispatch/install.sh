@@ -0,0 +1,33 @@
+#!/bin/bash
+
+# Build every backend with -O3 next to the dispatcher and measure the
+# threshold table of this host (dispatch/thresholds.txt).
+# Usage: ./install.sh [max_n] [dtype...]
+#   max_n   largest size measured (default 1024)
+#   dtype   element types to calibrate (default int32)
+
+set -e
+cd "$(dirname "$0")"
+
+MAX_N=${1:-1024}
+shift || true
+DTYPES=("${@:-int32}")
+
+# Function to log and echo
+log() {
+    echo "$1"
+}
+
+mkdir -p bin
+log "Compiling backends into dispatch/bin"
+gcc -O3 ../sequential/sequential.c -o bin/sequential
+gcc -O3 ../threads/threads.c -o bin/threads -lpthread
+gcc -O3 ../processes/processes.c -o bin/processes
+gcc -O3 -fopenmp ../openmp/omp.c -o bin/omp
+gcc -O3 dispatch.c -o dispatch -lpthread
+
+for dtype in "${DTYPES[@]}"; do
+    log "Calibrating $dtype up to n = $MAX_N"
+    ./dispatch --calibrate --dtype "$dtype" --max "$MAX_N"
+done
+log "Done: run ./dispatch n [options] instead of a backend binary"
@@ -0,0 +1,572 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include "../common/matrix.h"
+#include "../common/matrix_io.h"
+#include "../common/blocked.h"
+#include "../common/simd.h"
+#include "../common/message.h"
+#include "../common/verify.h"
+
+// Distributed-memory multiplication on a q x q grid of ranks.
+//
+// Every rank is a separate process that owns one b x b block of A, B and C
+// (b = ceil(n / q), the edge blocks are zero-padded) and never sees the
+// others' memory: blocks travel as messages over Unix-domain sockets, one
+// socket per pair of ranks in the same grid row or column, standing in for
+// the network. The coordinator (the parent process) scatters the blocks,
+// starts the ranks together and gathers C. Each rank multiplies its blocks
+// with the blocked kernel while a helper thread already moves the blocks of
+// the next step, so communication overlaps computation.
+//   - SUMMA: at step k, rank (i, k) broadcasts its A block along row i and
+//     rank (k, j) its B block along column j; every rank adds the product.
+//   - Cannon: A is skewed left by i and B up by j, then every step each rank
+//     multiplies its blocks and shifts A one rank left and B one rank up.
+
+#define ALGORITHM_SUMMA  0
+#define ALGORITHM_CANNON 1
+
+// What one rank reports back to the coordinator
+typedef struct {
+    double computeSeconds;  // Local block products
+    double commSeconds;     // Transfers (overlapped with the products, except the Cannon skew)
+    double waitSeconds;     // Time the products waited for a transfer to finish
+    uint64_t bytesSent;
+    uint64_t messages;
+} RankStats;
+
+typedef struct {
+    int id;
+    int row;
+    int col;
+    int q;
+    int b;
+    int *links;             // links[s]: socket to rank s in the same row or column, -1 otherwise
+    const TileSizes *tiles;
+    TileKernel tileKernel;
+    RankStats stats;
+} Rank;
+
+// Transfers of one communication step, run on a helper thread
+typedef struct {
+    Transfer *transfers;
+    int count;
+    double seconds;
+    pthread_t thread;
+} Exchange;
+
+// Function to get the seconds elapsed since start
+double secondsSince(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Function to allocate a packed b x b block (stride b, so it is sent as one message)
+Matrix allocateBlock(int b) {
+    Matrix m;
+    m.rows = m.cols = m.stride = b;
+    m.type = MATRIX_TYPE_INT32;
+    m.elemSize = sizeof(int);
+    m.flags = 0;
+    m.bytes = (size_t) b * b * sizeof(int);
+    m.data = m.base = allocateMatrixMemory(&m.bytes, 0);
+    return m;
+}
+
+// Function to copy block (i, j) of a matrix into a packed block, zero-padding the edges
+void packBlock(const Matrix *m, Matrix *block, int i, int j) {
+    int b = block->rows;
+    memset(block->data, 0, (size_t) b * b * sizeof(int));
+    for (int r = 0; r < b && i * b + r < m->rows; r++) {
+        int cols = minInt(b, m->cols - j * b);
+        if (cols > 0) {
+            memcpy(matrixRow(block, r), matrixRow(m, i * b + r) + j * b, cols * sizeof(int));
+        }
+    }
+}
+
+// Function to copy a packed block back into block (i, j) of a matrix, dropping the padding
+void unpackBlock(const Matrix *block, Matrix *m, int i, int j) {
+    int b = block->rows;
+    for (int r = 0; r < b && i * b + r < m->rows; r++) {
+        int cols = minInt(b, m->cols - j * b);
+        if (cols > 0) {
+            memcpy(matrixRow(m, i * b + r) + j * b, matrixRow(block, r), cols * sizeof(int));
+        }
+    }
+}
+
+// Function to queue a block to send to (or receive from) rank peer in the next exchange
+void addTransfer(Rank *rank, Exchange *exchange, int peer, Matrix *block, int sending) {
+    Transfer *t = &exchange->transfers[exchange->count++];
+    t->fd = rank->links[peer];
+    t->data = block->data;
+    t->size = (size_t) rank->b * rank->b * sizeof(int);
+    t->done = 0;
+    t->sending = sending;
+    if (sending) {
+        rank->stats.bytesSent += t->size;
+        rank->stats.messages++;
+    }
+}
+
+// Helper thread: runs the queued transfers of an exchange
+void *runExchange(void *arg) {
+    Exchange *exchange = (Exchange *) arg;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    runTransfers(exchange->transfers, exchange->count);
+    exchange->seconds = secondsSince(&start);
+    return NULL;
+}
+
+// Function to start the queued transfers in the background
+void startExchange(Exchange *exchange) {
+    exchange->seconds = 0;
+    if (exchange->count > 0 && pthread_create(&exchange->thread, NULL, runExchange, exchange) != 0) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Function to wait for an exchange and account for its time
+void finishExchange(Rank *rank, Exchange *exchange) {
+    if (exchange->count > 0) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        pthread_join(exchange->thread, NULL);
+        rank->stats.waitSeconds += secondsSince(&start);
+    }
+    rank->stats.commSeconds += exchange->seconds;
+    exchange->count = 0;
+}
+
+// Function to add the product of two blocks to the rank's C block
+void multiplyBlocks(Rank *rank, const Matrix *a, const Matrix *b, Matrix *c) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    multiplyBlockedRows(a, b, c, 0, rank->b, rank->tiles, rank->tileKernel);
+    rank->stats.computeSeconds += secondsSince(&start);
+}
+
+// Function to queue the SUMMA broadcasts of step k. The panels to multiply at
+// that step are the rank's own blocks if it is the root, else the receive buffers.
+void postSummaStep(Rank *rank, Exchange *exchange, int k, Matrix *a, Matrix *b,
+                   Matrix *aBuffer, Matrix *bBuffer, Matrix **aPanel, Matrix **bPanel) {
+    int q = rank->q;
+    if (rank->col == k) {
+        *aPanel = a;
+        for (int c = 0; c < q; c++) {
+            if (c != rank->col) {
+                addTransfer(rank, exchange, rank->row * q + c, a, 1);
+            }
+        }
+    } else {
+        *aPanel = aBuffer;
+        addTransfer(rank, exchange, rank->row * q + k, aBuffer, 0);
+    }
+    if (rank->row == k) {
+        *bPanel = b;
+        for (int r = 0; r < q; r++) {
+            if (r != rank->row) {
+                addTransfer(rank, exchange, r * q + rank->col, b, 1);
+            }
+        }
+    } else {
+        *bPanel = bBuffer;
+        addTransfer(rank, exchange, k * q + rank->col, bBuffer, 0);
+    }
+}
+
+// Function to run SUMMA: the broadcasts of step k+1 overlap the product of step k
+void runSumma(Rank *rank, Exchange exchanges[2], Matrix *a, Matrix *b, Matrix *c) {
+    Matrix aBuffers[2] = { allocateBlock(rank->b), allocateBlock(rank->b) };
+    Matrix bBuffers[2] = { allocateBlock(rank->b), allocateBlock(rank->b) };
+    Matrix *aPanels[2], *bPanels[2];
+    postSummaStep(rank, &exchanges[0], 0, a, b, &aBuffers[0], &bBuffers[0], &aPanels[0], &bPanels[0]);
+    startExchange(&exchanges[0]);
+    for (int k = 0; k < rank->q; k++) {
+        int cur = k % 2, next = 1 - cur;
+        finishExchange(rank, &exchanges[cur]);
+        if (k + 1 < rank->q) {
+            postSummaStep(rank, &exchanges[next], k + 1, a, b, &aBuffers[next], &bBuffers[next],
+                          &aPanels[next], &bPanels[next]);
+            startExchange(&exchanges[next]);
+        }
+        multiplyBlocks(rank, aPanels[cur], bPanels[cur], c);
+    }
+    for (int t = 0; t < 2; t++) {
+        freeMatrix(&aBuffers[t]);
+        freeMatrix(&bBuffers[t]);
+    }
+}
+
+// Function to run Cannon's algorithm: the shifts for step s+1 overlap the product of step s
+void runCannon(Rank *rank, Exchange exchanges[2], Matrix *a, Matrix *b, Matrix *c) {
+    int q = rank->q, i = rank->row, j = rank->col;
+    Matrix aNext = allocateBlock(rank->b), bNext = allocateBlock(rank->b);
+    Matrix *aCur = a, *bCur = b, *aSpare = &aNext, *bSpare = &bNext, *swap;
+
+    // Initial alignment: A(i, j) goes i ranks left, B(i, j) goes j ranks up
+    if (i > 0) {
+        addTransfer(rank, &exchanges[0], i * q + (j - i + q) % q, aCur, 1);
+        addTransfer(rank, &exchanges[0], i * q + (j + i) % q, aSpare, 0);
+    }
+    if (j > 0) {
+        addTransfer(rank, &exchanges[0], ((i - j + q) % q) * q + j, bCur, 1);
+        addTransfer(rank, &exchanges[0], ((i + j) % q) * q + j, bSpare, 0);
+    }
+    startExchange(&exchanges[0]);
+    finishExchange(rank, &exchanges[0]);
+    if (i > 0) {
+        swap = aCur; aCur = aSpare; aSpare = swap;
+    }
+    if (j > 0) {
+        swap = bCur; bCur = bSpare; bSpare = swap;
+    }
+
+    for (int s = 0; s < q; s++) {
+        if (s + 1 < q) {
+            addTransfer(rank, &exchanges[0], i * q + (j - 1 + q) % q, aCur, 1);
+            addTransfer(rank, &exchanges[0], i * q + (j + 1) % q, aSpare, 0);
+            addTransfer(rank, &exchanges[0], ((i - 1 + q) % q) * q + j, bCur, 1);
+            addTransfer(rank, &exchanges[0], ((i + 1) % q) * q + j, bSpare, 0);
+            startExchange(&exchanges[0]);
+        }
+        multiplyBlocks(rank, aCur, bCur, c);
+        if (s + 1 < q) {
+            finishExchange(rank, &exchanges[0]);
+            swap = aCur; aCur = aSpare; aSpare = swap;
+            swap = bCur; bCur = bSpare; bSpare = swap;
+        }
+    }
+    freeMatrix(&aNext);
+    freeMatrix(&bNext);
+}
+
+// Function run by every rank: receive the blocks, multiply, report, send C back
+void rankMain(Rank *rank, int control, int algorithm) {
+    int b = rank->b;
+    size_t blockBytes = (size_t) b * b * sizeof(int);
+    Matrix a = allocateBlock(b), bBlock = allocateBlock(b), c = allocateBlock(b);
+    if (receiveAll(control, a.data, blockBytes) != 0 || receiveAll(control, bBlock.data, blockBytes) != 0) {
+        _exit(EXIT_FAILURE);
+    }
+    zeroMatrix(&c);
+    for (int s = 0; s < rank->q * rank->q; s++) {
+        if (rank->links[s] >= 0) {
+            setNonBlocking(rank->links[s]);
+        }
+    }
+    Exchange exchanges[2];
+    for (int e = 0; e < 2; e++) {
+        exchanges[e].transfers = malloc((2 * rank->q + 4) * sizeof(Transfer));
+        exchanges[e].count = 0;
+    }
+    memset(&rank->stats, 0, sizeof(rank->stats));
+
+    // Ready, then wait until the coordinator starts every rank at once
+    char token = 'r';
+    if (sendAll(control, &token, 1) != 0 || receiveAll(control, &token, 1) != 0) {
+        _exit(EXIT_FAILURE);
+    }
+    if (algorithm == ALGORITHM_CANNON) {
+        runCannon(rank, exchanges, &a, &bBlock, &c);
+    } else {
+        runSumma(rank, exchanges, &a, &bBlock, &c);
+    }
+    if (sendAll(control, &rank->stats, sizeof(rank->stats)) != 0 || sendAll(control, c.data, blockBytes) != 0) {
+        _exit(EXIT_FAILURE);
+    }
+    _exit(EXIT_SUCCESS);
+}
+
+// Function to run the row blocks of a verification pass in forked children of
+// the coordinator, one per rank, each taking a contiguous range of blocks
+void runVerifyTasks(void *context, VerifyPlan *plan, int count) {
+    int numWorkers = *(int *) context;
+    fflush(stdout);
+    for (int p = 0; p < numWorkers; p++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            exit(EXIT_FAILURE);
+        } else if (pid == 0) {
+            for (int t = count * p / numWorkers; t < count * (p + 1) / numWorkers; t++) {
+                verifyRunTask(plan, t);
+            }
+            exit(EXIT_SUCCESS);
+        }
+    }
+    for (int p = 0; p < numWorkers; p++) {
+        wait(NULL);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int n = 2000;
+    int useFiles = 0;
+    int numRanks = 0;     // Ranks chosen with --ranks, 0 for the largest square grid that fits the CPUs
+    int algorithm = ALGORITHM_SUMMA;
+    int useSimd = 0;      // Flag for SIMD micro-kernels
+    char simdIsa[16] = "";  // ISA forced with --isa, empty for CPUID detection
+    TileSizes tiles = defaultTileSizes();
+    int verifyMode = VERIFY_OFF;  // O(n²) check of the gathered result chosen with --verify
+    int verifyRounds = VERIFY_DEFAULT_ROUNDS;
+    int useResultFile = 0;  // --result given (with --verify the result is only written then)
+    char fileA[100], fileB[100];
+    char fileResult[100];
+    strcpy(fileResult, "result.out"); // Default result file if not provided
+
+    // Parse arguments
+    if (argc > 1) {
+        n = atoi(argv[1]);
+    }
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--files") == 0 && (i+2 < argc)) {
+            useFiles = 1;
+            snprintf(fileA, sizeof(fileA), "%s", argv[++i]);
+            snprintf(fileB, sizeof(fileB), "%s", argv[++i]);
+        } else if(strcmp(argv[i], "--result") == 0 && (i+1 < argc)) {
+            snprintf(fileResult, sizeof(fileResult), "%s", argv[++i]);
+            useResultFile = 1;
+        } else if(strcmp(argv[i], "--ranks") == 0 && (i+1 < argc)) {
+            numRanks = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--algorithm") == 0 && (i+1 < argc)) {
+            i++;
+            if (strcmp(argv[i], "summa") == 0) {
+                algorithm = ALGORITHM_SUMMA;
+            } else if (strcmp(argv[i], "cannon") == 0) {
+                algorithm = ALGORITHM_CANNON;
+            } else {
+                fprintf(stderr, "Unknown algorithm '%s' (use summa or cannon)\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if(strcmp(argv[i], "--verify") == 0 && (i+1 < argc)) {
+            verifyMode = parseVerifyMode(argv[++i]);
+        } else if(strcmp(argv[i], "--verify-rounds") == 0 && (i+1 < argc)) {
+            verifyRounds = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--simd") == 0) {
+            useSimd = 1;
+        } else if(strcmp(argv[i], "--isa") == 0 && (i+1 < argc)) {
+            useSimd = 1;
+            snprintf(simdIsa, sizeof(simdIsa), "%s", argv[++i]);
+        } else if(strcmp(argv[i], "--tiles") == 0 && (i+3 < argc)) {
+            tiles.l1 = atoi(argv[++i]);
+            tiles.l2 = atoi(argv[++i]);
+            tiles.l3 = atoi(argv[++i]);
+        }
+    }
+    checkTileSizes(&tiles);
+    if (n <= 0) {
+        fprintf(stderr, "Invalid matrix size %d\n", n);
+        return EXIT_FAILURE;
+    }
+
+    // A square grid of ranks
+    if (numRanks <= 0) {
+        int numCPUs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+        numRanks = (int) sqrt((double) numCPUs);
+        numRanks = numRanks > 0 ? numRanks * numRanks : 1;
+    }
+    int q = (int) lround(sqrt((double) numRanks));
+    if (q * q != numRanks || q > n) {
+        fprintf(stderr, "--ranks must be a square number of ranks, at most n x n (got %d)\n", numRanks);
+        return EXIT_FAILURE;
+    }
+    int b = (n + q - 1) / q;
+    size_t blockBytes = (size_t) b * b * sizeof(int);
+
+    SimdKernels simd = selectSimdKernels(simdIsa);
+    TileKernel tileKernel = useSimd ? simd.panel : NULL;
+    char simdNote[32] = "";
+    if (useSimd) {
+        snprintf(simdNote, sizeof(simdNote), " (SIMD %s)", simd.isa);
+    }
+
+    printf("Matrix size: %d x %d\n", n, n);
+    printf("Running %d rank(s) on a %d x %d grid, %d x %d blocks\n", numRanks, q, q, b, b);
+
+    // Initialization of seed for random numbers
+    srand(time(NULL));
+
+    Matrix matrix1, matrix2;
+    Matrix resultMatrix = allocateMatrix(n, n, 0);
+    if(useFiles) {
+        loadMatrix(&matrix1, n, n, fileA, 0, 1);
+        loadMatrix(&matrix2, n, n, fileB, 0, 1);
+    } else {
+        matrix1 = allocateMatrix(n, n, 0);
+        matrix2 = allocateMatrix(n, n, 0);
+        fillMatrix(&matrix1);
+        fillMatrix(&matrix2);
+    }
+
+    // One socket per rank to the coordinator, one per pair of ranks in the same row or column
+    int *control = malloc(numRanks * 2 * sizeof(int));
+    int *mesh = malloc((size_t) numRanks * numRanks * sizeof(int));
+    for (int r = 0; r < numRanks; r++) {
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, &control[2 * r]) == -1) {
+            perror("socketpair");
+            return EXIT_FAILURE;
+        }
+        for (int s = 0; s < numRanks; s++) {
+            mesh[r * numRanks + s] = -1;
+        }
+    }
+    for (int r = 0; r < numRanks; r++) {
+        for (int s = r + 1; s < numRanks; s++) {
+            if (r / q == s / q || r % q == s % q) {
+                int pair[2];
+                if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1) {
+                    perror("socketpair");
+                    return EXIT_FAILURE;
+                }
+                mesh[r * numRanks + s] = pair[0];
+                mesh[s * numRanks + r] = pair[1];
+            }
+        }
+    }
+
+    // Fork the ranks; each keeps only its own ends of the sockets
+    pid_t *pids = malloc(numRanks * sizeof(pid_t));
+    fflush(stdout);
+    for (int r = 0; r < numRanks; r++) {
+        pids[r] = fork();
+        if (pids[r] < 0) {
+            perror("fork");
+            return EXIT_FAILURE;
+        } else if (pids[r] == 0) {
+            for (int s = 0; s < numRanks * numRanks; s++) {
+                if (mesh[s] >= 0 && s / numRanks != r) {
+                    close(mesh[s]);
+                }
+            }
+            for (int s = 0; s < numRanks; s++) {
+                close(control[2 * s]);
+                if (s != r) {
+                    close(control[2 * s + 1]);
+                }
+            }
+            Rank rank = { r, r / q, r % q, q, b, &mesh[r * numRanks], &tiles, tileKernel, { 0, 0, 0, 0, 0 } };
+            rankMain(&rank, control[2 * r + 1], algorithm);
+        }
+    }
+    for (int s = 0; s < numRanks * numRanks; s++) {
+        if (mesh[s] >= 0) {
+            close(mesh[s]);
+        }
+    }
+    for (int r = 0; r < numRanks; r++) {
+        close(control[2 * r + 1]);
+    }
+
+    // Scatter block (i, j) of A and B to rank (i, j)
+    Matrix block = allocateBlock(b);
+    for (int r = 0; r < numRanks; r++) {
+        packBlock(&matrix1, &block, r / q, r % q);
+        int failed = sendAll(control[2 * r], block.data, blockBytes);
+        packBlock(&matrix2, &block, r / q, r % q);
+        if (failed || sendAll(control[2 * r], block.data, blockBytes) != 0) {
+            fprintf(stderr, "Cannot send the blocks of rank %d\n", r);
+            return EXIT_FAILURE;
+        }
+    }
+    char token;
+    for (int r = 0; r < numRanks; r++) {
+        if (receiveAll(control[2 * r], &token, 1) != 0) {
+            fprintf(stderr, "Rank %d failed to start\n", r);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Timed: from the start signal until every rank has reported its finished block
+    RankStats *stats = malloc(numRanks * sizeof(RankStats));
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < numRanks; r++) {
+        token = 'g';
+        sendAll(control[2 * r], &token, 1);
+    }
+    for (int r = 0; r < numRanks; r++) {
+        if (receiveAll(control[2 * r], &stats[r], sizeof(RankStats)) != 0) {
+            fprintf(stderr, "Rank %d failed\n", r);
+            return EXIT_FAILURE;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    // Gather C
+    for (int r = 0; r < numRanks; r++) {
+        if (receiveAll(control[2 * r], block.data, blockBytes) != 0) {
+            fprintf(stderr, "Cannot receive the block of rank %d\n", r);
+            return EXIT_FAILURE;
+        }
+        unpackBlock(&block, &resultMatrix, r / q, r % q);
+        close(control[2 * r]);
+    }
+    for (int r = 0; r < numRanks; r++) {
+        waitpid(pids[r], NULL, 0);
+    }
+
+    printf("Using distributed %s multiplication method (blocked per rank)%s\n",
+           algorithm == ALGORITHM_CANNON ? "Cannon" : "SUMMA", simdNote);
+    double computeTime = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    // Show computation time of the kernel
+    printf("Multiplication computation time: %.9f seconds\n", computeTime);
+
+    // Communication report: per rank, then the totals
+    RankStats total;
+    memset(&total, 0, sizeof(total));
+    for (int r = 0; r < numRanks; r++) {
+        printf("Rank %d (%d, %d): compute %.9f s, transfers %.9f s, waiting %.9f s, sent %.3f MB in %llu message(s)\n",
+               r, r / q, r % q, stats[r].computeSeconds, stats[r].commSeconds, stats[r].waitSeconds,
+               stats[r].bytesSent / 1e6, (unsigned long long) stats[r].messages);
+        total.computeSeconds += stats[r].computeSeconds;
+        total.commSeconds += stats[r].commSeconds;
+        total.waitSeconds += stats[r].waitSeconds;
+        total.bytesSent += stats[r].bytesSent;
+        total.messages += stats[r].messages;
+    }
+    printf("Communication volume: %.3f MB in %llu message(s)\n", total.bytesSent / 1e6,
+           (unsigned long long) total.messages);
+    printf("Communication/computation ratio: %.3f (transfers), %.3f (not overlapped)\n",
+           total.computeSeconds > 0 ? total.commSeconds / total.computeSeconds : 0.0,
+           total.computeSeconds > 0 ? total.waitSeconds / total.computeSeconds : 0.0);
+
+    // --verify: O(n²) check of the gathered C against A and B, after timing
+    int verified = 1;
+    if (verifyMode != VERIFY_OFF) {
+        VerifyPlan verifyPlan = createVerifyPlan(verifyMode, verifyRounds, &matrix1, &matrix2, &resultMatrix,
+                                                 numRanks, runVerifyTasks, &numRanks);
+        VerifyResult verifyResult = verifyProduct(&verifyPlan);
+        verified = printVerifyResult(&verifyPlan, &verifyResult);
+        freeVerifyPlan(&verifyPlan);
+    }
+
+    // Save result matrix to file (binary when the name ends in .bin); with --verify only
+    // when --result is given
+    if (verifyMode == VERIFY_OFF || useResultFile) {
+        saveMatrix(&resultMatrix, fileResult, 1);
+    }
+
+    freeMatrix(&block);
+    freeMatrix(&matrix1);
+    freeMatrix(&matrix2);
+    freeMatrix(&resultMatrix);
+    free(stats);
+    free(pids);
+    free(mesh);
+    free(control);
+
+    return verified ? 0 : EXIT_FAILURE;
+}
@@ -1,92 +1,281 @@
+#define _GNU_SOURCE  // pread/pwrite, MAP_ANONYMOUS/MAP_POPULATE, CLOCK_MONOTONIC
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
 #include <omp.h>
+#include "../common/matrix.h"
+#include "../common/matrix_io.h"
+#include "../common/blocked.h"
+#include "../common/simd.h"
+#include "../common/stream.h"
+#include "../common/strassen.h"
+#include "../common/typed.h"
+#include "../common/batch.h"
+#include "../common/perf.h"
+#include "../common/sparse.h"
+#include "../common/gemm.h"
+#include "../common/transpose.h"
+#include "../common/verify.h"
+#include "../common/chain.h"
+#include "../common/pipeline.h"
+#include "../common/narrow.h"
+#include "../common/fixed.h"
 
 
-// Function to fill a matrix with random integer numbers
-void fillMatrix(int n, int **matrix) {
+// Function to multiply matrices
+void* multiplyStandard(const Matrix *matrix1, const Matrix *matrix2, Matrix *resultMatrix)
+{
+    int n = resultMatrix->rows;
+    int lda = matrix1->stride, ldb = matrix2->stride, ldc = resultMatrix->stride;
+    const int *restrict a = matrix1->data;
+    const int *restrict b = matrix2->data;
+    int *restrict c = resultMatrix->data;
+
+    #pragma omp parallel for
     for (int i = 0; i < n; i++){
         for (int j = 0; j < n; j++){
-            matrix[i][j] = rand() % 10;  // Random numbers between 0 and 9
+            // The result matrix is already initialized to 0 outside
+            for (int k = 0; k < n; k++){
+                c[(size_t) i*ldc + j] += a[(size_t) i*lda + k] * b[(size_t) k*ldb + j];
+            }
         }
     }
+    return NULL;
 }
 
+// Function to multiply matrices reading the second one as its packed transpose (matrix2 holds Bᵀ)
+void* multiplyTranspose(const Matrix *matrix1, const Matrix *matrix2, Matrix *resultMatrix)
+{
+    int n = resultMatrix->rows;
+    int lda = matrix1->stride, ldb = matrix2->stride, ldc = resultMatrix->stride;
+    const int *restrict a = matrix1->data;
+    const int *restrict b = matrix2->data;
+    int *restrict c = resultMatrix->data;
 
-void readMatrixFromFile(int n, int **matrix, const char* fileName) {
-    FILE *file = fopen(fileName, "r");
-    if (!file) {
-        fprintf(stderr, "Cannot open file %s\n", fileName);
-        exit(1);
-    }
+    #pragma omp parallel for
     for (int i = 0; i < n; i++){
         for (int j = 0; j < n; j++){
-            if (fscanf(file, "%d", &matrix[i][j]) != 1) {
-                fprintf(stderr, "Error leyendo archivo.\n");
-                exit(1);
+            // The result matrix is already initialized to 0 outside
+            for (int k = 0; k < n; k++){
+                c[(size_t) i*ldc + j] += a[(size_t) i*lda + k] * b[(size_t) j*ldb + k];
             }
         }
     }
-    fclose(file);
+    return NULL;
 }
 
+// Function to pack the transpose of a matrix, one band of rows of the target per iteration
+void transposeParallel(const Matrix *source, Matrix *target)
+{
+    int numBands = transposeBandCount(source);
 
+    #pragma omp parallel for schedule(dynamic)
+    for (int b = 0; b < numBands; b++){
+        transposeBand(source, target, b);
+    }
+}
+
+// Function to multiply matrices with L1/L2/L3 cache blocking.
+// Threads take L2-sized row blocks dynamically so uneven tails are balanced.
+void* multiplyBlocked(const Matrix *matrix1, const Matrix *matrix2, Matrix *resultMatrix, const TileSizes *tiles,
+                      TileKernel tileKernel)
+{
+    int n = resultMatrix->rows;
+    int rowBlock = tiles->l2;
+    int numBlocks = (n + rowBlock - 1) / rowBlock;
 
-void writeMatrixToFile(int n, int **matrix, const char* fileName) {
-    FILE *file = fopen(fileName, "w");
-    if (!file) {
-        fprintf(stderr, "Cannot open file %s for writing\n", fileName);
-        exit(1);
+    #pragma omp parallel for schedule(dynamic)
+    for (int b = 0; b < numBlocks; b++){
+        int startRow = b * rowBlock;
+        int endRow = minInt(startRow + rowBlock, n);
+        multiplyBlockedRows(matrix1, matrix2, resultMatrix, startRow, endRow, tiles, tileKernel);
     }
-    for (int i = 0; i < n; i++){
-        for (int j = 0; j < n; j++){
-            fprintf(file, "%d ", matrix[i][j]);
-        }
-        fprintf(file, "\n");
+    return NULL;
+}
+
+// Function to multiply with the narrow (int8/int16) kernels, row blocks shared out dynamically
+void multiplyNarrow(const NarrowPlan *plan, Matrix *resultMatrix)
+{
+    int n = resultMatrix->rows;
+    int rowBlock = plan->edges[1];
+    int numBlocks = (n + rowBlock - 1) / rowBlock;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int b = 0; b < numBlocks; b++){
+        int startRow = b * rowBlock;
+        multiplyNarrowRange(plan, resultMatrix, startRow, minInt(startRow + rowBlock, n), 0, n);
     }
-    fclose(file);
 }
 
-// Function to multiply matrices
-void* multiplyStandard(int n, int** matrix1, int** matrix2, int** resultMatrix)
+// Function to pack B for the narrow kernels, bands of group rows shared out
+void packNarrowParallel(NarrowPlan *plan)
 {
-    
-    #pragma omp parallel for
-    for (int i = 0; i < n; i++){
-        for (int j = 0; j < n; j++){
-            // The result matrix is already initialized to 0 outside
-            for (int k = 0; k < n; k++){
-                resultMatrix[i][j] += matrix1[i][k] * matrix2[k][j];
-            }
-        }
+    #pragma omp parallel for schedule(dynamic)
+    for (int band = 0; band < narrowBandCount(plan); band++){
+        narrowPackBand(plan, band);
+    }
+}
+
+// Function to multiply with a size-specialized kernel, row blocks of the L2 edge shared out
+void multiplyFixed(const FixedPlan *plan, const Matrix *matrix1, const Matrix *matrix2, Matrix *resultMatrix)
+{
+    int n = resultMatrix->rows;
+    int rowBlock = DEFAULT_TILE_L2;
+    int numBlocks = (n + rowBlock - 1) / rowBlock;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int b = 0; b < numBlocks; b++){
+        int startRow = b * rowBlock;
+        multiplyFixedRows(plan, matrix1, matrix2, resultMatrix, startRow, minInt(startRow + rowBlock, n));
+    }
+}
+
+// Function to multiply matrices with a SIMD micro-kernel (panel or transposed access).
+// Row blocks are a multiple of the 4-row register block so only the last one has a tail.
+void* multiplySimd(TileKernel kernel, const Matrix *matrix1, const Matrix *matrix2, Matrix *resultMatrix)
+{
+    int n = resultMatrix->rows;
+    int rowBlock = 16 * SIMD_MR;
+    int numBlocks = (n + rowBlock - 1) / rowBlock;
+
+    #pragma omp parallel for schedule(static)
+    for (int b = 0; b < numBlocks; b++){
+        int startRow = b * rowBlock;
+        int endRow = minInt(startRow + rowBlock, n);
+        kernel(matrix1->data, matrix1->stride, matrix2->data, matrix2->stride,
+               resultMatrix->data, resultMatrix->stride, startRow, endRow, 0, n, 0, n);
     }
     return NULL;
 }
 
-// Function to multiply matrices simulating a transpose operation on the second matrix for cache optimization
-void* multiplyTranspose(int n, int** matrix1, int** matrix2, int** resultMatrix)
+// Settings of the in-memory products done while streaming
+typedef struct {
+    const TileSizes *tiles;
+    TileKernel tileKernel;
+} StreamContext;
+
+// Function to multiply one pair of streamed blocks with the parallel blocked kernel
+void multiplyStreamBlock(void *context, const Matrix *a, const Matrix *b, Matrix *c)
 {
-    
-    #pragma omp parallel for
-    for (int i = 0; i < n; i++){
-        for (int j = 0; j < n; j++){
-            // The result matrix is already initialized to 0 outside
-            for (int k = 0; k < n; k++){
-                resultMatrix[i][j] += matrix1[i][k] * matrix2[j][k];
-            }
-        }
+    const StreamContext *ctx = (const StreamContext *) context;
+    multiplyBlocked(a, b, c, ctx->tiles, ctx->tileKernel);
+}
+
+// Function to multiply matrices of a non-int32 element type with its specialized kernels.
+// Threads take L2-sized row blocks dynamically, as in multiplyBlocked.
+void* multiplyTyped(const TypedKernels *typed, int method, int useSimd, const Matrix *matrix1,
+                    const Matrix *matrix2, Matrix *resultMatrix, const TileSizes *tiles)
+{
+    int n = resultMatrix->rows;
+    int rowBlock = tiles->l2;
+    int numBlocks = (n + rowBlock - 1) / rowBlock;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int b = 0; b < numBlocks; b++){
+        int startRow = b * rowBlock;
+        int endRow = minInt(startRow + rowBlock, n);
+        multiplyTypedRange(typed, method, useSimd, matrix1, matrix2, resultMatrix,
+                           startRow, endRow, 0, resultMatrix->cols, tiles);
     }
     return NULL;
 }
 
+// Function to multiply every product of a batch, each one whole on a single
+// thread. Products are handed out one at a time, largest first.
+void multiplyBatch(const BatchKernel *kernel, Batch *batch)
+{
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int p = 0; p < batch->count; p++){
+        multiplyBatchProduct(kernel, &batch->products[batch->order[p]]);
+    }
+}
+
+// Function to run the leaf products of the parallel Strassen levels, one per thread at a time
+void runStrassenTasks(void *context, StrassenTask *tasks, int count)
+{
+    (void) context;  // The OpenMP team needs no pool
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int t = 0; t < count; t++){
+        strassenRunTask(&tasks[t]);
+    }
+}
+
+// Function to run the row blocks of a sparse product, one per thread at a time
+void runSparseTasks(void *context, SparsePlan *plan, int count)
+{
+    (void) context;  // The OpenMP team needs no pool
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int t = 0; t < count; t++){
+        sparseRunTask(plan, t, omp_get_thread_num());
+    }
+}
+
+// Function to run the row blocks of a verification pass, one per thread at a time
+void runVerifyTasks(void *context, VerifyPlan *plan, int count)
+{
+    (void) context;  // The OpenMP team needs no pool
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int t = 0; t < count; t++){
+        verifyRunTask(plan, t);
+    }
+}
+
+// Function to run the output tiles of every product of a chain wave, shared out dynamically
+void runChainTasks(void *context, ChainPlan *plan, int count)
+{
+    (void) context;  // The OpenMP team needs no pool
+    #pragma omp parallel for schedule(dynamic)
+    for (int t = 0; t < count; t++){
+        chainRunTask(plan, t);
+    }
+}
+
+// Function to run the column tiles of one pipeline step, shared out dynamically
+void runPipelineTasks(void *context, PipelinePlan *plan, int count)
+{
+    (void) context;  // The OpenMP team needs no pool
+    #pragma omp parallel for schedule(dynamic)
+    for (int t = 0; t < count; t++){
+        pipelineRunTask(plan, t);
+    }
+}
+
+// Function to run the output tiles of a GEMM, each thread with its own workspace
+void multiplyGemm(const GemmProblem *problem, int *workspaces, size_t workspaceSize)
+{
+    #pragma omp parallel for schedule(dynamic)
+    for (int t = 0; t < gemmTileCount(problem); t++){
+        gemmRunTile(problem, t, workspaces + omp_get_thread_num() * workspaceSize);
+    }
+}
+
 int main(int argc, char *argv[]) {
     int numThreads = 1;
     int n = 2000;
     int useFiles = 0;
     int useTranspose = 0; // Flag for transpose method
-    char fileA[100], fileB[100];
+    int useBlocked = 0;   // Flag for cache-blocked method
+    int useHugePages = 0; // Flag for huge page backed matrices
+    int useSimd = 0;      // Flag for SIMD micro-kernels
+    int streamBudgetMB = 0;  // Memory budget of --stream, 0 to load everything
+    int useStrassen = 0;  // Flag for Strassen-Winograd recursion
+    int strassenCutoff = STRASSEN_DEFAULT_CUTOFF;
+    int dtype = MATRIX_TYPE_INT32;  // Element type chosen with --dtype
+    int useBatch = 0;     // Flag for batch mode (many small products from one file)
+    int usePerf = 0;      // Flag for hardware counter reporting
+    int verifyMode = VERIFY_OFF;  // O(n²) check of the result chosen with --verify
+    int verifyRounds = VERIFY_DEFAULT_ROUNDS;
+    int useResultFile = 0;  // --result given (with --verify the result is only written then)
+    int sparseMode = SPARSE_OFF;  // CSR kernels chosen with --sparse
+    double sparseThreshold = SPARSE_DEFAULT_THRESHOLD;
+    char simdIsa[16] = "";  // ISA forced with --isa, empty for CPUID detection
+    const char *chainList = NULL;  // Comma-separated matrix files of --chain
+    int usePipeline = 0;  // Flag for overlapping loading, multiplication and writing
+    int narrowMode = NARROW_OFF;  // int8/int16 storage of the inputs chosen with --narrow
+    int useFixed = 1;     // Flag for the size-specialized kernels of registered sizes
+    TileSizes tiles = defaultTileSizes();
+    char fileA[100], fileB[100], fileBatch[100];
     char fileResult[100];
     strcpy(fileResult, "result.out"); // Default result file if not provided
 
@@ -94,100 +283,440 @@ int main(int argc, char *argv[]) {
     if (argc > 1) {
         n = atoi(argv[1]);
     }
+    GemmArgs gemmArgs = defaultGemmArgs(n);  // Rectangular C = alpha * op(A) * op(B) + beta * C
     for(int i = 1; i < argc; i++){
-        if(strcmp(argv[i], "--files") == 0 && (i+2 < argc)) {
+        if(parseGemmOption(argc, argv, &i, &gemmArgs)) {
+            continue;
+        } else if(strcmp(argv[i], "--files") == 0 && (i+2 < argc)) {
             useFiles = 1;
             strcpy(fileA, argv[++i]);
             strcpy(fileB, argv[++i]);
         } else if(strcmp(argv[i], "--result") == 0 && (i+1 < argc)) {
             strcpy(fileResult, argv[++i]);
+            useResultFile = 1;
         } else if(strcmp(argv[i], "--transpose") == 0) {
             useTranspose = 1;
         } else if(strcmp(argv[i], "--threads") == 0 && (i+1 < argc)) {
             numThreads = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--hugepages") == 0) {
+            useHugePages = 1;
+        } else if(strcmp(argv[i], "--blocked") == 0) {
+            useBlocked = 1;
+        } else if(strcmp(argv[i], "--simd") == 0) {
+            useSimd = 1;
+        } else if(strcmp(argv[i], "--isa") == 0 && (i+1 < argc)) {
+            useSimd = 1;
+            snprintf(simdIsa, sizeof(simdIsa), "%s", argv[++i]);
+        } else if(strcmp(argv[i], "--tiles") == 0 && (i+3 < argc)) {
+            tiles.l1 = atoi(argv[++i]);
+            tiles.l2 = atoi(argv[++i]);
+            tiles.l3 = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--stream") == 0 && (i+1 < argc)) {
+            streamBudgetMB = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--strassen") == 0) {
+            useStrassen = 1;
+        } else if(strcmp(argv[i], "--cutoff") == 0 && (i+1 < argc)) {
+            strassenCutoff = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--dtype") == 0 && (i+1 < argc)) {
+            dtype = parseMatrixType(argv[++i]);
+        } else if(strcmp(argv[i], "--batch") == 0 && (i+1 < argc)) {
+            useBatch = 1;
+            snprintf(fileBatch, sizeof(fileBatch), "%s", argv[++i]);
+        } else if(strcmp(argv[i], "--perf") == 0) {
+            usePerf = 1;
+        } else if(strcmp(argv[i], "--verify") == 0 && (i+1 < argc)) {
+            verifyMode = parseVerifyMode(argv[++i]);
+        } else if(strcmp(argv[i], "--verify-rounds") == 0 && (i+1 < argc)) {
+            verifyRounds = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--sparse") == 0 && (i+1 < argc)) {
+            sparseMode = parseSparseMode(argv[++i]);
+        } else if(strcmp(argv[i], "--sparse-threshold") == 0 && (i+1 < argc)) {
+            sparseThreshold = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--chain") == 0 && (i+1 < argc)) {
+            chainList = argv[++i];
+        } else if(strcmp(argv[i], "--pipeline") == 0) {
+            usePipeline = 1;
+        } else if(strcmp(argv[i], "--narrow") == 0 && (i+1 < argc)) {
+            narrowMode = parseNarrowMode(argv[++i]);
+        } else if(strcmp(argv[i], "--no-fixed") == 0) {
+            useFixed = 0;
         }
     }
+    checkTileSizes(&tiles);
+    if (verifyMode != VERIFY_OFF && (useBatch || streamBudgetMB > 0 || gemmArgs.enabled)) {
+        fprintf(stderr, "--verify cannot be combined with --batch, --stream or the GEMM options\n");
+        return EXIT_FAILURE;
+    }
+
+    // Pick the SIMD micro-kernels for this CPU once, outside the timed section
+    SimdKernels simd = selectSimdKernels(simdIsa);
+    TileKernel tileKernel = useSimd ? simd.panel : NULL;
+    TypedKernels typed;
+    if (dtype != MATRIX_TYPE_INT32) {
+        if (useStrassen || streamBudgetMB > 0 || sparseMode != SPARSE_OFF) {
+            fprintf(stderr, "--strassen, --stream and --sparse only support --dtype int32\n");
+            return EXIT_FAILURE;
+        }
+        typed = selectTypedKernels(dtype, simdIsa);
+    }
+    if (sparseMode != SPARSE_OFF && (useStrassen || streamBudgetMB > 0 || useBatch)) {
+        fprintf(stderr, "--sparse cannot be combined with --strassen, --stream or --batch\n");
+        return EXIT_FAILURE;
+    }
+    if (narrowMode != NARROW_OFF && (dtype != MATRIX_TYPE_INT32 || useTranspose || useStrassen || streamBudgetMB > 0 ||
+                                     useBatch || gemmArgs.enabled || chainList != NULL || usePipeline ||
+                                     sparseMode != SPARSE_OFF)) {
+        fprintf(stderr, "--narrow cannot be combined with --dtype, --transpose, --strassen, --stream, --batch, "
+                "--chain, --pipeline, --sparse or the GEMM options\n");
+        return EXIT_FAILURE;
+    }
+    char simdNote[32] = "";
+    if (useSimd) {
+        snprintf(simdNote, sizeof(simdNote), " (SIMD %s)", dtype != MATRIX_TYPE_INT32 ? typed.isa : simd.isa);
+    }
     omp_set_num_threads(numThreads);
     printf("Running with %d threads\n", numThreads);
 
+    // Batch mode: many small products from one file, one product per thread at a time
+    if (useBatch) {
+        if (useStrassen || streamBudgetMB > 0) {
+            fprintf(stderr, "--batch cannot be combined with --strassen or --stream\n");
+            return EXIT_FAILURE;
+        }
+        Batch batch;
+        readBatchFile(&batch, fileBatch, dtype, useHugePages ? MATRIX_HUGEPAGES : 0, numThreads);
+        printBatchSummary(&batch);
+        BatchKernel kernel = { useBlocked ? TYPED_BLOCKED : (useTranspose ? TYPED_TRANSPOSE : TYPED_STANDARD),
+                               useSimd, &simd, &typed, &tiles };
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        multiplyBatch(&kernel, &batch);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("Using %s multiplication method (%s)%s\n", typedMethodName(kernel.method), matrixTypeName(dtype), simdNote);
+        double computeTime = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("Multiplication computation time: %.9f seconds\n", computeTime);
+        printBatchThroughput(&batch, computeTime);
+        writeBatchFile(&batch, fileResult, numThreads);
+        freeBatch(&batch);
+        return 0;
+    }
+
+    // Chain mode: A1·A2·...·Ak in the cheapest order; the output tiles of all
+    // the independent products of a wave are shared out together
+    if (chainList != NULL) {
+        if (dtype != MATRIX_TYPE_INT32 || useStrassen || streamBudgetMB > 0 || gemmArgs.enabled ||
+            verifyMode != VERIFY_OFF || sparseMode != SPARSE_OFF) {
+            fprintf(stderr, "--chain cannot be combined with --dtype, --strassen, --stream, --sparse, --verify or the GEMM options\n");
+            return EXIT_FAILURE;
+        }
+        ChainPlan *chain = createChainPlan(chainList, 0, numThreads, &tiles, useSimd ? &simd : NULL,
+                                           runChainTasks, NULL);
+        printf("Matrix size: %d x %d\n", chain->result.rows, chain->result.cols);
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        chainMultiply(chain);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printChainPlan(chain, simdNote);
+        double computeTime = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("Multiplication computation time: %.9f seconds\n", computeTime);
+        saveMatrix(&chain->result, fileResult, numThreads);
+        freeChainPlan(chain);
+        return 0;
+    }
 
     printf("Matrix size: %d x %d\n", n, n);
 
-    // Initialization of seed for random numbers
-    srand(time(NULL));
-    
-    // Dynamic memory allocation for matrices
-    int **matrix1 = malloc(n * sizeof(int*));
-    int **matrix2 = malloc(n * sizeof(int*));
-    int **resultMatrix = malloc(n * sizeof(int*));
-    if(matrix1 == NULL || matrix2 == NULL || resultMatrix == NULL){
-        printf("Error in memory allocation.\n");
-        return 1;
+    // Pipelined mode: B is loaded and C written while the panels of C are
+    // computed; the column tiles of each step are shared out dynamically
+    if (usePipeline) {
+        if (!useFiles || dtype != MATRIX_TYPE_INT32 || useStrassen || streamBudgetMB > 0 || gemmArgs.enabled ||
+            useTranspose || sparseMode != SPARSE_OFF) {
+            fprintf(stderr, "--pipeline needs --files and cannot be combined with --dtype, --strassen, --stream, "
+                    "--sparse, --transpose or the GEMM options\n");
+            return EXIT_FAILURE;
+        }
+        PipelinePlan *pipeline = createPipeline(fileA, fileB,
+                                                verifyMode == VERIFY_OFF || useResultFile ? fileResult : NULL, n,
+                                                numThreads, &tiles, tileKernel, runPipelineTasks, NULL);
+        PipelineStats stats;
+        pipelineMultiply(pipeline, &stats);
+        printf("Using pipelined blocked multiplication method (tiles %d/%d/%d)%s\n", tiles.l1, tiles.l2, tiles.l3,
+               simdNote);
+        printPipelineStats(pipeline, &stats);
+        printf("Multiplication computation time: %.9f seconds\n", stats.computeTime);
+        printf("End-to-end time: %.9f seconds\n", stats.totalTime);
+        int verified = 1;
+        if (verifyMode != VERIFY_OFF) {
+            VerifyPlan verifyPlan = createVerifyPlan(verifyMode, verifyRounds, &pipeline->a, &pipeline->b,
+                                                     &pipeline->c, numThreads, runVerifyTasks, NULL);
+            VerifyResult verifyResult = verifyProduct(&verifyPlan);
+            verified = printVerifyResult(&verifyPlan, &verifyResult);
+            freeVerifyPlan(&verifyPlan);
+        }
+        freePipeline(pipeline);
+        return verified ? 0 : EXIT_FAILURE;
     }
-    for (int i = 0; i < n; i++){
-        matrix1[i] = malloc(n * sizeof(int));
-        matrix2[i] = malloc(n * sizeof(int));
-        resultMatrix[i] = malloc(n * sizeof(int));
-        if(matrix1[i] == NULL || matrix2[i] == NULL || resultMatrix[i] == NULL){
+
+    // GEMM mode: C = alpha * op(A) * op(B) + beta * C on M x K and K x N
+    // operands, updated in place; the output tiles are shared out dynamically
+    if (gemmArgs.enabled) {
+        if (dtype != MATRIX_TYPE_INT32 || useStrassen || streamBudgetMB > 0 || useTranspose || sparseMode != SPARSE_OFF) {
+            fprintf(stderr, "The GEMM options cannot be combined with --dtype, --strassen, --stream, --sparse or --transpose (use --transb)\n");
+            return EXIT_FAILURE;
+        }
+        srand(time(NULL));
+        Matrix a, b, c;
+        loadGemmOperands(&gemmArgs, fileA, fileB, useFiles, numThreads, &a, &b, &c);
+        GemmProblem problem = createGemmFromArgs(&gemmArgs, &a, &b, &c, &tiles, useSimd ? &simd : NULL);
+        size_t workspaceSize = gemmWorkspaceSize(&problem);
+        int *workspaces = malloc(numThreads * workspaceSize * sizeof(int));
+        if (workspaces == NULL) {
             printf("Error in memory allocation.\n");
             return 1;
         }
+        printf("Matrix size: %d x %d x %d\n", gemmArgs.m, gemmArgs.n, gemmArgs.k);
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        multiplyGemm(&problem, workspaces, workspaceSize);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printGemm(&gemmArgs, simdNote);
+        double computeTime = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("Multiplication computation time: %.9f seconds\n", computeTime);
+        saveMatrix(&c, fileResult, numThreads);
+        free(workspaces);
+        freeMatrix(&a);
+        freeMatrix(&b);
+        freeMatrix(&c);
+        return 0;
+    }
+
+    // Out-of-core mode: inputs stay on disk and C is written block row by block row
+    if (streamBudgetMB > 0) {
+        if (!useFiles) {
+            fprintf(stderr, "--stream needs --files with binary matrices\n");
+            return EXIT_FAILURE;
+        }
+        StreamContext ctx = { &tiles, tileKernel };
+        StreamStats stats;
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        streamMultiply(fileA, fileB, fileResult, n, (size_t) streamBudgetMB << 20,
+                       multiplyStreamBlock, &ctx, numThreads, &stats);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("Using streamed blocked multiplication method (%d MB budget)%s\n", streamBudgetMB, simdNote);
+        printStreamStats(&stats);
+        double computeTime = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("Multiplication computation time: %.9f seconds\n", computeTime);
+        return 0;
     }
+
+    // Initialization of seed for random numbers
+    srand(time(NULL));
     
-    if(useFiles) {
-        readMatrixFromFile(n, matrix1, fileA);
-        readMatrixFromFile(n, matrix2, fileB);
+    // One contiguous, aligned allocation per matrix
+    int allocFlags = useHugePages ? MATRIX_HUGEPAGES : 0;
+    Matrix matrix1, matrix2;
+    Matrix resultMatrix = allocateTypedMatrix(n, n, dtype, allocFlags);
+    
+    if(useFiles && narrowMode != NARROW_OFF) {
+        loadNarrowMatrix(&matrix1, n, n, fileA, narrowMode, allocFlags, numThreads);
+        loadNarrowMatrix(&matrix2, n, n, fileB, narrowMode, allocFlags, numThreads);
+    } else if(useFiles) {
+        // Text files are parsed, binary files are mapped in place
+        loadTypedMatrix(&matrix1, n, n, dtype, fileA, allocFlags, numThreads);
+        loadTypedMatrix(&matrix2, n, n, dtype, fileB, allocFlags, numThreads);
     } else {
-        fillMatrix(n, matrix1);
-        fillMatrix(n, matrix2);
+        matrix1 = allocateTypedMatrix(n, n, dtype, allocFlags);
+        matrix2 = allocateTypedMatrix(n, n, dtype, allocFlags);
+        fillMatrix(&matrix1);
+        fillMatrix(&matrix2);
     }
     
-    // Initialize result matrix to zeros
-    for (int i = 0; i < n; i++){
-        for (int j = 0; j < n; j++){
-            resultMatrix[i][j] = 0;
+    // --narrow: int8/int16 copies of the inputs (unless they were read that
+    // way) and the buffer of packed B, outside the timed section
+    int narrowType = MATRIX_TYPE_INT32;
+    NarrowPlan narrowPlan;
+    if (narrowMode != NARROW_OFF) {
+        narrowType = narrowOperands(&matrix1, &matrix2, narrowMode, allocFlags);
+        if (narrowType != MATRIX_TYPE_INT32) {
+            narrowPlan = createNarrowPlan(&matrix1, &matrix2, &tiles, useSimd, simdIsa, allocFlags);
+            if (useSimd) {
+                snprintf(simdNote, sizeof(simdNote), " (SIMD %s)", narrowPlan.isa);
+            }
+        } else {
+            printf("Narrow storage: the values need int32, using the int32 kernels\n");
         }
     }
 
+    // Initialize result matrix to zeros
+    zeroMatrix(&resultMatrix);
+
 
     // Decide which kernel function to use
-    void* (*kernelFunc)(int, int**, int**, int**);
+    void* (*kernelFunc)(const Matrix *, const Matrix *, Matrix *);
     if(useTranspose) {
         kernelFunc = multiplyTranspose;
     } else {
         kernelFunc = multiplyStandard;
     }
 
-    struct timespec start,end;
+    // Strassen-Winograd workspace is allocated here, outside the timed section
+    int strassenDepth = strassenParallelDepth(numThreads);
+    StrassenPlan plan;
+    if(useStrassen) {
+        plan = createStrassenPlan(n, strassenCutoff, strassenDepth, &tiles, tileKernel, runStrassenTasks, NULL);
+    }
+
+    // --sparse: operands at or below the density threshold are converted to
+    // CSR here, outside the timed section; two dense operands use the kernels above
+    SparsePlan sparsePlan;
+    sparsePlan.kind = SPARSE_NONE;
+    double densityA = 1.0, densityB = 1.0;
+    if (sparseMode != SPARSE_OFF) {
+        densityA = matrixDensity(&matrix1);
+        densityB = matrixDensity(&matrix2);
+        int kind = chooseSparseKind(sparseMode, densityA, densityB, sparseThreshold);
+        if (kind != SPARSE_NONE) {
+            sparsePlan = createSparsePlan(kind, &matrix1, &matrix2, &resultMatrix, numThreads,
+                                          runSparseTasks, NULL);
+        }
+    }
+
+    // Registered sizes run a kernel compiled for that n (common/fixed.h)
+    FixedPlan fixed = { NULL, n, NULL };
+    if (useFixed && dtype == MATRIX_TYPE_INT32 && narrowType == MATRIX_TYPE_INT32 && !useTranspose &&
+        !useStrassen && sparsePlan.kind == SPARSE_NONE) {
+        fixed = selectFixedKernel(&matrix1, &matrix2, &resultMatrix, useBlocked, &tiles, useSimd, &simd);
+    }
+
+    // --transpose: Bᵀ is packed into its own matrix by a first timed stage,
+    // then the transposed kernels read it row by row
+    int packB = useTranspose && !useBlocked && !useStrassen && sparsePlan.kind == SPARSE_NONE;
+    Matrix packedB;
+    if (packB) {
+        packedB = allocateTypedMatrix(n, n, dtype, allocFlags | MATRIX_POPULATE);
+    }
+    const Matrix *operandB = packB ? &packedB : &matrix2;
+
+    // --perf: every thread of the team opens its counter group on itself. The
+    // groups are enabled from here around the timed region, so a thread's
+    // counts include the time it spins at the implicit barriers.
+    PerfCounters *perfWorkers = NULL;
+    if (usePerf) {
+        perfWorkers = calloc(numThreads, sizeof(PerfCounters));
+        #pragma omp parallel
+        perfOpen(&perfWorkers[omp_get_thread_num()]);
+    }
+
+    struct timespec start,packEnd,end;
+    for (int w = 0; perfWorkers != NULL && w < numThreads; w++) {
+        perfStart(&perfWorkers[w]);
+    }
     clock_gettime(CLOCK_MONOTONIC, &start);
+    if(packB) {
+        transposeParallel(&matrix2, &packedB);
+    } else if(narrowType != MATRIX_TYPE_INT32) {
+        packNarrowParallel(&narrowPlan);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &packEnd);
 
-    (*kernelFunc)(n, matrix1, matrix2, resultMatrix);
+    int typedMethod = useBlocked ? TYPED_BLOCKED : (useTranspose ? TYPED_TRANSPOSE : TYPED_STANDARD);
+    if(sparsePlan.kind != SPARSE_NONE) {
+        sparseMultiply(&sparsePlan);
+    } else if(narrowType != MATRIX_TYPE_INT32) {
+        multiplyNarrow(&narrowPlan, &resultMatrix);
+    } else if(dtype != MATRIX_TYPE_INT32) {
+        multiplyTyped(&typed, typedMethod, useSimd, &matrix1, operandB, &resultMatrix, &tiles);
+    } else if(useStrassen) {
+        strassenMultiply(&plan, &matrix1, &matrix2, &resultMatrix);
+    } else if(fixed.kernel != NULL) {
+        multiplyFixed(&fixed, &matrix1, &matrix2, &resultMatrix);
+    } else if(useBlocked) {
+        multiplyBlocked(&matrix1, &matrix2, &resultMatrix, &tiles, tileKernel);
+    } else if(useSimd) {
+        multiplySimd(useTranspose ? simd.transposed : simd.panel, &matrix1, operandB, &resultMatrix);
+    } else {
+        (*kernelFunc)(&matrix1, operandB, &resultMatrix);
+    }
 
     clock_gettime(CLOCK_MONOTONIC, &end);
+    for (int w = 0; perfWorkers != NULL && w < numThreads; w++) {
+        perfStop(&perfWorkers[w]);
+        // The window is the same for every thread: use its CPU time (task-clock) instead
+        if (perfWorkers[w].events & 1u) {
+            perfWorkers[w].seconds = perfWorkers[w].values[0] / 1e9;
+        }
+    }
 
     // Print which method was used
-    if(useTranspose) {
-        printf("Using transpose multiplication method\n");
+    if(sparsePlan.kind != SPARSE_NONE) {
+        printf("Using sparse %s multiplication method (density %.4f / %.4f)\n", sparseKindName(&sparsePlan),
+               densityA, densityB);
+    } else if(useStrassen) {
+        printf("Using Strassen-Winograd multiplication method (cutoff %d, %d parallel level(s))%s\n",
+               strassenCutoff, strassenDepth, simdNote);
+        freeStrassenPlan(&plan);
+    } else if(narrowType != MATRIX_TYPE_INT32) {
+        printf("Using narrow blocked multiplication method (%s, tiles %d/%d/%d)%s\n", matrixTypeName(narrowType),
+               narrowPlan.edges[0], narrowPlan.edges[1], narrowPlan.edges[2], simdNote);
+    } else if(dtype != MATRIX_TYPE_INT32) {
+        printf("Using %s multiplication method (%s)%s\n", typedMethodName(typedMethod), matrixTypeName(dtype), simdNote);
+    } else if(fixed.kernel != NULL) {
+        printf("Using fixed-size %s multiplication method (n = %d)%s\n", fixed.shape, n, simdNote);
+    } else if(useBlocked) {
+        printf("Using blocked multiplication method (tiles %d/%d/%d)%s\n", tiles.l1, tiles.l2, tiles.l3, simdNote);
+    } else if(useTranspose) {
+        printf("Using transpose multiplication method%s\n", simdNote);
     } else {
-        printf("Using standard multiplication method\n");
+        printf("Using standard multiplication method%s\n", simdNote);
     }
     
     double computeTime = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
     
-    // Show computation time of the kernel
+    // Show computation time of the kernel (with the pack stage, also shown on its own)
+    if(packB) {
+        double packTime = (packEnd.tv_sec - start.tv_sec) + (packEnd.tv_nsec - start.tv_nsec) / 1e9;
+        printf("Transpose pack time: %.9f seconds\n", packTime);
+        freeMatrix(&packedB);
+    } else if(narrowType != MATRIX_TYPE_INT32) {
+        double packTime = (packEnd.tv_sec - start.tv_sec) + (packEnd.tv_nsec - start.tv_nsec) / 1e9;
+        printf("Narrow pack time: %.9f seconds\n", packTime);
+        freeNarrowPlan(&narrowPlan);
+    }
     printf("Multiplication computation time: %.9f seconds\n", computeTime);
+    if (perfWorkers != NULL) {
+        perfReport("openmp", perfWorkers, numThreads, computeTime);
+        for (int w = 0; w < numThreads; w++) {
+            perfClose(&perfWorkers[w]);
+        }
+        free(perfWorkers);
+    }
     
-    // Save result matrix to file
-    writeMatrixToFile(n, resultMatrix, fileResult);
+    // The sparse product is scattered into C after timing
+    if (sparsePlan.kind != SPARSE_NONE) {
+        sparseStoreResult(&sparsePlan);
+        freeSparsePlan(&sparsePlan);
+    }
 
-    for (int i = 0; i < n; i++){
-        free(matrix1[i]);
-        free(matrix2[i]);
-        free(resultMatrix[i]);
+    // --verify: O(n²) check of C against A and B, after timing
+    int verified = 1;
+    if (verifyMode != VERIFY_OFF) {
+        VerifyPlan verifyPlan = createVerifyPlan(verifyMode, verifyRounds, &matrix1, &matrix2, &resultMatrix,
+                                                 numThreads, runVerifyTasks, NULL);
+        VerifyResult verifyResult = verifyProduct(&verifyPlan);
+        verified = printVerifyResult(&verifyPlan, &verifyResult);
+        freeVerifyPlan(&verifyPlan);
+    }
+
+    // Save result matrix to file (binary when the name ends in .bin); with --verify only
+    // when --result is given
+    if (verifyMode == VERIFY_OFF || useResultFile) {
+        saveMatrix(&resultMatrix, fileResult, numThreads);
     }
-    free(matrix1);
-    free(matrix2);
-    free(resultMatrix);
+
+    freeMatrix(&matrix1);
+    freeMatrix(&matrix2);
+    freeMatrix(&resultMatrix);
     
-    return 0;
+    return verified ? 0 : EXIT_FAILURE;
 }
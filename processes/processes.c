@@ -1,3 +1,4 @@
+#define _GNU_SOURCE  // CPU affinity (sched_setaffinity, cpu_set_t)
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
@@ -5,74 +6,31 @@
 #include <unistd.h>
 #include <sys/mman.h>
 #include <sys/wait.h>
+#include "../common/matrix.h"
+#include "../common/matrix_io.h"
+#include "../common/blocked.h"
+#include "../common/simd.h"
+#include "../common/typed.h"
+#include "../common/batch.h"
+#include "../common/affinity.h"
+#include "../common/process_pool.h"
+#include "../common/perf.h"
+#include "../common/transpose.h"
+#include "../common/verify.h"
+#include "../common/chain.h"
+#include "../common/fixed.h"
+#include "../common/narrow.h"
 
 // Function to allocate a shared matrix of size n x n.
-// It allocates an array of int* pointers (for rows) and one contiguous block for all elements.
-int **allocate_shared_matrix(int n) {
-    int **mat = malloc(n * sizeof(int *));
-    if(mat == NULL) {
-        perror("malloc");
-        exit(EXIT_FAILURE);
-    }
-    int *data = mmap(NULL, n * n * sizeof(int), PROT_READ | PROT_WRITE,
-                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
-    if(data == MAP_FAILED) {
-        perror("mmap");
-        exit(EXIT_FAILURE);
-    }
-    for (int i = 0; i < n; i++) {
-        mat[i] = data + i * n;
-    }
-    return mat;
+// The whole matrix is one contiguous MAP_SHARED mapping, so the children write
+// their rows of the result straight into memory the parent can read.
+Matrix allocate_shared_matrix(int n, int type, int flags) {
+    return allocateTypedMatrix(n, n, type, MATRIX_SHARED | flags);
 }
 
 // Function to free a shared matrix allocated with allocate_shared_matrix
-void free_shared_matrix(int **mat, int n) {
-    if(munmap(mat[0], n * n * sizeof(int)) == -1) {
-        perror("munmap");
-    }
-    free(mat);
-}
-
-// Function to fill a matrix with random integer numbers
-void fillMatrix(int n, int **matrix) {
-    for (int i = 0; i < n; i++){
-        for (int j = 0; j < n; j++){
-            matrix[i][j] = rand() % 10;  // Random numbers between 0 and 9
-        }
-    }
-}
-
-void readMatrixFromFile(int n, int **matrix, const char* fileName) {
-    FILE *file = fopen(fileName, "r");
-    if (!file) {
-        fprintf(stderr, "Cannot open file %s\n", fileName);
-        exit(EXIT_FAILURE);
-    }
-    for (int i = 0; i < n; i++){
-        for (int j = 0; j < n; j++){
-            if (fscanf(file, "%d", &matrix[i][j]) != 1) {
-                fprintf(stderr, "Error reading file %s.\n", fileName);
-                exit(EXIT_FAILURE);
-            }
-        }
-    }
-    fclose(file);
-}
-
-void writeMatrixToFile(int n, int **matrix, const char* fileName) {
-    FILE *file = fopen(fileName, "w");
-    if (!file) {
-        fprintf(stderr, "Cannot open file %s for writing\n", fileName);
-        exit(EXIT_FAILURE);
-    }
-    for (int i = 0; i < n; i++){
-        for (int j = 0; j < n; j++){
-            fprintf(file, "%d ", matrix[i][j]);
-        }
-        fprintf(file, "\n");
-    }
-    fclose(file);
+void free_shared_matrix(Matrix *mat) {
+    freeMatrix(mat);
 }
 
 // Structure to hold process-specific data for multiplication.
@@ -81,32 +39,212 @@ typedef struct {
     int startRow;
     int endRow;
     int n;
-    int **matrix1;
-    int **matrix2;
-    int **resultMatrix;
+    const Matrix *matrix1;
+    const Matrix *matrix2;
+    Matrix *resultMatrix;
+    const TileSizes *tiles;
+    const SimdKernels *simd;
+    TileKernel tileKernel;
+    const TypedKernels *typed;  // Kernels of the element type when it is not int32
+    int typedMethod;            // TYPED_STANDARD, TYPED_TRANSPOSE or TYPED_BLOCKED
+    int useSimd;
+    const FixedPlan *fixed;     // Kernel compiled for n (common/fixed.h), if n is registered
+    const NarrowPlan *narrow;   // --narrow: int8/int16 inputs and packed B
 } ProcessData;
 
 // Function to multiply matrices
 void multiplyChunkStandard(ProcessData *data) {
     int n = data->n;
+    int lda = data->matrix1->stride, ldb = data->matrix2->stride, ldc = data->resultMatrix->stride;
+    const int *restrict a = data->matrix1->data;
+    const int *restrict b = data->matrix2->data;
+    int *restrict c = data->resultMatrix->data;
     for (int i = data->startRow; i < data->endRow; i++){
         for (int j = 0; j < n; j++){
             for (int k = 0; k < n; k++){
-                data->resultMatrix[i][j] += data->matrix1[i][k] * data->matrix2[k][j];
+                c[(size_t) i*ldc + j] += a[(size_t) i*lda + k] * b[(size_t) k*ldb + j];
             }
         }
     }
 }
 
-// Function to multiply matrices simulating a transpose operation on the second matrix for cache optimization
+// Function to multiply matrices reading the second one as its packed transpose (matrix2 holds Bᵀ)
 void multiplyChunkTranspose(ProcessData *data) {
     int n = data->n;
+    int lda = data->matrix1->stride, ldb = data->matrix2->stride, ldc = data->resultMatrix->stride;
+    const int *restrict a = data->matrix1->data;
+    const int *restrict b = data->matrix2->data;
+    int *restrict c = data->resultMatrix->data;
     for (int i = data->startRow; i < data->endRow; i++){
         for (int j = 0; j < n; j++){
             for (int k = 0; k < n; k++){
-                data->resultMatrix[i][j] += data->matrix1[i][k] * data->matrix2[j][k];
+                c[(size_t) i*ldc + j] += a[(size_t) i*lda + k] * b[(size_t) j*ldb + k];
+            }
+        }
+    }
+}
+
+// Function to multiply matrices with L1/L2/L3 cache blocking over the process's rows
+void multiplyChunkBlocked(ProcessData *data) {
+    multiplyBlockedRows(data->matrix1, data->matrix2, data->resultMatrix,
+                        data->startRow, data->endRow, data->tiles, data->tileKernel);
+}
+
+// Function to multiply the process's rows with the SIMD micro-kernel selected at startup
+void multiplyChunkSimd(ProcessData *data) {
+    const Matrix *m1 = data->matrix1, *m2 = data->matrix2;
+    Matrix *r = data->resultMatrix;
+    data->simd->panel(m1->data, m1->stride, m2->data, m2->stride, r->data, r->stride,
+                      data->startRow, data->endRow, 0, data->n, 0, data->n);
+}
+
+// Function to multiply the process's rows with the transposed-access SIMD micro-kernel
+void multiplyChunkTransposeSimd(ProcessData *data) {
+    const Matrix *m1 = data->matrix1, *m2 = data->matrix2;
+    Matrix *r = data->resultMatrix;
+    data->simd->transposed(m1->data, m1->stride, m2->data, m2->stride, r->data, r->stride,
+                           data->startRow, data->endRow, 0, data->n, 0, data->n);
+}
+
+// Function to multiply the process's rows with the kernel specialized for n
+void multiplyChunkFixed(ProcessData *data) {
+    multiplyFixedRows(data->fixed, data->matrix1, data->matrix2, data->resultMatrix,
+                      data->startRow, data->endRow);
+}
+
+// Function to multiply the process's rows with the narrow (int8/int16) kernels once B is packed
+void multiplyChunkNarrow(ProcessData *data) {
+    multiplyNarrowRange(data->narrow, data->resultMatrix, data->startRow, data->endRow, 0, data->n);
+}
+
+// Function to multiply the process's rows with the kernels of a non-int32 element type
+void multiplyChunkTyped(ProcessData *data) {
+    multiplyTypedRange(data->typed, data->typedMethod, data->useSimd,
+                       data->matrix1, data->matrix2, data->resultMatrix,
+                       data->startRow, data->endRow, 0, data->n, data->tiles);
+}
+
+// One multiplication split into row blocks for the pre-forked pool (--pool).
+// Set up before the workers are forked, so every worker has its own copy.
+typedef struct {
+    ProcessData base;
+    void (*kernelFunc)(ProcessData *);
+    int rowsPerTask;
+    const Matrix *replicas;   // Per-node copies of matrix2 (--numa replicate), or NULL
+    const int *workerNodes;   // NUMA node of each worker
+} RowJob;
+
+// Function to run one row block of a RowJob in a pool worker
+void runRowTask(void *arg, int task) {
+    RowJob *job = (RowJob *) arg;
+    ProcessData data = job->base;
+    data.processID = processPoolWorkerId;
+    data.startRow = task * job->rowsPerTask;
+    data.endRow = data.startRow + job->rowsPerTask < data.n ? data.startRow + job->rowsPerTask : data.n;
+    if (job->replicas != NULL) {
+        data.matrix2 = &job->replicas[job->workerNodes[processPoolWorkerId]];
+    }
+    job->kernelFunc(&data);
+}
+
+// Pack stage of --transpose: bands of rows of Bᵀ, written to every target.
+// The targets are shared, so the bands written by any worker reach the others.
+typedef struct {
+    const Matrix *source;
+    Matrix *targets;        // Bᵀ, or its per-node copies with --numa replicate
+    int numTargets;
+} TransposeJob;
+
+// Function to write one band of rows of Bᵀ (pool task, or a range of them in a forked child)
+void runTransposeTask(void *arg, int band) {
+    TransposeJob *job = (TransposeJob *) arg;
+    for (int t = 0; t < job->numTargets; t++) {
+        transposeBand(job->source, &job->targets[t], band);
+    }
+}
+
+// Function to pack one band of group rows of the packed B of --narrow (the
+// packed matrix is shared, so the bands written by any worker reach the others)
+void runNarrowPackTask(void *arg, int band) {
+    narrowPackBand((NarrowPlan *) arg, band);
+}
+
+// Function to run every band of a pack stage (--transpose or --narrow) with
+// one forked child per process, each taking a contiguous range of bands, and
+// wait for all of them
+void forkPackBands(void (*run)(void *, int), void *job, int numBands, int numProcesses, const int *workerCpus) {
+    for (int p = 0; p < numProcesses; p++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            exit(EXIT_FAILURE);
+        } else if (pid == 0) {
+            pinToCpu(workerCpus[p]);
+            for (int b = numBands * p / numProcesses; b < numBands * (p + 1) / numProcesses; b++) {
+                run(job, b);
+            }
+            exit(EXIT_SUCCESS);
+        }
+    }
+    for (int p = 0; p < numProcesses; p++) {
+        wait(NULL);
+    }
+}
+
+// Function to run the row blocks of a verification pass in forked children,
+// each taking a contiguous range of blocks (the plan's buffers are shared)
+void runVerifyTasks(void *context, VerifyPlan *plan, int count) {
+    int numProcesses = *(int *) context;
+    fflush(stdout);
+    for (int p = 0; p < numProcesses; p++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            exit(EXIT_FAILURE);
+        } else if (pid == 0) {
+            for (int t = count * p / numProcesses; t < count * (p + 1) / numProcesses; t++) {
+                verifyRunTask(plan, t);
+            }
+            exit(EXIT_SUCCESS);
+        }
+    }
+    for (int p = 0; p < numProcesses; p++) {
+        wait(NULL);
+    }
+}
+
+// Function to run the output tiles of every product of a chain wave, forking
+// the children over contiguous ranges of them (the pool and the result are shared)
+void runChainTasks(void *context, ChainPlan *plan, int count) {
+    int numProcesses = *(int *) context;
+    fflush(stdout);
+    for (int p = 0; p < numProcesses; p++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            exit(EXIT_FAILURE);
+        } else if (pid == 0) {
+            for (int t = count * p / numProcesses; t < count * (p + 1) / numProcesses; t++) {
+                chainRunTask(plan, t);
             }
+            exit(EXIT_SUCCESS);
+        }
+    }
+    for (int p = 0; p < numProcesses; p++) {
+        wait(NULL);
+    }
+}
+
+// Function to multiply whole products of a batch until none is left. The
+// next product index lives in shared memory, so every child takes one
+// product at a time (largest first) and uneven sizes balance themselves.
+void multiplyBatchProducts(const BatchKernel *kernel, Batch *batch, int *nextProduct) {
+    for (;;) {
+        int p = __atomic_fetch_add(nextProduct, 1, __ATOMIC_RELAXED);
+        if (p >= batch->count) {
+            break;
         }
+        multiplyBatchProduct(kernel, &batch->products[batch->order[p]]);
     }
 }
 
@@ -115,7 +253,28 @@ int main(int argc, char *argv[]) {
     int useFiles = 0;
     int useTranspose = 0;   // Flag for transpose method
     int useDoubleThreads = 0;   // Flag for doubling the number of processes
-    char fileA[100], fileB[100];
+    int requestedProcesses = 0; // Process count forced with --processes, 0 for #CPUs
+    int useBlocked = 0;   // Flag for cache-blocked method
+    int useHugePages = 0; // Flag for huge page backed matrices
+    int useSimd = 0;      // Flag for SIMD micro-kernels
+    char simdIsa[16] = "";  // ISA forced with --isa, empty for CPUID detection
+    const char *chainList = NULL;  // Comma-separated matrix files of --chain
+    int dtype = MATRIX_TYPE_INT32;  // Element type chosen with --dtype
+    int useBatch = 0;     // Flag for batch mode (many small products from one file)
+    int affinityPolicy = AFFINITY_NONE;  // Process pinning chosen with --affinity
+    int useSmt = 0;       // Flag for one process per hardware thread instead of per core
+    int numaMode = NUMA_FIRST_TOUCH;     // Placement of the inputs chosen with --numa
+    int usePool = 0;      // Flag for the pre-forked worker pool
+    int usePopulate = 0;  // Flag for prefaulting the shared matrices (MAP_POPULATE)
+    int repeat = 1;       // Number of timed multiplications (--repeat)
+    int usePerf = 0;      // Flag for hardware counter reporting
+    int useFixed = 1;     // Flag for the size-specialized kernels of registered sizes
+    int narrowMode = NARROW_OFF;  // int8/int16 storage of the inputs chosen with --narrow
+    int verifyMode = VERIFY_OFF;  // O(n²) check of the result chosen with --verify
+    int verifyRounds = VERIFY_DEFAULT_ROUNDS;
+    int useResultFile = 0;  // --result given (with --verify the result is only written then)
+    TileSizes tiles = defaultTileSizes();
+    char fileA[100], fileB[100], fileBatch[100], affinityList[256] = "";
     char fileResult[100];
     strcpy(fileResult, "result.out"); // Default result file if not provided
 
@@ -130,110 +289,480 @@ int main(int argc, char *argv[]) {
             strcpy(fileB, argv[++i]);
         } else if(strcmp(argv[i], "--result") == 0 && (i+1 < argc)) {
             strcpy(fileResult, argv[++i]);
+            useResultFile = 1;
         } else if(strcmp(argv[i], "--transpose") == 0) {
             useTranspose = 1;
         } else if(strcmp(argv[i], "--doublethreads") == 0) {
             useDoubleThreads = 1;
+        } else if(strcmp(argv[i], "--processes") == 0 && (i+1 < argc)) {
+            requestedProcesses = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--hugepages") == 0) {
+            useHugePages = 1;
+        } else if(strcmp(argv[i], "--blocked") == 0) {
+            useBlocked = 1;
+        } else if(strcmp(argv[i], "--simd") == 0) {
+            useSimd = 1;
+        } else if(strcmp(argv[i], "--isa") == 0 && (i+1 < argc)) {
+            useSimd = 1;
+            snprintf(simdIsa, sizeof(simdIsa), "%s", argv[++i]);
+        } else if(strcmp(argv[i], "--tiles") == 0 && (i+3 < argc)) {
+            tiles.l1 = atoi(argv[++i]);
+            tiles.l2 = atoi(argv[++i]);
+            tiles.l3 = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--dtype") == 0 && (i+1 < argc)) {
+            dtype = parseMatrixType(argv[++i]);
+        } else if(strcmp(argv[i], "--batch") == 0 && (i+1 < argc)) {
+            useBatch = 1;
+            snprintf(fileBatch, sizeof(fileBatch), "%s", argv[++i]);
+        } else if(strcmp(argv[i], "--affinity") == 0 && (i+1 < argc)) {
+            affinityPolicy = parseAffinity(argv[++i]);
+            snprintf(affinityList, sizeof(affinityList), "%s", argv[i]);
+        } else if(strcmp(argv[i], "--smt") == 0) {
+            useSmt = 1;
+        } else if(strcmp(argv[i], "--numa") == 0 && (i+1 < argc)) {
+            numaMode = parseNumaMode(argv[++i]);
+        } else if(strcmp(argv[i], "--pool") == 0) {
+            usePool = 1;
+        } else if(strcmp(argv[i], "--populate") == 0) {
+            usePopulate = 1;
+        } else if(strcmp(argv[i], "--perf") == 0) {
+            usePerf = 1;
+        } else if(strcmp(argv[i], "--verify") == 0 && (i+1 < argc)) {
+            verifyMode = parseVerifyMode(argv[++i]);
+        } else if(strcmp(argv[i], "--verify-rounds") == 0 && (i+1 < argc)) {
+            verifyRounds = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--repeat") == 0 && (i+1 < argc)) {
+            repeat = atoi(argv[++i]);
+            if (repeat < 1) {
+                fprintf(stderr, "--repeat needs a count of at least 1\n");
+                return EXIT_FAILURE;
+            }
+        } else if(strcmp(argv[i], "--chain") == 0 && (i+1 < argc)) {
+            chainList = argv[++i];
+        } else if(strcmp(argv[i], "--no-fixed") == 0) {
+            useFixed = 0;
+        } else if(strcmp(argv[i], "--narrow") == 0 && (i+1 < argc)) {
+            narrowMode = parseNarrowMode(argv[++i]);
         }
     }
+    checkTileSizes(&tiles);
+    if (verifyMode != VERIFY_OFF && useBatch) {
+        fprintf(stderr, "--verify cannot be combined with --batch\n");
+        return EXIT_FAILURE;
+    }
+    if (narrowMode != NARROW_OFF && (dtype != MATRIX_TYPE_INT32 || useTranspose || useBatch || chainList != NULL ||
+                                     numaMode == NUMA_REPLICATE)) {
+        fprintf(stderr, "--narrow cannot be combined with --dtype, --transpose, --batch, --chain or --numa replicate\n");
+        return EXIT_FAILURE;
+    }
+
+    // Pick the SIMD micro-kernels for this CPU once, outside the timed section
+    SimdKernels simd = selectSimdKernels(simdIsa);
+    TileKernel tileKernel = useSimd ? simd.panel : NULL;
+    TypedKernels typed;
+    if (dtype != MATRIX_TYPE_INT32) {
+        typed = selectTypedKernels(dtype, simdIsa);
+    }
+    char simdNote[32] = "";
+    if (useSimd) {
+        snprintf(simdNote, sizeof(simdNote), " (SIMD %s)", dtype != MATRIX_TYPE_INT32 ? typed.isa : simd.isa);
+    }
 
     // Determine number of processes based on available CPUs.
     int numCPUs = (int) sysconf(_SC_NPROCESSORS_ONLN);
     int numProcesses = useDoubleThreads ? (2 * numCPUs) : numCPUs;
 
+    // With an affinity policy the process count follows the sysfs topology:
+    // one per physical core, or per hardware thread with --smt / --doublethreads
+    CpuTopology topo = readCpuTopology();
+    Placement placement = buildPlacement(&topo, affinityPolicy, affinityList);
+    if (affinityPolicy == AFFINITY_LIST) {
+        numProcesses = placement.count;
+    } else if (affinityPolicy != AFFINITY_NONE) {
+        numProcesses = defaultWorkerCount(&topo, useSmt || useDoubleThreads);
+    }
+    if (requestedProcesses > 0) {
+        numProcesses = requestedProcesses;
+    }
+    if (numaMode == NUMA_REPLICATE && affinityPolicy == AFFINITY_NONE) {
+        fprintf(stderr, "--numa replicate needs --affinity to know the node of every process\n");
+        return EXIT_FAILURE;
+    }
+
+    // Batch mode: the children share the arena and take whole products
+    if (useBatch) {
+        Batch batch;
+        readBatchFile(&batch, fileBatch, dtype, MATRIX_SHARED | (useHugePages ? MATRIX_HUGEPAGES : 0),
+                      numProcesses);
+        printBatchSummary(&batch);
+        if (numProcesses > batch.count) {
+            numProcesses = batch.count;
+        }
+        printf("Using %d process(es)\n", numProcesses);
+        BatchKernel kernel = { useBlocked ? TYPED_BLOCKED : (useTranspose ? TYPED_TRANSPOSE : TYPED_STANDARD),
+                               useSimd, &simd, &typed, &tiles };
+        int *nextProduct = mmap(NULL, sizeof(int), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (nextProduct == MAP_FAILED) {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+        *nextProduct = 0;
+        fflush(stdout);
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int p = 0; p < numProcesses; p++) {
+            pid_t pid = fork();
+            if (pid < 0) {
+                perror("fork");
+                exit(EXIT_FAILURE);
+            } else if (pid == 0) {
+                pinToCpu(placementCpu(&placement, p));
+                multiplyBatchProducts(&kernel, &batch, nextProduct);
+                exit(EXIT_SUCCESS);
+            }
+        }
+        for (int p = 0; p < numProcesses; p++) {
+            wait(NULL);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("Using %s multiplication method (%s)%s\n", typedMethodName(kernel.method), matrixTypeName(dtype), simdNote);
+        double computeTime = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("Multiplication computation time: %.9f seconds\n", computeTime);
+        printBatchThroughput(&batch, computeTime);
+        writeBatchFile(&batch, fileResult, numProcesses);
+        munmap(nextProduct, sizeof(int));
+        freeBatch(&batch);
+        freePlacement(&placement);
+        freeCpuTopology(&topo);
+        return 0;
+    }
+
+    // Chain mode: A1·A2·...·Ak in the cheapest order; every wave of independent
+    // products is one fork of the children over all of their output tiles
+    if (chainList != NULL) {
+        if (dtype != MATRIX_TYPE_INT32 || verifyMode != VERIFY_OFF) {
+            fprintf(stderr, "--chain cannot be combined with --dtype or --verify\n");
+            return EXIT_FAILURE;
+        }
+        ChainPlan *chain = createChainPlan(chainList, MATRIX_SHARED, numProcesses, &tiles, useSimd ? &simd : NULL,
+                                           runChainTasks, &numProcesses);
+        printf("Matrix size: %d x %d\n", chain->result.rows, chain->result.cols);
+        printf("Using %d process(es)\n", numProcesses);
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        chainMultiply(chain);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printChainPlan(chain, simdNote);
+        double computeTime = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("Multiplication computation time: %.9f seconds\n", computeTime);
+        saveMatrix(&chain->result, fileResult, numProcesses);
+        freeChainPlan(chain);
+        freePlacement(&placement);
+        freeCpuTopology(&topo);
+        return 0;
+    }
+
     printf("Matrix size: %d x %d\n", n, n);
     printf("Using %d process(es)\n", numProcesses);
+    if (affinityPolicy != AFFINITY_NONE) {
+        printPlacement(&placement, &topo, numProcesses);
+    }
 
     // Initialize random seed
     srand(time(NULL));
 
-    // Allocate shared memory for matrices
-    int **matrix1 = allocate_shared_matrix(n);
-    int **matrix2 = allocate_shared_matrix(n);
-    int **resultMatrix = allocate_shared_matrix(n);
+    // Allocate shared memory for matrices; with --numa the inputs are
+    // interleaved over the nodes before anything touches them
+    int allocFlags = (useHugePages ? MATRIX_HUGEPAGES : 0) | (usePopulate ? MATRIX_POPULATE : 0);
+    int inputFlags = allocFlags | (numaMode != NUMA_FIRST_TOUCH ? MATRIX_INTERLEAVE : 0);
+    Matrix matrix1, matrix2;
+    Matrix resultMatrix = allocate_shared_matrix(n, dtype, allocFlags);
 
-    if(useFiles) {
-        readMatrixFromFile(n, matrix1, fileA);
-        readMatrixFromFile(n, matrix2, fileB);
+    if(useFiles && narrowMode != NARROW_OFF) {
+        loadNarrowMatrix(&matrix1, n, n, fileA, narrowMode, MATRIX_SHARED | inputFlags, numProcesses);
+        loadNarrowMatrix(&matrix2, n, n, fileB, narrowMode, MATRIX_SHARED | inputFlags, numProcesses);
+    } else if(useFiles) {
+        // Text files are parsed, binary files are mapped in place (children inherit the mapping)
+        loadTypedMatrix(&matrix1, n, n, dtype, fileA, MATRIX_SHARED | inputFlags, numProcesses);
+        loadTypedMatrix(&matrix2, n, n, dtype, fileB, MATRIX_SHARED | inputFlags, numProcesses);
     } else {
-        fillMatrix(n, matrix1);
-        fillMatrix(n, matrix2);
+        matrix1 = allocate_shared_matrix(n, dtype, inputFlags);
+        matrix2 = allocate_shared_matrix(n, dtype, inputFlags);
+        fillMatrix(&matrix1);
+        fillMatrix(&matrix2);
     }
 
-    // Initialize result matrix to zeros
-    for (int i = 0; i < n; i++){
-        for (int j = 0; j < n; j++){
-            resultMatrix[i][j] = 0;
+    // --narrow: int8/int16 copies of the inputs (unless they were read that
+    // way) and the shared buffer of packed B, which the children fill in
+    // bands in a first timed stage
+    int narrowType = MATRIX_TYPE_INT32;
+    NarrowPlan narrowPlan;
+    int numNarrowBands = 0;
+    if (narrowMode != NARROW_OFF) {
+        narrowType = narrowOperands(&matrix1, &matrix2, narrowMode, MATRIX_SHARED | inputFlags);
+        if (narrowType != MATRIX_TYPE_INT32) {
+            narrowPlan = createNarrowPlan(&matrix1, &matrix2, &tiles, useSimd, simdIsa, MATRIX_SHARED | allocFlags);
+            if (useSimd) {
+                snprintf(simdNote, sizeof(simdNote), " (SIMD %s)", narrowPlan.isa);
+            }
+            numNarrowBands = narrowBandCount(&narrowPlan);
+        } else {
+            printf("Narrow storage: the values need int32, using the int32 kernels\n");
+        }
+    }
+
+    // --numa replicate: one shared copy of B bound to each node
+    Matrix *replicas = NULL;
+    if (numaMode == NUMA_REPLICATE) {
+        replicas = malloc(topo.numNodes * sizeof(Matrix));
+        for (int node = 0; node < topo.numNodes; node++) {
+            replicas[node] = replicateMatrix(&matrix2, node, MATRIX_SHARED | allocFlags);
         }
     }
 
+    // Initialize result matrix to zeros. Pinned children skip this: the fresh
+    // mapping is already zero, and leaving it untouched lets each page of C
+    // be faulted in on the node of the child that writes its rows.
+    if (affinityPolicy == AFFINITY_NONE && !usePopulate) {
+        zeroMatrix(&resultMatrix);
+    }
+
     // Choose the multiplication kernel before starting timing.
     void (*kernelFunc)(ProcessData *);
     char *methodName;
-    if (useTranspose) {
-        kernelFunc = multiplyChunkTranspose;
-        methodName = "transpose multiplication method";
+    char methodBuffer[128];
+    int typedMethod = useBlocked ? TYPED_BLOCKED : (useTranspose ? TYPED_TRANSPOSE : TYPED_STANDARD);
+    // Registered sizes run a kernel compiled for that n on each child's rows
+    FixedPlan fixed = { NULL, n, NULL };
+    if (useFixed && dtype == MATRIX_TYPE_INT32 && narrowType == MATRIX_TYPE_INT32 && !useTranspose) {
+        fixed = selectFixedKernel(&matrix1, &matrix2, &resultMatrix, useBlocked, &tiles, useSimd, &simd);
+    }
+    if (narrowType != MATRIX_TYPE_INT32) {
+        kernelFunc = multiplyChunkNarrow;
+        snprintf(methodBuffer, sizeof(methodBuffer), "narrow blocked multiplication method (%s, tiles %d/%d/%d)%s",
+                 matrixTypeName(narrowType), narrowPlan.edges[0], narrowPlan.edges[1], narrowPlan.edges[2], simdNote);
+    } else if (fixed.kernel != NULL) {
+        kernelFunc = multiplyChunkFixed;
+        snprintf(methodBuffer, sizeof(methodBuffer), "fixed-size %s multiplication method (n = %d)%s",
+                 fixed.shape, n, simdNote);
+    } else if (dtype != MATRIX_TYPE_INT32) {
+        kernelFunc = multiplyChunkTyped;
+        snprintf(methodBuffer, sizeof(methodBuffer), "%s multiplication method (%s)%s",
+                 typedMethodName(typedMethod), matrixTypeName(dtype), simdNote);
+    } else if (useBlocked) {
+        kernelFunc = multiplyChunkBlocked;
+        snprintf(methodBuffer, sizeof(methodBuffer), "blocked multiplication method (tiles %d/%d/%d)%s",
+                 tiles.l1, tiles.l2, tiles.l3, simdNote);
+    } else if (useTranspose) {
+        kernelFunc = useSimd ? multiplyChunkTransposeSimd : multiplyChunkTranspose;
+        snprintf(methodBuffer, sizeof(methodBuffer), "transpose multiplication method%s", simdNote);
     } else {
-        kernelFunc = multiplyChunkStandard;
-        methodName = "standard multiplication method";
+        kernelFunc = useSimd ? multiplyChunkSimd : multiplyChunkStandard;
+        snprintf(methodBuffer, sizeof(methodBuffer), "standard multiplication method%s", simdNote);
     }
+    methodName = methodBuffer;
 
-    // Compute row-chunk sizes for processes
-    int baseChunk = n / numProcesses;
-    int remainder = n % numProcesses;
+    // Kernel settings shared by every row chunk
+    RowJob job;
+    job.base.n = n;
+    job.base.matrix1 = &matrix1;
+    job.base.matrix2 = &matrix2;
+    job.base.resultMatrix = &resultMatrix;
+    job.base.tiles = &tiles;
+    job.base.simd = &simd;
+    job.base.tileKernel = tileKernel;
+    job.base.typed = &typed;
+    job.base.typedMethod = typedMethod;
+    job.base.useSimd = useSimd;
+    job.base.fixed = &fixed;
+    job.base.narrow = &narrowPlan;
+    job.kernelFunc = kernelFunc;
+    job.replicas = replicas;
 
-    // Timing start (only for the multiplication kernel)
-    struct timespec start, end;
-    clock_gettime(CLOCK_MONOTONIC, &start);
+    // --transpose: Bᵀ is packed into its own shared matrix (into the per-node
+    // copies with --numa replicate) by a first timed stage on the workers
+    int packB = useTranspose && !useBlocked;
+    Matrix packedB;
+    TransposeJob transposeJob = { &matrix2, &packedB, 1 };
+    int numBands = transposeBandCount(&matrix2);
+    if (packB) {
+        if (replicas != NULL) {
+            transposeJob.targets = replicas;
+            transposeJob.numTargets = topo.numNodes;
+        } else {
+            packedB = allocate_shared_matrix(n, dtype, allocFlags | MATRIX_POPULATE);
+            job.base.matrix2 = &packedB;
+        }
+    }
 
-    // Fork processes for parallel matrix multiplication
-    int currentRow = 0;
+    // --pool: fork the workers once, before timing. Each takes row blocks
+    // (about four per worker) from the shared queue until none is left.
+    ProcessPool pool = { 0, NULL, NULL };
+    int *workerCpus = malloc(numProcesses * sizeof(int));
+    int *workerNodes = malloc(numProcesses * sizeof(int));
     for (int p = 0; p < numProcesses; p++) {
-        int rowsForThisProcess = baseChunk + (p < remainder ? 1 : 0);
-
-        ProcessData data;
-        data.processID = p;
-        data.startRow = currentRow;
-        data.endRow = currentRow + rowsForThisProcess;
-        data.n = n;
-        data.matrix1 = matrix1;
-        data.matrix2 = matrix2;
-        data.resultMatrix = resultMatrix;
+        workerCpus[p] = placementCpu(&placement, p);
+        workerNodes[p] = placementNode(&placement, p);
+    }
+    job.workerNodes = workerNodes;
+    job.rowsPerTask = (n + 4 * numProcesses - 1) / (4 * numProcesses);
+    if (job.rowsPerTask < 1) {
+        job.rowsPerTask = 1;  // n = 0: no tasks, but keep the divisor valid
+    }
+    int numTasks = (n + job.rowsPerTask - 1) / job.rowsPerTask;
 
-        pid_t pid = fork();
-        if (pid < 0) {
-            perror("fork");
+    // --perf: one counter group per child, in shared memory so the parent can
+    // read the totals (mapped before the pool is forked, so its workers see it)
+    PerfCounters *perfWorkers = NULL;
+    if (usePerf) {
+        perfWorkers = mmap(NULL, numProcesses * sizeof(PerfCounters), PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (perfWorkers == MAP_FAILED) {
+            perror("mmap");
             exit(EXIT_FAILURE);
-        } else if (pid == 0) {
-            // In child process: perform assigned multiplication chunk
-            kernelFunc(&data);
-            exit(EXIT_SUCCESS); // Child exits after finishing its work.
         }
-        // Parent: update row index and continue forking other processes.
-        currentRow += rowsForThisProcess;
     }
-
-    // Parent waits for all child processes
-    for (int p = 0; p < numProcesses; p++) {
-        wait(NULL);
+    if (usePool) {
+        pool = createProcessPool(numProcesses, workerCpus);
+        printf("Pre-forked pool: %d worker(s), %d task(s) of %d row(s)\n", numProcesses, numTasks, job.rowsPerTask);
+        if (perfWorkers != NULL) {
+            // Every worker opens its counter group in an empty job before timing
+            processPoolSetHook(&pool, perfOpenHook, perfWorkers);
+            processPoolRun(&pool, perfNoopTask, NULL, 1);
+            processPoolSetHook(&pool, perfCountHook, perfWorkers);
+        }
     }
 
-    // Timing end
-    clock_gettime(CLOCK_MONOTONIC, &end);
-    double computeTime = (end.tv_sec - start.tv_sec) +
+    // Compute row-chunk sizes for processes
+    int baseChunk = n / numProcesses;
+    int remainder = n % numProcesses;
+
+    double totalTime = 0, totalPackTime = 0;
+    for (int r = 0; r < repeat; r++) {
+        if (r > 0) {
+            zeroMatrix(&resultMatrix);  // The kernels accumulate into C
+        }
+
+        // Timing start (only for the multiplication kernel). Flush first, so
+        // the forked children do not inherit and write out buffered output.
+        fflush(stdout);
+        struct timespec start, packEnd, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (packB && usePool) {
+            processPoolRun(&pool, runTransposeTask, &transposeJob, numBands);
+        } else if (packB) {
+            forkPackBands(runTransposeTask, &transposeJob, numBands, numProcesses, workerCpus);
+        } else if (narrowType != MATRIX_TYPE_INT32 && usePool) {
+            processPoolRun(&pool, runNarrowPackTask, &narrowPlan, numNarrowBands);
+        } else if (narrowType != MATRIX_TYPE_INT32) {
+            forkPackBands(runNarrowPackTask, &narrowPlan, numNarrowBands, numProcesses, workerCpus);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &packEnd);
+
+        if (usePool) {
+            processPoolRun(&pool, runRowTask, &job, numTasks);
+        } else {
+            // Fork processes for parallel matrix multiplication
+            int currentRow = 0;
+            for (int p = 0; p < numProcesses; p++) {
+                int rowsForThisProcess = baseChunk + (p < remainder ? 1 : 0);
+
+                ProcessData data = job.base;
+                data.processID = p;
+                data.startRow = currentRow;
+                data.endRow = currentRow + rowsForThisProcess;
+                if (replicas != NULL) {
+                    data.matrix2 = &replicas[workerNodes[p]];
+                }
+
+                pid_t pid = fork();
+                if (pid < 0) {
+                    perror("fork");
+                    exit(EXIT_FAILURE);
+                } else if (pid == 0) {
+                    // In child process: perform assigned multiplication chunk
+                    pinToCpu(workerCpus[p]);
+                    if (perfWorkers != NULL) {
+                        perfOpen(&perfWorkers[p]);
+                        perfStart(&perfWorkers[p]);
+                    }
+                    kernelFunc(&data);
+                    if (perfWorkers != NULL) {
+                        perfStop(&perfWorkers[p]);
+                        perfClose(&perfWorkers[p]);
+                    }
+                    exit(EXIT_SUCCESS); // Child exits after finishing its work.
+                }
+                // Parent: update row index and continue forking other processes.
+                currentRow += rowsForThisProcess;
+            }
+
+            // Parent waits for all child processes
+            for (int p = 0; p < numProcesses; p++) {
+                wait(NULL);
+            }
+        }
+
+        // Timing end
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double runTime = (end.tv_sec - start.tv_sec) +
                          (end.tv_nsec - start.tv_nsec) / 1e9;
+        if (repeat > 1) {
+            printf("Repetition %d: %.9f seconds\n", r + 1, runTime);
+        }
+        totalTime += runTime;
+        totalPackTime += (packEnd.tv_sec - start.tv_sec) + (packEnd.tv_nsec - start.tv_nsec) / 1e9;
+    }
+    double computeTime = totalTime / repeat;  // Mean over the repetitions
+    if (usePool) {
+        destroyProcessPool(&pool);
+    }
 
     // Print the multiplication method and computation time
     printf("Using %s\n", methodName);
+    if (packB) {
+        printf("Transpose pack time: %.9f seconds\n", totalPackTime / repeat);
+        if (replicas == NULL) {
+            free_shared_matrix(&packedB);
+        }
+    } else if (narrowType != MATRIX_TYPE_INT32) {
+        printf("Narrow pack time: %.9f seconds\n", totalPackTime / repeat);
+        freeNarrowPlan(&narrowPlan);
+    }
     printf("Multiplication computation time: %.9f seconds\n", computeTime);
+    if (perfWorkers != NULL) {
+        perfReport("processes", perfWorkers, numProcesses, computeTime);
+        munmap(perfWorkers, numProcesses * sizeof(PerfCounters));
+    }
 
-    // Save the result matrix to file
-    writeMatrixToFile(n, resultMatrix, fileResult);
+    // --verify: O(n²) check of C against A and B, after timing
+    int verified = 1;
+    if (verifyMode != VERIFY_OFF) {
+        VerifyPlan verifyPlan = createVerifyPlan(verifyMode, verifyRounds, &matrix1, &matrix2, &resultMatrix,
+                                                 numProcesses, runVerifyTasks, &numProcesses);
+        VerifyResult verifyResult = verifyProduct(&verifyPlan);
+        verified = printVerifyResult(&verifyPlan, &verifyResult);
+        freeVerifyPlan(&verifyPlan);
+    }
+
+    // Save the result matrix to file (binary when the name ends in .bin); with --verify only
+    // when --result is given
+    if (verifyMode == VERIFY_OFF || useResultFile) {
+        saveMatrix(&resultMatrix, fileResult, numProcesses);
+    }
 
     // Clean up shared memory allocations
-    free_shared_matrix(matrix1, n);
-    free_shared_matrix(matrix2, n);
-    free_shared_matrix(resultMatrix, n);
+    free_shared_matrix(&matrix1);
+    free_shared_matrix(&matrix2);
+    free_shared_matrix(&resultMatrix);
+    for (int node = 0; replicas != NULL && node < topo.numNodes; node++) {
+        free_shared_matrix(&replicas[node]);
+    }
+    free(replicas);
+    free(workerCpus);
+    free(workerNodes);
+    freePlacement(&placement);
+    freeCpuTopology(&topo);
 
-    return 0;
+    return verified ? 0 : EXIT_FAILURE;
 }
@@ -1,78 +1,106 @@
+#define _GNU_SOURCE  // pread/pwrite, MAP_ANONYMOUS/MAP_POPULATE, CLOCK_MONOTONIC
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
-
-// Function to fill a matrix with random integer numbers
-void fillMatrix(int n, int **matrix) {
-    for (int i = 0; i < n; i++){
-        for (int j = 0; j < n; j++){
-            matrix[i][j] = rand() % 10;  // Random numbers between 0 and 9
-        }
-    }
-}
+#include "../common/matrix.h"
+#include "../common/matrix_io.h"
+#include "../common/blocked.h"
+#include "../common/simd.h"
+#include "../common/stream.h"
+#include "../common/strassen.h"
+#include "../common/typed.h"
+#include "../common/batch.h"
+#include "../common/perf.h"
+#include "../common/gemm.h"
+#include "../common/transpose.h"
+#include "../common/verify.h"
+#include "../common/chain.h"
+#include "../common/pipeline.h"
+#include "../common/narrow.h"
+#include "../common/fixed.h"
 
 // Function to multiply matrices
-void multiplyMatrix(int n, int **matrix1, int **matrix2, int **resultMatrix){
-    int sum;
+void multiplyMatrix(const Matrix *matrix1, const Matrix *matrix2, Matrix *resultMatrix){
+    int n = resultMatrix->rows;
+    int lda = matrix1->stride, ldb = matrix2->stride, ldc = resultMatrix->stride;
+    const int *restrict a = matrix1->data;
+    const int *restrict b = matrix2->data;
+    int *restrict c = resultMatrix->data;
     for (int i = 0; i < n; i++){
         for (int j = 0; j < n; j++){
             for (int k = 0; k < n; k++){
-                resultMatrix[i][j] += matrix1[i][k] * matrix2[k][j];
+                c[(size_t) i*ldc + j] += a[(size_t) i*lda + k] * b[(size_t) k*ldb + j];
             }
         }
     }
 }
 
-// Function to multiply matrices simulating a transpose operation on the second matrix for cache optimization
-void multiplyTransposeMatrix(int n, int **matrix1, int **matrix2, int **resultMatrix){
-    int sum;
+// Function to multiply matrices reading the second one as its packed transpose (matrix2 holds Bᵀ)
+void multiplyTransposeMatrix(const Matrix *matrix1, const Matrix *matrix2, Matrix *resultMatrix){
+    int n = resultMatrix->rows;
+    int lda = matrix1->stride, ldb = matrix2->stride, ldc = resultMatrix->stride;
+    const int *restrict a = matrix1->data;
+    const int *restrict b = matrix2->data;
+    int *restrict c = resultMatrix->data;
     for (int i = 0; i < n; i++){
         for (int j = 0; j < n; j++){
             for (int k = 0; k < n; k++){
-                resultMatrix[i][j] += matrix1[i][k] * matrix2[j][k];
+                c[(size_t) i*ldc + j] += a[(size_t) i*lda + k] * b[(size_t) j*ldb + k];
             }
         }
     }
 }
 
-void readMatrixFromFile(int n, int **matrix, const char* fileName) {
-    FILE *file = fopen(fileName, "r");
-    if (!file) {
-        fprintf(stderr, "Cannot open file %s\n", fileName);
-        exit(1);
-    }
-    for (int i = 0; i < n; i++){
-        for (int j = 0; j < n; j++){
-            if (fscanf(file, "%d", &matrix[i][j]) != 1) {
-                fprintf(stderr, "Error leyendo archivo.\n");
-                exit(1);
-            }
-        }
-    }
-    fclose(file);
+// Function to multiply matrices with the SIMD micro-kernel selected at startup
+void multiplyMatrixSimd(const SimdKernels *simd, const Matrix *matrix1, const Matrix *matrix2, Matrix *resultMatrix){
+    simd->panel(matrix1->data, matrix1->stride, matrix2->data, matrix2->stride,
+                resultMatrix->data, resultMatrix->stride,
+                0, resultMatrix->rows, 0, resultMatrix->cols, 0, matrix1->cols);
 }
 
-void writeMatrixToFile(int n, int **matrix, const char* fileName) {
-    FILE *file = fopen(fileName, "w");
-    if (!file) {
-        fprintf(stderr, "Cannot open file %s for writing\n", fileName);
-        exit(1);
-    }
-    for (int i = 0; i < n; i++){
-        for (int j = 0; j < n; j++){
-            fprintf(file, "%d ", matrix[i][j]);
-        }
-        fprintf(file, "\n");
-    }
-    fclose(file);
+// Function to multiply matrices with the transposed-access SIMD micro-kernel selected at startup
+void multiplyTransposeMatrixSimd(const SimdKernels *simd, const Matrix *matrix1, const Matrix *matrix2, Matrix *resultMatrix){
+    simd->transposed(matrix1->data, matrix1->stride, matrix2->data, matrix2->stride,
+                     resultMatrix->data, resultMatrix->stride,
+                     0, resultMatrix->rows, 0, resultMatrix->cols, 0, matrix1->cols);
+}
+
+// Settings of the in-memory products done while streaming
+typedef struct {
+    const TileSizes *tiles;
+    TileKernel tileKernel;
+} StreamContext;
+
+// Function to multiply one pair of streamed blocks with the blocked kernel
+void multiplyStreamBlock(void *context, const Matrix *a, const Matrix *b, Matrix *c){
+    const StreamContext *ctx = (const StreamContext *) context;
+    multiplyBlockedRange(a, b, c, 0, c->rows, 0, c->cols, ctx->tiles, ctx->tileKernel);
 }
 
 int main(int argc, char *argv[]) {
     int n = 2000;
     int useFiles = 0;
     int useTranspose = 0; // Flag for transpose method
-    char fileA[100], fileB[100];
+    int useBlocked = 0;   // Flag for cache-blocked method
+    int useHugePages = 0; // Flag for huge page backed matrices
+    int useSimd = 0;      // Flag for SIMD micro-kernels
+    int streamBudgetMB = 0;  // Memory budget of --stream, 0 to load everything
+    int useStrassen = 0;  // Flag for Strassen-Winograd recursion
+    int strassenCutoff = STRASSEN_DEFAULT_CUTOFF;
+    int dtype = MATRIX_TYPE_INT32;  // Element type chosen with --dtype
+    int useBatch = 0;     // Flag for batch mode (many small products from one file)
+    int usePerf = 0;      // Flag for hardware counter reporting
+    int verifyMode = VERIFY_OFF;  // O(n²) check of the result chosen with --verify
+    int verifyRounds = VERIFY_DEFAULT_ROUNDS;
+    int useResultFile = 0;  // --result given (with --verify the result is only written then)
+    char simdIsa[16] = "";  // ISA forced with --isa, empty for CPUID detection
+    const char *chainList = NULL;  // Comma-separated matrix files of --chain
+    int usePipeline = 0;  // Flag for overlapping loading, multiplication and writing
+    int narrowMode = NARROW_OFF;  // int8/int16 storage of the inputs chosen with --narrow
+    int useFixed = 1;     // Flag for the size-specialized kernels of registered sizes
+    TileSizes tiles = defaultTileSizes();
+    char fileA[100], fileB[100], fileBatch[100];
     char fileResult[100];
     strcpy(fileResult, "result.out"); // Default result file if not provided
 
@@ -80,87 +108,401 @@ int main(int argc, char *argv[]) {
     if (argc > 1) {
         n = atoi(argv[1]);
     }
+    GemmArgs gemmArgs = defaultGemmArgs(n);  // Rectangular C = alpha * op(A) * op(B) + beta * C
     for(int i=1; i<argc; i++){
-        if(strcmp(argv[i], "--files") == 0 && (i+2 < argc)) {
+        if(parseGemmOption(argc, argv, &i, &gemmArgs)) {
+            continue;
+        } else if(strcmp(argv[i], "--files") == 0 && (i+2 < argc)) {
             useFiles = 1;
             strcpy(fileA, argv[++i]);
             strcpy(fileB, argv[++i]);
         } else if(strcmp(argv[i], "--result") == 0 && (i+1 < argc)) {
             strcpy(fileResult, argv[++i]);
+            useResultFile = 1;
         } else if(strcmp(argv[i], "--transpose") == 0) {
             useTranspose = 1;
+        } else if(strcmp(argv[i], "--hugepages") == 0) {
+            useHugePages = 1;
+        } else if(strcmp(argv[i], "--blocked") == 0) {
+            useBlocked = 1;
+        } else if(strcmp(argv[i], "--simd") == 0) {
+            useSimd = 1;
+        } else if(strcmp(argv[i], "--isa") == 0 && (i+1 < argc)) {
+            useSimd = 1;
+            snprintf(simdIsa, sizeof(simdIsa), "%s", argv[++i]);
+        } else if(strcmp(argv[i], "--tiles") == 0 && (i+3 < argc)) {
+            tiles.l1 = atoi(argv[++i]);
+            tiles.l2 = atoi(argv[++i]);
+            tiles.l3 = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--stream") == 0 && (i+1 < argc)) {
+            streamBudgetMB = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--strassen") == 0) {
+            useStrassen = 1;
+        } else if(strcmp(argv[i], "--cutoff") == 0 && (i+1 < argc)) {
+            strassenCutoff = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--dtype") == 0 && (i+1 < argc)) {
+            dtype = parseMatrixType(argv[++i]);
+        } else if(strcmp(argv[i], "--batch") == 0 && (i+1 < argc)) {
+            useBatch = 1;
+            snprintf(fileBatch, sizeof(fileBatch), "%s", argv[++i]);
+        } else if(strcmp(argv[i], "--perf") == 0) {
+            usePerf = 1;
+        } else if(strcmp(argv[i], "--verify") == 0 && (i+1 < argc)) {
+            verifyMode = parseVerifyMode(argv[++i]);
+        } else if(strcmp(argv[i], "--verify-rounds") == 0 && (i+1 < argc)) {
+            verifyRounds = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--chain") == 0 && (i+1 < argc)) {
+            chainList = argv[++i];
+        } else if(strcmp(argv[i], "--pipeline") == 0) {
+            usePipeline = 1;
+        } else if(strcmp(argv[i], "--narrow") == 0 && (i+1 < argc)) {
+            narrowMode = parseNarrowMode(argv[++i]);
+        } else if(strcmp(argv[i], "--no-fixed") == 0) {
+            useFixed = 0;
         }
     }
+    checkTileSizes(&tiles);
+    if (verifyMode != VERIFY_OFF && (useBatch || streamBudgetMB > 0 || gemmArgs.enabled)) {
+        fprintf(stderr, "--verify cannot be combined with --batch, --stream or the GEMM options\n");
+        return EXIT_FAILURE;
+    }
+    if (narrowMode != NARROW_OFF && (dtype != MATRIX_TYPE_INT32 || useTranspose || useStrassen || streamBudgetMB > 0 ||
+                                     useBatch || gemmArgs.enabled || chainList != NULL || usePipeline)) {
+        fprintf(stderr, "--narrow cannot be combined with --dtype, --transpose, --strassen, --stream, --batch, "
+                "--chain, --pipeline or the GEMM options\n");
+        return EXIT_FAILURE;
+    }
 
-    // Initialization of seed for random numbers
-    srand(time(NULL));
-    
-    // Dynamic memory allocation for matrices
-    int **matrix1 = malloc(n * sizeof(int*));
-    int **matrix2 = malloc(n * sizeof(int*));
-    int **resultMatrix = malloc(n * sizeof(int*));
-    if(matrix1 == NULL || matrix2 == NULL || resultMatrix == NULL){
-        printf("Error in memory allocation.\n");
-        return 1;
+    // Pick the SIMD micro-kernels for this CPU once, outside the timed section
+    SimdKernels simd = selectSimdKernels(simdIsa);
+    TileKernel tileKernel = useSimd ? simd.panel : NULL;
+    TypedKernels typed;
+    if (dtype != MATRIX_TYPE_INT32) {
+        if (useStrassen || streamBudgetMB > 0) {
+            fprintf(stderr, "--strassen and --stream only support --dtype int32\n");
+            return EXIT_FAILURE;
+        }
+        typed = selectTypedKernels(dtype, simdIsa);
     }
-    for (int i = 0; i < n; i++){
-        matrix1[i] = malloc(n * sizeof(int));
-        matrix2[i] = malloc(n * sizeof(int));
-        resultMatrix[i] = malloc(n * sizeof(int));
-        if(matrix1[i] == NULL || matrix2[i] == NULL || resultMatrix[i] == NULL){
+    char simdNote[32] = "";
+    if (useSimd) {
+        snprintf(simdNote, sizeof(simdNote), " (SIMD %s)", dtype != MATRIX_TYPE_INT32 ? typed.isa : simd.isa);
+    }
+
+    // Batch mode: many small products from one file, each multiplied whole
+    if (useBatch) {
+        if (useStrassen || streamBudgetMB > 0) {
+            fprintf(stderr, "--batch cannot be combined with --strassen or --stream\n");
+            return EXIT_FAILURE;
+        }
+        Batch batch;
+        readBatchFile(&batch, fileBatch, dtype, useHugePages ? MATRIX_HUGEPAGES : 0, 1);
+        printBatchSummary(&batch);
+        BatchKernel kernel = { useBlocked ? TYPED_BLOCKED : (useTranspose ? TYPED_TRANSPOSE : TYPED_STANDARD),
+                               useSimd, &simd, &typed, &tiles };
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int p = 0; p < batch.count; p++) {
+            multiplyBatchProduct(&kernel, &batch.products[p]);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("Using %s multiplication method (%s)%s\n", typedMethodName(kernel.method), matrixTypeName(dtype), simdNote);
+        double computeTime = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("Multiplication computation time: %.9f seconds\n", computeTime);
+        printBatchThroughput(&batch, computeTime);
+        writeBatchFile(&batch, fileResult, 1);
+        freeBatch(&batch);
+        return 0;
+    }
+
+    // Chain mode: A1·A2·...·Ak in the cheapest order, intermediates in a reused buffer pool
+    if (chainList != NULL) {
+        if (dtype != MATRIX_TYPE_INT32 || useStrassen || streamBudgetMB > 0 || gemmArgs.enabled || verifyMode != VERIFY_OFF) {
+            fprintf(stderr, "--chain cannot be combined with --dtype, --strassen, --stream, --verify or the GEMM options\n");
+            return EXIT_FAILURE;
+        }
+        ChainPlan *chain = createChainPlan(chainList, 0, 1, &tiles, useSimd ? &simd : NULL, NULL, NULL);
+        printf("Matrix size: %d x %d\n", chain->result.rows, chain->result.cols);
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        chainMultiply(chain);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printChainPlan(chain, simdNote);
+        double computeTime = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("Multiplication computation time: %.9f seconds\n", computeTime);
+        saveMatrix(&chain->result, fileResult, 1);
+        freeChainPlan(chain);
+        return 0;
+    }
+
+    // Pipelined mode: B is loaded and C written while the panels of C are computed
+    if (usePipeline) {
+        if (!useFiles || dtype != MATRIX_TYPE_INT32 || useStrassen || streamBudgetMB > 0 || gemmArgs.enabled ||
+            useTranspose) {
+            fprintf(stderr, "--pipeline needs --files and cannot be combined with --dtype, --strassen, --stream, "
+                    "--transpose or the GEMM options\n");
+            return EXIT_FAILURE;
+        }
+        PipelinePlan *pipeline = createPipeline(fileA, fileB,
+                                                verifyMode == VERIFY_OFF || useResultFile ? fileResult : NULL, n,
+                                                1, &tiles, tileKernel, NULL, NULL);
+        PipelineStats stats;
+        pipelineMultiply(pipeline, &stats);
+        printf("Using pipelined blocked multiplication method (tiles %d/%d/%d)%s\n", tiles.l1, tiles.l2, tiles.l3,
+               simdNote);
+        printPipelineStats(pipeline, &stats);
+        printf("Multiplication computation time: %.9f seconds\n", stats.computeTime);
+        printf("End-to-end time: %.9f seconds\n", stats.totalTime);
+        int verified = 1;
+        if (verifyMode != VERIFY_OFF) {
+            VerifyPlan verifyPlan = createVerifyPlan(verifyMode, verifyRounds, &pipeline->a, &pipeline->b,
+                                                     &pipeline->c, 1, NULL, NULL);
+            VerifyResult verifyResult = verifyProduct(&verifyPlan);
+            verified = printVerifyResult(&verifyPlan, &verifyResult);
+            freeVerifyPlan(&verifyPlan);
+        }
+        freePipeline(pipeline);
+        return verified ? 0 : EXIT_FAILURE;
+    }
+
+    // GEMM mode: C = alpha * op(A) * op(B) + beta * C on M x K and K x N operands,
+    // updated in place tile by tile
+    if (gemmArgs.enabled) {
+        if (dtype != MATRIX_TYPE_INT32 || useStrassen || streamBudgetMB > 0 || useTranspose) {
+            fprintf(stderr, "The GEMM options cannot be combined with --dtype, --strassen, --stream or --transpose (use --transb)\n");
+            return EXIT_FAILURE;
+        }
+        srand(time(NULL));
+        Matrix a, b, c;
+        loadGemmOperands(&gemmArgs, fileA, fileB, useFiles, 1, &a, &b, &c);
+        GemmProblem problem = createGemmFromArgs(&gemmArgs, &a, &b, &c, &tiles, useSimd ? &simd : NULL);
+        int *workspace = malloc(gemmWorkspaceSize(&problem) * sizeof(int));
+        if (workspace == NULL) {
             printf("Error in memory allocation.\n");
             return 1;
         }
+        printf("Matrix size: %d x %d x %d\n", gemmArgs.m, gemmArgs.n, gemmArgs.k);
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int t = 0; t < gemmTileCount(&problem); t++) {
+            gemmRunTile(&problem, t, workspace);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printGemm(&gemmArgs, simdNote);
+        double computeTime = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("Multiplication computation time: %.9f seconds\n", computeTime);
+        saveMatrix(&c, fileResult, 1);
+        free(workspace);
+        freeMatrix(&a);
+        freeMatrix(&b);
+        freeMatrix(&c);
+        return 0;
+    }
+
+    // Out-of-core mode: inputs stay on disk and C is written block row by block row
+    if (streamBudgetMB > 0) {
+        if (!useFiles) {
+            fprintf(stderr, "--stream needs --files with binary matrices\n");
+            return EXIT_FAILURE;
+        }
+        StreamContext ctx = { &tiles, tileKernel };
+        StreamStats stats;
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        streamMultiply(fileA, fileB, fileResult, n, (size_t) streamBudgetMB << 20,
+                       multiplyStreamBlock, &ctx, 1, &stats);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("Using streamed blocked multiplication method (%d MB budget)%s\n", streamBudgetMB, simdNote);
+        printStreamStats(&stats);
+        double computeTime = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("Multiplication computation time: %.9f seconds\n", computeTime);
+        return 0;
     }
+
+    // Initialization of seed for random numbers
+    srand(time(NULL));
+    
+    // One contiguous, aligned allocation per matrix
+    int allocFlags = useHugePages ? MATRIX_HUGEPAGES : 0;
+    Matrix matrix1, matrix2;
+    Matrix resultMatrix = allocateTypedMatrix(n, n, dtype, allocFlags);
     
-    if(useFiles) {
-        readMatrixFromFile(n, matrix1, fileA);
-        readMatrixFromFile(n, matrix2, fileB);
+    if(useFiles && narrowMode != NARROW_OFF) {
+        loadNarrowMatrix(&matrix1, n, n, fileA, narrowMode, allocFlags, 1);
+        loadNarrowMatrix(&matrix2, n, n, fileB, narrowMode, allocFlags, 1);
+    } else if(useFiles) {
+        // Text files are parsed, binary files are mapped in place
+        loadTypedMatrix(&matrix1, n, n, dtype, fileA, allocFlags, 1);
+        loadTypedMatrix(&matrix2, n, n, dtype, fileB, allocFlags, 1);
     } else {
-        fillMatrix(n, matrix1);
-        fillMatrix(n, matrix2);
+        matrix1 = allocateTypedMatrix(n, n, dtype, allocFlags);
+        matrix2 = allocateTypedMatrix(n, n, dtype, allocFlags);
+        fillMatrix(&matrix1);
+        fillMatrix(&matrix2);
     }
     
-    // Initialize result matrix to zeros
-    for (int i = 0; i < n; i++){
-        for (int j = 0; j < n; j++){
-            resultMatrix[i][j] = 0;
+    // --narrow: int8/int16 copies of the inputs (unless they were read that
+    // way) and the buffer of packed B, outside the timed section
+    int narrowType = MATRIX_TYPE_INT32;
+    NarrowPlan narrowPlan;
+    if (narrowMode != NARROW_OFF) {
+        narrowType = narrowOperands(&matrix1, &matrix2, narrowMode, allocFlags);
+        if (narrowType != MATRIX_TYPE_INT32) {
+            narrowPlan = createNarrowPlan(&matrix1, &matrix2, &tiles, useSimd, simdIsa, allocFlags);
+            if (useSimd) {
+                snprintf(simdNote, sizeof(simdNote), " (SIMD %s)", narrowPlan.isa);
+            }
+        } else {
+            printf("Narrow storage: the values need int32, using the int32 kernels\n");
         }
     }
+
+    // Initialize result matrix to zeros
+    zeroMatrix(&resultMatrix);
+
+    // Registered sizes run a kernel compiled for that n (common/fixed.h)
+    FixedPlan fixed = { NULL, n, NULL };
+    if (useFixed && dtype == MATRIX_TYPE_INT32 && narrowType == MATRIX_TYPE_INT32 && !useTranspose && !useStrassen) {
+        fixed = selectFixedKernel(&matrix1, &matrix2, &resultMatrix, useBlocked, &tiles, useSimd, &simd);
+    }
     
+    // --perf: counter group of the main thread, opened before timing
+    PerfCounters *perf = NULL;
+    if (usePerf) {
+        perf = calloc(1, sizeof(PerfCounters));
+        perfOpen(perf);
+    }
+
     // Start time measurement for kernel function
     struct timespec start, end;
+
+    // --transpose: Bᵀ is packed into its own matrix by a first timed stage,
+    // then the transposed kernels read it row by row (--narrow packs B in k
+    // groups the same way)
+    int packB = (useTranspose && !useBlocked && !useStrassen) || narrowType != MATRIX_TYPE_INT32;
+    Matrix packedB;
+    struct timespec packEnd;
+    if (packB && narrowType == MATRIX_TYPE_INT32) {
+        packedB = allocateTypedMatrix(n, n, dtype, allocFlags | MATRIX_POPULATE);
+    }
     
     // Choose multiplication method based on flag OUTSIDE the timed section
-    if (useTranspose) {
+    if (dtype != MATRIX_TYPE_INT32) {
+        // int64/float/double: kernels specialized for the element type
+        int method = useBlocked ? TYPED_BLOCKED : (useTranspose ? TYPED_TRANSPOSE : TYPED_STANDARD);
         clock_gettime(CLOCK_MONOTONIC, &start);
-        multiplyTransposeMatrix(n, matrix1, matrix2, resultMatrix);
+        perfStart(perf);
+        if (packB) {
+            transposeMatrix(&matrix2, &packedB);
+            clock_gettime(CLOCK_MONOTONIC, &packEnd);
+        }
+        multiplyTypedRange(&typed, method, useSimd, &matrix1, packB ? &packedB : &matrix2, &resultMatrix,
+                           0, n, 0, n, &tiles);
+        perfStop(perf);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("Using %s multiplication method (%s)%s\n", typedMethodName(method), matrixTypeName(dtype), simdNote);
+    } else if (narrowType != MATRIX_TYPE_INT32) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        perfStart(perf);
+        for (int band = 0; band < narrowBandCount(&narrowPlan); band++) {
+            narrowPackBand(&narrowPlan, band);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &packEnd);
+        multiplyNarrowRange(&narrowPlan, &resultMatrix, 0, n, 0, n);
+        perfStop(perf);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("Using narrow blocked multiplication method (%s, tiles %d/%d/%d)%s\n", matrixTypeName(narrowType),
+               narrowPlan.edges[0], narrowPlan.edges[1], narrowPlan.edges[2], simdNote);
+    } else if (fixed.kernel != NULL) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        perfStart(perf);
+        multiplyFixedRows(&fixed, &matrix1, &matrix2, &resultMatrix, 0, n);
+        perfStop(perf);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("Using fixed-size %s multiplication method (n = %d)%s\n", fixed.shape, n, simdNote);
+    } else if (useStrassen) {
+        // Workspace for every recursion level is allocated before timing
+        StrassenPlan plan = createStrassenPlan(n, strassenCutoff, 0, &tiles, tileKernel, NULL, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        perfStart(perf);
+        strassenMultiply(&plan, &matrix1, &matrix2, &resultMatrix);
+        perfStop(perf);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("Using Strassen-Winograd multiplication method (cutoff %d)%s\n", strassenCutoff, simdNote);
+        freeStrassenPlan(&plan);
+    } else if (useBlocked) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        perfStart(perf);
+        multiplyBlockedRows(&matrix1, &matrix2, &resultMatrix, 0, n, &tiles, tileKernel);
+        perfStop(perf);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("Using blocked multiplication method (tiles %d/%d/%d)%s\n", tiles.l1, tiles.l2, tiles.l3, simdNote);
+    } else if (useTranspose) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        perfStart(perf);
+        transposeMatrix(&matrix2, &packedB);
+        clock_gettime(CLOCK_MONOTONIC, &packEnd);
+        if (useSimd) {
+            multiplyTransposeMatrixSimd(&simd, &matrix1, &packedB, &resultMatrix);
+        } else {
+            multiplyTransposeMatrix(&matrix1, &packedB, &resultMatrix);
+        }
+        perfStop(perf);
         clock_gettime(CLOCK_MONOTONIC, &end);
-        printf("Using transpose multiplication method\n");
+        printf("Using transpose multiplication method%s\n", simdNote);
     } else {
         clock_gettime(CLOCK_MONOTONIC, &start);
-        multiplyMatrix(n, matrix1, matrix2, resultMatrix);
+        perfStart(perf);
+        if (useSimd) {
+            multiplyMatrixSimd(&simd, &matrix1, &matrix2, &resultMatrix);
+        } else {
+            multiplyMatrix(&matrix1, &matrix2, &resultMatrix);
+        }
+        perfStop(perf);
         clock_gettime(CLOCK_MONOTONIC, &end);
-        printf("Using standard multiplication method\n");
+        printf("Using standard multiplication method%s\n", simdNote);
     }
     
     double computeTime = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
     
-    // Show computation time of the kernel
+    // Show computation time of the kernel (with the pack stage, also shown on its own)
+    if (packB) {
+        double packTime = (packEnd.tv_sec - start.tv_sec) + (packEnd.tv_nsec - start.tv_nsec) / 1e9;
+        if (narrowType != MATRIX_TYPE_INT32) {
+            printf("Narrow pack time: %.9f seconds\n", packTime);
+            freeNarrowPlan(&narrowPlan);
+        } else {
+            printf("Transpose pack time: %.9f seconds\n", packTime);
+            freeMatrix(&packedB);
+        }
+    }
     printf("Multiplication computation time: %.9f seconds\n", computeTime);
+    if (perf != NULL) {
+        perfReport("sequential", perf, 1, computeTime);
+        perfClose(perf);
+        free(perf);
+    }
     
-    // Save result matrix to file
-    writeMatrixToFile(n, resultMatrix, fileResult);
+    // --verify: O(n²) check of C against A and B, after timing
+    int verified = 1;
+    if (verifyMode != VERIFY_OFF) {
+        VerifyPlan verifyPlan = createVerifyPlan(verifyMode, verifyRounds, &matrix1, &matrix2, &resultMatrix,
+                                                 1, NULL, NULL);
+        VerifyResult verifyResult = verifyProduct(&verifyPlan);
+        verified = printVerifyResult(&verifyPlan, &verifyResult);
+        freeVerifyPlan(&verifyPlan);
+    }
 
-    // Free allocated memory
-    for (int i = 0; i < n; i++){
-        free(matrix1[i]);
-        free(matrix2[i]);
-        free(resultMatrix[i]);
+    // Save result matrix to file (binary when the name ends in .bin); with --verify only
+    // when --result is given
+    if (verifyMode == VERIFY_OFF || useResultFile) {
+        saveMatrix(&resultMatrix, fileResult, 1);
     }
-    free(matrix1);
-    free(matrix2);
-    free(resultMatrix);
+
+    // Free allocated memory
+    freeMatrix(&matrix1);
+    freeMatrix(&matrix2);
+    freeMatrix(&resultMatrix);
     
-    return 0;
+    return verified ? 0 : EXIT_FAILURE;
 }
\ No newline at end of file
@@ -0,0 +1,193 @@
+#define _GNU_SOURCE  // memfd_create
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "../common/message.h"
+#include "../common/server.h"
+
+// Operands of the shared requests of one client: A, B and C in one memfd
+typedef struct {
+    int fd;
+    int *a, *b, *c;
+    size_t bytes;
+} SharedOperands;
+
+// Function to round a byte count up to a cache line
+size_t alignLine(size_t bytes) {
+    return (bytes + 63) / 64 * 64;
+}
+
+// Function to create the shared object of an m x k by k x n product and fill A and B
+SharedOperands createSharedOperands(MultiplyRequest *request) {
+    SharedOperands s;
+    size_t m = request->m, n = request->n, k = request->k;
+    request->offsetA = 0;
+    request->offsetB = alignLine(m * k * sizeof(int));
+    request->offsetC = request->offsetB + alignLine(k * n * sizeof(int));
+    s.bytes = request->offsetC + m * n * sizeof(int);
+    s.fd = memfd_create("matrix-request", 0);
+    if (s.fd < 0 || ftruncate(s.fd, (off_t) s.bytes) < 0) {
+        perror("memfd_create");
+        exit(EXIT_FAILURE);
+    }
+    char *base = mmap(NULL, s.bytes, PROT_READ | PROT_WRITE, MAP_SHARED, s.fd, 0);
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    s.a = (int *) (base + request->offsetA);
+    s.b = (int *) (base + request->offsetB);
+    s.c = (int *) (base + request->offsetC);
+    for (size_t i = 0; i < m * k; i++) {
+        s.a[i] = rand() % 10;  // Random numbers between 0 and 9, like fillMatrix()
+    }
+    for (size_t i = 0; i < k * n; i++) {
+        s.b[i] = rand() % 10;
+    }
+    return s;
+}
+
+// Function to compare the C computed by the server with a naive product; returns 1 if equal
+int checkSharedResult(const MultiplyRequest *request, const SharedOperands *s) {
+    int m = request->m, n = request->n, k = request->k;
+    for (int i = 0; i < m; i++) {
+        for (int j = 0; j < n; j++) {
+            int sum = 0;
+            for (int kk = 0; kk < k; kk++) {
+                sum += s->a[(size_t) i * k + kk] * s->b[(size_t) kk * n + j];
+            }
+            if (sum != s->c[(size_t) i * n + j]) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Function to send the requests of one client over its own connection and print
+// their timings; returns 0, or 1 if a request failed or a check did not pass
+int runClient(const char *path, MultiplyRequest request, int repeat, int check, int id) {
+    srand(time(NULL) + id);
+    int fd = connectServer(path);
+    SharedOperands shared = { -1, NULL, NULL, NULL, 0 };
+    if (request.kind == REQUEST_SHARED) {
+        shared = createSharedOperands(&request);
+    }
+    double roundTrip = 0, queue = 0, compute = 0, batch = 0;
+    int failed = 0;
+    for (int r = 0; r < repeat; r++) {
+        MultiplyReply reply;
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (sendRequest(fd, &request, shared.fd) < 0 || receiveAll(fd, &reply, sizeof(reply)) < 0) {
+            fprintf(stderr, "Lost the connection to the server\n");
+            return 1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (reply.status != 0) {
+            fprintf(stderr, "Request failed: %s\n", reply.error);
+            failed = 1;
+            break;
+        }
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("Client %d request %d: %d x %d x %d, batch of %d, load %.9f s, queue %.9f s, compute %.9f s, "
+               "save %.9f s, round trip %.9f s\n", id, r, reply.m, reply.n, reply.k, reply.batchSize,
+               reply.loadSeconds, reply.queueSeconds, reply.computeSeconds, reply.saveSeconds, seconds);
+        roundTrip += seconds;
+        queue += reply.queueSeconds;
+        compute += reply.computeSeconds;
+        batch += reply.batchSize;
+    }
+    if (!failed && repeat > 1) {
+        printf("Client %d: %d request(s), mean queue %.9f s, compute %.9f s, round trip %.9f s, batch of %.1f\n",
+               id, repeat, queue / repeat, compute / repeat, roundTrip / repeat, batch / repeat);
+    }
+    if (!failed && check && request.kind == REQUEST_SHARED) {
+        int passed = checkSharedResult(&request, &shared);
+        printf("Client %d check: %s\n", id, passed ? "passed" : "FAILED");
+        failed = !passed;
+    }
+    close(fd);
+    return failed;
+}
+
+int main(int argc, char *argv[]) {
+    char socketPath[SERVER_PATH_MAX] = SERVER_DEFAULT_SOCKET;
+    int repeat = 1;         // Requests per client
+    int numClients = 1;     // Concurrent clients, one connection each
+    int check = 0;          // Flag for checking shared results against a naive product
+    MultiplyRequest request;
+    memset(&request, 0, sizeof(request));
+    request.magic = SERVER_MAGIC;
+
+    // Parse arguments
+    for (int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--socket") == 0 && (i+1 < argc)) {
+            snprintf(socketPath, sizeof(socketPath), "%s", argv[++i]);
+        } else if(strcmp(argv[i], "--files") == 0 && (i+2 < argc)) {
+            request.kind = REQUEST_FILES;
+            snprintf(request.fileA, sizeof(request.fileA), "%s", argv[++i]);
+            snprintf(request.fileB, sizeof(request.fileB), "%s", argv[++i]);
+        } else if(strcmp(argv[i], "--result") == 0 && (i+1 < argc)) {
+            snprintf(request.fileResult, sizeof(request.fileResult), "%s", argv[++i]);
+        } else if(strcmp(argv[i], "--shape") == 0 && (i+3 < argc)) {
+            request.m = atoi(argv[++i]);
+            request.n = atoi(argv[++i]);
+            request.k = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--shared") == 0 && (i+3 < argc)) {
+            request.kind = REQUEST_SHARED;
+            request.m = atoi(argv[++i]);
+            request.n = atoi(argv[++i]);
+            request.k = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--repeat") == 0 && (i+1 < argc)) {
+            repeat = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--clients") == 0 && (i+1 < argc)) {
+            numClients = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--check") == 0) {
+            check = 1;
+        } else if(strcmp(argv[i], "--shutdown") == 0) {
+            request.kind = REQUEST_SHUTDOWN;
+        }
+    }
+    if (request.kind == 0 || repeat < 1 || numClients < 1) {
+        fprintf(stderr, "Usage: %s [--socket PATH] --files A B [--result C] [--shape M N K] | --shared M N K [--check] | "
+                "--shutdown [--repeat R] [--clients C]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (request.kind == REQUEST_SHUTDOWN) {
+        int fd = connectServer(socketPath);
+        MultiplyReply reply;
+        if (sendRequest(fd, &request, -1) < 0 || receiveAll(fd, &reply, sizeof(reply)) < 0) {
+            fprintf(stderr, "Lost the connection to the server\n");
+            return EXIT_FAILURE;
+        }
+        printf("Server stopped\n");
+        return 0;
+    }
+    if (numClients == 1) {
+        return runClient(socketPath, request, repeat, check, 0) ? EXIT_FAILURE : 0;
+    }
+
+    // One process per client, so their requests reach the server concurrently
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    for (int c = 0; c < numClients; c++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            exit(EXIT_FAILURE);
+        } else if (pid == 0) {
+            exit(runClient(socketPath, request, repeat, check, c) ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
+    }
+    int failed = 0;
+    for (int c = 0; c < numClients; c++) {
+        int status;
+        wait(&status);
+        failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    }
+    return failed ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,553 @@
+#define _GNU_SOURCE  // CLOCK_MONOTONIC timed waits, MAP_POPULATE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../common/matrix.h"
+#include "../common/matrix_io.h"
+#include "../common/blocked.h"
+#include "../common/simd.h"
+#include "../common/thread_pool.h"
+#include "../common/gemm.h"
+#include "../common/message.h"
+#include "../common/server.h"
+
+#define SERVER_MAX_BATCH    256         // Requests computed in one pool job
+#define SERVER_MAX_BUFFERS  64          // Matrix buffers kept between file requests
+#define DEFAULT_WINDOW_US   500         // Longest wait for more requests to join a batch
+#define DEFAULT_SMALL_MACS  (128.0 * 128 * 128)  // At or below: one task for the whole product
+
+// A file request's matrix buffer, kept allocated for the next requests
+typedef struct {
+    Matrix matrix;
+    int inUse;
+} CachedBuffer;
+
+typedef struct ServerRequest {
+    MultiplyRequest request;
+    MultiplyReply reply;
+    int sharedFd;               // Shared requests: the object, mapped at shared
+    void *shared;
+    size_t sharedBytes;
+    Matrix a, b, c;             // Views of the operands
+    int slotA, slotB, slotC;    // Cache slots behind a, b and c (-1 for none)
+    int mappedA, mappedB;       // Binary files mapped in place, freed after the request
+    GemmProblem problem;
+    struct timespec ready;      // Operands in place, waiting for a batch
+    int done;
+    struct ServerRequest *next;
+} ServerRequest;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t queued;      // A request was queued (or one stopped loading)
+    pthread_cond_t finished;    // A batch has finished
+    ServerRequest *head, *tail;
+    int queueLength;
+    int loading;                // Requests received but not queued yet
+    ThreadPool *pool;
+    int numThreads;
+    TileSizes tiles;
+    SimdKernels simd;
+    int useSimd;
+    long windowMicros;
+    int maxBatch;
+    double smallMacs;
+    int verbose;
+    long served;
+    long batches;
+    pthread_mutex_t bufferLock;
+    CachedBuffer buffers[SERVER_MAX_BUFFERS];
+    int numBuffers;
+} Server;
+
+static Server server;
+static char socketPath[SERVER_PATH_MAX] = SERVER_DEFAULT_SOCKET;
+
+// Function to get the seconds between two time stamps
+double secondsBetween(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Function to remove the socket when the server is stopped by a signal
+void stopOnSignal(int signal) {
+    (void) signal;
+    unlink(socketPath);
+    _exit(EXIT_SUCCESS);
+}
+
+// Function to get a rows x cols view of a cached buffer that is large enough:
+// the smallest free one, else a new one while there are slots left, else an
+// uncached matrix (*slot = -1)
+Matrix acquireBuffer(int rows, int cols, int *slot) {
+    size_t need = (size_t) rows * paddedStride(cols) * sizeof(int);
+    pthread_mutex_lock(&server.bufferLock);
+    int best = -1;
+    for (int b = 0; b < server.numBuffers; b++) {
+        if (!server.buffers[b].inUse && server.buffers[b].matrix.bytes >= need &&
+            (best < 0 || server.buffers[b].matrix.bytes < server.buffers[best].matrix.bytes)) {
+            best = b;
+        }
+    }
+    if (best < 0 && server.numBuffers < SERVER_MAX_BUFFERS) {
+        best = server.numBuffers++;
+        server.buffers[best].matrix = allocateMatrix(rows, cols, 0);
+    }
+    if (best >= 0) {
+        server.buffers[best].inUse = 1;
+    }
+    pthread_mutex_unlock(&server.bufferLock);
+    *slot = best;
+    if (best < 0) {
+        return allocateMatrix(rows, cols, 0);
+    }
+    Matrix view = server.buffers[best].matrix;
+    view.rows = rows;
+    view.cols = cols;
+    view.stride = paddedStride(cols);
+    return view;
+}
+
+// Function to give a buffer back to the cache (or free an uncached one)
+void releaseBuffer(Matrix *matrix, int slot) {
+    if (slot < 0) {
+        freeMatrix(matrix);
+        return;
+    }
+    pthread_mutex_lock(&server.bufferLock);
+    server.buffers[slot].inUse = 0;
+    pthread_mutex_unlock(&server.bufferLock);
+}
+
+// Function to load an operand of a file request: binary files are mapped in
+// place, text and Matrix Market files are read into a cached buffer. Returns
+// 0, or -1 with the reason in error; a buffer already taken is released by
+// finishRequest().
+int loadOperand(const char *fileName, int rows, int cols, Matrix *matrix, int *slot, int *mapped, char *error) {
+    *slot = -1;
+    *mapped = 0;
+    if (!isMatrixMarketFileName(fileName)) {
+        *mapped = tryIsBinaryMatrixFile(fileName, error);
+        if (*mapped < 0) {
+            *mapped = 0;
+            return -1;
+        }
+    }
+    if (*mapped) {
+        return tryMapBinaryMatrix(matrix, rows, cols, MATRIX_TYPE_INT32, fileName, 0, error);
+    }
+    *matrix = acquireBuffer(rows, cols, slot);
+    if (isMatrixMarketFileName(fileName)) {
+        zeroMatrix(matrix);
+        return tryReadMatrixMarket(matrix, fileName, error);
+    }
+    return tryReadMatrixFromFile(matrix, fileName, server.numThreads, error);
+}
+
+// Function to get an unpadded rows x cols int32 matrix at offset bytes of a
+// shared object (the leading dimension is the number of columns)
+Matrix sharedView(void *shared, uint64_t offset, int rows, int cols) {
+    Matrix view;
+    memset(&view, 0, sizeof(view));
+    view.rows = rows;
+    view.cols = cols;
+    view.stride = cols;
+    view.data = (char *) shared + offset;
+    view.type = MATRIX_TYPE_INT32;
+    view.elemSize = sizeof(int);
+    return view;
+}
+
+// Function to fail a request with a message; returns -1
+int rejectRequest(ServerRequest *r, const char *message) {
+    r->reply.status = -1;
+    snprintf(r->reply.error, sizeof(r->reply.error), "%s", message);
+    return -1;
+}
+
+// Function to put the operands of a request in place; returns 0, or -1 with
+// the reply's error set (a malformed file fails its request, not the server)
+int prepareRequest(ServerRequest *r) {
+    MultiplyRequest *q = &r->request;
+    r->slotA = r->slotB = r->slotC = -1;
+    if (q->kind == REQUEST_FILES) {
+        q->fileA[SERVER_PATH_MAX - 1] = q->fileB[SERVER_PATH_MAX - 1] = q->fileResult[SERVER_PATH_MAX - 1] = '\0';
+        if (access(q->fileA, R_OK) != 0 || access(q->fileB, R_OK) != 0) {
+            return rejectRequest(r, "Cannot read an input file");
+        }
+        int rowsA, colsA, rowsB, colsB;
+        char error[MATRIX_IO_ERROR_MAX];
+        if (tryProbeMatrixShape(q->fileA, &rowsA, &colsA, error) < 0 ||
+            tryProbeMatrixShape(q->fileB, &rowsB, &colsB, error) < 0) {
+            return rejectRequest(r, error);
+        }
+        // An empty file or a header without a shape probes as 0 x 0
+        const char *empty = rowsA < 1 || colsA < 1 ? q->fileA : rowsB < 1 || colsB < 1 ? q->fileB : NULL;
+        if (empty != NULL) {
+            loadError(error, "Error reading file %s.", empty);
+            return rejectRequest(r, error);
+        }
+        if ((q->m > 0 && q->m != rowsA) || (q->k > 0 && q->k != colsA) || (q->n > 0 && q->n != colsB) ||
+            colsA != rowsB) {
+            return rejectRequest(r, "The shapes of the input files do not match");
+        }
+        q->m = rowsA;
+        q->k = colsA;
+        q->n = colsB;
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (loadOperand(q->fileA, q->m, q->k, &r->a, &r->slotA, &r->mappedA, error) < 0 ||
+            loadOperand(q->fileB, q->k, q->n, &r->b, &r->slotB, &r->mappedB, error) < 0) {
+            return rejectRequest(r, error);
+        }
+        r->c = acquireBuffer(q->m, q->n, &r->slotC);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        r->reply.loadSeconds = secondsBetween(&start, &end);
+    } else if (q->kind == REQUEST_SHARED) {
+        struct stat st;
+        if (r->sharedFd < 0 || fstat(r->sharedFd, &st) < 0) {
+            return rejectRequest(r, "A shared request needs the descriptor of its object");
+        }
+        if (q->m < 1 || q->n < 1 || q->k < 1) {
+            return rejectRequest(r, "Invalid shape");
+        }
+        size_t size = (size_t) st.st_size;
+        uint64_t offsets[3] = { q->offsetA, q->offsetB, q->offsetC };
+        uint64_t bytes[3] = { (uint64_t) q->m * q->k * sizeof(int), (uint64_t) q->k * q->n * sizeof(int),
+                              (uint64_t) q->m * q->n * sizeof(int) };
+        for (int i = 0; i < 3; i++) {
+            if (offsets[i] % sizeof(int) != 0 || offsets[i] > size || bytes[i] > size - offsets[i]) {
+                return rejectRequest(r, "An operand lies outside the shared object");
+            }
+        }
+        r->shared = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->sharedFd, 0);
+        if (r->shared == MAP_FAILED) {
+            r->shared = NULL;
+            return rejectRequest(r, "Cannot map the shared object");
+        }
+        r->sharedBytes = size;
+        r->a = sharedView(r->shared, q->offsetA, q->m, q->k);
+        r->b = sharedView(r->shared, q->offsetB, q->k, q->n);
+        r->c = sharedView(r->shared, q->offsetC, q->m, q->n);
+    } else {
+        return rejectRequest(r, "Unknown request kind");
+    }
+    r->problem = createGemm(GEMM_ROW_MAJOR, 0, 0, q->m, q->n, q->k, 1, r->a.data, r->a.stride, r->b.data, r->b.stride,
+                            0, r->c.data, r->c.stride, &server.tiles, server.useSimd ? &server.simd : NULL);
+    r->reply.m = q->m;
+    r->reply.n = q->n;
+    r->reply.k = q->k;
+    return 0;
+}
+
+// Function to write the result of a file request and release its operands
+void finishRequest(ServerRequest *r) {
+    if (r->request.kind == REQUEST_FILES) {
+        if (r->reply.status == 0 && r->request.fileResult[0] != '\0') {
+            struct timespec start, end;
+            char error[MATRIX_IO_ERROR_MAX];
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            if (trySaveMatrix(&r->c, r->request.fileResult, server.numThreads, error) < 0) {
+                rejectRequest(r, error);  // The result could not be written, the server goes on
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            r->reply.saveSeconds = secondsBetween(&start, &end);
+        }
+        if (r->a.data != NULL) {
+            r->mappedA ? freeMatrix(&r->a) : releaseBuffer(&r->a, r->slotA);
+        }
+        if (r->b.data != NULL) {
+            r->mappedB ? freeMatrix(&r->b) : releaseBuffer(&r->b, r->slotB);
+        }
+        if (r->c.data != NULL) {
+            releaseBuffer(&r->c, r->slotC);
+        }
+    }
+    if (r->shared != NULL) {
+        munmap(r->shared, r->sharedBytes);
+    }
+    if (r->sharedFd >= 0) {
+        close(r->sharedFd);
+    }
+}
+
+// Pool task: one output tile of a large request
+void runRequestTile(void *arg, int index) {
+    // alpha 1 and untransposed operands: the products go straight into C and
+    // the workspace is never touched
+    int unused = 0;
+    gemmRunTile(&((ServerRequest *) arg)->problem, index, &unused);
+}
+
+// Pool task: every tile of a small request, so it never waits for a second worker
+void runRequestWhole(void *arg, int index) {
+    (void) index;
+    ServerRequest *r = (ServerRequest *) arg;
+    int unused = 0;
+    for (int t = 0; t < gemmTileCount(&r->problem); t++) {
+        gemmRunTile(&r->problem, t, &unused);
+    }
+}
+
+// Function to compute a batch of requests as one pool job: a small request is
+// one task, a large one a task per output tile
+void runBatch(ServerRequest **batch, int count, PoolTask **tasks, int *capacity) {
+    int numTasks = 0;
+    for (int i = 0; i < count; i++) {
+        const MultiplyRequest *q = &batch[i]->request;
+        numTasks += (double) q->m * q->n * q->k <= server.smallMacs ? 1 : gemmTileCount(&batch[i]->problem);
+    }
+    if (numTasks > *capacity) {
+        *capacity = numTasks;
+        *tasks = realloc(*tasks, numTasks * sizeof(PoolTask));
+        if (*tasks == NULL) {
+            printf("Error in memory allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    int t = 0;
+    for (int i = 0; i < count; i++) {
+        const MultiplyRequest *q = &batch[i]->request;
+        if ((double) q->m * q->n * q->k <= server.smallMacs) {
+            (*tasks)[t++] = (PoolTask) { runRequestWhole, batch[i], 0 };
+        } else {
+            for (int tile = 0; tile < gemmTileCount(&batch[i]->problem); tile++) {
+                (*tasks)[t++] = (PoolTask) { runRequestTile, batch[i], tile };
+            }
+        }
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    threadPoolRun(server.pool, *tasks, numTasks);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    for (int i = 0; i < count; i++) {
+        batch[i]->reply.batchSize = count;
+        batch[i]->reply.queueSeconds = secondsBetween(&batch[i]->ready, &start);
+        batch[i]->reply.computeSeconds = secondsBetween(&start, &end);
+    }
+    if (server.verbose) {
+        printf("Batch %ld: %d request(s), %d task(s), %.9f seconds\n", server.batches + 1, count, numTasks,
+               secondsBetween(&start, &end));
+    }
+}
+
+// Function to take batches off the queue and compute them, forever. After the
+// first request of a batch the dispatcher waits up to the window for more,
+// but only while other requests are still being received or loaded.
+void dispatchRequests(void) {
+    ServerRequest *batch[SERVER_MAX_BATCH];
+    PoolTask *tasks = NULL;
+    int capacity = 0;
+    for (;;) {
+        pthread_mutex_lock(&server.lock);
+        while (server.head == NULL) {
+            pthread_cond_wait(&server.queued, &server.lock);
+        }
+        struct timespec deadline = server.head->ready;
+        deadline.tv_nsec += server.windowMicros * 1000;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+        while (server.loading > 0 && server.queueLength < server.maxBatch &&
+               pthread_cond_timedwait(&server.queued, &server.lock, &deadline) != ETIMEDOUT) {
+            // A request joined or stopped loading, check again
+        }
+        int count = 0;
+        while (server.head != NULL && count < server.maxBatch) {
+            batch[count++] = server.head;
+            server.head = server.head->next;
+            server.queueLength--;
+        }
+        if (server.head == NULL) {
+            server.tail = NULL;
+        }
+        pthread_mutex_unlock(&server.lock);
+
+        runBatch(batch, count, &tasks, &capacity);
+
+        pthread_mutex_lock(&server.lock);
+        for (int i = 0; i < count; i++) {
+            batch[i]->done = 1;
+        }
+        server.served += count;
+        server.batches++;
+        pthread_cond_broadcast(&server.finished);
+        pthread_mutex_unlock(&server.lock);
+    }
+}
+
+// Function to serve the requests of one connection, in order, until it is closed
+void *serveConnection(void *arg) {
+    int fd = (int) (intptr_t) arg;
+    for (;;) {
+        ServerRequest *r = calloc(1, sizeof(ServerRequest));
+        if (r == NULL) {
+            printf("Error in memory allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (receiveRequest(fd, &r->request, &r->sharedFd) < 0) {
+            free(r);
+            break;
+        }
+        r->reply.magic = SERVER_MAGIC;
+        if (r->request.magic != SERVER_MAGIC) {
+            rejectRequest(r, "Not a request of this server");
+            sendAll(fd, &r->reply, sizeof(r->reply));
+            finishRequest(r);
+            free(r);
+            break;
+        }
+        if (r->request.kind == REQUEST_SHUTDOWN) {
+            pthread_mutex_lock(&server.lock);
+            printf("Shutting down after %ld request(s) in %ld batch(es)\n", server.served, server.batches);
+            fflush(stdout);
+            unlink(socketPath);
+            sendAll(fd, &r->reply, sizeof(r->reply));
+            exit(EXIT_SUCCESS);
+        }
+
+        pthread_mutex_lock(&server.lock);
+        server.loading++;
+        pthread_mutex_unlock(&server.lock);
+        int prepared = prepareRequest(r);
+        clock_gettime(CLOCK_MONOTONIC, &r->ready);
+        pthread_mutex_lock(&server.lock);
+        server.loading--;
+        if (prepared == 0) {
+            if (server.tail != NULL) {
+                server.tail->next = r;
+            } else {
+                server.head = r;
+            }
+            server.tail = r;
+            server.queueLength++;
+        }
+        pthread_cond_signal(&server.queued);
+        while (prepared == 0 && !r->done) {
+            pthread_cond_wait(&server.finished, &server.lock);
+        }
+        pthread_mutex_unlock(&server.lock);
+
+        finishRequest(r);
+        int sent = sendAll(fd, &r->reply, sizeof(r->reply));
+        free(r);
+        if (sent < 0) {
+            break;
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+// Function to accept connections, one serving thread each
+void *acceptConnections(void *arg) {
+    int listener = (int) (intptr_t) arg;
+    for (;;) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("accept");
+            exit(EXIT_FAILURE);
+        }
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, serveConnection, (void *) (intptr_t) fd) != 0) {
+            perror("pthread_create");
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    int numThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    char simdIsa[16] = "";  // ISA forced with --isa, empty for CPUID detection
+    memset(&server, 0, sizeof(server));
+    server.tiles = defaultTileSizes();
+    server.windowMicros = DEFAULT_WINDOW_US;
+    server.maxBatch = SERVER_MAX_BATCH;
+    server.smallMacs = DEFAULT_SMALL_MACS;
+
+    // Parse arguments
+    for (int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--socket") == 0 && (i+1 < argc)) {
+            snprintf(socketPath, sizeof(socketPath), "%s", argv[++i]);
+        } else if(strcmp(argv[i], "--threads") == 0 && (i+1 < argc)) {
+            numThreads = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--simd") == 0) {
+            server.useSimd = 1;
+        } else if(strcmp(argv[i], "--isa") == 0 && (i+1 < argc)) {
+            server.useSimd = 1;
+            snprintf(simdIsa, sizeof(simdIsa), "%s", argv[++i]);
+        } else if(strcmp(argv[i], "--tiles") == 0 && (i+3 < argc)) {
+            server.tiles.l1 = atoi(argv[++i]);
+            server.tiles.l2 = atoi(argv[++i]);
+            server.tiles.l3 = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--window") == 0 && (i+1 < argc)) {
+            server.windowMicros = atol(argv[++i]);
+        } else if(strcmp(argv[i], "--max-batch") == 0 && (i+1 < argc)) {
+            server.maxBatch = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--small") == 0 && (i+1 < argc)) {
+            server.smallMacs = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--verbose") == 0) {
+            server.verbose = 1;
+        }
+    }
+    checkTileSizes(&server.tiles);
+    if (numThreads < 1 || server.windowMicros < 0 || server.maxBatch < 1 || server.maxBatch > SERVER_MAX_BATCH) {
+        fprintf(stderr, "Invalid --threads, --window or --max-batch (at most %d)\n", SERVER_MAX_BATCH);
+        return EXIT_FAILURE;
+    }
+    server.numThreads = numThreads;
+
+    // Everything a request would otherwise pay for at startup happens once here
+    server.simd = selectSimdKernels(simdIsa);
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_mutex_init(&server.bufferLock, NULL);
+    pthread_condattr_t monotonic;
+    pthread_condattr_init(&monotonic);
+    pthread_condattr_setclock(&monotonic, CLOCK_MONOTONIC);
+    pthread_cond_init(&server.queued, &monotonic);
+    pthread_cond_init(&server.finished, NULL);
+    server.pool = createThreadPool(numThreads);
+
+    struct sockaddr_un address;
+    if (serverAddress(socketPath, &address) < 0) {
+        fprintf(stderr, "Socket path %s is too long\n", socketPath);
+        return EXIT_FAILURE;
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socketPath);
+    if (listener < 0 || bind(listener, (struct sockaddr *) &address, sizeof(address)) < 0 || listen(listener, 128) < 0) {
+        fprintf(stderr, "Cannot listen on %s: %s\n", socketPath, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    signal(SIGINT, stopOnSignal);
+    signal(SIGTERM, stopOnSignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("Serving on %s with %d thread(s)%s%s\n", socketPath, numThreads,
+           server.useSimd ? ", SIMD " : "", server.useSimd ? server.simd.isa : "");
+    printf("Batching window %ld us, at most %d request(s) per batch, whole-product tasks up to %.0f multiply-adds\n",
+           server.windowMicros, server.maxBatch, server.smallMacs);
+    fflush(stdout);
+
+    pthread_t acceptor;
+    if (pthread_create(&acceptor, NULL, acceptConnections, (void *) (intptr_t) listener) != 0) {
+        perror("pthread_create");
+        return EXIT_FAILURE;
+    }
+    dispatchRequests();
+    return 0;
+}
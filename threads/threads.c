@@ -1,60 +1,51 @@
+#define _GNU_SOURCE  // CPU affinity (sched_setaffinity, cpu_set_t)
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
 #include <pthread.h>
 #include <unistd.h>
+#include "../common/matrix.h"
+#include "../common/matrix_io.h"
+#include "../common/blocked.h"
+#include "../common/simd.h"
+#include "../common/thread_pool.h"
+#include "../common/stream.h"
+#include "../common/strassen.h"
+#include "../common/typed.h"
+#include "../common/batch.h"
+#include "../common/affinity.h"
+#include "../common/perf.h"
+#include "../common/sparse.h"
+#include "../common/gemm.h"
+#include "../common/transpose.h"
+#include "../common/verify.h"
+#include "../common/chain.h"
+#include "../common/pipeline.h"
+#include "../common/narrow.h"
+#include "../common/fixed.h"
 
-// Function to fill a matrix with random integer numbers
-void fillMatrix(int n, int **matrix) {
-    for (int i = 0; i < n; i++){
-        for (int j = 0; j < n; j++){
-            matrix[i][j] = rand() % 10;  // Random numbers between 0 and 9
-        }
-    }
-}
-
-void readMatrixFromFile(int n, int **matrix, const char* fileName) {
-    FILE *file = fopen(fileName, "r");
-    if (!file) {
-        fprintf(stderr, "Cannot open file %s\n", fileName);
-        exit(1);
-    }
-    for (int i = 0; i < n; i++){
-        for (int j = 0; j < n; j++){
-            if (fscanf(file, "%d", &matrix[i][j]) != 1) {
-                fprintf(stderr, "Error leyendo archivo.\n");
-                exit(1);
-            }
-        }
-    }
-    fclose(file);
-}
-
-void writeMatrixToFile(int n, int **matrix, const char* fileName) {
-    FILE *file = fopen(fileName, "w");
-    if (!file) {
-        fprintf(stderr, "Cannot open file %s for writing\n", fileName);
-        exit(1);
-    }
-    for (int i = 0; i < n; i++){
-        for (int j = 0; j < n; j++){
-            fprintf(file, "%d ", matrix[i][j]);
-        }
-        fprintf(file, "\n");
-    }
-    fclose(file);
-}
+// Default edge of the output tiles handed to the pool
+#define DEFAULT_TASK_TILE 128
 
-// Thread data structure
+// Thread data structure: the block of the result one kernel call computes
 typedef struct {
-    int threadID;
+    int tileID;
     int startRow;
     int endRow;
+    int startCol;
+    int endCol;
     int n;
-    int **matrix1;
-    int **matrix2;
-    int **resultMatrix;
+    const Matrix *matrix1;
+    const Matrix *matrix2;
+    Matrix *resultMatrix;
+    const TileSizes *tiles;
+    const SimdKernels *simd;
+    TileKernel tileKernel;
+    const TypedKernels *typed;  // Kernels of the element type when it is not int32
+    int typedMethod;            // TYPED_STANDARD, TYPED_TRANSPOSE or TYPED_BLOCKED
+    int useSimd;
+    const NarrowPlan *narrow;   // --narrow: int8/int16 inputs and packed B
 } ThreadData;
 
 // Function to multiply matrices
@@ -63,41 +54,293 @@ void* multiplyChunkStandard(void* arg) {
     int start = data->startRow;
     int end   = data->endRow;
     int n     = data->n;
+    int lda = data->matrix1->stride, ldb = data->matrix2->stride, ldc = data->resultMatrix->stride;
+    const int *restrict a = data->matrix1->data;
+    const int *restrict b = data->matrix2->data;
+    int *restrict c = data->resultMatrix->data;
 
     for (int i = start; i < end; i++){
-        for (int j = 0; j < n; j++){
+        for (int j = data->startCol; j < data->endCol; j++){
             // The result matrix is already initialized to 0 outside
             for (int k = 0; k < n; k++){
-                data->resultMatrix[i][j] += data->matrix1[i][k] * data->matrix2[k][j];
+                c[(size_t) i*ldc + j] += a[(size_t) i*lda + k] * b[(size_t) k*ldb + j];
             }
         }
     }
     return NULL;
 }
 
-// Function to multiply matrices simulating a transpose operation on the second matrix for cache optimization
+// Function to multiply matrices reading the second one as its packed transpose (matrix2 holds Bᵀ)
 void* multiplyChunkTranspose(void* arg) {
     ThreadData* data = (ThreadData*) arg;
     int start = data->startRow;
     int end   = data->endRow;
     int n     = data->n;
+    int lda = data->matrix1->stride, ldb = data->matrix2->stride, ldc = data->resultMatrix->stride;
+    const int *restrict a = data->matrix1->data;
+    const int *restrict b = data->matrix2->data;
+    int *restrict c = data->resultMatrix->data;
 
     for (int i = start; i < end; i++){
-        for (int j = 0; j < n; j++){
+        for (int j = data->startCol; j < data->endCol; j++){
             for (int k = 0; k < n; k++){
-                data->resultMatrix[i][j] += data->matrix1[i][k] * data->matrix2[j][k];
+                c[(size_t) i*ldc + j] += a[(size_t) i*lda + k] * b[(size_t) j*ldb + k];
             }
         }
     }
     return NULL;
 }
 
+// Function to multiply matrices with L1/L2/L3 cache blocking over the tile
+void* multiplyChunkBlocked(void* arg) {
+    ThreadData* data = (ThreadData*) arg;
+    multiplyBlockedRange(data->matrix1, data->matrix2, data->resultMatrix,
+                         data->startRow, data->endRow, data->startCol, data->endCol,
+                         data->tiles, data->tileKernel);
+    return NULL;
+}
+
+// Function to multiply the tile with the SIMD micro-kernel selected at startup
+void* multiplyChunkSimd(void* arg) {
+    ThreadData* data = (ThreadData*) arg;
+    const Matrix *m1 = data->matrix1, *m2 = data->matrix2;
+    Matrix *r = data->resultMatrix;
+    data->simd->panel(m1->data, m1->stride, m2->data, m2->stride, r->data, r->stride,
+                      data->startRow, data->endRow, data->startCol, data->endCol, 0, data->n);
+    return NULL;
+}
+
+// Function to multiply the tile with the transposed-access SIMD micro-kernel
+void* multiplyChunkTransposeSimd(void* arg) {
+    ThreadData* data = (ThreadData*) arg;
+    const Matrix *m1 = data->matrix1, *m2 = data->matrix2;
+    Matrix *r = data->resultMatrix;
+    data->simd->transposed(m1->data, m1->stride, m2->data, m2->stride, r->data, r->stride,
+                           data->startRow, data->endRow, data->startCol, data->endCol, 0, data->n);
+    return NULL;
+}
+
+// Function to multiply the tile with the kernels of a non-int32 element type
+void* multiplyChunkTyped(void* arg) {
+    ThreadData* data = (ThreadData*) arg;
+    multiplyTypedRange(data->typed, data->typedMethod, data->useSimd,
+                       data->matrix1, data->matrix2, data->resultMatrix,
+                       data->startRow, data->endRow, data->startCol, data->endCol, data->tiles);
+    return NULL;
+}
+
+// Function to multiply the tile with the narrow (int8/int16) kernels once B is packed
+void* multiplyChunkNarrow(void* arg) {
+    ThreadData* data = (ThreadData*) arg;
+    multiplyNarrowRange(data->narrow, data->resultMatrix, data->startRow, data->endRow,
+                        data->startCol, data->endCol);
+    return NULL;
+}
+
+// Function to zero the tile before timing, so its pages are first touched
+// (and allocated on the NUMA node of) the worker that will compute it
+void* touchChunk(void* arg) {
+    ThreadData* data = (ThreadData*) arg;
+    Matrix *r = data->resultMatrix;
+    size_t bytes = (size_t) (data->endCol - data->startCol) * r->elemSize;
+    for (int i = data->startRow; i < data->endRow; i++){
+        memset((char *) matrixRowAt(r, i) + (size_t) data->startCol * r->elemSize, 0, bytes);
+    }
+    return NULL;
+}
+
+// One multiplication split into 2D output tiles for the pool
+typedef struct {
+    ThreadData base;          // Matrices and kernel settings shared by every tile
+    void* (*kernelFunc)(void*);
+    int rows;                 // Size of the result block being tiled
+    int cols;
+    int tileEdge;
+    int tilesPerRow;
+    const Matrix *replicas;   // Per-node copies of matrix2 (--numa replicate), or NULL
+    const int *workerNodes;   // NUMA node of each pool worker
+} TileJob;
+
+// Pool task: compute output tile number index of the job
+void runTileTask(void *arg, int index) {
+    TileJob *job = (TileJob *) arg;
+    ThreadData data = job->base;
+    data.tileID   = index;
+    data.startRow = (index / job->tilesPerRow) * job->tileEdge;
+    data.startCol = (index % job->tilesPerRow) * job->tileEdge;
+    data.endRow   = minInt(data.startRow + job->tileEdge, job->rows);
+    data.endCol   = minInt(data.startCol + job->tileEdge, job->cols);
+    if (job->replicas != NULL && currentPoolWorker != NULL) {
+        data.matrix2 = &job->replicas[job->workerNodes[currentPoolWorker->id]];
+    }
+    job->kernelFunc(&data);
+}
+
+// Pool and job reused for every pair of streamed blocks
+typedef struct {
+    ThreadPool *pool;
+    TileJob *job;
+    PoolTask *tasks;
+} StreamContext;
+
+// Function to multiply one pair of streamed blocks with the blocked kernel on the pool
+void multiplyStreamBlock(void *context, const Matrix *a, const Matrix *b, Matrix *c) {
+    StreamContext *ctx = (StreamContext *) context;
+    TileJob *job = ctx->job;
+    job->base.n            = a->cols;
+    job->base.matrix1      = a;
+    job->base.matrix2      = b;
+    job->base.resultMatrix = c;
+    job->rows              = c->rows;
+    job->cols              = c->cols;
+    job->tilesPerRow       = (c->cols + job->tileEdge - 1) / job->tileEdge;
+    int numTiles = job->tilesPerRow * ((c->rows + job->tileEdge - 1) / job->tileEdge);
+    threadPoolRun(ctx->pool, ctx->tasks, numTiles);
+}
+
+// Pool task: one independent Strassen-Winograd product
+void runStrassenTask(void *arg, int index) {
+    strassenRunTask(&((StrassenTask *) arg)[index]);
+}
+
+// Function to run the leaf products of the parallel Strassen levels on the pool
+void runStrassenTasks(void *context, StrassenTask *tasks, int count) {
+    poolRunnerRun((PoolRunner *) context, tasks, count);
+}
+
+// Pool task: one row block of a sparse product, on the worker that took it
+void runSparseTask(void *arg, int index) {
+    sparseRunTask((SparsePlan *) arg, index, currentPoolWorker->id);
+}
+
+// Function to run the row blocks of a sparse product on the pool
+void runSparseTasks(void *context, SparsePlan *plan, int count) {
+    poolRunnerRun((PoolRunner *) context, plan, count);
+}
+
+// Pool task: one row block of a verification pass
+void runVerifyTask(void *arg, int index) {
+    verifyRunTask((VerifyPlan *) arg, index);
+}
+
+// Function to run the row blocks of a verification pass on the pool
+void runVerifyTasks(void *context, VerifyPlan *plan, int count) {
+    poolRunnerRun((PoolRunner *) context, plan, count);
+}
+
+// Pool task: one output tile of one product of the current chain wave
+void runChainTask(void *arg, int index) {
+    chainRunTask((ChainPlan *) arg, index);
+}
+
+// Function to run the output tiles of every product of a chain wave on the pool
+void runChainTasks(void *context, ChainPlan *plan, int count) {
+    poolRunnerRun((PoolRunner *) context, plan, count);
+}
+
+// Pool task: one column tile of the current panel and block of B
+void runPipelineTask(void *arg, int index) {
+    pipelineRunTask((PipelinePlan *) arg, index);
+}
+
+// Function to run the column tiles of one pipeline step on the pool
+void runPipelineTasks(void *context, PipelinePlan *plan, int count) {
+    poolRunnerRun((PoolRunner *) context, plan, count);
+}
+
+// Pack stage of --transpose: bands of rows of Bᵀ, written to every target
+typedef struct {
+    const Matrix *source;
+    Matrix *targets;        // Bᵀ, or its per-node copies with --numa replicate
+    int numTargets;
+} TransposeJob;
+
+// Pool task: one band of rows of Bᵀ
+void runTransposeTask(void *arg, int index) {
+    TransposeJob *job = (TransposeJob *) arg;
+    for (int t = 0; t < job->numTargets; t++) {
+        transposeBand(job->source, &job->targets[t], index);
+    }
+}
+
+// Pool task: one band of group rows of the packed B of --narrow
+void runNarrowPackTask(void *arg, int index) {
+    narrowPackBand((NarrowPlan *) arg, index);
+}
+
+// Row strips of a product computed by a size-specialized kernel
+typedef struct {
+    const FixedPlan *plan;
+    const Matrix *matrix1;
+    const Matrix *matrix2;
+    Matrix *resultMatrix;
+    int rowsPerTask;
+} FixedJob;
+
+// Pool task: one strip of whole rows with the kernel of common/fixed.h
+void runFixedTask(void *arg, int index) {
+    FixedJob *job = (FixedJob *) arg;
+    int startRow = index * job->rowsPerTask;
+    multiplyFixedRows(job->plan, job->matrix1, job->matrix2, job->resultMatrix,
+                      startRow, minInt(startRow + job->rowsPerTask, job->plan->n));
+}
+
+// Output tiles of a GEMM, with one workspace per worker
+typedef struct {
+    const GemmProblem *problem;
+    int *workspaces;
+    size_t workspaceSize;   // ints per worker
+} GemmJob;
+
+// Pool task: one output tile of the GEMM
+void runGemmTask(void *arg, int index) {
+    GemmJob *job = (GemmJob *) arg;
+    gemmRunTile(job->problem, index, job->workspaces + currentPoolWorker->id * job->workspaceSize);
+}
+
+// Whole products of a batch, one pool task each
+typedef struct {
+    Batch *batch;
+    const BatchKernel *kernel;
+} BatchJob;
+
+// Pool task: one product of the batch, taken in order of decreasing size
+void runBatchTask(void *arg, int index) {
+    BatchJob *job = (BatchJob *) arg;
+    multiplyBatchProduct(job->kernel, &job->batch->products[job->batch->order[index]]);
+}
+
 int main(int argc, char *argv[]) {
     int n = 2000;
     int useFiles = 0;
     int useTranspose = 0; // Flag for transpose method
     int useDoubleThreads = 0;   // Flag for doubling #threads
-    char fileA[100], fileB[100];
+    int requestedThreads = 0;   // Thread count forced with --threads, 0 for #processors
+    int taskTile = DEFAULT_TASK_TILE;  // Edge of the output tiles scheduled on the pool
+    int useBlocked = 0;   // Flag for cache-blocked method
+    int useHugePages = 0; // Flag for huge page backed matrices
+    int useSimd = 0;      // Flag for SIMD micro-kernels
+    int streamBudgetMB = 0;  // Memory budget of --stream, 0 to load everything
+    int useStrassen = 0;  // Flag for Strassen-Winograd recursion
+    int strassenCutoff = STRASSEN_DEFAULT_CUTOFF;
+    int dtype = MATRIX_TYPE_INT32;  // Element type chosen with --dtype
+    int useBatch = 0;     // Flag for batch mode (many small products from one file)
+    int usePerf = 0;      // Flag for hardware counter reporting
+    int verifyMode = VERIFY_OFF;  // O(n²) check of the result chosen with --verify
+    int verifyRounds = VERIFY_DEFAULT_ROUNDS;
+    int useResultFile = 0;  // --result given (with --verify the result is only written then)
+    int affinityPolicy = AFFINITY_NONE;  // Worker pinning chosen with --affinity
+    int useSmt = 0;       // Flag for one worker per hardware thread instead of per core
+    int numaMode = NUMA_FIRST_TOUCH;     // Placement of the inputs chosen with --numa
+    int sparseMode = SPARSE_OFF;         // CSR kernels chosen with --sparse
+    double sparseThreshold = SPARSE_DEFAULT_THRESHOLD;
+    char simdIsa[16] = "";  // ISA forced with --isa, empty for CPUID detection
+    const char *chainList = NULL;  // Comma-separated matrix files of --chain
+    int usePipeline = 0;  // Flag for overlapping loading, multiplication and writing
+    int narrowMode = NARROW_OFF;  // int8/int16 storage of the inputs chosen with --narrow
+    int useFixed = 1;     // Flag for the size-specialized kernels of registered sizes
+    TileSizes tiles = defaultTileSizes();
+    char fileA[100], fileB[100], fileBatch[100], affinityList[256] = "";
     char fileResult[100];
     strcpy(fileResult, "result.out"); // Default result file if not provided
 
@@ -105,133 +348,713 @@ int main(int argc, char *argv[]) {
     if (argc > 1) {
         n = atoi(argv[1]);
     }
+    GemmArgs gemmArgs = defaultGemmArgs(n);  // Rectangular C = alpha * op(A) * op(B) + beta * C
     for(int i = 1; i < argc; i++){
-        if(strcmp(argv[i], "--files") == 0 && (i+2 < argc)) {
+        if(parseGemmOption(argc, argv, &i, &gemmArgs)) {
+            continue;
+        } else if(strcmp(argv[i], "--files") == 0 && (i+2 < argc)) {
             useFiles = 1;
             strcpy(fileA, argv[++i]);
             strcpy(fileB, argv[++i]);
         } else if(strcmp(argv[i], "--result") == 0 && (i+1 < argc)) {
             strcpy(fileResult, argv[++i]);
+            useResultFile = 1;
         } else if(strcmp(argv[i], "--transpose") == 0) {
             useTranspose = 1;
         } else if(strcmp(argv[i], "--doublethreads") == 0) {
             useDoubleThreads = 1;
+        } else if(strcmp(argv[i], "--threads") == 0 && (i+1 < argc)) {
+            requestedThreads = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--tasktile") == 0 && (i+1 < argc)) {
+            taskTile = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--hugepages") == 0) {
+            useHugePages = 1;
+        } else if(strcmp(argv[i], "--blocked") == 0) {
+            useBlocked = 1;
+        } else if(strcmp(argv[i], "--simd") == 0) {
+            useSimd = 1;
+        } else if(strcmp(argv[i], "--isa") == 0 && (i+1 < argc)) {
+            useSimd = 1;
+            snprintf(simdIsa, sizeof(simdIsa), "%s", argv[++i]);
+        } else if(strcmp(argv[i], "--tiles") == 0 && (i+3 < argc)) {
+            tiles.l1 = atoi(argv[++i]);
+            tiles.l2 = atoi(argv[++i]);
+            tiles.l3 = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--stream") == 0 && (i+1 < argc)) {
+            streamBudgetMB = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--strassen") == 0) {
+            useStrassen = 1;
+        } else if(strcmp(argv[i], "--cutoff") == 0 && (i+1 < argc)) {
+            strassenCutoff = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--dtype") == 0 && (i+1 < argc)) {
+            dtype = parseMatrixType(argv[++i]);
+        } else if(strcmp(argv[i], "--batch") == 0 && (i+1 < argc)) {
+            useBatch = 1;
+            snprintf(fileBatch, sizeof(fileBatch), "%s", argv[++i]);
+        } else if(strcmp(argv[i], "--affinity") == 0 && (i+1 < argc)) {
+            affinityPolicy = parseAffinity(argv[++i]);
+            snprintf(affinityList, sizeof(affinityList), "%s", argv[i]);
+        } else if(strcmp(argv[i], "--smt") == 0) {
+            useSmt = 1;
+        } else if(strcmp(argv[i], "--numa") == 0 && (i+1 < argc)) {
+            numaMode = parseNumaMode(argv[++i]);
+        } else if(strcmp(argv[i], "--perf") == 0) {
+            usePerf = 1;
+        } else if(strcmp(argv[i], "--verify") == 0 && (i+1 < argc)) {
+            verifyMode = parseVerifyMode(argv[++i]);
+        } else if(strcmp(argv[i], "--verify-rounds") == 0 && (i+1 < argc)) {
+            verifyRounds = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--sparse") == 0 && (i+1 < argc)) {
+            sparseMode = parseSparseMode(argv[++i]);
+        } else if(strcmp(argv[i], "--sparse-threshold") == 0 && (i+1 < argc)) {
+            sparseThreshold = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--chain") == 0 && (i+1 < argc)) {
+            chainList = argv[++i];
+        } else if(strcmp(argv[i], "--pipeline") == 0) {
+            usePipeline = 1;
+        } else if(strcmp(argv[i], "--narrow") == 0 && (i+1 < argc)) {
+            narrowMode = parseNarrowMode(argv[++i]);
+        } else if(strcmp(argv[i], "--no-fixed") == 0) {
+            useFixed = 0;
         }
     }
+    checkTileSizes(&tiles);
+    if (verifyMode != VERIFY_OFF && (useBatch || streamBudgetMB > 0 || gemmArgs.enabled)) {
+        fprintf(stderr, "--verify cannot be combined with --batch, --stream or the GEMM options\n");
+        return EXIT_FAILURE;
+    }
+    if (taskTile <= 0) {
+        fprintf(stderr, "Invalid task tile size %d\n", taskTile);
+        return 1;
+    }
+
+    // Pick the SIMD micro-kernels for this CPU once, outside the timed section
+    SimdKernels simd = selectSimdKernels(simdIsa);
+    TileKernel tileKernel = useSimd ? simd.panel : NULL;
+    TypedKernels typed;
+    if (dtype != MATRIX_TYPE_INT32) {
+        if (useStrassen || streamBudgetMB > 0 || sparseMode != SPARSE_OFF) {
+            fprintf(stderr, "--strassen, --stream and --sparse only support --dtype int32\n");
+            return EXIT_FAILURE;
+        }
+        typed = selectTypedKernels(dtype, simdIsa);
+    }
+    if (sparseMode != SPARSE_OFF && (useStrassen || streamBudgetMB > 0 || useBatch)) {
+        fprintf(stderr, "--sparse cannot be combined with --strassen, --stream or --batch\n");
+        return EXIT_FAILURE;
+    }
+    if (narrowMode != NARROW_OFF && (dtype != MATRIX_TYPE_INT32 || useTranspose || useStrassen || streamBudgetMB > 0 ||
+                                     useBatch || gemmArgs.enabled || chainList != NULL || usePipeline ||
+                                     sparseMode != SPARSE_OFF || numaMode == NUMA_REPLICATE)) {
+        fprintf(stderr, "--narrow cannot be combined with --dtype, --transpose, --strassen, --stream, --batch, "
+                "--chain, --pipeline, --sparse, --numa replicate or the GEMM options\n");
+        return EXIT_FAILURE;
+    }
+    char simdNote[32] = "";
+    if (useSimd) {
+        snprintf(simdNote, sizeof(simdNote), " (SIMD %s)", dtype != MATRIX_TYPE_INT32 ? typed.isa : simd.isa);
+    }
 
     // Determine number of threads based on #processors
     int numCPUs = (int) sysconf(_SC_NPROCESSORS_ONLN);
     int numThreads = useDoubleThreads ? (2 * numCPUs) : numCPUs;
 
+    // With an affinity policy the pool follows the sysfs topology: one worker
+    // per physical core, or per hardware thread with --smt / --doublethreads
+    CpuTopology topo = readCpuTopology();
+    Placement placement = buildPlacement(&topo, affinityPolicy, affinityList);
+    if (affinityPolicy == AFFINITY_LIST) {
+        numThreads = placement.count;
+    } else if (affinityPolicy != AFFINITY_NONE) {
+        numThreads = defaultWorkerCount(&topo, useSmt || useDoubleThreads);
+    }
+    if (requestedThreads > 0) {
+        numThreads = requestedThreads;
+    }
+    if (numaMode == NUMA_REPLICATE && affinityPolicy == AFFINITY_NONE) {
+        fprintf(stderr, "--numa replicate needs --affinity to know the node of every worker\n");
+        return EXIT_FAILURE;
+    }
+    int *workerCpus = NULL;
+    int *workerNodes = malloc(numThreads * sizeof(int));
+    if (affinityPolicy != AFFINITY_NONE) {
+        workerCpus = malloc(numThreads * sizeof(int));
+        for (int w = 0; w < numThreads; w++) {
+            workerCpus[w] = placementCpu(&placement, w);
+        }
+    }
+    for (int w = 0; w < numThreads; w++) {
+        workerNodes[w] = placementNode(&placement, w);
+    }
+
+    // Batch mode: one pool task per product, so a small product never pays
+    // for splitting it over every thread
+    if (useBatch) {
+        if (useStrassen || streamBudgetMB > 0) {
+            fprintf(stderr, "--batch cannot be combined with --strassen or --stream\n");
+            return EXIT_FAILURE;
+        }
+        Batch batch;
+        readBatchFile(&batch, fileBatch, dtype, useHugePages ? MATRIX_HUGEPAGES : 0, numThreads);
+        printBatchSummary(&batch);
+        if (numThreads > batch.count) {
+            numThreads = batch.count;
+        }
+        printf("Using %d thread(s)\n", numThreads);
+        BatchKernel kernel = { useBlocked ? TYPED_BLOCKED : (useTranspose ? TYPED_TRANSPOSE : TYPED_STANDARD),
+                               useSimd, &simd, &typed, &tiles };
+        BatchJob job = { &batch, &kernel };
+        ThreadPool *pool = createPinnedThreadPool(numThreads, workerCpus);
+        PoolTask *tasks = malloc(batch.count * sizeof(PoolTask));
+        if (tasks == NULL) {
+            printf("Error in memory allocation.\n");
+            return 1;
+        }
+        for (int t = 0; t < batch.count; t++) {
+            tasks[t].run   = runBatchTask;
+            tasks[t].arg   = &job;
+            tasks[t].index = t;
+        }
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        threadPoolRun(pool, tasks, batch.count);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("Using %s multiplication method (%s)%s\n", typedMethodName(kernel.method), matrixTypeName(dtype), simdNote);
+        double computeTime = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("Multiplication computation time: %.9f seconds\n", computeTime);
+        printBatchThroughput(&batch, computeTime);
+        writeBatchFile(&batch, fileResult, numThreads);
+        destroyThreadPool(pool);
+        free(tasks);
+        freeBatch(&batch);
+        return 0;
+    }
+
+    // Chain mode: A1·A2·...·Ak in the cheapest order; the output tiles of all
+    // the independent products of a wave are one pool job
+    if (chainList != NULL) {
+        if (dtype != MATRIX_TYPE_INT32 || useStrassen || streamBudgetMB > 0 || gemmArgs.enabled ||
+            verifyMode != VERIFY_OFF || sparseMode != SPARSE_OFF) {
+            fprintf(stderr, "--chain cannot be combined with --dtype, --strassen, --stream, --sparse, --verify or the GEMM options\n");
+            return EXIT_FAILURE;
+        }
+        PoolRunner chainRunner = { NULL, NULL, runChainTask };
+        ChainPlan *chain = createChainPlan(chainList, 0, numThreads, &tiles, useSimd ? &simd : NULL,
+                                           runChainTasks, &chainRunner);
+        chainRunner.tasks = malloc((chain->maxTasks > 0 ? chain->maxTasks : 1) * sizeof(PoolTask));
+        if (chainRunner.tasks == NULL) {
+            printf("Error in memory allocation.\n");
+            return 1;
+        }
+        printf("Matrix size: %d x %d\n", chain->result.rows, chain->result.cols);
+        printf("Using %d thread(s)\n", numThreads);
+        chainRunner.pool = createPinnedThreadPool(numThreads, workerCpus);
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        chainMultiply(chain);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printChainPlan(chain, simdNote);
+        double computeTime = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("Multiplication computation time: %.9f seconds\n", computeTime);
+        saveMatrix(&chain->result, fileResult, numThreads);
+        destroyThreadPool(chainRunner.pool);
+        free(chainRunner.tasks);
+        freeChainPlan(chain);
+        return 0;
+    }
+
+    // Pipelined mode: B is loaded and C written while the panels of C are
+    // computed; the column tiles of each step are one pool job
+    if (usePipeline) {
+        if (!useFiles || dtype != MATRIX_TYPE_INT32 || useStrassen || streamBudgetMB > 0 || gemmArgs.enabled ||
+            useTranspose || sparseMode != SPARSE_OFF) {
+            fprintf(stderr, "--pipeline needs --files and cannot be combined with --dtype, --strassen, --stream, "
+                    "--sparse, --transpose or the GEMM options\n");
+            return EXIT_FAILURE;
+        }
+        PoolRunner pipelineRunner = { NULL, NULL, runPipelineTask };
+        PipelinePlan *pipeline = createPipeline(fileA, fileB,
+                                                verifyMode == VERIFY_OFF || useResultFile ? fileResult : NULL, n,
+                                                numThreads, &tiles, tileKernel, runPipelineTasks, &pipelineRunner);
+        pipelineRunner.tasks = malloc((pipeline->numTasks > 0 ? pipeline->numTasks : 1) * sizeof(PoolTask));
+        if (pipelineRunner.tasks == NULL) {
+            printf("Error in memory allocation.\n");
+            return 1;
+        }
+        printf("Matrix size: %d x %d\n", n, n);
+        printf("Using %d thread(s)\n", numThreads);
+        ThreadPool *pool = createPinnedThreadPool(numThreads, workerCpus);
+        pipelineRunner.pool = pool;
+        PipelineStats stats;
+        pipelineMultiply(pipeline, &stats);
+        printf("Using pipelined blocked multiplication method (tiles %d/%d/%d)%s\n", tiles.l1, tiles.l2, tiles.l3,
+               simdNote);
+        printPipelineStats(pipeline, &stats);
+        printf("Multiplication computation time: %.9f seconds\n", stats.computeTime);
+        printf("End-to-end time: %.9f seconds\n", stats.totalTime);
+        int verified = 1;
+        PoolRunner verifyRunner = { pool, NULL, runVerifyTask };
+        if (verifyMode != VERIFY_OFF) {
+            VerifyPlan verifyPlan = createVerifyPlan(verifyMode, verifyRounds, &pipeline->a, &pipeline->b,
+                                                     &pipeline->c, numThreads, runVerifyTasks, &verifyRunner);
+            verifyRunner.tasks = malloc(verifyPlan.numTasks * sizeof(PoolTask));
+            if (verifyRunner.tasks == NULL) {
+                printf("Error in memory allocation.\n");
+                return 1;
+            }
+            VerifyResult verifyResult = verifyProduct(&verifyPlan);
+            verified = printVerifyResult(&verifyPlan, &verifyResult);
+            freeVerifyPlan(&verifyPlan);
+            free(verifyRunner.tasks);
+        }
+        destroyThreadPool(pool);
+        free(pipelineRunner.tasks);
+        freePipeline(pipeline);
+        return verified ? 0 : EXIT_FAILURE;
+    }
+
+    // GEMM mode: C = alpha * op(A) * op(B) + beta * C on M x K and K x N
+    // operands, updated in place; one pool task per output tile
+    if (gemmArgs.enabled) {
+        if (dtype != MATRIX_TYPE_INT32 || useStrassen || streamBudgetMB > 0 || useTranspose || sparseMode != SPARSE_OFF) {
+            fprintf(stderr, "The GEMM options cannot be combined with --dtype, --strassen, --stream, --sparse or --transpose (use --transb)\n");
+            return EXIT_FAILURE;
+        }
+        srand(time(NULL));
+        Matrix a, b, c;
+        loadGemmOperands(&gemmArgs, fileA, fileB, useFiles, numThreads, &a, &b, &c);
+        GemmProblem problem = createGemmFromArgs(&gemmArgs, &a, &b, &c, &tiles, useSimd ? &simd : NULL);
+        int numTiles = gemmTileCount(&problem);
+        GemmJob job = { &problem, NULL, gemmWorkspaceSize(&problem) };
+        job.workspaces = malloc(numThreads * job.workspaceSize * sizeof(int));
+        PoolTask *tasks = malloc((numTiles > 0 ? numTiles : 1) * sizeof(PoolTask));
+        if (job.workspaces == NULL || tasks == NULL) {
+            printf("Error in memory allocation.\n");
+            return 1;
+        }
+        for (int t = 0; t < numTiles; t++) {
+            tasks[t].run   = runGemmTask;
+            tasks[t].arg   = &job;
+            tasks[t].index = t;
+        }
+        printf("Matrix size: %d x %d x %d\n", gemmArgs.m, gemmArgs.n, gemmArgs.k);
+        printf("Using %d thread(s)\n", numThreads);
+        ThreadPool *pool = createPinnedThreadPool(numThreads, workerCpus);
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        threadPoolRun(pool, tasks, numTiles);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printGemm(&gemmArgs, simdNote);
+        double computeTime = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("Multiplication computation time: %.9f seconds\n", computeTime);
+        saveMatrix(&c, fileResult, numThreads);
+        destroyThreadPool(pool);
+        free(tasks);
+        free(job.workspaces);
+        freeMatrix(&a);
+        freeMatrix(&b);
+        freeMatrix(&c);
+        return 0;
+    }
+
     printf("Matrix size: %d x %d\n", n, n);
     printf("Using %d thread(s)\n", numThreads);
-
-    // Initialization of seed for random numbers
-    srand(time(NULL));
-    
-    // Dynamic memory allocation for matrices
-    int **matrix1 = malloc(n * sizeof(int*));
-    int **matrix2 = malloc(n * sizeof(int*));
-    int **resultMatrix = malloc(n * sizeof(int*));
-    if(matrix1 == NULL || matrix2 == NULL || resultMatrix == NULL){
-        printf("Error in memory allocation.\n");
-        return 1;
+    printf("Work-stealing pool with %d x %d output tiles\n", taskTile, taskTile);
+    if (affinityPolicy != AFFINITY_NONE) {
+        printPlacement(&placement, &topo, numThreads);
     }
-    for (int i = 0; i < n; i++){
-        matrix1[i] = malloc(n * sizeof(int));
-        matrix2[i] = malloc(n * sizeof(int));
-        resultMatrix[i] = malloc(n * sizeof(int));
-        if(matrix1[i] == NULL || matrix2[i] == NULL || resultMatrix[i] == NULL){
+
+    // Out-of-core mode: inputs stay on disk and C is written block row by block row
+    if (streamBudgetMB > 0) {
+        if (!useFiles) {
+            fprintf(stderr, "--stream needs --files with binary matrices\n");
+            return EXIT_FAILURE;
+        }
+        ThreadPool *pool = createPinnedThreadPool(numThreads, workerCpus);
+        // A streamed block is never larger than n x n, so n x n tiles' worth of tasks is enough
+        int maxTilesPerRow = (n + taskTile - 1) / taskTile;
+        int maxTiles = maxTilesPerRow * maxTilesPerRow;
+        PoolTask *tasks = malloc((maxTiles > 0 ? maxTiles : 1) * sizeof(PoolTask));
+        if (tasks == NULL) {
             printf("Error in memory allocation.\n");
             return 1;
         }
+        TileJob job;
+        memset(&job, 0, sizeof(job));
+        job.base.tiles      = &tiles;
+        job.base.simd       = &simd;
+        job.base.tileKernel = tileKernel;
+        job.kernelFunc      = multiplyChunkBlocked;
+        job.tileEdge        = taskTile;
+        for (int t = 0; t < maxTiles; t++) {
+            tasks[t].run   = runTileTask;
+            tasks[t].arg   = &job;
+            tasks[t].index = t;
+        }
+        StreamContext ctx = { pool, &job, tasks };
+        StreamStats stats;
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        streamMultiply(fileA, fileB, fileResult, n, (size_t) streamBudgetMB << 20,
+                       multiplyStreamBlock, &ctx, numThreads, &stats);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf("Using streamed blocked multiplication method (%d MB budget)%s\n", streamBudgetMB, simdNote);
+        printStreamStats(&stats);
+        double computeTime = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("Multiplication computation time: %.9f seconds\n", computeTime);
+        destroyThreadPool(pool);
+        free(tasks);
+        return 0;
     }
+
+    // Initialization of seed for random numbers
+    srand(time(NULL));
+    
+    // One contiguous, aligned allocation per matrix; with --numa the inputs
+    // are interleaved over the nodes before anything touches them
+    int allocFlags = useHugePages ? MATRIX_HUGEPAGES : 0;
+    int inputFlags = allocFlags | (numaMode != NUMA_FIRST_TOUCH ? MATRIX_INTERLEAVE : 0);
+    Matrix matrix1, matrix2;
+    Matrix resultMatrix = allocateTypedMatrix(n, n, dtype, allocFlags);
     
-    if(useFiles) {
-        readMatrixFromFile(n, matrix1, fileA);
-        readMatrixFromFile(n, matrix2, fileB);
+    if(useFiles && narrowMode != NARROW_OFF) {
+        loadNarrowMatrix(&matrix1, n, n, fileA, narrowMode, inputFlags, numThreads);
+        loadNarrowMatrix(&matrix2, n, n, fileB, narrowMode, inputFlags, numThreads);
+    } else if(useFiles) {
+        // Text files are parsed, binary files are mapped in place
+        loadTypedMatrix(&matrix1, n, n, dtype, fileA, inputFlags, numThreads);
+        loadTypedMatrix(&matrix2, n, n, dtype, fileB, inputFlags, numThreads);
     } else {
-        fillMatrix(n, matrix1);
-        fillMatrix(n, matrix2);
+        matrix1 = allocateTypedMatrix(n, n, dtype, inputFlags);
+        matrix2 = allocateTypedMatrix(n, n, dtype, inputFlags);
+        fillMatrix(&matrix1);
+        fillMatrix(&matrix2);
     }
-    
-    // Initialize result matrix to zeros
-    for (int i = 0; i < n; i++){
-        for (int j = 0; j < n; j++){
-            resultMatrix[i][j] = 0;
+
+    // --narrow: int8/int16 copies of the inputs (unless they were read that
+    // way) and the buffer of packed B, outside the timed section
+    int narrowType = MATRIX_TYPE_INT32;
+    NarrowPlan narrowPlan;
+    PoolTask *narrowTasks = NULL;
+    int numNarrowBands = 0;
+    if (narrowMode != NARROW_OFF) {
+        narrowType = narrowOperands(&matrix1, &matrix2, narrowMode, inputFlags);
+        if (narrowType != MATRIX_TYPE_INT32) {
+            narrowPlan = createNarrowPlan(&matrix1, &matrix2, &tiles, useSimd, simdIsa, allocFlags);
+            if (useSimd) {
+                snprintf(simdNote, sizeof(simdNote), " (SIMD %s)", narrowPlan.isa);
+            }
+            numNarrowBands = narrowBandCount(&narrowPlan);
+            narrowTasks = malloc((numNarrowBands > 0 ? numNarrowBands : 1) * sizeof(PoolTask));
+            if (narrowTasks == NULL) {
+                printf("Error in memory allocation.\n");
+                return 1;
+            }
+            for (int t = 0; t < numNarrowBands; t++) {
+                narrowTasks[t].run   = runNarrowPackTask;
+                narrowTasks[t].arg   = &narrowPlan;
+                narrowTasks[t].index = t;
+            }
+        } else {
+            printf("Narrow storage: the values need int32, using the int32 kernels\n");
+        }
+    }
+
+    // --numa replicate: one copy of B bound to each node
+    Matrix *replicas = NULL;
+    if (numaMode == NUMA_REPLICATE) {
+        replicas = malloc(topo.numNodes * sizeof(Matrix));
+        for (int node = 0; node < topo.numNodes; node++) {
+            replicas[node] = replicateMatrix(&matrix2, node, allocFlags);
         }
     }
 
-    // Prepare for threading
-    pthread_t *threads = malloc(numThreads * sizeof(pthread_t));
-    ThreadData *threadData = malloc(numThreads * sizeof(ThreadData));
+    // Initialize result matrix to zeros. Pinned workers do it themselves
+    // below, tile by tile, so each page of C lands on its worker's node.
+    if (affinityPolicy == AFFINITY_NONE) {
+        zeroMatrix(&resultMatrix);
+    }
+
+    // Start the worker pool once, outside the timed section
+    ThreadPool *pool = createPinnedThreadPool(numThreads, workerCpus);
 
     // Decide which kernel function to use
     void* (*kernelFunc)(void*);
-    if(useTranspose) {
-        kernelFunc = multiplyChunkTranspose;
+    if(narrowType != MATRIX_TYPE_INT32) {
+        kernelFunc = multiplyChunkNarrow;
+    } else if(dtype != MATRIX_TYPE_INT32) {
+        kernelFunc = multiplyChunkTyped;
+    } else if(useBlocked) {
+        kernelFunc = multiplyChunkBlocked;
+    } else if(useTranspose) {
+        kernelFunc = useSimd ? multiplyChunkTransposeSimd : multiplyChunkTranspose;
     } else {
-        kernelFunc = multiplyChunkStandard;
+        kernelFunc = useSimd ? multiplyChunkSimd : multiplyChunkStandard;
+    }
+
+    // Split the result into 2D tiles; workers start on contiguous runs of
+    // tiles and steal from each other when they run out
+    TileJob job;
+    job.base.tileID       = 0;
+    job.base.n            = n;
+    job.base.matrix1      = &matrix1;
+    job.base.matrix2      = &matrix2;
+    job.base.resultMatrix = &resultMatrix;
+    job.base.tiles        = &tiles;
+    job.base.simd         = &simd;
+    job.base.tileKernel   = tileKernel;
+    job.base.typed        = &typed;
+    job.base.typedMethod  = useBlocked ? TYPED_BLOCKED : (useTranspose ? TYPED_TRANSPOSE : TYPED_STANDARD);
+    job.base.useSimd      = useSimd;
+    job.base.narrow       = &narrowPlan;
+    job.kernelFunc        = kernelFunc;
+    job.rows              = n;
+    job.cols              = n;
+    job.tileEdge          = taskTile;
+    job.tilesPerRow       = (n + taskTile - 1) / taskTile;
+    job.replicas          = replicas;
+    job.workerNodes       = workerNodes;
+    int numTiles = job.tilesPerRow * job.tilesPerRow;
+    PoolTask *tasks = malloc((numTiles > 0 ? numTiles : 1) * sizeof(PoolTask));
+    if (tasks == NULL) {
+        printf("Error in memory allocation.\n");
+        return 1;
+    }
+    for (int t = 0; t < numTiles; t++) {
+        tasks[t].run   = runTileTask;
+        tasks[t].arg   = &job;
+        tasks[t].index = t;
+    }
+
+    // First touch of C: the same tasks start on the same workers as the multiplication
+    if (affinityPolicy != AFFINITY_NONE) {
+        job.kernelFunc = touchChunk;
+        threadPoolRun(pool, tasks, numTiles);
+        job.kernelFunc = kernelFunc;
+    }
+
+    // Strassen-Winograd: expand enough levels that every worker gets leaf
+    // products; the workspace is allocated here, outside the timed section
+    int strassenDepth = strassenParallelDepth(numThreads);
+    PoolTask *strassenPoolTasks = NULL;
+    PoolRunner strassenRunner = { pool, NULL, runStrassenTask };
+    StrassenPlan plan;
+    if (useStrassen) {
+        int maxProducts = 1;
+        for (int d = 0; d < strassenDepth; d++) {
+            maxProducts *= 7;
+        }
+        strassenPoolTasks = malloc(maxProducts * sizeof(PoolTask));
+        if (strassenPoolTasks == NULL) {
+            printf("Error in memory allocation.\n");
+            return 1;
+        }
+        strassenRunner.tasks = strassenPoolTasks;
+        plan = createStrassenPlan(n, strassenCutoff, strassenDepth, &tiles, tileKernel,
+                                  runStrassenTasks, &strassenRunner);
+    }
+
+    // --sparse: operands at or below the density threshold are converted to
+    // CSR here, outside the timed section; two dense operands use the kernels above
+    PoolRunner sparseRunner = { pool, NULL, runSparseTask };
+    SparsePlan sparsePlan;
+    sparsePlan.kind = SPARSE_NONE;
+    double densityA = 1.0, densityB = 1.0;
+    if (sparseMode != SPARSE_OFF) {
+        densityA = matrixDensity(&matrix1);
+        densityB = matrixDensity(&matrix2);
+        int kind = chooseSparseKind(sparseMode, densityA, densityB, sparseThreshold);
+        if (kind != SPARSE_NONE) {
+            sparsePlan = createSparsePlan(kind, &matrix1, &matrix2, &resultMatrix, numThreads,
+                                          runSparseTasks, &sparseRunner);
+            sparseRunner.tasks = malloc((sparsePlan.numTasks > 0 ? sparsePlan.numTasks : 1) * sizeof(PoolTask));
+            if (sparseRunner.tasks == NULL) {
+                printf("Error in memory allocation.\n");
+                return 1;
+            }
+        }
     }
 
-    // Compute row-chunk sizes
-    int baseChunk = n / numThreads;
-    int remainder = n % numThreads;
+    // Registered sizes run a kernel compiled for that n (common/fixed.h), in
+    // strips of --tasktile rows
+    FixedPlan fixed = { NULL, n, NULL };
+    if (useFixed && dtype == MATRIX_TYPE_INT32 && narrowType == MATRIX_TYPE_INT32 && !useTranspose &&
+        !useStrassen && sparsePlan.kind == SPARSE_NONE && replicas == NULL) {
+        fixed = selectFixedKernel(&matrix1, &matrix2, &resultMatrix, useBlocked, &tiles, useSimd, &simd);
+    }
+    FixedJob fixedJob = { &fixed, &matrix1, &matrix2, &resultMatrix, taskTile };
+    int numFixedTasks = (n + taskTile - 1) / taskTile;
+    PoolTask *fixedTasks = NULL;
+    if (fixed.kernel != NULL) {
+        fixedTasks = malloc((numFixedTasks > 0 ? numFixedTasks : 1) * sizeof(PoolTask));
+        if (fixedTasks == NULL) {
+            printf("Error in memory allocation.\n");
+            return 1;
+        }
+        for (int t = 0; t < numFixedTasks; t++) {
+            fixedTasks[t].run   = runFixedTask;
+            fixedTasks[t].arg   = &fixedJob;
+            fixedTasks[t].index = t;
+        }
+    }
+
+    // --transpose: Bᵀ is packed into its own matrix (into the per-node copies
+    // with --numa replicate) by a first timed stage, band by band on the pool
+    int packB = useTranspose && !useBlocked && !useStrassen && sparsePlan.kind == SPARSE_NONE;
+    Matrix packedB;
+    TransposeJob transposeJob = { &matrix2, &packedB, 1 };
+    int numBands = transposeBandCount(&matrix2);
+    PoolTask *transposeTasks = NULL;
+    if (packB) {
+        if (replicas != NULL) {
+            transposeJob.targets    = replicas;
+            transposeJob.numTargets = topo.numNodes;
+        } else {
+            packedB = allocateTypedMatrix(n, n, dtype, allocFlags | MATRIX_POPULATE);
+            job.base.matrix2 = &packedB;
+        }
+        transposeTasks = malloc((numBands > 0 ? numBands : 1) * sizeof(PoolTask));
+        if (transposeTasks == NULL) {
+            printf("Error in memory allocation.\n");
+            return 1;
+        }
+        for (int t = 0; t < numBands; t++) {
+            transposeTasks[t].run   = runTransposeTask;
+            transposeTasks[t].arg   = &transposeJob;
+            transposeTasks[t].index = t;
+        }
+    }
+
+    // --perf: every worker opens its counter group on its own thread (one
+    // empty job), then counts only while it works on the timed jobs
+    PerfCounters *perfWorkers = NULL;
+    if (usePerf) {
+        perfWorkers = calloc(numThreads, sizeof(PerfCounters));
+        PoolTask openTask = { perfNoopTask, NULL, 0 };
+        threadPoolSetHook(pool, perfOpenHook, perfWorkers);
+        threadPoolRun(pool, &openTask, 1);
+        threadPoolSetHook(pool, perfCountHook, perfWorkers);
+    }
     
     // Start time measurement for kernel function
-    struct timespec start, end;
+    struct timespec start, packEnd, end;
     clock_gettime(CLOCK_MONOTONIC, &start);
-
-    // Launch threads
-    int currentRow = 0;
-    for (int t = 0; t < numThreads; t++) {
-        int rowsForThisThread = baseChunk + (t < remainder ? 1 : 0);
-        threadData[t].threadID    = t;
-        threadData[t].startRow    = currentRow;
-        threadData[t].endRow      = currentRow + rowsForThisThread;
-        threadData[t].n           = n;
-        threadData[t].matrix1     = matrix1;
-        threadData[t].matrix2     = matrix2;
-        threadData[t].resultMatrix= resultMatrix;
-
-        pthread_create(&threads[t], NULL, kernelFunc, (void*)&threadData[t]);
-        currentRow += rowsForThisThread;
+    if(packB) {
+        threadPoolRun(pool, transposeTasks, numBands);
+    } else if(narrowType != MATRIX_TYPE_INT32) {
+        threadPoolRun(pool, narrowTasks, numNarrowBands);
     }
+    clock_gettime(CLOCK_MONOTONIC, &packEnd);
 
-    // Wait for all threads
-    for (int t = 0; t < numThreads; t++) {
-        pthread_join(threads[t], NULL);
+    if(sparsePlan.kind != SPARSE_NONE) {
+        sparseMultiply(&sparsePlan);
+    } else if(useStrassen) {
+        strassenMultiply(&plan, &matrix1, &matrix2, &resultMatrix);
+    } else if(fixed.kernel != NULL) {
+        threadPoolRun(pool, fixedTasks, numFixedTasks);
+    } else {
+        threadPoolRun(pool, tasks, numTiles);
     }
 
     // End timing
     clock_gettime(CLOCK_MONOTONIC, &end);
+    threadPoolSetHook(pool, NULL, NULL);
 
     // Print which method was used
-    if(useTranspose) {
-        printf("Using transpose multiplication method\n");
+    if(sparsePlan.kind != SPARSE_NONE) {
+        printf("Using sparse %s multiplication method (density %.4f / %.4f)\n", sparseKindName(&sparsePlan),
+               densityA, densityB);
+    } else if(useStrassen) {
+        printf("Using Strassen-Winograd multiplication method (cutoff %d, %d parallel level(s))%s\n",
+               strassenCutoff, strassenDepth, simdNote);
+        freeStrassenPlan(&plan);
+        free(strassenPoolTasks);
+    } else if(narrowType != MATRIX_TYPE_INT32) {
+        printf("Using narrow blocked multiplication method (%s, tiles %d/%d/%d)%s\n", matrixTypeName(narrowType),
+               narrowPlan.edges[0], narrowPlan.edges[1], narrowPlan.edges[2], simdNote);
+    } else if(fixed.kernel != NULL) {
+        printf("Using fixed-size %s multiplication method (n = %d)%s\n", fixed.shape, n, simdNote);
+        free(fixedTasks);
+    } else if(dtype != MATRIX_TYPE_INT32) {
+        printf("Using %s multiplication method (%s)%s\n", typedMethodName(job.base.typedMethod),
+               matrixTypeName(dtype), simdNote);
+    } else if(useBlocked) {
+        printf("Using blocked multiplication method (tiles %d/%d/%d)%s\n", tiles.l1, tiles.l2, tiles.l3, simdNote);
+    } else if(useTranspose) {
+        printf("Using transpose multiplication method%s\n", simdNote);
     } else {
-        printf("Using standard multiplication method\n");
+        printf("Using standard multiplication method%s\n", simdNote);
     }
     
     double computeTime = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
     
-    // Show computation time of the kernel
+    // Show computation time of the kernel (with the pack stage, also shown on its own)
+    if(packB) {
+        double packTime = (packEnd.tv_sec - start.tv_sec) + (packEnd.tv_nsec - start.tv_nsec) / 1e9;
+        printf("Transpose pack time: %.9f seconds\n", packTime);
+        if (replicas == NULL) {
+            freeMatrix(&packedB);
+        }
+        free(transposeTasks);
+    } else if(narrowType != MATRIX_TYPE_INT32) {
+        double packTime = (packEnd.tv_sec - start.tv_sec) + (packEnd.tv_nsec - start.tv_nsec) / 1e9;
+        printf("Narrow pack time: %.9f seconds\n", packTime);
+        freeNarrowPlan(&narrowPlan);
+        free(narrowTasks);
+    }
     printf("Multiplication computation time: %.9f seconds\n", computeTime);
+    if (perfWorkers != NULL) {
+        perfReport("threads", perfWorkers, numThreads, computeTime);
+        for (int w = 0; w < numThreads; w++) {
+            perfClose(&perfWorkers[w]);  // Descriptors are per process, any thread may close them
+        }
+        free(perfWorkers);
+    }
     
-    // Save result matrix to file
-    writeMatrixToFile(n, resultMatrix, fileResult);
+    // The sparse product is scattered into C after timing
+    if (sparsePlan.kind != SPARSE_NONE) {
+        sparseStoreResult(&sparsePlan);
+        freeSparsePlan(&sparsePlan);
+        free(sparseRunner.tasks);
+    }
+
+    // --verify: O(n²) check of C against A and B, after timing
+    int verified = 1;
+    PoolRunner verifyRunner = { pool, NULL, runVerifyTask };
+    if (verifyMode != VERIFY_OFF) {
+        VerifyPlan verifyPlan = createVerifyPlan(verifyMode, verifyRounds, &matrix1, &matrix2, &resultMatrix,
+                                                 numThreads, runVerifyTasks, &verifyRunner);
+        verifyRunner.tasks = malloc(verifyPlan.numTasks * sizeof(PoolTask));
+        if (verifyRunner.tasks == NULL) {
+            printf("Error in memory allocation.\n");
+            return 1;
+        }
+        VerifyResult verifyResult = verifyProduct(&verifyPlan);
+        verified = printVerifyResult(&verifyPlan, &verifyResult);
+        freeVerifyPlan(&verifyPlan);
+        free(verifyRunner.tasks);
+    }
+
+    // Save result matrix to file (binary when the name ends in .bin); with --verify only
+    // when --result is given
+    if (verifyMode == VERIFY_OFF || useResultFile) {
+        saveMatrix(&resultMatrix, fileResult, numThreads);
+    }
 
     // Free allocated memory
-    free(threads);
-    free(threadData);
-    for (int i = 0; i < n; i++){
-        free(matrix1[i]);
-        free(matrix2[i]);
-        free(resultMatrix[i]);
-    }
-    free(matrix1);
-    free(matrix2);
-    free(resultMatrix);
+    destroyThreadPool(pool);
+    free(tasks);
+    freeMatrix(&matrix1);
+    freeMatrix(&matrix2);
+    freeMatrix(&resultMatrix);
+    for (int node = 0; replicas != NULL && node < topo.numNodes; node++) {
+        freeMatrix(&replicas[node]);
+    }
+    free(replicas);
+    free(workerCpus);
+    free(workerNodes);
+    freePlacement(&placement);
+    freeCpuTopology(&topo);
     
-    return 0;
+    return verified ? 0 : EXIT_FAILURE;
 }
\ No newline at end of file
@@ -0,0 +1,107 @@
+import sys
+import struct
+from array import array
+
+# Binary matrix format read by every backend (see common/matrix_io.h):
+# a header padded to DATA_OFFSET bytes, then rows x stride elements.
+MAGIC = b"MMB1"
+VERSION = 1
+ENDIAN_TAG = 0x01020304
+TYPE_INT32 = 1
+DATA_OFFSET = 4096
+HEADER = struct.Struct("=4s5I4Q")
+CACHE_LINE = 64
+
+# Element types of common/matrix.h: type code -> (--dtype name, array typecode, size in bytes)
+TYPES = {
+    1: ("int32", "i", 4),
+    2: ("int64", "q", 8),
+    3: ("float", "f", 4),
+    4: ("double", "d", 8),
+    5: ("int8", "b", 1),
+    6: ("int16", "h", 2),
+}
+
+
+def type_code(name):
+    for code, (type_name, _, _) in TYPES.items():
+        if type_name == name:
+            return code
+    raise ValueError("unknown element type %s (use int32, int64, float, double, int8 or int16)" % name)
+
+
+def padded_stride(cols, elem_size=4):
+    # Same rule as paddedStrideOf() in common/matrix.h: an odd number of cache lines per row
+    per_line = CACHE_LINE // elem_size
+    lines = (cols + per_line - 1) // per_line
+    if lines > 1 and lines % 2 == 0:
+        lines += 1
+    return lines * per_line
+
+
+def read_text_matrix(filename):
+    rows = []
+    with open(filename) as f:
+        for line in f:
+            values = line.split()
+            if values:
+                rows.append([float(v) if any(c in v for c in ".eEnN") else int(v) for v in values])
+    if not rows or any(len(r) != len(rows[0]) for r in rows):
+        raise ValueError("%s is not a rectangular matrix" % filename)
+    return rows
+
+
+def write_binary_matrix(rows, filename, elem_type=TYPE_INT32):
+    _, typecode, elem_size = TYPES[elem_type]
+    n_rows, n_cols = len(rows), len(rows[0])
+    stride = padded_stride(n_cols, elem_size)
+    header = HEADER.pack(MAGIC, VERSION, ENDIAN_TAG, elem_type, elem_size, DATA_OFFSET,
+                         n_rows, n_cols, stride, DATA_OFFSET)
+    if typecode in "fd":
+        rows = [[float(v) for v in r] for r in rows]
+    data = array(typecode)
+    padding = [0] * (stride - n_cols)
+    for r in rows:
+        data.extend(r)
+        data.extend(padding)
+    with open(filename, "wb") as f:
+        f.write(header.ljust(DATA_OFFSET, b"\0"))
+        data.tofile(f)
+
+
+def read_binary_matrix(filename):
+    with open(filename, "rb") as f:
+        raw = f.read()
+    magic, version, tag, elem_type, elem_size, _, n_rows, n_cols, stride, offset = HEADER.unpack_from(raw)
+    if magic != MAGIC or elem_type not in TYPES or elem_size != TYPES[elem_type][2]:
+        raise ValueError("%s is not a binary matrix" % filename)
+    data = array(TYPES[elem_type][1])
+    data.frombytes(raw[offset:offset + n_rows * stride * elem_size])
+    if tag != ENDIAN_TAG:
+        data.byteswap()
+    return [data[i * stride:i * stride + n_cols].tolist() for i in range(n_rows)]
+
+
+def write_text_matrix(rows, filename):
+    # Same layout as writeMatrixToFile(): every value followed by a space, and
+    # floating point values with the same %.17g as the double writer
+    with open(filename, "w") as f:
+        for r in rows:
+            f.write("".join(("%.17g " if isinstance(v, float) else "%d ") % v for v in r) + "\n")
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 3:
+        print("Usage: python convert_matrix.py <input_file> <output_file> [int32|int64|float|double|int8|int16]")
+        print("Text input is written as binary of the given element type (default int32),")
+        print("binary input (MMB1) is written as text.")
+        sys.exit(1)
+
+    input_file, output_file = sys.argv[1], sys.argv[2]
+    elem_type = type_code(sys.argv[3]) if len(sys.argv) > 3 else TYPE_INT32
+    with open(input_file, "rb") as f:
+        is_binary = f.read(4) == MAGIC
+    if is_binary:
+        write_text_matrix(read_binary_matrix(input_file), output_file)
+    else:
+        write_binary_matrix(read_text_matrix(input_file), output_file, elem_type)
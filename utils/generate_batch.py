@@ -0,0 +1,25 @@
+import sys
+import random
+
+# Batch file read by --batch: for every product a line with its size n,
+# then the n rows of A and the n rows of B (see common/batch.h).
+
+def generate_batch(count, min_n, max_n, filename):
+    with open(filename, 'w') as f:
+        for _ in range(count):
+            n = random.randint(min_n, max_n)
+            f.write("%d\n" % n)
+            for _ in range(2 * n):
+                row = [str(random.randint(0, 9)) for _ in range(n)]
+                f.write(" ".join(row) + "\n")
+
+if __name__ == "__main__":
+    if len(sys.argv) < 5:
+        print("Usage: python generate_batch.py <count> <min_n> <max_n> <output_file>")
+        sys.exit(1)
+
+    count, min_n, max_n = int(sys.argv[1]), int(sys.argv[2]), int(sys.argv[3])
+    if not 1 <= min_n <= max_n:
+        print("Sizes must satisfy 1 <= min_n <= max_n")
+        sys.exit(1)
+    generate_batch(count, min_n, max_n, sys.argv[4])
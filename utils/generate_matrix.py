@@ -1,17 +1,37 @@
 import sys
 import random
 
-def generate_matrix(n, filename):
+def random_element(density):
+    # A nonzero element with probability density (values 1..9), 0 otherwise
+    if density >= 1.0:
+        return random.randint(0, 9)
+    return random.randint(1, 9) if random.random() < density else 0
+
+def generate_matrix(n, filename, dtype="int32", density=1.0):
+    rows = [[random_element(density) for _ in range(n)] for _ in range(n)]
+    if filename.endswith('.bin'):
+        # Binary format read through mmap by the backends (see convert_matrix.py)
+        from convert_matrix import write_binary_matrix, type_code
+        write_binary_matrix(rows, filename, type_code(dtype))
+        return
     with open(filename, 'w') as f:
-        for _ in range(n):
-            row = [str(random.randint(0, 9)) for _ in range(n)]
-            f.write(" ".join(row) + "\n")
+        if filename.endswith('.mtx'):
+            # Matrix Market coordinate format: only the nonzeros, 1-based
+            entries = [(i, j, v) for i, row in enumerate(rows) for j, v in enumerate(row) if v != 0]
+            f.write("%%MatrixMarket matrix coordinate integer general\n")
+            f.write("%d %d %d\n" % (n, n, len(entries)))
+            for i, j, v in entries:
+                f.write("%d %d %d\n" % (i + 1, j + 1, v))
+            return
+        for row in rows:
+            f.write(" ".join(str(v) for v in row) + "\n")
 
 if __name__ == "__main__":
     if len(sys.argv) < 3:
-        print("Usage: python generate_matrix.py <n> <output_file>")
+        print("Usage: python generate_matrix.py <n> <output_file> [int32|int64|float|double|int8|int16] [density]")
         sys.exit(1)
 
     n = int(sys.argv[1])
     output_file = sys.argv[2]
-    generate_matrix(n, output_file)
\ No newline at end of file
+    generate_matrix(n, output_file, sys.argv[3] if len(sys.argv) > 3 else "int32",
+                    float(sys.argv[4]) if len(sys.argv) > 4 else 1.0)
@@ -9,7 +9,9 @@ def plot_results(csv_file):
     
     # Get unique dimensions and configurations
     dimensions = sorted(df['dimension'].unique())
-    configurations = ['Standard', 'Transpose Only', 'O3 + loop', 'O3 + transpose']
+    # In the order of the CSV: the four configurations of main_run.sh, plus
+    # e.g. "Blocked" or "SIMD" from benchmark/benchmark --configs
+    configurations = list(df['configuration'].unique())
     
     # Calculate average times for each dimension and configuration
     avg_results = {}
@@ -22,14 +24,15 @@ def plot_results(csv_file):
     
     # Set up the plot
     plt.figure(figsize=(12, 8))
-    markers = ['o', 's', '^', 'D']
-    colors = ['#1f77b4', '#ff7f0e', '#2ca02c', '#d62728']
+    markers = ['o', 's', '^', 'D', 'v', 'P', 'X', '*']
+    colors = ['#1f77b4', '#ff7f0e', '#2ca02c', '#d62728', '#9467bd', '#8c564b', '#e377c2', '#7f7f7f']
     
     # Create summary table for the log
     print("\nAverage execution times (seconds):")
-    print("=" * 80)
-    print(f"{'Dimension':<12} {'Standard':<15} {'Transpose Only':<15} {'O3 + loop':<15} {'O3 + transpose':<15}")
-    print("-" * 80)
+    width = 12 + 16 * len(configurations)
+    print("=" * width)
+    print(f"{'Dimension':<12}" + "".join(f" {config:<15}" for config in configurations))
+    print("-" * width)
     
     for i, dim in enumerate(dimensions):
         row = f"{dim:<12}"
@@ -39,7 +42,7 @@ def plot_results(csv_file):
     
     # Plot each configuration
     for i, config in enumerate(configurations):
-        plt.plot(dimensions, avg_results[config], marker=markers[i], color=colors[i], 
+        plt.plot(dimensions, avg_results[config], marker=markers[i % len(markers)], color=colors[i % len(colors)], 
                  linewidth=2, markersize=8, label=config)
     
     # Add a logarithmic scale for better visualization
@@ -65,8 +68,9 @@ def plot_results(csv_file):
     
     # Calculate and print speedups for the largest dimension
     largest_dim = max(dimensions)
+    baseline = 'Standard' if 'Standard' in configurations else configurations[0]
     baseline_time = df[(df['dimension'] == largest_dim) & 
-                     (df['configuration'] == 'Standard')]['time'].mean()
+                     (df['configuration'] == baseline)]['time'].mean()
                      
     print(f"\nSpeedups for {largest_dim}x{largest_dim} matrices:")
     print("=" * 40)